@@ -72,6 +72,7 @@
 #include <AddressMonitorService.h>
 #include <TransactionMonitorService.h>
 #include <BlockNotificationService.h>
+#include <HubControlService.h>
 
 #if defined(QT_STATICPLUGIN)
 #include <QtPlugin>
@@ -219,6 +220,7 @@ private:
     std::unique_ptr<AddressMonitorService> addressMonitorService;
     std::unique_ptr<TransactionMonitorService> transactionMonitorService;
     std::unique_ptr<BlockNotificationService> blockNotificationService;
+    std::unique_ptr<HubControlService> hubControlService;
 
     /// Pass fatal exception message to UI thread
     void handleRunawayException(const std::exception *e);
@@ -311,12 +313,14 @@ void BitcoinCore::initialize()
             addressMonitorService.reset(new AddressMonitorService());
             transactionMonitorService.reset(new TransactionMonitorService());
             blockNotificationService.reset(new BlockNotificationService());
+            hubControlService.reset(new HubControlService());
             extern CTxMemPool mempool;
             addressMonitorService->setMempool(&mempool);
             transactionMonitorService->setMempool(&mempool);
             apiServer->addService(addressMonitorService.get());
             apiServer->addService(transactionMonitorService.get());
             apiServer->addService(blockNotificationService.get());
+            apiServer->addService(hubControlService.get());
         }
     } catch (const std::exception& e) {
         handleRunawayException(&e);
@@ -330,6 +334,7 @@ void BitcoinCore::shutdown()
     try
     {
         qDebug() << __func__ << ": Running Shutdown in thread";
+        hubControlService.reset();
         blockNotificationService.reset();
         transactionMonitorService.reset();
         addressMonitorService.reset();
@@ -39,6 +39,7 @@
 #include <AddressMonitorService.h>
 #include <TransactionMonitorService.h>
 #include <BlockNotificationService.h>
+#include <HubControlService.h>
 #include <cstdio>
 
 static bool fDaemon;
@@ -114,6 +115,7 @@ bool AppInit(int argc, char* argv[])
     std::unique_ptr<TransactionMonitorService> transactionMonitorService;
     std::unique_ptr<AddressMonitorService> addressMonitorService;
     std::unique_ptr<BlockNotificationService> blockNotificationService;
+    std::unique_ptr<HubControlService> hubControlService;
     try
     {
         for (int i = 1; i < argc; i++) {
@@ -183,12 +185,14 @@ bool AppInit(int argc, char* argv[])
                 addressMonitorService.reset(new AddressMonitorService());
                 transactionMonitorService.reset(new TransactionMonitorService());
                 blockNotificationService.reset(new BlockNotificationService());
+                hubControlService.reset(new HubControlService());
                 extern CTxMemPool mempool;
                 addressMonitorService->setMempool(&mempool);
                 transactionMonitorService->setMempool(&mempool);
                 apiServer->addService(addressMonitorService.get());
                 apiServer->addService(transactionMonitorService.get());
                 apiServer->addService(blockNotificationService.get());
+                apiServer->addService(hubControlService.get());
             }
         }
     }
@@ -207,6 +211,7 @@ bool AppInit(int argc, char* argv[])
     } else {
         WaitForShutdown(&threadGroup);
     }
+    hubControlService.reset();
     addressMonitorService.reset();
     transactionMonitorService.reset();
     apiServer.reset();
@@ -21,15 +21,25 @@
 #include <APIProtocol.h>
 #include <streaming/MessageParser.h>
 #include <Message.h>
+#include <config/flowee-config.h>
 
 #include <QTime>
+#include <QtEndian>
 #include <qsettings.h>
+#include <qsqldriver.h>
 #include <qsqlerror.h>
 #include <qtimer.h>
 #include <qvariant.h>
 #include <qcoreapplication.h>
 
+#ifdef HAVE_LIBPQ
+#include <libpq-fe.h>
+#endif
+
 namespace {
+// The max amount of rows we insert in one multi-row insert statement.
+constexpr int RowsPerInsert = 5000;
+
 
 QString valueFromSettings(const QSettings &settings, const QString &key, const QString &defvalue=QString()) {
     QVariant x = settings.value(QString("addressdb/") + key);
@@ -58,6 +68,36 @@ public:
         QString createIndexString("create index %1_index on %1 (address_row)");
         return query.exec(createIndexString.arg(tableName));
     }
+
+    // Insert the rows using large multi-row insert statements, the drivers
+    // would otherwise do a round-trip to the server for every single row.
+    virtual bool insertRows(QSqlDatabase &db, const QString &tableName, const std::deque<AddressIndexer::Entry> &rows) const {
+        QSqlQuery query(db);
+        const QString insert = "insert into " + tableName + " values ";
+        QString statement;
+        auto iter = rows.begin();
+        while (iter != rows.end()) {
+            statement = insert;
+            for (int i = 0; i < RowsPerInsert && iter != rows.end(); ++i, ++iter) {
+                if (i > 0)
+                    statement += ',';
+                statement += '(';
+                statement += QString::number(iter->row);
+                statement += ',';
+                statement += QString::number(iter->height);
+                statement += ',';
+                statement += QString::number(iter->offsetInBlock);
+                statement += ',';
+                statement += QString::number(iter->outIndex);
+                statement += ')';
+            }
+            if (!query.exec(statement)) {
+                logFatal() << "Failed to insert into" << tableName << "reason:" << query.lastError().text();
+                return false;
+            }
+        }
+        return true;
+    }
 };
 
 class PostgresTables : public TableSpecification
@@ -76,6 +116,73 @@ public:
         QString createIndexString("CREATE INDEX IF NOT EXISTS %1_index ON %1 (address_row)");
         return query.exec(createIndexString.arg(tableName.toLower()));
     }
+
+#ifdef HAVE_LIBPQ
+    // Use the binary COPY protocol, which is much faster than any insert statement.
+    bool insertRows(QSqlDatabase &db, const QString &tableName, const std::deque<AddressIndexer::Entry> &rows) const override {
+        QVariant handle = db.driver()->handle();
+        if (!handle.isValid() || qstrcmp(handle.typeName(), "PGconn*") != 0)
+            return TableSpecification::insertRows(db, tableName, rows);
+        PGconn *connection = *static_cast<PGconn**>(handle.data());
+        if (connection == nullptr)
+            return TableSpecification::insertRows(db, tableName, rows);
+
+        const QByteArray copy = "COPY " + tableName.toLower().toLatin1()
+                + " (address_row, block_height, offset_in_block, out_index) FROM STDIN WITH (FORMAT binary)";
+        PGresult *result = PQexec(connection, copy.constData());
+        const bool copyStarted = PQresultStatus(result) == PGRES_COPY_IN;
+        PQclear(result);
+        if (!copyStarted) {
+            logFatal() << "Failed to start COPY into" << tableName << "reason:" << PQerrorMessage(connection);
+            return false;
+        }
+
+        QByteArray buffer;
+        buffer.reserve(1024 * 1024 + 100);
+        static const char signature[] = "PGCOPY\n\377\r\n"; // followed by a zero byte
+        buffer.append(signature, 11);
+        appendInt32(buffer, 0); // flags
+        appendInt32(buffer, 0); // header extension length
+        bool ok = true;
+        for (auto iter = rows.begin(); ok && iter != rows.end(); ++iter) {
+            appendInt16(buffer, 4); // field count
+            appendField(buffer, iter->row);
+            appendField(buffer, iter->height);
+            appendField(buffer, iter->offsetInBlock);
+            appendField(buffer, iter->outIndex);
+            if (buffer.size() > 1024 * 1024) {
+                ok = PQputCopyData(connection, buffer.constData(), buffer.size()) == 1;
+                buffer.clear();
+            }
+        }
+        appendInt16(buffer, -1); // trailer
+        if (ok)
+            ok = PQputCopyData(connection, buffer.constData(), buffer.size()) == 1;
+        ok = PQputCopyEnd(connection, ok ? nullptr : "failed to send data") == 1 && ok;
+        while ((result = PQgetResult(connection)) != nullptr) {
+            if (PQresultStatus(result) != PGRES_COMMAND_OK)
+                ok = false;
+            PQclear(result);
+        }
+        if (!ok)
+            logFatal() << "Failed to COPY into" << tableName << "reason:" << PQerrorMessage(connection);
+        return ok;
+    }
+
+private:
+    static void appendInt16(QByteArray &buffer, int16_t value) {
+        const int16_t be = qToBigEndian(value);
+        buffer.append(reinterpret_cast<const char*>(&be), 2);
+    }
+    static void appendInt32(QByteArray &buffer, int32_t value) {
+        const int32_t be = qToBigEndian(value);
+        buffer.append(reinterpret_cast<const char*>(&be), 4);
+    }
+    static void appendField(QByteArray &buffer, int32_t value) {
+        appendInt32(buffer, 4); // the size of an INTEGER
+        appendInt32(buffer, value);
+    }
+#endif
 };
 
 class MySQLTables : public TableSpecification
@@ -104,11 +211,18 @@ AddressIndexer::AddressIndexer(const boost::filesystem::path &basedir, Indexer *
 AddressIndexer::~AddressIndexer()
 {
     delete m_spec;
+    delete m_postings;
 }
 
 void AddressIndexer::loadSetting(const QSettings &settings)
 {
-    auto db = valueFromSettings(settings, "db_driver");
+    auto db = valueFromSettings(settings, "db_driver", "native");
+    if (db == "native") {
+        logCritical() << "AddressIndexer using native storage in" << m_basedir;
+        delete m_postings;
+        m_postings = new PostingStorage(m_basedir.toStdString() + "/postings");
+        return;
+    }
     m_insertDb = QSqlDatabase::addDatabase(db, "insertConnection");
     if (!m_insertDb.isValid()) {
         if (QSqlDatabase::drivers().contains(db)) {
@@ -208,6 +322,19 @@ std::vector<AddressIndexer::TxData> AddressIndexer::find(const uint256 &address)
     if (result.db == -1)
         return answer;
 
+    if (m_postings) {
+        const auto postings = m_postings->find(result);
+        answer.reserve(postings.size());
+        for (auto iter = postings.rbegin(); iter != postings.rend(); ++iter) { // newest first
+            TxData txData;
+            txData.offsetInBlock = iter->offsetInBlock;
+            txData.blockHeight = iter->blockHeight;
+            txData.outputIndex = iter->outIndex;
+            answer.push_back(txData);
+        }
+        return answer;
+    }
+
     QSqlQuery query(m_selectDb);
     const QString select = QString("select DISTINCT offset_in_block, block_height, out_index "
                                   "FROM AddressUsage%1 "
@@ -279,6 +406,11 @@ void AddressIndexer::run()
 {
     // wait for database to come online.
     while (!isInterruptionRequested()) {
+        if (m_postings) { // no database to wait for
+            m_height = m_postings->blockHeight();
+            m_topOfChain = InInitialSync;
+            break;
+        }
         assert(m_selectDb.isValid());
         if (m_insertDb.open() && m_selectDb.open()) {
             createTables();
@@ -352,6 +484,10 @@ void AddressIndexer::commitAllData()
         Q_ASSERT(m_uncommittedData.empty());
         return;
     }
+    if (m_postings) {
+        commitToPostings();
+        return;
+    }
 
     QTime time;
     time.start();
@@ -387,31 +523,9 @@ void AddressIndexer::commitAllData()
         const std::deque<Entry> &list = m_uncommittedData.at(db);
         if (!list.empty()) {
             const QString table = addressTable(db);
-            QSqlQuery query(m_insertDb);
-            query.prepare("insert into " + table + " values (?, ?, ?, ?)");
             logDebug() << "bulk insert of" << list.size() << "rows into" << table;
-            QVariantList row;
-            row.reserve(list.size());
-            QVariantList height;
-            height.reserve(list.size());
-            QVariantList offsetInBlock;
-            offsetInBlock.reserve(list.size());
-            QVariantList outIndex;
-            outIndex.reserve(list.size());
-            for (auto entry : list) {
-                row.append(entry.row);
-                height.append(entry.height);
-                offsetInBlock.append(entry.offsetInBlock);
-                outIndex.append(entry.outIndex);
-            }
-            query.addBindValue(row);
-            query.addBindValue(height);
-            query.addBindValue(offsetInBlock);
-            query.addBindValue(outIndex);
-            if (!query.execBatch()) {
-                logFatal() << "Failed to insert into" << table << "reason:" << query.lastError().text();
+            if (!m_spec->insertRows(m_insertDb, table, list))
                 QCoreApplication::exit(1);
-            }
             rowsInserted += list.size();
         }
     }
@@ -425,7 +539,9 @@ void AddressIndexer::commitAllData()
     }
 
     m_insertDb.commit();
-    logCritical().nospace() << "AddressDB: SQL-DB took " << time.elapsed() << "ms to insert " << rowsInserted << " rows";
+    const int elapsed = std::max(1, time.elapsed());
+    logCritical().nospace() << "AddressDB: SQL-DB took " << elapsed << "ms to insert " << rowsInserted << " rows ("
+                            << (rowsInserted * qint64(1000) / elapsed) << " rows/s)";
 
     if (m_topOfChain == FlushRequested) { // only ever run this code once per DB
         logCritical() << "Reached top of chain, creating indexes on our tables";
@@ -441,3 +557,37 @@ void AddressIndexer::commitAllData()
         m_topOfChain = InitialSyncFinished;
     }
 }
+
+void AddressIndexer::commitToPostings()
+{
+    QTime time;
+    time.start();
+    std::vector<PostingStorage::Entry> entries;
+    entries.reserve(m_uncommittedCount);
+    for (size_t db = 0; db < m_uncommittedData.size(); ++db) {
+        for (auto entry : m_uncommittedData.at(db)) {
+            PostingStorage::Entry e;
+            e.address = HashIndexPoint(static_cast<int>(db), entry.row);
+            e.posting.blockHeight = entry.height;
+            e.posting.offsetInBlock = entry.offsetInBlock;
+            e.posting.outIndex = entry.outIndex;
+            entries.push_back(e);
+        }
+    }
+    m_uncommittedData.clear();
+    try {
+        m_postings->append(entries, m_height);
+        const int elapsed = std::max(1, time.elapsed());
+        logCritical().nospace() << "AddressDB: took " << elapsed << "ms to store " << entries.size() << " rows ("
+                                << (static_cast<qint64>(entries.size()) * 1000 / elapsed) << " rows/s)";
+
+        if (m_topOfChain == FlushRequested) {
+            logCritical() << "Reached top of chain, merging the address-data segments";
+            m_postings->compact();
+            m_topOfChain = InitialSyncFinished;
+        }
+    } catch (const std::exception &e) {
+        logFatal() << "Failed to store address data" << e;
+        QCoreApplication::exit(1);
+    }
+}
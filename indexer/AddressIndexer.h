@@ -25,6 +25,7 @@
 #include <streaming/ConstBuffer.h>
 
 #include "HashStorage.h"
+#include "PostingStorage.h"
 
 #include <boost/filesystem/path.hpp>
 #include <vector>
@@ -58,19 +59,23 @@ public:
 
     void run() override;
 
-private:
-    void createTables();
-    void commitAllData();
-
+    /// One row of address-usage, the row refers to the HashStorage.
     struct Entry {
         short outIndex;
         int height, row, offsetInBlock;
     };
+
+private:
+    void createTables();
+    void commitAllData();
+    void commitToPostings();
+
     std::vector<std::deque<Entry> > m_uncommittedData;
     int m_uncommittedCount = 0;
     int m_height = -1;
 
     HashStorage m_addresses;
+    PostingStorage *m_postings = nullptr; // when not using a SQL database
     QString m_basedir;
     Indexer *m_dataSource;
 
@@ -0,0 +1,299 @@
+/*
+ * This file is part of the Flowee project
+ * Copyright (C) 2020 Tom Zander <tomz@freedommail.ch>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "BlockFileReader.h"
+
+#include <APIProtocol.h>
+#include <Logger.h>
+#include <arith_uint256.h>
+#include <hash.h>
+#include <primitives/FastBlock.h>
+#include <primitives/FastTransaction.h>
+#include <streaming/BufferPool.h>
+#include <streaming/MessageBuilder.h>
+#include <tinyformat.h>
+
+#include <boost/unordered_map.hpp>
+
+#include <cstring>
+
+namespace {
+thread_local Streaming::BufferPool m_pool;
+
+constexpr int RecordHeaderSize = 8; // 4 bytes magic, 4 bytes block-size
+constexpr int BlockHeaderSize = 80;
+constexpr size_t MaxOpenFiles = 8;
+
+enum ChainState {
+    Unresolved = -1,
+    NotConnected = -2 // no path to the genesis block found
+};
+
+struct HeaderInfo {
+    uint256 hash;
+    uint256 prevHash;
+    uint32_t bits = 0;
+    int height = Unresolved;
+    int file = -1;
+    uint32_t pos = 0;
+    uint32_t size = 0;
+    arith_uint256 chainWork;
+};
+
+// same as GetBlockProof() in the Hub
+arith_uint256 blockProof(uint32_t bits)
+{
+    arith_uint256 target;
+    bool negative, overflow;
+    target.SetCompact(bits, &negative, &overflow);
+    if (negative || overflow || target == 0)
+        return 0;
+    return (~target / (target + 1)) + 1;
+}
+
+inline uint32_t readUInt32(const char *data)
+{
+    return le32toh(*reinterpret_cast<const uint32_t*>(data));
+}
+}
+
+BlockFileReader::BlockFileReader(const boost::filesystem::path &blocksDir)
+    : m_blocksDir(blocksDir)
+{
+}
+
+bool BlockFileReader::scan()
+{
+    typedef boost::unordered_map<uint256, HeaderInfo, HashShortener> HeaderMap;
+    HeaderMap headers;
+    uint32_t magic = 0;
+    for (int fileIndex = 0;; ++fileIndex) {
+        const auto path = filepathForIndex(fileIndex);
+        if (!boost::filesystem::exists(path))
+            break;
+        boost::iostreams::mapped_file_source file;
+        try {
+            file.open(path.string());
+        } catch (const std::exception &e) {
+            logCritical() << "Failed to open block file" << path.string() << e;
+            break;
+        }
+        const char *begin = file.data();
+        const char *end = begin + file.size();
+        if (magic == 0 && file.size() >= 4) // the first record tells us which network the Hub uses
+            magic = readUInt32(begin);
+
+        int blockCount = 0;
+        const char *buf = begin;
+        while (buf + RecordHeaderSize + BlockHeaderSize <= end) {
+            if (readUInt32(buf) != magic) { // the Hub pre-allocates space, skip the zeros
+                buf = reinterpret_cast<const char*>(memchr(buf + 1, magic & 0xFF, end - buf - 1));
+                if (buf == nullptr)
+                    break;
+                continue;
+            }
+            const uint32_t blockSize = readUInt32(buf + 4);
+            buf += RecordHeaderSize;
+            if (blockSize < BlockHeaderSize || buf + blockSize > end)
+                continue;
+
+            const uint256 hash = Hash(buf, buf + BlockHeaderSize);
+            HeaderInfo &info = headers[hash];
+            info.hash = hash;
+            info.prevHash = uint256(buf + 4);
+            info.bits = readUInt32(buf + 72);
+            info.file = fileIndex;
+            info.pos = static_cast<uint32_t>(buf - begin);
+            info.size = blockSize;
+            ++blockCount;
+            buf += blockSize;
+        }
+        logInfo() << "Block file" << fileIndex << "has" << blockCount << "blocks";
+    }
+    logCritical() << "Found" << headers.size() << "blocks in" << m_blocksDir.string();
+
+    // calculate the height and the chain-work of each block.
+    HeaderInfo *tip = nullptr;
+    std::vector<HeaderInfo*> path;
+    for (auto iter = headers.begin(); iter != headers.end(); ++iter) {
+        HeaderInfo *info = &iter->second;
+        // walk back to a block we know the height of (or the genesis), then forward to fill them in.
+        path.clear();
+        HeaderInfo *base = nullptr;
+        bool connected = true;
+        while (info->height == Unresolved) {
+            path.push_back(info);
+            if (info->prevHash.IsNull()) // genesis
+                break;
+            auto prev = headers.find(info->prevHash);
+            if (prev == headers.end()) {
+                connected = false;
+                break;
+            }
+            info = &prev->second;
+        }
+        if (info->height == NotConnected)
+            connected = false;
+        else if (info->height >= 0)
+            base = info;
+        for (auto i = path.rbegin(); i != path.rend(); ++i) {
+            HeaderInfo *item = *i;
+            if (!connected) {
+                item->height = NotConnected;
+                continue;
+            }
+            item->height = base ? base->height + 1 : 0;
+            item->chainWork = (base ? base->chainWork : arith_uint256(0)) + blockProof(item->bits);
+            base = item;
+            if (tip == nullptr || item->chainWork > tip->chainWork)
+                tip = item;
+        }
+    }
+    if (tip == nullptr)
+        return false;
+
+    m_chain.resize(static_cast<size_t>(tip->height) + 1);
+    HeaderInfo *info = tip;
+    while (true) {
+        BlockPos &pos = m_chain[static_cast<size_t>(info->height)];
+        pos.hash = info->hash;
+        pos.file = info->file;
+        pos.pos = info->pos;
+        pos.size = info->size;
+        if (info->prevHash.IsNull())
+            break;
+        info = &headers.find(info->prevHash)->second;
+    }
+    logCritical() << "Main chain in the block files has height" << tip->height;
+    return true;
+}
+
+int BlockFileReader::chainHeight() const
+{
+    return static_cast<int>(m_chain.size()) - 1;
+}
+
+uint256 BlockFileReader::blockHash(int height) const
+{
+    if (height < 0 || height >= static_cast<int>(m_chain.size()))
+        return uint256();
+    return m_chain.at(static_cast<size_t>(height)).hash;
+}
+
+Message BlockFileReader::createBlockMessage(int height, int content) const
+{
+    if (height < 0 || height >= static_cast<int>(m_chain.size()))
+        return Message();
+    const BlockPos &pos = m_chain.at(static_cast<size_t>(height));
+    auto file = mapFile(pos.file);
+    if (file.get() == nullptr || pos.pos + pos.size > file->size())
+        return Message();
+
+    // the aliasing constructor makes the buffer keep the memory map alive.
+    std::shared_ptr<char> data(file, const_cast<char*>(file->data()));
+    FastBlock block(Streaming::ConstBuffer(data, data.get() + pos.pos, data.get() + pos.pos + pos.size));
+    try {
+        block.findTransactions();
+    } catch (const std::exception &e) {
+        logWarning() << "Block file" << pos.file << "has an invalid block at height" << height << e;
+        return Message();
+    }
+
+    // calculate the size of the message.
+    int total = 45;
+    for (const Tx &tx : block.transactions()) {
+        total += 42;
+        Tx::Iterator iter(tx);
+        auto type = iter.next();
+        while (type != Tx::End) {
+            if ((content & Inputs) && type == Tx::PrevTxHash)
+                total += 42;
+            else if ((content & Inputs) && type == Tx::TxInScript)
+                total += iter.dataLength() + 3;
+            else if ((content & OutputScriptHashes) && type == Tx::OutputScript)
+                total += 40;
+            type = iter.next();
+        }
+    }
+
+    m_pool.reserve(total);
+    Streaming::MessageBuilder builder(m_pool);
+    builder.add(Api::BlockChain::BlockHeight, height);
+    builder.add(Api::BlockChain::BlockHash, block.createHash());
+    for (const Tx &tx : block.transactions()) {
+        const int offsetInBlock = static_cast<int>(tx.offsetInBlock(block));
+        builder.add(Api::BlockChain::Tx_OffsetInBlock, offsetInBlock);
+        if (content & TxIds)
+            builder.add(Api::BlockChain::TxId, tx.createHash());
+        if (content & (Inputs | OutputScriptHashes)) {
+            Tx::Iterator iter(tx);
+            if (offsetInBlock < 91)
+                iter.next(Tx::PrevTxIndex); // skip version, prevTxId and prevTxIndex for coinbase
+            int outIndex = 0;
+            auto type = iter.next();
+            while (type != Tx::End) {
+                if ((content & Inputs) && type == Tx::PrevTxHash) {
+                    builder.add(Api::BlockChain::Tx_IN_TxId, iter.uint256Data());
+                } else if ((content & Inputs) && type == Tx::TxInScript) {
+                    builder.add(Api::BlockChain::Tx_InputScript, iter.byteData());
+                } else if ((content & Inputs) && type == Tx::PrevTxIndex) {
+                    builder.add(Api::BlockChain::Tx_IN_OutIndex, iter.intData());
+                } else if (type == Tx::OutputScript) {
+                    if (content & OutputScriptHashes) {
+                        builder.add(Api::BlockChain::Tx_Out_Index, outIndex);
+                        builder.add(Api::BlockChain::Tx_Out_ScriptHash, iter.hashedByteData());
+                    }
+                    ++outIndex;
+                }
+                type = iter.next();
+            }
+        }
+        builder.add(Api::BlockChain::Separator, true);
+    }
+    return builder.message(Api::BlockChainService, Api::BlockChain::GetBlockReply);
+}
+
+boost::filesystem::path BlockFileReader::filepathForIndex(int fileIndex) const
+{
+    // same naming as Blocks::getFilepathForIndex() in the Hub
+    return m_blocksDir / strprintf("blk%05u.dat", fileIndex);
+}
+
+std::shared_ptr<boost::iostreams::mapped_file_source> BlockFileReader::mapFile(int fileIndex) const
+{
+    std::lock_guard<std::mutex> lock(m_lock);
+    auto iter = m_openFiles.find(fileIndex);
+    if (iter != m_openFiles.end())
+        return iter->second;
+
+    std::shared_ptr<boost::iostreams::mapped_file_source> file;
+    try {
+        file = std::make_shared<boost::iostreams::mapped_file_source>(filepathForIndex(fileIndex).string());
+    } catch (const std::exception &e) {
+        logWarning() << "Failed to memmap block file" << fileIndex << e;
+        return file;
+    }
+    // the blocks are mostly ordered by height in the files, forget the file furthest away.
+    if (m_openFiles.size() >= MaxOpenFiles) {
+        if (m_openFiles.begin()->first < fileIndex)
+            m_openFiles.erase(m_openFiles.begin());
+        else
+            m_openFiles.erase(--m_openFiles.end());
+    }
+    m_openFiles.insert(std::make_pair(fileIndex, file));
+    return file;
+}
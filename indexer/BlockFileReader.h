@@ -0,0 +1,98 @@
+/*
+ * This file is part of the Flowee project
+ * Copyright (C) 2020 Tom Zander <tomz@freedommail.ch>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef BLOCKFILEREADER_H
+#define BLOCKFILEREADER_H
+
+#include <Message.h>
+#include <uint256.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+/**
+ * Reads blocks directly from the blk*.dat files of a Hub on the same machine.
+ *
+ * During the initial sync this avoids the Hub having to serialize every block
+ * in the history and send it over the API. The files are memory-mapped read-only.
+ *
+ * The Hub keeps its block-index in a database only it can open, so the main
+ * chain is found by reading all block-headers from the files and following
+ * the chain with the most proof of work.
+ * The files may hold blocks the Hub rejected, callers should compare blockHash()
+ * with the Hub's main chain before trusting the blocks.
+ */
+class BlockFileReader
+{
+public:
+    /// The parts of the block to include in the message, matching the GetBlock options.
+    enum Content {
+        TxIds = 1,
+        Inputs = 2,
+        OutputScriptHashes = 4
+    };
+
+    /// \param blocksDir is the 'blocks' directory in the datadir of the Hub.
+    explicit BlockFileReader(const boost::filesystem::path &blocksDir);
+
+    /**
+     * Read all the block-files and find the main chain.
+     * This will take some time, as it needs to touch every block-header in the files.
+     * @returns false if no blocks were found.
+     */
+    bool scan();
+
+    /// Returns the height of the last block we found in the main chain, or -1 if none.
+    int chainHeight() const;
+
+    /// Returns the hash of the block at \a height in our main chain, or a null hash if out of range.
+    uint256 blockHash(int height) const;
+
+    /**
+     * Create a message holding the block at \a height in the same format as
+     * the Hub's GetBlockReply.
+     * \param content is a combination of Content flags.
+     * This method is thread-safe.
+     * @returns the block-message, or an empty message if the block could not be read.
+     */
+    Message createBlockMessage(int height, int content) const;
+
+private:
+    struct BlockPos {
+        uint256 hash;
+        int file;
+        uint32_t pos; ///< the position of the block-data, directly after the record header.
+        uint32_t size;
+    };
+
+    boost::filesystem::path filepathForIndex(int fileIndex) const;
+    /// Return the memory map of the file, possibly from cache. Thread-safe.
+    std::shared_ptr<boost::iostreams::mapped_file_source> mapFile(int fileIndex) const;
+
+    boost::filesystem::path m_blocksDir;
+    std::vector<BlockPos> m_chain; // the main chain, indexed by block height
+
+    mutable std::mutex m_lock; // protects m_openFiles
+    mutable std::map<int, std::shared_ptr<boost::iostreams::mapped_file_source> > m_openFiles;
+};
+
+#endif
@@ -27,9 +27,91 @@
 
 #include <boost/filesystem.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <thread>
+
 #define WIDTH 32
 
 namespace {
+constexpr size_t RecordSize = WIDTH + sizeof(int);
+
+// the bloom filter uses 12 bits per hash, giving a false-positive rate below 1%.
+constexpr int BloomBitsPerHash = 12;
+constexpr int BloomBlockSize = 64; // one cache-line, 8 words
+
+constexpr int MaxInterpolationGuesses = 6;
+
+// below this amount of hashes sorting is not worth starting threads for.
+constexpr size_t ParallelSortMin = 50000;
+constexpr size_t WriteBufferSize = 1000000;
+
+inline uint64_t readUInt64(const uchar *data)
+{
+    uint64_t answer;
+    memcpy(&answer, data, sizeof(answer));
+    return answer;
+}
+
+// the most significant 8 bytes of a hash, as used in uint256::Compare()
+inline uint64_t sortKey(const uchar *hash)
+{
+    return le64toh(readUInt64(hash + WIDTH - 8));
+}
+
+/*
+ * Returns the row of \a hash in the sorted records, or -1 if its not there.
+ *
+ * The hashes are evenly distributed, so instead of a plain binary search we guess
+ * the position by interpolating between the keys at the bounds, which typically
+ * finds the hash in 3 or 4 steps instead of 20+.
+ * Data that is not evenly distributed could make interpolation very slow, so after
+ * a couple of guesses we fall back to bisection, keeping the worst case logarithmic.
+ */
+int findRow(const uchar *sorted, int rows, const uint256 &hash)
+{
+    const uint64_t key = sortKey(hash.begin());
+    int low = 0;
+    int high = rows - 1;
+    int guesses = 0;
+    while (low <= high) {
+        const uint64_t lowKey = sortKey(sorted + low * RecordSize);
+        const uint64_t highKey = sortKey(sorted + high * RecordSize);
+        if (key < lowKey || key > highKey)
+            return -1;
+        int m;
+        if (guesses < MaxInterpolationGuesses && highKey > lowKey) {
+            const double fraction = static_cast<double>(key - lowKey) / static_cast<double>(highKey - lowKey);
+            m = std::min(high, low + static_cast<int>(fraction * (high - low)));
+            ++guesses;
+        } else {
+            m = (low + high) / 2;
+        }
+        const int comp = reinterpret_cast<const uint256*>(sorted + m * RecordSize)->Compare(hash);
+        if (comp == 0)
+            return m;
+        if (comp < 0)
+            low = m + 1;
+        else
+            high = m - 1;
+    }
+    return -1;
+}
+
+// set or test the bits for one hash in its block.
+// The block is picked from bytes 8-15, the bit in each of the 8 words from bytes 16-23 of the hash.
+inline uint64_t *bloomBlock(uchar *blocks, int blockCount, const uint256 &hash)
+{
+    const uint64_t selector = readUInt64(hash.begin() + 8) >> 32;
+    return reinterpret_cast<uint64_t*>(blocks + ((selector * static_cast<uint64_t>(blockCount)) >> 32) * BloomBlockSize);
+}
+
+inline uint64_t bloomBit(const uint256 &hash, int word)
+{
+    return uint64_t(1) << ((readUInt64(hash.begin() + 16) >> (word * 6)) & 63);
+}
+
 struct Pair {
     Pair(const uint256 *h, int i) : hash(h), index(i) {}
     const uint256 *hash;
@@ -44,13 +126,54 @@ struct PairSorter {
         }
     }
 
+    /*
+     * Sort the pairs, using all cores.
+     * The hashes are evenly distributed, so we split them into partitions on their most
+     * significant bits. The partitions are sorted in parallel and are, by definition,
+     * in the right order relative to each other.
+     */
+    void sort() {
+        const int threads = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+        if (threads == 1 || pairs.size() < ParallelSortMin) {
+            std::sort(pairs.begin(), pairs.end(), &sortPairs);
+            return;
+        }
+        // a couple of partitions per thread evens out the differences in size.
+        const uint64_t partitionCount = static_cast<uint64_t>(threads) * 4;
+        std::vector<std::vector<Pair> > partitions(partitionCount);
+        for (auto &partition : partitions) {
+            partition.reserve(pairs.size() / partitionCount + 100);
+        }
+        for (const Pair &pair : pairs) {
+            partitions[((sortKey(pair.hash->begin()) >> 32) * partitionCount) >> 32].push_back(pair);
+        }
+        std::atomic<size_t> nextPartition(0);
+        auto sorter = [&partitions, &nextPartition]() {
+            for (size_t i = nextPartition++; i < partitions.size(); i = nextPartition++) {
+                std::sort(partitions[i].begin(), partitions[i].end(), &sortPairs);
+            }
+        };
+        std::vector<std::thread> helpers;
+        for (int i = 1; i < threads; ++i) {
+            helpers.push_back(std::thread(sorter));
+        }
+        sorter();
+        for (auto &helper : helpers) {
+            helper.join();
+        }
+        pairs.clear();
+        for (const auto &partition : partitions) {
+            pairs.insert(pairs.end(), partition.begin(), partition.end());
+        }
+    }
+
+    static bool sortPairs(const Pair &a, const Pair &b) {
+        return a.hash->Compare(*b.hash) < 0;
+    }
+
     std::vector<Pair> pairs;
 };
 
-bool sortPairs(const Pair &a, const Pair &b) {
-    return a.hash->Compare(*b.hash) <= 0;
-}
-
 struct PartHashTip {
     int partIndex;
     int value;
@@ -61,16 +184,21 @@ struct HashListPartProxy {
     int pos, rows;
 };
 
+// Does a streaming k-way merge of the sorted parts.
 struct HashCollector {
     HashCollector(const QList<HashListPart*> &parts)
     {
         m_tips.reserve(parts.size());
         m_parts.reserve(parts.size());
+        int totalRows = 0;
         for (int i = 0; i < parts.size(); ++i) {
             auto &p = parts.at(i);
-            m_parts.push_back({p->sorted, 0, (int)(p->sortedFile.size() / (WIDTH + sizeof(int)))});
-            sortInTip(i);
+            m_parts.push_back({p->sorted, 0, p->rowCount()});
+            totalRows += p->rowCount();
+            if (p->rowCount() > 0)
+                sortInTip(i);
         }
+        m_revertLookup.resize(static_cast<size_t>(totalRows), -1);
     }
 
     void sortInTip(int partIndex) {
@@ -79,7 +207,7 @@ struct HashCollector {
         Q_ASSERT(m_parts.size() > partIndex);
         HashListPartProxy &p = m_parts.at(partIndex);
         Q_ASSERT(p.pos < p.rows);
-        const uchar *recordStart = (p.file + p.pos * (WIDTH + sizeof(int)));
+        const uchar *recordStart = (p.file + p.pos * RecordSize);
         tip.key = reinterpret_cast<const uint256*>(recordStart);
         tip.value = *reinterpret_cast<const int*>(recordStart + WIDTH);
         ++p.pos;
@@ -97,59 +225,148 @@ struct HashCollector {
                 l = m + 1;
             else if (comp > 0)
                 r = m - 1;
-            else {
-                assert(false);
+            else
                 throw std::runtime_error("Duplicate entries in HashStorage");
-            }
         }
         m_tips.insert(l, tip);
-
-        // logFatal()  << "ran a sortInTip";
-        // for (int i = 0; i < m_tips.size(); ++i) {
-        //     logFatal() << *m_tips.at(i).key;
-        // }
     }
 
     void writeHashesToFile(QFile *outFile) {
         Q_ASSERT(outFile);
         Q_ASSERT(outFile->isOpen());
+        std::vector<char> buffer;
+        buffer.reserve(WriteBufferSize + RecordSize);
+        int row = 0;
         while (!m_tips.isEmpty()) {
             auto item = m_tips.takeFirst();
-            outFile->write(reinterpret_cast<const char*>(item.key->begin()), WIDTH);
-            outFile->write(reinterpret_cast<const char*>(&item.value), sizeof(int));
+            const char *key = reinterpret_cast<const char*>(item.key->begin());
+            buffer.insert(buffer.end(), key, key + WIDTH);
+            const char *value = reinterpret_cast<const char*>(&item.value);
+            buffer.insert(buffer.end(), value, value + sizeof(int));
+            if (buffer.size() >= WriteBufferSize) {
+                write(outFile, buffer);
+                buffer.clear();
+            }
 
+            if (item.value < 0 || item.value >= static_cast<int>(m_revertLookup.size()))
+                throw std::runtime_error("HashStorage index out of range");
+            m_revertLookup[static_cast<size_t>(item.value)] = row++;
             auto &p = m_parts.at(item.partIndex);
-            m_revertLookup.insert(item.value, m_revertLookup.size());
             if (p.pos < p.rows)
                 sortInTip(item.partIndex);
         }
+        write(outFile, buffer);
         outFile->close();
     }
     void writeRevertLookup(QFile *outFile) {
         Q_ASSERT(outFile);
         Q_ASSERT(outFile->isOpen());
-        for (auto iter = m_revertLookup.begin(); iter != m_revertLookup.end(); ++iter) {
-            outFile->write(reinterpret_cast<const char*>(&iter.value()), sizeof(int));
-        }
+        const char *data = reinterpret_cast<const char*>(m_revertLookup.data());
+        const qint64 size = static_cast<qint64>(m_revertLookup.size() * sizeof(int));
+        if (outFile->write(data, size) != size)
+            throw std::runtime_error("Failed to write HashStorage index file");
         m_revertLookup.clear();
         outFile->close();
     }
 
 private:
+    static void write(QFile *outFile, const std::vector<char> &buffer) {
+        const qint64 size = static_cast<qint64>(buffer.size());
+        if (outFile->write(buffer.data(), size) != size)
+            throw std::runtime_error("Failed to write HashStorage db file");
+    }
+
     QList<PartHashTip> m_tips;
     std::vector<HashListPartProxy> m_parts;
-    QMap<int, int> m_revertLookup;
+    // maps the value (the index) to the row in the output file.
+    std::vector<int> m_revertLookup;
 };
 
 }
 
 uint256 HashStoragePrivate::s_null = uint256();
 
+// -----------------------------------------------------------------
+
+HashBloomFilter::HashBloomFilter(const QString &filename)
+    : m_file(filename)
+{
+}
+
+HashBloomFilter::~HashBloomFilter()
+{
+    close();
+}
+
+void HashBloomFilter::open(const uchar *sorted, int rows)
+{
+    Q_ASSERT(m_blocks == nullptr);
+    const int blockCount = blockCountFor(rows);
+    if (m_file.size() != qint64(blockCount) * BloomBlockSize) {
+        // missing, or from a different version of the sorted file.
+        std::vector<uint64_t> words(static_cast<size_t>(blockCount) * BloomBlockSize / sizeof(uint64_t));
+        uchar *blocks = reinterpret_cast<uchar*>(words.data());
+        for (int row = 0; row < rows; ++row) {
+            const uint256 *hash = reinterpret_cast<const uint256*>(sorted + row * RecordSize);
+            uint64_t *block = bloomBlock(blocks, blockCount, *hash);
+            for (int i = 0; i < 8; ++i) {
+                block[i] |= bloomBit(*hash, i);
+            }
+        }
+        if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            logWarning() << "Failed to write bloom filter" << m_file.fileName();
+            return;
+        }
+        m_file.write(reinterpret_cast<const char*>(blocks), qint64(blockCount) * BloomBlockSize);
+        m_file.close();
+    }
+    if (m_file.open(QIODevice::ReadOnly)) {
+        m_blocks = m_file.map(0, m_file.size());
+        m_file.close();
+        if (m_blocks)
+            m_blockCount = blockCount;
+    }
+}
+
+void HashBloomFilter::close()
+{
+    if (m_blocks) {
+        m_file.unmap(m_blocks);
+        m_blocks = nullptr;
+        m_blockCount = 0;
+    }
+}
+
+void HashBloomFilter::remove()
+{
+    close();
+    m_file.remove();
+}
+
+bool HashBloomFilter::mayContain(const uint256 &hash) const
+{
+    if (m_blocks == nullptr) // no filter, we can't tell.
+        return true;
+    const uint64_t *block = bloomBlock(m_blocks, m_blockCount, hash);
+    for (int i = 0; i < 8; ++i) {
+        if ((block[i] & bloomBit(hash, i)) == 0)
+            return false;
+    }
+    return true;
+}
+
+int HashBloomFilter::blockCountFor(int rows)
+{
+    return std::max(1, static_cast<int>(int64_t(rows) * BloomBitsPerHash / (BloomBlockSize * 8)));
+}
+
+
 // -----------------------------------------------------------------
 
 HashListPart::HashListPart(const QString &partBase)
     : sortedFile(partBase + ".db"),
-    reverseLookupFile(partBase + ".index")
+    reverseLookupFile(partBase + ".index"),
+    filter(partBase + ".bloom")
 {
 }
 
@@ -170,11 +387,14 @@ void HashListPart::openFiles()
         reverseLookup = reverseLookupFile.map(0, reverseLookupFile.size());
         reverseLookupFile.close();
     }
+    if (sorted)
+        filter.open(sorted, rowCount());
 }
 
 void HashListPart::closeFiles()
 {
     // technically speaking, the files are not actually open. They are just mapped.
+    filter.close();
     if (sorted) {
         sortedFile.unmap(sorted);
         sorted = nullptr;
@@ -185,6 +405,31 @@ void HashListPart::closeFiles()
     }
 }
 
+int HashListPart::find(const uint256 &hash) const
+{
+    Q_ASSERT(sorted);
+    if (!filter.mayContain(hash))
+        return -1;
+    const int row = findRow(sorted, rowCount(), hash);
+    if (row < 0)
+        return -1;
+    return *reinterpret_cast<const int*>(sorted + row * RecordSize + WIDTH);
+}
+
+const uint256 &HashListPart::at(int index) const
+{
+    Q_ASSERT(index >= 0);
+    Q_ASSERT(index < rowCount());
+    Q_ASSERT(reverseLookup);
+    const int row = *reinterpret_cast<const int*>(reverseLookup + index * sizeof(int));
+    return *reinterpret_cast<const uint256*>(sorted + row * RecordSize);
+}
+
+int HashListPart::rowCount() const
+{
+    return static_cast<int>(sortedFile.size() / RecordSize);
+}
+
 
 // -----------------------------------------------------------------
 
@@ -210,10 +455,13 @@ HashIndexPoint HashStorage::append(const uint256 &hash)
     auto db = dbs.last();
     int index = db->append(hash);
     Q_ASSERT(index >= 0);
-    if (db->m_cacheMap.size() > 833333)
+    if (db->m_cacheMap.size() > 833333) {
         db->stabilize();
-    else if (db->m_parts.size() > 10 && dbs == d->dbs)
-        finalize();
+    } else if (db->m_parts.size() > 10 && dbs == d->dbs) {
+        // merge in the background, new hashes go into a new list.
+        db->startFinalize();
+        d->dbs.append(HashList::createEmpty(d->basedir, d->dbs.size() + 1));
+    }
     return HashIndexPoint(dbs.size() - 1, index);
 }
 
@@ -242,6 +490,9 @@ HashIndexPoint HashStorage::lookup(const uint256 &hash) const
 
 void HashStorage::finalize()
 {
+    for (auto db : d->dbs) { // wait for any background merges
+        db->waitForFinalize();
+    }
     d->dbs.last()->finalize();
     d->dbs.append(HashList::createEmpty(d->basedir, d->dbs.size() + 1));
 }
@@ -252,7 +503,8 @@ void HashStorage::finalize()
 HashList::HashList(const QString &dbBase)
     : m_filebase(dbBase),
       m_sortedFile(m_filebase + ".db"),
-      m_reverseLookupFile(m_filebase + ".index")
+      m_reverseLookupFile(m_filebase + ".index"),
+      m_filter(m_filebase + ".bloom")
 {
     QFile info(m_filebase + ".info");
     int partCount = 0;
@@ -264,13 +516,24 @@ HashList::HashList(const QString &dbBase)
 
     // is it finalized?
     if (m_sortedFile.open(QIODevice::ReadOnly)) {
-        Q_ASSERT(partCount == 0);
+        if (partCount > 0) { // we were stopped between writing the merged file and the cleanup.
+            for (int i = 0; i < partCount; ++i) {
+                HashListPart part(QString("%1_%2").arg(m_filebase).arg(i, 2, 10, QChar('0')));
+                part.sortedFile.remove();
+                part.reverseLookupFile.remove();
+                part.filter.remove();
+            }
+            QFile::remove(m_filebase + ".log");
+            writeInfoFile();
+        }
         m_sorted = m_sortedFile.map(0, m_sortedFile.size());
         m_sortedFile.close();
         if (m_reverseLookupFile.open(QIODevice::ReadOnly)) {
             m_reverseLookup = m_reverseLookupFile.map(0, m_reverseLookupFile.size());
             m_reverseLookupFile.close();
         }
+        if (m_sorted)
+            m_filter.open(m_sorted, static_cast<int>(m_sortedFile.size() / RecordSize));
     }
     else { // We are not finalized, so we should have a log
         m_log = new QFile(m_filebase + ".log");
@@ -296,6 +559,8 @@ HashList::HashList(const QString &dbBase)
 
 HashList::~HashList()
 {
+    waitForFinalize();
+    qDeleteAll(m_parts);
     if (m_log) {
         m_log->close();
         delete m_log;
@@ -331,35 +596,17 @@ int HashList::lookup(const uint256 &hash) const
     if (item != m_cacheMap.end())
         return item->second;
 
-    int pos = 0;
-    int endpos = m_sortedFile.size() / (WIDTH + sizeof(int)) - 1;
-    while (pos <= endpos) {
-        int m = (pos + endpos) / 2;
-        uint256 *item = (uint256*)(m_sorted + m * (WIDTH + sizeof(int)));
-        const int comp = item->Compare(hash);
-        if (comp < 0)
-            pos = m + 1;
-        else if (comp > 0)
-            endpos = m - 1;
-        else
-            return *reinterpret_cast<int*>(m_sorted + m * (WIDTH + sizeof(int)) + WIDTH);
+    if (m_sorted && m_filter.mayContain(hash)) {
+        const int row = findRow(m_sorted, static_cast<int>(m_sortedFile.size() / RecordSize), hash);
+        if (row >= 0)
+            return *reinterpret_cast<int*>(m_sorted + row * RecordSize + WIDTH);
     }
     for (auto part : m_parts) {
         Q_ASSERT(part->reverseLookup);
         Q_ASSERT(part->sorted);
-        pos = 0;
-        endpos = part->sortedFile.size() / (WIDTH + sizeof(int)) - 1;
-        while (pos <= endpos) {
-            int m = (pos + endpos) / 2;
-            uint256 *item = (uint256*)(part->sorted + m * (WIDTH + sizeof(int)));
-            const int comp = item->Compare(hash);
-            if (comp < 0)
-                pos = m + 1;
-            else if (comp > 0)
-                endpos = m - 1;
-            else
-                return *reinterpret_cast<int*>(part->sorted + m * (WIDTH + sizeof(int)) + WIDTH);
-        }
+        const int result = part->find(hash);
+        if (result >= 0)
+            return result;
     }
 
     return -1;
@@ -378,6 +625,12 @@ const uint256 &HashList::at(int index) const
         const uint256 *dummy = reinterpret_cast<uint256*>(m_sorted + row * (WIDTH + sizeof(int)));
         return *dummy;
     }
+    int first = 0; // the parts each hold a range of indexes, in order.
+    for (auto part : m_parts) {
+        if (index < first + part->rowCount())
+            return part->at(index - first);
+        first += part->rowCount();
+    }
 
     // also check the dirty cache. Do this at end as this is a slow lookup
     for (auto iter = m_cacheMap.begin(); iter != m_cacheMap.end(); ++iter) {
@@ -401,24 +654,32 @@ void HashList::stabilize()
     m_parts.append(part);
 
     PairSorter sorted(m_cacheMap);
-    std::sort(sorted.pairs.begin(), sorted.pairs.end(), &sortPairs);
-    QMap<int, int> lookupTable;
+    sorted.sort();
+    // the cache holds a continuous range of indexes, the lookup table maps them to the row.
+    const int firstIndex = m_nextId - static_cast<int>(sorted.pairs.size());
+    std::vector<int> lookupTable(sorted.pairs.size(), -1);
+    std::vector<char> buffer;
+    buffer.reserve(sorted.pairs.size() * RecordSize);
+    int row = 0;
     for (auto iter = sorted.pairs.begin(); iter != sorted.pairs.end(); ++iter) {
-        assert(iter->index >= 0); // no negative numbers, please.
-        part->sortedFile.write(reinterpret_cast<const char*>(iter->hash->begin()), WIDTH);
-        part->sortedFile.write(reinterpret_cast<const char*>(&iter->index), sizeof(int));
-        lookupTable.insert(iter->index, lookupTable.size());
+        assert(iter->index >= firstIndex);
+        assert(iter->index < m_nextId);
+        const char *hash = reinterpret_cast<const char*>(iter->hash->begin());
+        buffer.insert(buffer.end(), hash, hash + WIDTH);
+        const char *index = reinterpret_cast<const char*>(&iter->index);
+        buffer.insert(buffer.end(), index, index + sizeof(int));
+        lookupTable[static_cast<size_t>(iter->index - firstIndex)] = row++;
     }
+    part->sortedFile.write(buffer.data(), static_cast<qint64>(buffer.size()));
     sorted.pairs.clear();
     m_cacheMap.clear();
     part->sortedFile.close();
-    for (auto iter = lookupTable.begin(); iter != lookupTable.end(); ++iter) {
-        part->reverseLookupFile.write(reinterpret_cast<const char*>(&iter.value()), sizeof(int));
-    }
-    lookupTable.clear();
+    part->reverseLookupFile.write(reinterpret_cast<const char*>(lookupTable.data()),
+                                  static_cast<qint64>(lookupTable.size() * sizeof(int)));
     part->reverseLookupFile.close();
     m_log->close();
     m_log->open(QIODevice::WriteOnly | QIODevice::Truncate);
+    part->filter.remove(); // in case a previous run crashed halfway, leaving an old one.
     part->openFiles();
     writeInfoFile();
 }
@@ -435,47 +696,98 @@ void HashList::writeInfoFile() const
 
 void HashList::finalize()
 {
+    startFinalize();
+    waitForFinalize();
+}
+
+void HashList::startFinalize()
+{
+    if (m_merger.joinable()) // already running
+        return;
     if (!m_cacheMap.empty())
         stabilize();
     Q_ASSERT(m_cacheMap.empty());
     Q_ASSERT(!m_sortedFile.exists());
     Q_ASSERT(!m_sorted);
     Q_ASSERT(!m_reverseLookup);
-    QMutexLocker lock(&m_mutex);
-    if (!m_sortedFile.open(QIODevice::ReadWrite | QIODevice::Truncate)) {
-        throw std::runtime_error("Failed to open db file for writing");
-    }
-    if (!m_reverseLookupFile.open(QIODevice::ReadWrite | QIODevice::Truncate)) {
-        throw std::runtime_error("Failed to open index file for writing");
-    }
+    m_merger = std::thread(&HashList::mergeParts, this);
+}
 
-    HashCollector collector(m_parts);
-    collector.writeHashesToFile(&m_sortedFile);
-    collector.writeRevertLookup(&m_reverseLookupFile);
+void HashList::waitForFinalize()
+{
+    if (m_merger.joinable())
+        m_merger.join();
+}
 
-    for (auto p : m_parts) {
-        p->closeFiles();
-        p->reverseLookupFile.remove();
-        p->sortedFile.remove();
+void HashList::mergeParts()
+{
+    QList<HashListPart*> parts;
+    {
+        QMutexLocker lock(&m_mutex);
+        parts = m_parts;
     }
-    qDeleteAll(m_parts);
-    m_parts.clear();
-    m_log->close();
-    bool ok = m_log->remove();
-    Q_ASSERT(ok); Q_UNUSED(ok)
-    delete m_log;
-    m_log = nullptr;
-    m_sortedFile.close();
+    // The parts are read-only, so we merge them without holding the lock
+    // allowing lookups to continue using the parts.
+    // The new files get a temporary name, the '.db' file appearing marks us as finalized.
+    QFile sortedFile(m_filebase + ".db.tmp");
+    QFile reverseLookupFile(m_filebase + ".index.tmp");
+    try {
+        if (!sortedFile.open(QIODevice::WriteOnly | QIODevice::Truncate))
+            throw std::runtime_error("Failed to open db file for writing");
+        if (!reverseLookupFile.open(QIODevice::WriteOnly | QIODevice::Truncate))
+            throw std::runtime_error("Failed to open index file for writing");
+
+        HashCollector collector(parts);
+        collector.writeHashesToFile(&sortedFile);
+        collector.writeRevertLookup(&reverseLookupFile);
+
+        QFile::remove(m_reverseLookupFile.fileName());
+        if (!reverseLookupFile.rename(m_reverseLookupFile.fileName()))
+            throw std::runtime_error("Failed to rename index file");
+        m_filter.remove();
+        if (!sortedFile.rename(m_sortedFile.fileName()))
+            throw std::runtime_error("Failed to rename db file");
+    } catch (const std::exception &e) {
+        logFatal() << "HashStorage failed to merge" << m_filebase << e;
+        sortedFile.remove();
+        reverseLookupFile.remove();
+        return; // we just keep using the parts.
+    }
+
+    // map the new files and create the filter, all before we make them visible.
+    uchar *sorted = nullptr;
     if (m_sortedFile.open(QIODevice::ReadOnly)) {
-        m_sorted = m_sortedFile.map(0, m_sortedFile.size());
+        sorted = m_sortedFile.map(0, m_sortedFile.size());
         m_sortedFile.close();
     }
-    m_reverseLookupFile.close();
+    uchar *reverseLookup = nullptr;
     if (m_reverseLookupFile.open(QIODevice::ReadOnly)) {
-        m_reverseLookup = m_reverseLookupFile.map(0, m_reverseLookupFile.size());
+        reverseLookup = m_reverseLookupFile.map(0, m_reverseLookupFile.size());
         m_reverseLookupFile.close();
     }
-    writeInfoFile();
+    if (sorted)
+        m_filter.open(sorted, static_cast<int>(m_sortedFile.size() / RecordSize));
+
+    {   // swap to the merged file
+        QMutexLocker lock(&m_mutex);
+        m_sorted = sorted;
+        m_reverseLookup = reverseLookup;
+        m_parts.clear();
+        m_log->close();
+        bool ok = m_log->remove();
+        Q_ASSERT(ok); Q_UNUSED(ok)
+        delete m_log;
+        m_log = nullptr;
+        writeInfoFile();
+    }
+
+    for (auto p : parts) {
+        p->closeFiles();
+        p->reverseLookupFile.remove();
+        p->sortedFile.remove();
+        p->filter.remove();
+    }
+    qDeleteAll(parts);
 }
 
 
@@ -502,6 +814,11 @@ HashStoragePrivate::HashStoragePrivate(const boost::filesystem::path &basedir_)
     if (dbs.isEmpty()) {
         dbs.append(HashList::createEmpty(basedir, 1));
     }
+    // restart merges that got interrupted, only the last list should be unfinalized.
+    for (int i = 0; i < dbs.size() - 1; ++i) {
+        if (dbs.at(i)->m_log)
+            dbs.at(i)->startFinalize();
+    }
 }
 
 HashStoragePrivate::~HashStoragePrivate()
@@ -37,10 +37,42 @@
 #include <qmap.h>
 #include <qmutex.h>
 
+#include <thread>
+
 inline uint32_t qHash(const uint256 &key, uint32_t seed) {
     return *reinterpret_cast<const uint32_t*>(key.begin() + (seed % 5));
 }
 
+/*
+ * A bloom filter on all the hashes of one sorted file, stored next to that file.
+ * All the bits for one hash are in a single 64-byte block, so testing a hash
+ * touches just one cache-line.
+ * Most lookups are for hashes we have never seen, the filter avoids searching
+ * the sorted files for those.
+ */
+class HashBloomFilter
+{
+public:
+    HashBloomFilter(const QString &filename);
+    ~HashBloomFilter();
+
+    /// Map the filter file, (re)creating it from the \a rows records in \a sorted if needed.
+    void open(const uchar *sorted, int rows);
+    void close();
+    void remove();
+
+    /// Returns false only if the hash is definitely not in the sorted file.
+    bool mayContain(const uint256 &hash) const;
+
+    /// return the amount of 64-byte blocks a filter for \a rows hashes uses.
+    static int blockCountFor(int rows);
+
+private:
+    QFile m_file;
+    uchar *m_blocks = nullptr;
+    int m_blockCount = 0;
+};
+
 class HashListPart
 {
 public:
@@ -49,13 +81,17 @@ public:
     void openFiles();
     void closeFiles();
     int find(const uint256 &hash) const;
+    /// return the hash for the \a index relative to the first index stored in this part
     const uint256 &at(int index) const;
+    int rowCount() const;
 
     uchar *sorted = nullptr;
     QFile sortedFile;
 
     uchar *reverseLookup = nullptr;
     QFile reverseLookupFile;
+
+    HashBloomFilter filter;
 };
 
 class HashList {
@@ -75,6 +111,15 @@ public:
     // copy all parts into one file and switch to (single) file lookups only
     void finalize();
 
+    /*
+     * Start merging all parts into one file in a background thread.
+     * Lookups keep using the parts until the merge is done, at which point
+     * we switch to the new file. No more appends are allowed after this call.
+     */
+    void startFinalize();
+    /// Block until a merge started by startFinalize() is done.
+    void waitForFinalize();
+
     const QString m_filebase;
     QList<HashListPart*> m_parts;
 
@@ -83,6 +128,7 @@ public:
     QFile m_sortedFile;
     uchar *m_reverseLookup = nullptr;
     QFile m_reverseLookupFile;
+    HashBloomFilter m_filter;
 
     // the unsorted part
     QFile *m_log = nullptr;
@@ -90,6 +136,12 @@ public:
 
     int m_nextId = 0;
     mutable QMutex m_mutex;
+
+private:
+    // the body of the thread started in startFinalize()
+    void mergeParts();
+
+    std::thread m_merger;
 };
 
 class HashStoragePrivate
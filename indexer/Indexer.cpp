@@ -17,6 +17,7 @@
  */
 #include "Indexer.h"
 #include "AddressIndexer.h"
+#include "BlockFileReader.h"
 #include "TxIndexer.h"
 #include "SpentOuputIndexer.h"
 
@@ -36,37 +37,6 @@
 
 namespace {
 
-static std::vector<std::atomic<int> > s_requestedHeights = std::vector<std::atomic<int> >(3);
-
-struct Token {
-    Token(int wantedHeight) : m_wantedHeight(wantedHeight) {
-        for (int i = 0; i < s_requestedHeights.size(); ++i) {
-            int expected = -1;
-            if (s_requestedHeights[i].compare_exchange_strong(expected, wantedHeight)) {
-                m_token = i;
-                break;
-            }
-        }
-        assert(m_token >= 0); // if fail, then make sure your vector size matches the max number of indexer-threads
-    }
-    ~Token() {
-        // only exchange when someone else didn't take our slot yet.
-        s_requestedHeights[m_token].compare_exchange_strong(m_wantedHeight, -1);
-    }
-
-    int allocatedTokens() const {
-        int answer = 0;
-        for (size_t i = 0; i < s_requestedHeights.size(); ++i) {
-            if (s_requestedHeights[i].load() != -1)
-                answer++;
-        }
-        return answer;
-    }
-private:
-    int m_token = -1;
-    int m_wantedHeight = 0;
-};
-
 void buildAddressSearchReply(Streaming::MessageBuilder &builder, const std::vector<AddressIndexer::TxData> &data)
 {
     int bh = -1, oib = -1;
@@ -94,11 +64,6 @@ Indexer::Indexer(const boost::filesystem::path &basedir)
     qRegisterMetaType<Message>("Message");
     m_network.addService(this);
 
-    // init static
-    for (size_t i = 0; i < s_requestedHeights.size(); ++i) {
-        s_requestedHeights[i] = -1;
-    }
-
     connect (&m_pollingTimer, SIGNAL(timeout()), SLOT(checkBlockArrived()));
     m_pollingTimer.start(2 * 60 * 1000);
     connect (this, SIGNAL(requestFindAddress(Message)), this, SLOT(onFindAddressRequest(Message)), Qt::QueuedConnection);
@@ -174,6 +139,13 @@ void Indexer::loadConfig(const QString &filename, const EndPoint &prioHubLocatio
             enableSpentDb = settings.value("spentdb/enabled", "false").toBool();
         }
         else if (group == "services") {
+            QMutexLocker lock(&m_nextBlockLock);
+            m_prefetchWindow = std::max(1, settings.value("services/prefetch", m_prefetchWindow).toInt());
+            m_prefetchMemory = std::max(1, settings.value("services/prefetch_memory", 500).toInt()) * qint64(1024 * 1024);
+            lock.unlock();
+            const QString blocksDir = settings.value("services/blocksdir").toString();
+            if (!blocksDir.isEmpty() && !m_blockFiles)
+                openBlockFiles(blocksDir);
             if (hub.hostname.empty()) { // only if user didn't override using commandline
                 QString connectionString = settings.value("services/hub").toString();
                 hub = EndPoint("", 1235); // clear the IP address-default
@@ -226,6 +198,7 @@ void Indexer::loadConfig(const QString &filename, const EndPoint &prioHubLocatio
     } else if (!enableAddressDb && m_addressdb) {
         m_addressdb->requestInterruption();
         m_addressdb->wait();
+        removeConsumer(m_addressdb);
         delete m_addressdb;
         m_addressdb = nullptr;
     }
@@ -235,6 +208,7 @@ void Indexer::loadConfig(const QString &filename, const EndPoint &prioHubLocatio
     } else if (!enableTxDB && m_txdb) {
         m_txdb->requestInterruption();
         m_txdb->wait();
+        removeConsumer(m_txdb);
         delete m_txdb;
         m_txdb = nullptr;
     }
@@ -244,6 +218,7 @@ void Indexer::loadConfig(const QString &filename, const EndPoint &prioHubLocatio
     } else if (!enableSpentDb && m_spentOutputDb) {
         m_spentOutputDb->requestInterruption();
         m_spentOutputDb->wait();
+        removeConsumer(m_spentOutputDb);
         delete m_spentOutputDb;
         m_spentOutputDb = nullptr;
     }
@@ -339,18 +314,14 @@ void Indexer::onIncomingMessage(NetworkService::Remote *con, const Message &mess
         con->connection.send(builder.reply(message));
     }
     else if (message.messageId() == Api::Indexer::GetIndexerLastBlock) {
-        int lastReceivedBlock = -1;
-        Streaming::MessageParser parser(m_nextBlock.body());
-        while (parser.next() == Streaming::FoundTag) {
-            if (parser.tag() == Api::BlockChain::BlockHeight) {
-                lastReceivedBlock = parser.intData();
-                break;
-            }
-        }
+        QMutexLocker lock(&m_nextBlockLock);
+        const int wantedHeight = lowestWantedHeight();
+        lock.unlock();
 
         con->pool.reserve(10);
         Streaming::MessageBuilder builder(con->pool);
-        builder.add(Api::Indexer::BlockHeight, lastReceivedBlock);
+        // the last block all indexers are done with.
+        builder.add(Api::Indexer::BlockHeight, wantedHeight == -1 ? -1 : wantedHeight - 1);
         con->connection.send(builder.reply(message));
     }
 }
@@ -360,25 +331,16 @@ Message Indexer::nextBlock(int height, int *knownTip, unsigned long timeout)
     if (knownTip)
         *knownTip = 0;
     QMutexLocker lock(&m_nextBlockLock);
-    // store an RAII token to synchronize all threads.
-    Token token(height);
+    m_consumers[QThread::currentThread()] = height;
+    dropProcessedBlocks();
     while (!QThread::currentThread()->isInterruptionRequested()) {
-        if (m_nextBlock.serviceId() == Api::BlockChainService && m_nextBlock.messageId() == Api::BlockChain::GetBlockReply) {
-            Streaming::MessageParser parser(m_nextBlock.body());
-            parser.next();
-            if (parser.tag() == Api::BlockChain::BlockHeight && parser.intData() == height) {
-                if (knownTip)
-                    *knownTip = m_bestBlockHeight.load();
-                return m_nextBlock;
-            }
+        auto iter = m_blocks.find(height);
+        if (iter != m_blocks.end()) {
+            if (knownTip)
+                *knownTip = m_bestBlockHeight.load();
+            return iter->second;
         }
-
-        int totalWanted = 0;
-        if (m_txdb) totalWanted++;
-        if (m_spentOutputDb) totalWanted++;
-        if (m_addressdb) totalWanted++;
-        if (token.allocatedTokens() == totalWanted && height <= m_bestBlockHeight.load())
-            requestBlock();
+        requestBlocks();
 
         // wait until the network-manager thread actually finds the block-message as sent by the Hub
         if (!m_waitForBlock.wait(&m_nextBlockLock, timeout))
@@ -387,31 +349,54 @@ Message Indexer::nextBlock(int height, int *knownTip, unsigned long timeout)
     return Message();
 }
 
-void Indexer::checkBlockArrived()
+int Indexer::lowestWantedHeight() const
 {
-    if (!m_serverConnection.isConnected())
-        return;
-    if (QDateTime::currentMSecsSinceEpoch() - m_timeLastRequest < 20000)
-        return;
+    int answer = -1;
+    for (auto iter = m_consumers.begin(); iter != m_consumers.end(); ++iter) {
+        if (answer == -1 || iter->second < answer)
+            answer = iter->second;
+    }
+    return answer;
+}
 
-    QMutexLocker lock(&m_nextBlockLock);
-    int lastReceivedBlock = -1;
-    Streaming::MessageParser parser(m_nextBlock.body());
-    while (parser.next() == Streaming::FoundTag) {
-        if (parser.tag() == Api::BlockChain::BlockHeight) {
-            lastReceivedBlock = parser.intData();
-            break;
-        }
+void Indexer::dropProcessedBlocks()
+{
+    const int wantedHeight = lowestWantedHeight();
+    while (!m_blocks.empty() && m_blocks.begin()->first < wantedHeight) {
+        m_blocksMemory -= m_blocks.begin()->second.body().size();
+        m_blocks.erase(m_blocks.begin());
     }
+}
 
-    if (m_lastRequestedBlock != lastReceivedBlock) {
-        logDebug() << "repeating block request";
-        // Hub never sent the block to us :(
-        requestBlock(m_lastRequestedBlock);
+void Indexer::removeConsumer(QThread *indexer)
+{
+    QMutexLocker lock(&m_nextBlockLock);
+    m_consumers.erase(indexer);
+    dropProcessedBlocks();
+}
+
+void Indexer::checkBlockArrived()
+{
+    QMutexLocker lock(&m_nextBlockLock);
+    if (!m_serverConnection.isConnected() && m_blockFilesHeight == -1)
+        return;
+    const auto now = QDateTime::currentMSecsSinceEpoch();
+    auto iter = m_requestedBlocks.begin();
+    while (iter != m_requestedBlocks.end()) {
+        if (now - iter->second > 20000) {
+            // Hub never sent the block to us (or the worker didn't load it) :(
+            logDebug() << "repeating block request" << iter->first;
+            iter = m_requestedBlocks.erase(iter);
+        } else {
+            ++iter;
+        }
     }
+    requestBlocks();
+    lock.unlock();
 
     // also poll the block count, so we can progress if for some reason the notification was not send.
-    m_serverConnection.send(Message(Api::BlockChainService, Api::BlockChain::GetBlockCount));
+    if (m_serverConnection.isConnected())
+        m_serverConnection.send(Message(Api::BlockChainService, Api::BlockChain::GetBlockCount));
 }
 
 void Indexer::onFindAddressRequest(const Message &message)
@@ -476,52 +461,168 @@ void Indexer::hubConnected(const EndPoint &ep)
     logCritical() << "Connection to hub established." << ep << "TxDB:" << txHeight
                   << "addressDB:" << adHeight
                   << "spentOutputDB" << spentHeight;
+    {
+        // requests sent over an earlier connection will not be answered.
+        QMutexLocker lock(&m_nextBlockLock);
+        m_requestedBlocks.clear();
+        m_blockFilesCheckHeight = -1;
+    }
     m_serverConnection.send(Message(Api::APIService, Api::Meta::Version));
     m_serverConnection.send(Message(Api::BlockChainService, Api::BlockChain::GetBlockCount));
     m_serverConnection.send(Message(Api::BlockNotificationService, Api::BlockNotification::Subscribe));
 }
 
-void Indexer::requestBlock(int newBlockHeight)
+void Indexer::requestBlocks()
 {
-    if (!m_serverConnection.isConnected()) {
+    const int first = lowestWantedHeight();
+    if (first == -1) // no indexer asked for anything yet.
+        return;
+    const bool hubConnected = m_serverConnection.isConnected();
+    // until the Hub confirmed the block-files hold its chain, we don't use them.
+    const int blockFilesHeight = m_blockFilesChecked ? m_blockFilesHeight : -1;
+    if (!hubConnected && first > blockFilesHeight) {
         logCritical() << "Waiting for hub" << m_serverConnection.endPoint();
         return;
     }
+    const int last = std::min(first + m_prefetchWindow - 1, std::max(m_bestBlockHeight.load(), blockFilesHeight));
+    const auto now = QDateTime::currentMSecsSinceEpoch();
+    for (int blockHeight = first; blockHeight <= last; ++blockHeight) {
+        if (m_blocks.find(blockHeight) != m_blocks.end()
+                || m_requestedBlocks.find(blockHeight) != m_requestedBlocks.end())
+            continue;
+        // flow control; the memory we use and expect to use for the blocks on their way.
+        // The first block is always requested, or we would stop entirely.
+        if (blockHeight > first && m_blocksMemory
+                + static_cast<qint64>(m_requestedBlocks.size()) * m_averageBlockSize > m_prefetchMemory)
+            break;
 
-    int blockHeight = 9999999;
-    for (size_t i = 0; i < s_requestedHeights.size(); ++i) {
-        int h = s_requestedHeights.at(i).load();
-        if (h != -1)
-            blockHeight = std::min(h, blockHeight);
+        if (blockHeight <= blockFilesHeight) {
+            // skip the Hub, read the block ourselves.
+            int content = 0;
+            if (m_txdb)
+                content |= BlockFileReader::TxIds;
+            if (m_addressdb)
+                content |= BlockFileReader::OutputScriptHashes;
+            if (m_spentOutputDb)
+                content |= BlockFileReader::Inputs;
+            m_workers.ioService().post(std::bind(&Indexer::loadBlockFromFile, this, blockHeight, content));
+            m_requestedBlocks.insert(std::make_pair(blockHeight, now));
+            continue;
+        }
+        if (!hubConnected)
+            break;
+
+        m_pool.reserve(20);
+        Streaming::MessageBuilder builder(m_pool);
+        builder.add(Api::BlockChain::BlockHeight, blockHeight);
+        if (m_txdb)
+            builder.add(Api::BlockChain::Include_TxId, true);
+        if (m_addressdb)
+            builder.add(Api::BlockChain::Include_OutputScriptHash, true);
+        if (m_spentOutputDb)
+            builder.add(Api::BlockChain::Include_Inputs, true);
+        builder.add(Api::BlockChain::Include_OffsetInBlock, true);
+        logDebug() << "requesting block" << blockHeight;
+        // the requestId allows us to know which block failed, should the Hub not have it.
+        m_serverConnection.send(builder.message(Api::BlockChainService, Api::BlockChain::GetBlock, blockHeight));
+        m_requestedBlocks.insert(std::make_pair(blockHeight, now));
     }
-    if (blockHeight == 9999999) {
-        if (newBlockHeight == m_lastRequestedBlock && m_lastRequestedBlock > 0)
-            // we restart or timeout and someone requests the m_lastRequested one again.
-            blockHeight = newBlockHeight;
-        else // no valid block to get.
-            return;
+}
+
+void Indexer::addBlock(int blockHeight, const Message &message)
+{
+    if (m_requestedBlocks.erase(blockHeight) && blockHeight >= lowestWantedHeight()) {
+        if ((blockHeight % 500) == 0 || m_timeLastLogLine + 2000 < QDateTime::currentMSecsSinceEpoch()) {
+            m_timeLastLogLine = QDateTime::currentMSecsSinceEpoch();
+            logCritical() << "Processing block" << blockHeight;
+        }
+        const int size = message.body().size();
+        m_blocks.insert(std::make_pair(blockHeight, message));
+        m_blocksMemory += size;
+        m_averageBlockSize = (m_averageBlockSize * 7 + size) / 8;
+        m_waitForBlock.wakeAll();
     }
+}
 
-    const auto now = QDateTime::currentMSecsSinceEpoch();
-    if (m_lastRequestedBlock == blockHeight && now - m_timeLastRequest < 1200)
+void Indexer::loadBlockFromFile(int blockHeight, int content)
+{
+    QMutexLocker lock(&m_nextBlockLock);
+    std::shared_ptr<BlockFileReader> blockFiles(m_blockFiles);
+    if (blockHeight > m_blockFilesHeight) { // an earlier block failed to load, ask the Hub instead
+        m_requestedBlocks.erase(blockHeight);
+        requestBlocks();
         return;
-    if (blockHeight > m_bestBlockHeight.load())
+    }
+    lock.unlock();
+
+    // this is the slow part, don't block the other threads while we do it.
+    Message message = blockFiles->createBlockMessage(blockHeight, content);
+
+    lock.relock();
+    if (message.body().size() == 0) {
+        logWarning() << "Failed to read block from the block files, continuing with the Hub." << blockHeight;
+        m_blockFilesHeight = std::min(m_blockFilesHeight, blockHeight - 1);
+        m_requestedBlocks.erase(blockHeight);
+    } else {
+        logDebug() << "Read block from file" << blockHeight;
+        addBlock(blockHeight, message);
+        if (blockHeight == m_blockFilesHeight)
+            logCritical() << "Reached the end of the block files, continuing with the Hub.";
+    }
+    requestBlocks();
+}
+
+void Indexer::openBlockFiles(const QString &blocksDir)
+{
+    logCritical() << "Reading blocks from" << blocksDir;
+    std::shared_ptr<BlockFileReader> reader(new BlockFileReader(blocksDir.toStdString()));
+    if (!reader->scan()) {
+        logCritical() << "  no usable blocks found, getting all blocks from the Hub.";
         return;
+    }
+    QMutexLocker lock(&m_nextBlockLock);
+    m_blockFiles = reader;
+    m_blockFilesHeight = reader->chainHeight();
+}
 
-    m_lastRequestedBlock = blockHeight;
-    m_timeLastRequest = now;
-    m_pool.reserve(20);
+void Indexer::checkBlockFiles(int height)
+{
+    m_blockFilesCheckHeight = height;
+    m_pool.reserve(10);
     Streaming::MessageBuilder builder(m_pool);
-    builder.add(Api::BlockChain::BlockHeight, blockHeight);
-    if (m_txdb)
-        builder.add(Api::BlockChain::Include_TxId, true);
-    if (m_addressdb)
-        builder.add(Api::BlockChain::Include_OutputScriptHash, true);
-    if (m_spentOutputDb)
-        builder.add(Api::BlockChain::Include_Inputs, true);
-    builder.add(Api::BlockChain::Include_OffsetInBlock, true);
-    logDebug() << "requesting block" << blockHeight;
-    m_serverConnection.send(builder.message(Api::BlockChainService, Api::BlockChain::GetBlock));
+    builder.add(Api::BlockChain::BlockHeight, height);
+    m_serverConnection.send(builder.message(Api::BlockChainService, Api::BlockChain::GetBlockHeader));
+}
+
+void Indexer::blockFilesHeaderArrived(int height, const uint256 &hash)
+{
+    if (m_blockFilesChecked || m_blockFilesCheckHeight == -1)
+        return;
+    if (height == -1) // the Hub doesn't have a block at that height, same as not matching.
+        height = m_blockFilesCheckHeight;
+    if (height != m_blockFilesCheckHeight)
+        return;
+    m_blockFilesCheckHeight = -1;
+    if (m_blockFiles->blockHash(height) == hash) {
+        // the blocks below are linked by their hashes, so they are on the Hub's chain too.
+        logCritical() << "Block files match the Hub's chain up to height" << height;
+        m_blockFilesHeight = height;
+        m_blockFilesChecked = true;
+        requestBlocks();
+        return;
+    }
+    // the block-files went a different way than the Hub, find the point where they agree.
+    const int next = height - m_blockFilesCheckDistance;
+    m_blockFilesCheckDistance *= 2;
+    logWarning() << "Block files are not on the Hub's chain at height" << height;
+    if (next < 0) {
+        logCritical() << "  not using the block files, getting all blocks from the Hub.";
+        m_blockFilesHeight = -1;
+        m_blockFilesChecked = true;
+        requestBlocks();
+        return;
+    }
+    checkBlockFiles(next);
 }
 
 void Indexer::hubDisconnected()
@@ -539,34 +640,37 @@ void Indexer::hubSentMessage(const Message &message)
                 if (parser.tag() == Api::BlockChain::BlockHeight) {
                     blockHeight = parser.intData();
                     logDebug() << "Hub sent us block" << blockHeight;
-                    if ((blockHeight % 500) == 0 || m_timeLastLogLine + 2000 < QDateTime::currentMSecsSinceEpoch()) {
-                        m_timeLastLogLine = QDateTime::currentMSecsSinceEpoch();
-                        logCritical() << "Processing block" << blockHeight;
-                    }
                     break;
                 }
             }
             QMutexLocker lock(&m_nextBlockLock);
-            if (m_lastRequestedBlock == blockHeight) {
-                m_nextBlock = message;
-                // Clear tokens.
-                // While the threads do this themselves too, its better to do it
-                // here in order to make sure **our** internel state is proper and
-                // we can avoid multiple calls to requestBlock().
-                for (size_t i = 0; i < s_requestedHeights.size(); ++i) {
-                    int expected = blockHeight;
-                    s_requestedHeights[i].compare_exchange_strong(expected, -1);
-                }
-                m_waitForBlock.wakeAll();
+            addBlock(blockHeight, message);
+            requestBlocks();
+        }
+        else if (message.messageId() == Api::BlockChain::GetBlockHeaderReply) {
+            int blockHeight = -1;
+            uint256 blockHash;
+            Streaming::MessageParser parser(message.body());
+            while (parser.next() == Streaming::FoundTag) {
+                if (parser.tag() == Api::BlockChain::BlockHeight)
+                    blockHeight = parser.intData();
+                else if (parser.tag() == Api::BlockChain::BlockHash)
+                    blockHash = parser.uint256Data();
             }
+            QMutexLocker lock(&m_nextBlockLock);
+            blockFilesHeaderArrived(blockHeight, blockHash);
         }
         else if (message.messageId() == Api::BlockChain::GetBlockCountReply) {
             Streaming::MessageParser parser(message.body());
             while (parser.next() == Streaming::FoundTag) {
                 if (parser.tag() == Api::BlockChain::BlockHeight) {
-                    const int tipHeight = parser.intData();
-                    m_bestBlockHeight.store(tipHeight);
-                    requestBlock(tipHeight);
+                    m_bestBlockHeight.store(parser.intData());
+                    QMutexLocker lock(&m_nextBlockLock);
+                    // the block files may hold blocks the Hub did not validate yet.
+                    m_blockFilesHeight = std::min(m_blockFilesHeight, m_bestBlockHeight.load());
+                    if (m_blockFiles && !m_blockFilesChecked && m_blockFilesCheckHeight == -1 && m_blockFilesHeight >= 0)
+                        checkBlockFiles(m_blockFilesHeight);
+                    requestBlocks();
                 }
             }
         }
@@ -598,10 +702,20 @@ void Indexer::hubSentMessage(const Message &message)
                     failedReason = parser.stringData();
             }
             if (serviceId == Api::BlockChainService && messageId == Api::BlockChain::GetBlock) {
-                if (m_lastRequestedBlock > m_bestBlockHeight.load())
+                const int blockHeight = message.headerInt(Api::RequestId);
+                QMutexLocker lock(&m_nextBlockLock);
+                m_requestedBlocks.erase(blockHeight); // will be retried by checkBlockArrived()
+                lock.unlock();
+                if (blockHeight > m_bestBlockHeight.load())
                     logInfo().nospace() << "Reached top of chain (" << m_bestBlockHeight.load() << ")";
                 else
-                    logWarning() << "Failed to get block, hub didn't have it." << m_lastRequestedBlock;
+                    logWarning() << "Failed to get block, hub didn't have it." << blockHeight;
+            } else if (serviceId == Api::BlockChainService && messageId == Api::BlockChain::GetBlockHeader) {
+                logWarning() << "Hub failed to send header, not using the block files." << failedReason;
+                QMutexLocker lock(&m_nextBlockLock);
+                m_blockFilesHeight = -1;
+                m_blockFilesChecked = true;
+                requestBlocks();
             } else {
                 logWarning() << "Hub reported failure" << serviceId << messageId << failedReason;
             }
@@ -612,7 +726,8 @@ void Indexer::hubSentMessage(const Message &message)
         while (parser.next() == Streaming::FoundTag) {
             if (parser.tag() == Api::BlockNotification::BlockHeight) {
                 m_bestBlockHeight.store(parser.intData());
-                requestBlock(parser.intData());
+                QMutexLocker lock(&m_nextBlockLock);
+                requestBlocks();
             }
         }
     }
@@ -26,9 +26,14 @@
 #include <QMutex>
 #include <QWaitCondition>
 #include <WorkerThreads.h>
+#include <uint256.h>
 #include <qtimer.h>
 
+#include <map>
+#include <memory>
+
 class AddressIndexer;
+class BlockFileReader;
 class TxIndexer;
 class SpentOutputIndexer;
 
@@ -51,12 +56,14 @@ public:
     // network service API
     void onIncomingMessage(Remote *con, const Message &message, const EndPoint &ep) override;
 
-    /// called by the workerthreads to get a block-message. Blocking.
-    /// \param height is the requested blockheight of the next block to process
+    /**
+     * Called by the workerthreads to get a block-message. Blocking.
+     * Asking for a height also tells us that the calling thread is done with all blocks below it.
+     * \param height is the requested blockheight of the next block to process
+     */
     Message nextBlock(int height, int *knownTip, unsigned long timeout = ULONG_MAX);
 
 private slots:
-    void requestBlock(int newBlockHeight = -1);
     void checkBlockArrived();
 
     void onFindAddressRequest(const Message &message);
@@ -71,6 +78,25 @@ private:
 
     void clientConnected(NetworkConnection &con);
 
+    /// Request the blocks in the prefetch window we don't have yet. Requires m_nextBlockLock.
+    void requestBlocks();
+    /// Returns the lowest blockheight any of the indexer threads still needs, or -1. Requires m_nextBlockLock.
+    int lowestWantedHeight() const;
+    /// Forget about the blocks all indexer threads are done with. Requires m_nextBlockLock.
+    void dropProcessedBlocks();
+    /// Stop waiting for \a indexer, as it got removed.
+    void removeConsumer(QThread *indexer);
+    /// Store a block for the indexer threads to process. Requires m_nextBlockLock.
+    void addBlock(int blockHeight, const Message &message);
+    /// Called from a worker thread to read the block from the Hub's block-files.
+    void loadBlockFromFile(int blockHeight, int content);
+    /// Use the Hub's block-files in \a blocksDir during the initial sync.
+    void openBlockFiles(const QString &blocksDir);
+    /// Ask the Hub for the header at \a height to compare with our block-files. Requires m_nextBlockLock.
+    void checkBlockFiles(int height);
+    /// Handle the Hub's answer to checkBlockFiles(). Requires m_nextBlockLock.
+    void blockFilesHeaderArrived(int height, const uint256 &hash);
+
 private:
     QTimer m_pollingTimer;
     Streaming::BufferPool m_pool;
@@ -87,16 +113,25 @@ private:
 
     bool m_isServer = false; /// remembers if we (successfully) called m_network::bind() once.
 
-    int m_lastRequestedBlock = 0;
-    qint64 m_timeLastRequest = 0;
     qint64 m_timeLastLogLine = 0;
 
-
-
     // data to process blocks in different workers.
-    Message m_nextBlock;
+    // We keep a window of blocks requested from the Hub so the network round-trips overlap with the indexing.
+    std::map<int, Message> m_blocks; // blocks received, by height.
+    std::map<int, qint64> m_requestedBlocks; // height to the time we requested the block
+    std::map<QThread*, int> m_consumers; // the height each indexer thread waits for
+    qint64 m_blocksMemory = 0; // bytes used by m_blocks
+    int m_averageBlockSize = 100000;
+    int m_prefetchWindow = 20; // max amount of blocks requested or waiting to be processed
+    qint64 m_prefetchMemory = 500 * 1024 * 1024; // stop requesting blocks when we use this much
+    std::shared_ptr<BlockFileReader> m_blockFiles;
+    int m_blockFilesHeight = -1; // blocks up to this height are read from the Hub's block-files
+    // The block-files are only used after the Hub confirmed the block at m_blockFilesHeight is on its chain.
+    bool m_blockFilesChecked = false;
+    int m_blockFilesCheckHeight = -1; // the height we asked the Hub the header of
+    int m_blockFilesCheckDistance = 1; // how far we walk back on the next mismatch
     mutable std::atomic_int m_bestBlockHeight;
-    mutable QMutex m_nextBlockLock;
+    mutable QMutex m_nextBlockLock; // protects all of the above
     mutable QWaitCondition m_waitForBlock;
 };
 
@@ -0,0 +1,450 @@
+/*
+ * This file is part of the Flowee project
+ * Copyright (C) 2020 Tom Zander <tomz@freedommail.ch>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "PostingStorage.h"
+#include "PostingStorage_p.h"
+
+#include <Logger.h>
+#include <tinyformat.h>
+
+#include <algorithm>
+#include <cstdlib>
+
+namespace {
+constexpr uint32_t SegmentMagic = 0x31535046; // 'FPS1'
+
+// merge two segments when the older one is less than this many times bigger than the newer one.
+constexpr uint64_t MergeFactor = 2;
+
+inline uint64_t toKey(const HashIndexPoint &point)
+{
+    assert(point.db >= 0);
+    assert(point.row >= 0);
+    return (static_cast<uint64_t>(point.db) << 32) + static_cast<uint32_t>(point.row);
+}
+
+void sortAndUnique(std::vector<Posting> &postings)
+{
+    std::sort(postings.begin(), postings.end());
+    postings.erase(std::unique(postings.begin(), postings.end()), postings.end());
+}
+
+inline void writeVarInt(std::vector<char> &out, uint32_t value)
+{
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+// returns false if the data ran out
+inline bool readVarInt(const char *&data, const char *end, uint32_t &value)
+{
+    value = 0;
+    for (int shift = 0; shift < 35; shift += 7) {
+        if (data >= end)
+            return false;
+        const uint8_t byte = static_cast<uint8_t>(*data++);
+        value |= static_cast<uint32_t>(byte & 0x7F) << shift;
+        if ((byte & 0x80) == 0)
+            return true;
+    }
+    return false;
+}
+}
+
+// -----------------------------------------------------------------
+
+PostingSegment::PostingSegment(const boost::filesystem::path &base, int number)
+    : number(number),
+    m_base(base)
+{
+    try {
+        m_keys.open(keysFilename(base, number).string());
+    } catch (const std::exception &e) {
+        logCritical() << "PostingSegment: failed to open keys file" << number << e;
+        return;
+    }
+    if (m_keys.size() < sizeof(KeysHeader))
+        return;
+    m_header = reinterpret_cast<const KeysHeader*>(m_keys.data());
+    if (m_header->magic != SegmentMagic) {
+        m_header = nullptr;
+        return;
+    }
+    m_entries = reinterpret_cast<const KeyEntry*>(m_keys.data() + sizeof(KeysHeader));
+    m_keyCount = static_cast<int>((m_keys.size() - sizeof(KeysHeader)) / sizeof(KeyEntry));
+    if (m_keyCount > 0) {
+        try {
+            m_data.open(dataFilename(base, number).string());
+        } catch (const std::exception &e) {
+            logCritical() << "PostingSegment: failed to open data file" << number << e;
+            m_header = nullptr;
+        }
+    }
+}
+
+bool PostingSegment::isValid() const
+{
+    return m_header != nullptr;
+}
+
+int PostingSegment::blockHeight() const
+{
+    assert(m_header);
+    return m_header->blockHeight;
+}
+
+int PostingSegment::keyCount() const
+{
+    return m_keyCount;
+}
+
+uint64_t PostingSegment::size() const
+{
+    return m_keys.size() + (m_data.is_open() ? m_data.size() : 0);
+}
+
+uint64_t PostingSegment::keyAt(int index) const
+{
+    assert(index >= 0 && index < m_keyCount);
+    return m_entries[index].key;
+}
+
+void PostingSegment::postingsAt(int index, std::vector<Posting> &output) const
+{
+    assert(index >= 0 && index < m_keyCount);
+    const uint64_t offset = m_entries[index].dataOffset;
+    if (offset >= m_data.size())
+        return;
+    const char *data = m_data.data() + offset;
+    const char *end = m_data.data() + m_data.size();
+    uint32_t count;
+    if (!readVarInt(data, end, count))
+        return;
+    output.reserve(output.size() + count);
+    Posting posting;
+    posting.blockHeight = 0;
+    for (uint32_t i = 0; i < count; ++i) {
+        uint32_t heightDelta, offsetInBlock, outIndex;
+        if (!readVarInt(data, end, heightDelta) || !readVarInt(data, end, offsetInBlock)
+                || !readVarInt(data, end, outIndex)) {
+            logCritical() << "PostingSegment: data file is truncated" << number;
+            return;
+        }
+        posting.blockHeight += static_cast<int>(heightDelta);
+        if (heightDelta == 0) // same block, offset is relative to the previous one
+            posting.offsetInBlock += static_cast<int>(offsetInBlock);
+        else
+            posting.offsetInBlock = static_cast<int>(offsetInBlock);
+        posting.outIndex = static_cast<short>(outIndex);
+        output.push_back(posting);
+    }
+}
+
+int PostingSegment::find(uint64_t key) const
+{
+    int pos = 0;
+    int endpos = m_keyCount - 1;
+    while (pos <= endpos) {
+        const int m = (pos + endpos) / 2;
+        const uint64_t item = m_entries[m].key;
+        if (item < key)
+            pos = m + 1;
+        else if (item > key)
+            endpos = m - 1;
+        else
+            return m;
+    }
+    return -1;
+}
+
+void PostingSegment::remove()
+{
+    // remove the keys first, without it the data file is ignored.
+    boost::system::error_code error;
+    boost::filesystem::remove(keysFilename(m_base, number), error);
+    boost::filesystem::remove(dataFilename(m_base, number), error);
+}
+
+boost::filesystem::path PostingSegment::keysFilename(const boost::filesystem::path &base, int number)
+{
+    return base / strprintf("segment-%05d.keys", number);
+}
+
+boost::filesystem::path PostingSegment::dataFilename(const boost::filesystem::path &base, int number)
+{
+    return base / strprintf("segment-%05d.data", number);
+}
+
+
+// -----------------------------------------------------------------
+
+SegmentWriter::SegmentWriter(const boost::filesystem::path &base, int number, int blockHeight)
+    : m_base(base),
+    m_number(number)
+{
+    m_keys = fopen((PostingSegment::keysFilename(base, number).string() + ".tmp").c_str(), "wb");
+    m_data = fopen((PostingSegment::dataFilename(base, number).string() + ".tmp").c_str(), "wb");
+    if (m_keys == nullptr || m_data == nullptr)
+        throw std::runtime_error("PostingStorage: failed to open segment for writing");
+    PostingSegment::KeysHeader header;
+    header.magic = SegmentMagic;
+    header.blockHeight = blockHeight;
+    header.reserved = 0;
+    if (fwrite(&header, sizeof(header), 1, m_keys) != 1)
+        throw std::runtime_error("PostingStorage: failed to write");
+}
+
+SegmentWriter::~SegmentWriter()
+{
+    if (m_keys)
+        fclose(m_keys);
+    if (m_data)
+        fclose(m_data);
+}
+
+void SegmentWriter::add(uint64_t key, const std::vector<Posting> &postings)
+{
+    assert(!postings.empty());
+    m_buffer.clear();
+    writeVarInt(m_buffer, static_cast<uint32_t>(postings.size()));
+    Posting prev;
+    prev.blockHeight = 0;
+    for (const Posting &posting : postings) {
+        assert(posting.blockHeight >= prev.blockHeight);
+        assert(posting.outIndex >= 0);
+        const uint32_t heightDelta = static_cast<uint32_t>(posting.blockHeight - prev.blockHeight);
+        writeVarInt(m_buffer, heightDelta);
+        if (heightDelta == 0)
+            writeVarInt(m_buffer, static_cast<uint32_t>(posting.offsetInBlock - prev.offsetInBlock));
+        else
+            writeVarInt(m_buffer, static_cast<uint32_t>(posting.offsetInBlock));
+        writeVarInt(m_buffer, static_cast<uint32_t>(posting.outIndex));
+        prev = posting;
+    }
+    PostingSegment::KeyEntry entry;
+    entry.key = key;
+    entry.dataOffset = m_dataOffset;
+    if (fwrite(&entry, sizeof(entry), 1, m_keys) != 1
+            || fwrite(m_buffer.data(), m_buffer.size(), 1, m_data) != 1)
+        throw std::runtime_error("PostingStorage: failed to write");
+    m_dataOffset += m_buffer.size();
+}
+
+void SegmentWriter::commit()
+{
+    const bool ok = fclose(m_keys) == 0 && fclose(m_data) == 0;
+    m_keys = nullptr;
+    m_data = nullptr;
+    if (!ok)
+        throw std::runtime_error("PostingStorage: failed to write");
+    // the keys file makes the segment visible, so it is renamed last.
+    const auto dataFile = PostingSegment::dataFilename(m_base, m_number);
+    boost::filesystem::rename(dataFile.string() + ".tmp", dataFile);
+    const auto keysFile = PostingSegment::keysFilename(m_base, m_number);
+    boost::filesystem::rename(keysFile.string() + ".tmp", keysFile);
+}
+
+
+// -----------------------------------------------------------------
+
+PostingStoragePrivate::PostingStoragePrivate(const boost::filesystem::path &basedir)
+    : basedir(basedir)
+{
+    boost::filesystem::create_directories(basedir);
+    std::vector<int> numbers;
+    std::vector<boost::filesystem::path> leftovers;
+    for (boost::filesystem::directory_iterator iter(basedir); iter != boost::filesystem::directory_iterator(); ++iter) {
+        const auto path = iter->path();
+        if (path.extension() == ".keys" && path.stem().string().compare(0, 8, "segment-") == 0)
+            numbers.push_back(atoi(path.stem().string().c_str() + 8));
+        else if (path.extension() == ".tmp" || path.extension() == ".data")
+            leftovers.push_back(path);
+    }
+    std::sort(numbers.begin(), numbers.end());
+    // remove the files of segments that were not completely written or removed.
+    for (auto &path : leftovers) {
+        if (path.extension() == ".data") {
+            const int number = atoi(path.stem().string().c_str() + 8);
+            if (std::binary_search(numbers.begin(), numbers.end(), number))
+                continue;
+        }
+        boost::system::error_code error;
+        boost::filesystem::remove(path, error);
+    }
+    for (int number : numbers) {
+        auto segment = std::make_shared<PostingSegment>(basedir, number);
+        if (segment->isValid())
+            segments.push_back(segment);
+        else
+            logCritical() << "PostingStorage: skipping unreadable segment" << number;
+        nextSegment = number + 1;
+    }
+}
+
+void PostingStoragePrivate::merge(int count)
+{
+    std::vector<std::shared_ptr<PostingSegment> > inputs;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        assert(count <= static_cast<int>(segments.size()));
+        inputs.assign(segments.end() - count, segments.end());
+    }
+    int height = -1;
+    for (auto &segment : inputs) {
+        height = std::max(height, segment->blockHeight());
+    }
+
+    const int number = nextSegment++;
+    SegmentWriter writer(basedir, number, height);
+    std::vector<int> pos(inputs.size(), 0);
+    std::vector<Posting> postings;
+    while (true) {
+        // find the lowest key of all inputs
+        bool found = false;
+        uint64_t key = 0;
+        for (size_t i = 0; i < inputs.size(); ++i) {
+            if (pos[i] < inputs[i]->keyCount() && (!found || inputs[i]->keyAt(pos[i]) < key)) {
+                key = inputs[i]->keyAt(pos[i]);
+                found = true;
+            }
+        }
+        if (!found)
+            break;
+        postings.clear();
+        for (size_t i = 0; i < inputs.size(); ++i) {
+            if (pos[i] < inputs[i]->keyCount() && inputs[i]->keyAt(pos[i]) == key)
+                inputs[i]->postingsAt(pos[i]++, postings);
+        }
+        sortAndUnique(postings);
+        writer.add(key, postings);
+    }
+    writer.commit();
+
+    auto merged = std::make_shared<PostingSegment>(basedir, number);
+    if (!merged->isValid())
+        throw std::runtime_error("PostingStorage: failed to read merged segment");
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        segments.erase(segments.end() - count, segments.end());
+        segments.push_back(merged);
+    }
+    // readers may still use the old segments, they are unmapped when the last user is done.
+    for (auto &segment : inputs) {
+        segment->remove();
+    }
+}
+
+
+// -----------------------------------------------------------------
+
+PostingStorage::PostingStorage(const boost::filesystem::path &basedir)
+    : d(new PostingStoragePrivate(basedir))
+{
+}
+
+PostingStorage::~PostingStorage()
+{
+    delete d;
+}
+
+void PostingStorage::append(std::vector<PostingStorage::Entry> &entries, int blockHeight)
+{
+    std::sort(entries.begin(), entries.end(), [](const Entry &a, const Entry &b) {
+        const uint64_t keyA = toKey(a.address);
+        const uint64_t keyB = toKey(b.address);
+        if (keyA != keyB)
+            return keyA < keyB;
+        return a.posting < b.posting;
+    });
+
+    const int number = d->nextSegment++;
+    SegmentWriter writer(d->basedir, number, blockHeight);
+    std::vector<Posting> postings;
+    auto iter = entries.begin();
+    while (iter != entries.end()) {
+        const uint64_t key = toKey(iter->address);
+        postings.clear();
+        while (iter != entries.end() && toKey(iter->address) == key) {
+            if (postings.empty() || !(postings.back() == iter->posting))
+                postings.push_back(iter->posting);
+            ++iter;
+        }
+        writer.add(key, postings);
+    }
+    writer.commit();
+
+    auto segment = std::make_shared<PostingSegment>(d->basedir, number);
+    if (!segment->isValid())
+        throw std::runtime_error("PostingStorage: failed to read new segment");
+    std::unique_lock<std::mutex> guard(d->lock);
+    d->segments.push_back(segment);
+
+    // merge the newest segments while they are of similar size, which keeps the
+    // amount of segments logarithmic to the total size.
+    while (d->segments.size() > 1) {
+        const uint64_t newest = d->segments.back()->size();
+        const uint64_t previous = d->segments.at(d->segments.size() - 2)->size();
+        if (previous > newest * MergeFactor)
+            break;
+        guard.unlock();
+        d->merge(2);
+        guard.lock();
+    }
+}
+
+std::vector<Posting> PostingStorage::find(const HashIndexPoint &address) const
+{
+    std::vector<std::shared_ptr<PostingSegment> > segments;
+    {
+        std::lock_guard<std::mutex> guard(d->lock);
+        segments = d->segments;
+    }
+    const uint64_t key = toKey(address);
+    std::vector<Posting> answer;
+    for (auto &segment : segments) {
+        const int index = segment->find(key);
+        if (index >= 0)
+            segment->postingsAt(index, answer);
+    }
+    if (segments.size() > 1)
+        sortAndUnique(answer);
+    return answer;
+}
+
+int PostingStorage::blockHeight() const
+{
+    std::lock_guard<std::mutex> guard(d->lock);
+    int answer = -1;
+    for (auto &segment : d->segments) {
+        answer = std::max(answer, segment->blockHeight());
+    }
+    return answer;
+}
+
+void PostingStorage::compact()
+{
+    int count;
+    {
+        std::lock_guard<std::mutex> guard(d->lock);
+        count = static_cast<int>(d->segments.size());
+    }
+    if (count > 1)
+        d->merge(count);
+}
@@ -0,0 +1,92 @@
+/*
+ * This file is part of the Flowee project
+ * Copyright (C) 2020 Tom Zander <tomz@freedommail.ch>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef POSTINGSTORAGE_H
+#define POSTINGSTORAGE_H
+
+#include "HashStorage.h"
+
+#include <boost/filesystem.hpp>
+#include <vector>
+
+/// The usage of an address in one transaction-output.
+struct Posting
+{
+    int blockHeight = -1;
+    int offsetInBlock = 0;
+    short outIndex = -1;
+};
+
+inline bool operator==(const Posting &a, const Posting &b)
+{
+    return a.blockHeight == b.blockHeight && a.offsetInBlock == b.offsetInBlock && a.outIndex == b.outIndex;
+}
+
+/// Sorts postings by block-height, then by position in the block.
+inline bool operator<(const Posting &a, const Posting &b)
+{
+    if (a.blockHeight != b.blockHeight)
+        return a.blockHeight < b.blockHeight;
+    if (a.offsetInBlock != b.offsetInBlock)
+        return a.offsetInBlock < b.offsetInBlock;
+    return a.outIndex < b.outIndex;
+}
+
+class PostingStoragePrivate;
+
+/**
+ * Stores for each address (as found in the HashStorage) the list of outputs that use it.
+ *
+ * Data is written in append-only segments, each sorted by address and memory-mapped
+ * for reading. Postings are delta and varint compressed.
+ * Each append() merges the newest segments while they are of similar size, keeping
+ * the amount of segments low, so a lookup is at most a couple of binary searches.
+ * This merging is done synchronously, an append may take as long as rewriting
+ * the bigger of the merged segments.
+ */
+class PostingStorage
+{
+public:
+    PostingStorage(const boost::filesystem::path &basedir);
+    ~PostingStorage();
+
+    struct Entry {
+        HashIndexPoint address;
+        Posting posting;
+    };
+
+    /**
+     * Store the \a entries as a new segment, remembering we processed all blocks up to \a blockHeight.
+     * The entries list will be sorted by this method.
+     * Before returning this merges the newest segments if they are of similar size.
+     */
+    void append(std::vector<Entry> &entries, int blockHeight);
+
+    /// Return all postings for \a address, sorted by block-height.
+    std::vector<Posting> find(const HashIndexPoint &address) const;
+
+    /// Returns the block-height as passed to the last append(), or -1
+    int blockHeight() const;
+
+    /// Merge all segments into one, making lookups the fastest they can be.
+    void compact();
+
+private:
+    PostingStoragePrivate *d;
+};
+
+#endif
@@ -0,0 +1,129 @@
+/*
+ * This file is part of the Flowee project
+ * Copyright (C) 2020 Tom Zander <tomz@freedommail.ch>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef POSTINGSTORAGE_P_H
+#define POSTINGSTORAGE_P_H
+
+/*
+ * WARNING USAGE OF THIS HEADER IS RESTRICTED.
+ * This Header file is part of the private API and is meant to be used solely by the PostingStorage component.
+ *
+ * Usage of this API will likely mean your code will break in interesting ways in the future,
+ * or even stop to compile.
+ *
+ * YOU HAVE BEEN WARNED!!
+ */
+
+#include "PostingStorage.h"
+
+#include <boost/iostreams/device/mapped_file.hpp>
+
+#include <memory>
+#include <mutex>
+
+/*
+ * A segment is two files.
+ * The 'keys' file starts with a header, followed by the sorted list of addresses
+ * each with the offset of its postings in the 'data' file.
+ * The data file has per address the posting-count followed by the postings, all varint encoded.
+ * Postings are sorted by block-height and offset-in-block and those are stored as deltas of
+ * the previous posting.
+ */
+class PostingSegment
+{
+public:
+    PostingSegment(const boost::filesystem::path &base, int number);
+
+    bool isValid() const;
+    /// the last block-height included in this segment
+    int blockHeight() const;
+    int keyCount() const;
+    /// the size on disk, in bytes
+    uint64_t size() const;
+
+    uint64_t keyAt(int index) const;
+    /// Append all postings of the key at \a index to \a output.
+    void postingsAt(int index, std::vector<Posting> &output) const;
+    /// Returns the index of \a key, or -1 when not found.
+    int find(uint64_t key) const;
+
+    /// Remove the files from disk. The data stays available until this object is deleted.
+    void remove();
+
+    const int number;
+
+    struct KeysHeader {
+        uint32_t magic;
+        int32_t blockHeight;
+        uint64_t reserved;
+    };
+    struct KeyEntry {
+        uint64_t key;
+        uint64_t dataOffset;
+    };
+
+    static boost::filesystem::path keysFilename(const boost::filesystem::path &base, int number);
+    static boost::filesystem::path dataFilename(const boost::filesystem::path &base, int number);
+
+private:
+    boost::filesystem::path m_base;
+    boost::iostreams::mapped_file_source m_keys;
+    boost::iostreams::mapped_file_source m_data;
+    const KeysHeader *m_header = nullptr;
+    const KeyEntry *m_entries = nullptr;
+    int m_keyCount = 0;
+};
+
+/// Writes a new segment, call commit() to make it visible.
+class SegmentWriter
+{
+public:
+    SegmentWriter(const boost::filesystem::path &base, int number, int blockHeight);
+    ~SegmentWriter();
+
+    /// Add the \a postings for \a key. Keys have to be added in sorted order.
+    /// Postings are expected to be sorted and unique.
+    void add(uint64_t key, const std::vector<Posting> &postings);
+
+    /// Write the files to their final names.
+    void commit();
+
+private:
+    boost::filesystem::path m_base;
+    const int m_number;
+    FILE *m_keys = nullptr;
+    FILE *m_data = nullptr;
+    uint64_t m_dataOffset = 0;
+    std::vector<char> m_buffer;
+};
+
+class PostingStoragePrivate
+{
+public:
+    PostingStoragePrivate(const boost::filesystem::path &basedir);
+
+    /// Merge the \a count last segments into one.
+    void merge(int count);
+
+    const boost::filesystem::path basedir;
+    int nextSegment = 0;
+
+    mutable std::mutex lock; // protects segments
+    std::vector<std::shared_ptr<PostingSegment> > segments;
+};
+
+#endif
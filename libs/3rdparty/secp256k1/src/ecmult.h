@@ -28,4 +28,7 @@ static int secp256k1_ecmult_context_is_built(const secp256k1_ecmult_context *ctx
 /** Double multiply: R = na*A + ng*G */
 static void secp256k1_ecmult(const secp256k1_ecmult_context *ctx, secp256k1_gej *r, const secp256k1_gej *a, const secp256k1_scalar *na, const secp256k1_scalar *ng);
 
+/** Multi multiply: R = sum(scalars[i] * points[i]) for len points, none of which may be infinity. */
+static void secp256k1_ecmult_multi_var(secp256k1_gej *r, const secp256k1_ge *points, const secp256k1_scalar *scalars, size_t len, const secp256k1_callback *cb);
+
 #endif /* SECP256K1_ECMULT_H */
@@ -403,4 +403,60 @@ static void secp256k1_ecmult(const secp256k1_ecmult_context *ctx, secp256k1_gej
     }
 }
 
+/** Interleaved wNAF multiplication (Strauss). All points share the same doublings,
+ *  which makes this much cheaper than multiplying every point separately.
+ *  The tables of odd multiples of all points are made affine using a single inversion.
+ */
+static void secp256k1_ecmult_multi_var(secp256k1_gej *r, const secp256k1_ge *points, const secp256k1_scalar *scalars, size_t len, const secp256k1_callback *cb) {
+    secp256k1_gej *prej;
+    secp256k1_ge *pre;
+    int *wnaf;
+    int *bits;
+    secp256k1_gej d;
+    secp256k1_ge tmpa;
+    size_t i;
+    int j;
+    int maxbits = 0;
+
+    secp256k1_gej_set_infinity(r);
+    if (len == 0) {
+        return;
+    }
+    prej = (secp256k1_gej*)checked_malloc(cb, sizeof(secp256k1_gej) * len * ECMULT_TABLE_SIZE(WINDOW_A));
+    pre = (secp256k1_ge*)checked_malloc(cb, sizeof(secp256k1_ge) * len * ECMULT_TABLE_SIZE(WINDOW_A));
+    wnaf = (int*)checked_malloc(cb, sizeof(int) * len * 256);
+    bits = (int*)checked_malloc(cb, sizeof(int) * len);
+
+    for (i = 0; i < len; i++) {
+        secp256k1_gej *table = prej + i * ECMULT_TABLE_SIZE(WINDOW_A);
+        VERIFY_CHECK(!points[i].infinity);
+        bits[i] = secp256k1_ecmult_wnaf(wnaf + i * 256, 256, &scalars[i], WINDOW_A);
+        if (bits[i] > maxbits) {
+            maxbits = bits[i];
+        }
+        secp256k1_gej_set_ge(&table[0], &points[i]);
+        secp256k1_gej_double_var(&d, &table[0], NULL);
+        for (j = 1; j < ECMULT_TABLE_SIZE(WINDOW_A); j++) {
+            secp256k1_gej_add_var(&table[j], &table[j - 1], &d, NULL);
+        }
+    }
+    secp256k1_ge_set_all_gej_var(pre, prej, len * ECMULT_TABLE_SIZE(WINDOW_A), cb);
+    free(prej);
+
+    for (j = maxbits - 1; j >= 0; j--) {
+        int n;
+        secp256k1_gej_double_var(r, r, NULL);
+        for (i = 0; i < len; i++) {
+            if (j < bits[i] && (n = wnaf[i * 256 + j])) {
+                ECMULT_TABLE_GET_GE(&tmpa, pre + i * ECMULT_TABLE_SIZE(WINDOW_A), n, WINDOW_A);
+                secp256k1_gej_add_ge_var(r, r, &tmpa, NULL);
+            }
+        }
+    }
+
+    free(pre);
+    free(wnaf);
+    free(bits);
+}
+
 #endif /* SECP256K1_ECMULT_IMPL_H */
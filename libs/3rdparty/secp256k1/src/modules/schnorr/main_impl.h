@@ -27,6 +27,37 @@ int secp256k1_schnorr_verify(
     return secp256k1_schnorr_sig_verify(&ctx->ecmult_ctx, sig64, &q, msg32);
 }
 
+int secp256k1_schnorr_verify_batch(
+    const secp256k1_context* ctx,
+    const unsigned char *const *sig64,
+    const unsigned char *const *msg32,
+    const secp256k1_pubkey *const *pubkeys,
+    size_t n
+) {
+    secp256k1_ge *q;
+    size_t i;
+    int ret;
+    VERIFY_CHECK(ctx != NULL);
+    ARG_CHECK(secp256k1_ecmult_context_is_built(&ctx->ecmult_ctx));
+    ARG_CHECK(n == 0 || sig64 != NULL);
+    ARG_CHECK(n == 0 || msg32 != NULL);
+    ARG_CHECK(n == 0 || pubkeys != NULL);
+
+    if (n == 0) {
+        return 1;
+    }
+    q = (secp256k1_ge*)checked_malloc(&ctx->error_callback, sizeof(secp256k1_ge) * n);
+    ret = 1;
+    for (i = 0; ret && i < n; i++) {
+        ret = secp256k1_pubkey_load(ctx, &q[i], pubkeys[i]);
+    }
+    if (ret) {
+        ret = secp256k1_schnorr_sig_verify_batch(&ctx->ecmult_ctx, &ctx->error_callback, sig64, q, msg32, n);
+    }
+    free(q);
+    return ret;
+}
+
 int secp256k1_schnorr_sign(
     const secp256k1_context *ctx,
     unsigned char *sig64,
@@ -100,6 +100,115 @@ static int secp256k1_schnorr_sig_verify(
     return 1;
 }
 
+/**
+ * Batch verification uses option 2 on all signatures at once.
+ *   Derive a 128 bit random scalar a_i for every signature but the first, where a_0 = 1.
+ *   The randomizers are derived from a hash over all signatures, messages and public keys,
+ *   so they can not be predicted by whoever created the signatures.
+ *   The batch is valid if sum(a_i * R_i) + sum(a_i * e_i * P_i) - sum(a_i * s_i) * G == 0.
+ *   A batch that contains an invalid signature passes with negligible probability.
+ */
+static int secp256k1_schnorr_sig_verify_batch(
+    const secp256k1_ecmult_context* ctx,
+    const secp256k1_callback *cb,
+    const unsigned char *const *sig64,
+    secp256k1_ge *pubkeys,
+    const unsigned char *const *msg32,
+    size_t n
+) {
+    secp256k1_sha256 sha;
+    unsigned char seed[32];
+    unsigned char buf[40];
+    size_t size;
+    secp256k1_ge *points;
+    secp256k1_scalar *scalars;
+    secp256k1_scalar a, e, s, ssum;
+    secp256k1_gej Pj, result, rest;
+    secp256k1_fe Rx;
+    size_t i;
+    int overflow;
+    int ret = 1;
+
+    if (n == 0) {
+        return 1;
+    }
+
+    secp256k1_sha256_initialize(&sha);
+    for (i = 0; i < n; i++) {
+        if (secp256k1_ge_is_infinity(&pubkeys[i])) {
+            return 0;
+        }
+        secp256k1_sha256_write(&sha, sig64[i], 64);
+        secp256k1_sha256_write(&sha, msg32[i], 32);
+        secp256k1_eckey_pubkey_serialize(&pubkeys[i], buf, &size, 1);
+        secp256k1_sha256_write(&sha, buf, 33);
+    }
+    secp256k1_sha256_finalize(&sha, seed);
+
+    /* points[2i] is P_i with scalar a_i * e_i, points[2i+1] is R_i with scalar a_i */
+    points = (secp256k1_ge*)checked_malloc(cb, sizeof(secp256k1_ge) * 2 * n);
+    scalars = (secp256k1_scalar*)checked_malloc(cb, sizeof(secp256k1_scalar) * 2 * n);
+    secp256k1_scalar_set_int(&ssum, 0);
+    secp256k1_scalar_set_int(&a, 1);
+    for (i = 0; i < n; i++) {
+        overflow = 0;
+        secp256k1_scalar_set_b32(&s, sig64[i] + 32, &overflow);
+        if (overflow || !secp256k1_fe_set_b32(&Rx, sig64[i])
+                || !secp256k1_ge_set_xquad(&points[2 * i + 1], &Rx)) {
+            ret = 0;
+            break;
+        }
+        secp256k1_schnorr_compute_e(&e, sig64[i], &pubkeys[i], msg32[i]);
+
+        if (i > 0) {
+            secp256k1_schnorr_batch_randomizer(&a, seed, buf, i);
+        }
+        points[2 * i] = pubkeys[i];
+        secp256k1_scalar_mul(&scalars[2 * i], &a, &e);
+        scalars[2 * i + 1] = a;
+        secp256k1_scalar_mul(&s, &s, &a);
+        secp256k1_scalar_add(&ssum, &ssum, &s);
+    }
+
+    if (ret) {
+        /* The generator is handled together with the first public key. */
+        secp256k1_scalar_negate(&ssum, &ssum);
+        secp256k1_gej_set_ge(&Pj, &points[0]);
+        secp256k1_ecmult(ctx, &result, &Pj, &scalars[0], &ssum);
+        secp256k1_ecmult_multi_var(&rest, points + 1, scalars + 1, 2 * n - 1, cb);
+        secp256k1_gej_add_var(&result, &result, &rest, NULL);
+        ret = secp256k1_gej_is_infinity(&result);
+    }
+
+    free(points);
+    free(scalars);
+    return ret;
+}
+
+static void secp256k1_schnorr_batch_randomizer(
+    secp256k1_scalar *a,
+    const unsigned char *seed,
+    unsigned char *buf,
+    size_t index
+) {
+    secp256k1_sha256 sha;
+    int i;
+
+    for (i = 0; i < 4; i++) {
+        buf[i] = (unsigned char)(index >> (8 * i));
+    }
+    secp256k1_sha256_initialize(&sha);
+    secp256k1_sha256_write(&sha, seed, 32);
+    secp256k1_sha256_write(&sha, buf, 4);
+    secp256k1_sha256_finalize(&sha, buf);
+    /* only use 128 bits, that is plenty and it halves the cost of multiplying R_i */
+    memset(buf, 0, 16);
+    secp256k1_scalar_set_b32(a, buf, NULL);
+    if (secp256k1_scalar_is_zero(a)) {
+        secp256k1_scalar_set_int(a, 1);
+    }
+}
+
 static int secp256k1_schnorr_compute_e(
     secp256k1_scalar* e,
     const unsigned char *r,
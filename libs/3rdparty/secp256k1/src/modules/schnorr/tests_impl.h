@@ -508,6 +508,56 @@ void run_schnorr_compact_test(void) {
     }
 }
 
+#define BATCH_COUNT 24
+
+void test_schnorr_verify_batch(void) {
+    unsigned char privkey[BATCH_COUNT][32];
+    unsigned char message[BATCH_COUNT][32];
+    unsigned char signature[BATCH_COUNT][64];
+    secp256k1_pubkey pubkey[BATCH_COUNT];
+    const unsigned char *sigs[BATCH_COUNT];
+    const unsigned char *msgs[BATCH_COUNT];
+    const secp256k1_pubkey *pubkeys[BATCH_COUNT];
+    int i, n;
+
+    for (i = 0; i < BATCH_COUNT; i++) {
+        secp256k1_scalar key;
+        random_scalar_order_test(&key);
+        secp256k1_scalar_get_b32(privkey[i], &key);
+        secp256k1_rand256_test(message[i]);
+        CHECK(secp256k1_ec_pubkey_create(ctx, &pubkey[i], privkey[i]) == 1);
+        CHECK(secp256k1_schnorr_sign(ctx, signature[i], message[i], privkey[i], NULL, NULL) == 1);
+        sigs[i] = signature[i];
+        msgs[i] = message[i];
+        pubkeys[i] = &pubkey[i];
+    }
+
+    CHECK(secp256k1_schnorr_verify_batch(ctx, NULL, NULL, NULL, 0) == 1);
+    for (n = 1; n <= BATCH_COUNT; n++) {
+        CHECK(secp256k1_schnorr_verify_batch(ctx, sigs, msgs, pubkeys, n) == 1);
+    }
+
+    /* Any broken signature, message or key breaks the batch. */
+    for (i = 0; i < BATCH_COUNT; i += 5) {
+        int pos = secp256k1_rand_bits(6);
+        unsigned char orig = signature[i][pos];
+        signature[i][pos] += 1 + secp256k1_rand_int(255);
+        CHECK(secp256k1_schnorr_verify_batch(ctx, sigs, msgs, pubkeys, BATCH_COUNT) == 0);
+        signature[i][pos] = orig;
+
+        message[i][0] ^= 1;
+        CHECK(secp256k1_schnorr_verify_batch(ctx, sigs, msgs, pubkeys, BATCH_COUNT) == 0);
+        message[i][0] ^= 1;
+
+        pubkeys[i] = &pubkey[(i + 1) % BATCH_COUNT];
+        CHECK(secp256k1_schnorr_verify_batch(ctx, sigs, msgs, pubkeys, BATCH_COUNT) == 0);
+        pubkeys[i] = &pubkey[i];
+    }
+    CHECK(secp256k1_schnorr_verify_batch(ctx, sigs, msgs, pubkeys, BATCH_COUNT) == 1);
+}
+
+#undef BATCH_COUNT
+
 void run_schnorr_tests(void) {
     int i;
     for (i = 0; i < 32 * count; i++) {
@@ -515,6 +565,7 @@ void run_schnorr_tests(void) {
     }
 
     test_schnorr_sign_verify();
+    test_schnorr_verify_batch();
     run_schnorr_compact_test();
 }
 
@@ -18,6 +18,7 @@
 #include "APIRPCBinding.h"
 
 #include <APIProtocol.h>
+#include <Application.h>
 #include <streaming/MessageBuilder.h>
 #include <BlocksDB.h>
 #include <main.h>
@@ -35,6 +36,7 @@
 #include <primitives/FastBlock.h>
 #include <primitives/FastTransaction.h>
 #include <utxo/UnspentOutputDatabase.h>
+#include <validation/Engine.h>
 
 namespace {
 
@@ -535,6 +537,63 @@ public:
     }
 };
 
+class SendLiveTransactions : public Api::ASyncParser
+{
+public:
+    SendLiveTransactions() : ASyncParser(Api::LiveTransactions::SendTransactionsReply) {}
+
+    void start(const Message &request, const std::function<void()> &onFinished) override {
+        std::vector<Tx> transactions;
+        Streaming::MessageParser parser(request.body());
+        while (parser.next() == Streaming::FoundTag) {
+            if (parser.tag() == Api::LiveTransactions::Transaction
+                    || parser.tag() == Api::LiveTransactions::GenericByteData)
+                transactions.push_back(Tx(parser.bytesDataBuffer()));
+        }
+        if (transactions.empty())
+            throw Api::ParserException("Missing transactions");
+
+        for (auto &tx : transactions) {
+            m_txids.push_back(tx.createHash());
+        }
+        // validation of the batch is done in parallel, we get called when all of them finished.
+        Application::instance()->validation()->addTransactions(transactions,
+                    std::bind(&SendLiveTransactions::validationFinished, this, std::placeholders::_1, onFinished),
+                    Validation::ForwardGoodToPeers | Validation::RejectAbsurdFeeTx);
+    }
+
+    int calculateMessageSize(const Message&) override {
+        assert(m_txids.size() == m_results.size());
+        int size = 0;
+        for (auto &result : m_results) {
+            size += 37 + 2; // txid and separator
+            if (!result.empty())
+                size += result.size() + 5;
+        }
+        return size;
+    }
+
+    void buildReply(const Message&, Streaming::MessageBuilder &builder) override {
+        assert(m_txids.size() == m_results.size());
+        for (size_t i = 0; i < m_txids.size(); ++i) {
+            if (i > 0)
+                builder.add(Api::LiveTransactions::Separator, true);
+            builder.add(Api::LiveTransactions::TxId, m_txids.at(i));
+            if (!m_results.at(i).empty())
+                builder.add(Api::LiveTransactions::RejectReason, m_results.at(i));
+        }
+    }
+
+private:
+    void validationFinished(const std::vector<std::string> &results, const std::function<void()> &onFinished) {
+        m_results = results;
+        onFinished();
+    }
+
+    std::vector<uint256> m_txids;
+    std::vector<std::string> m_results;
+};
+
 // Util
 
 class CreateAddress : public Api::DirectParser
@@ -855,6 +914,8 @@ Api::Parser *Api::createParser(const Message &message)
             return new GetLiveTransaction();
         case Api::LiveTransactions::SendTransaction:
             return new SendLiveTransaction();
+        case Api::LiveTransactions::SendTransactions:
+            return new SendLiveTransactions();
         case Api::LiveTransactions::IsUnspent:
             return new UtxoFetcher(Api::LiveTransactions::IsUnspentReply);
         case Api::LiveTransactions::GetUnspentOutput:
@@ -923,3 +984,8 @@ Api::DirectParser::DirectParser(int replyMessageId, int messageSize)
     : Parser(IncludesHandler, replyMessageId, messageSize)
 {
 }
+
+Api::ASyncParser::ASyncParser(int replyMessageId, int messageSize)
+    : DirectParser(replyMessageId, messageSize)
+{
+}
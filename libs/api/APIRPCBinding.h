@@ -142,6 +142,20 @@ namespace Api
         virtual void buildReply(const Message &request, Streaming::MessageBuilder &builder) = 0;
     };
 
+    /**
+     * A DirectParser for calls that can't be answered right away, for instance because they wait for validation.
+     * The api server calls start() and does not wait for it to finish. The parser calls \a onFinished,
+     * from any thread, when it is done after which calculateMessageSize() and buildReply() are called
+     * to send the reply.
+     * Notice that the connection may be gone by then, the parser should not use its SessionData.
+     */
+    class ASyncParser : public DirectParser {
+    public:
+        ASyncParser(int replyMessageId, int messageSize = -1);
+
+        virtual void start(const Message &request, const std::function<void()> &onFinished) = 0;
+    };
+
     /// maps an input message to a Parser implementation.
     Parser* createParser(const Message &message);
 }
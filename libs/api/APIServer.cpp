@@ -28,6 +28,7 @@
 #include "utilstrencodings.h"
 #include "random.h"
 #include "rpcserver.h"
+#include <SettingsDefaults.h>
 
 #include <fstream>
 #include <functional>
@@ -68,11 +69,53 @@ std::deque<std::string> allInterfaces() {
 }
 #endif
 
+namespace {
+Message createFailedMessage(const Message &origin, const std::string &failReason, Streaming::BufferPool &pool)
+{
+    pool.reserve(failReason.size() + 40);
+    Streaming::MessageBuilder builder(pool);
+    builder.add(Api::Meta::FailedReason, failReason);
+    builder.add(Api::Meta::FailedCommandServiceId, origin.serviceId());
+    builder.add(Api::Meta::FailedCommandId, origin.messageId());
+    Message answer = builder.message(Api::APIService, Api::Meta::CommandFailed);
+    const int requestId = origin.headerInt(Api::RequestId);
+    if (requestId != -1)
+        answer.setHeaderInt(Api::RequestId, requestId);
+    return answer;
+}
+
+// called by an ASyncParser when it finished, from any thread.
+void sendASyncReply(const std::shared_ptr<Api::ASyncParser> &parser, const Message &request,
+                    const std::shared_ptr<NetworkConnection> &connection)
+{
+    Streaming::BufferPool pool;
+    Message reply;
+    try {
+        const int reserveSize = parser->calculateMessageSize(request);
+        pool.reserve(reserveSize);
+        Streaming::MessageBuilder builder(pool);
+        parser->buildReply(request, builder);
+        reply = builder.reply(request, parser->replyMessageId());
+        assert(reply.body().size() <= reserveSize); // fail fast.
+    } catch (const std::exception &e) {
+        logWarning(Log::ApiServer) << e;
+        reply = createFailedMessage(request, e.what(), pool);
+    }
+    try {
+        connection->send(reply); // does nothing if the client disconnected in the mean time.
+    } catch (const std::exception &e) {
+        logWarning(Log::ApiServer) << "Failed to send reply" << e;
+    }
+}
+}
+
 Api::Server::Server(boost::asio::io_service &service)
     : m_networkManager(service),
       m_timerRunning(false),
       m_newConnectionTimeout(service)
 {
+    m_networkManager.setCompressionEnabled(GetBoolArg("-apicompression", Settings::DefaultApiCompression));
+
     uint16_t defaultPort = BaseParams().ApiServerPort();
     using boost::asio::ip::tcp;
     std::list<tcp::endpoint> endpoints;
@@ -188,7 +231,7 @@ void Api::Server::incomingMessage(const Message &message)
         assert(con.isValid());
         con.setOnDisconnected(std::bind(&Api::Server::connectionRemoved, this, std::placeholders::_1));
 
-        handler = new Connection(std::move(con));
+        handler = new Connection(std::move(con), &m_networkManager);
         m_connections.push_back(handler);
     }
     handler->incomingMessage(message);
@@ -223,8 +266,9 @@ void Api::Server::checkConnections(boost::system::error_code error)
 }
 
 
-Api::Server::Connection::Connection(NetworkConnection && connection)
+Api::Server::Connection::Connection(NetworkConnection && connection, NetworkManager *manager)
     : m_connection(std::move(connection)),
+      m_manager(manager),
       m_bufferPool(4000000) // default size is 4MB
 {
     m_connection.setOnIncomingMessage(std::bind(&Api::Server::Connection::incomingMessage, this, std::placeholders::_1));
@@ -312,6 +356,24 @@ void Api::Server::Connection::incomingMessage(const Message &message)
         }
         return;
     }
+    auto *asyncParser = dynamic_cast<Api::ASyncParser*>(parser.get());
+    if (asyncParser) {
+        // the reply is sent by the parser when done, this connection object may be gone by then.
+        std::shared_ptr<Api::ASyncParser> shared(asyncParser);
+        parser.release();
+        std::shared_ptr<NetworkConnection> connection(new NetworkConnection(m_manager, message.remote));
+        logInfo(Log::ApiServer) << message.serviceId() << '/' << message.messageId();
+        try {
+            asyncParser->start(message, std::bind(&sendASyncReply, shared, message, connection));
+        } catch (const ParserException &e) {
+            logWarning(Log::ApiServer) << "start() threw:" << e;
+            sendFailedMessage(message, e.what());
+        } catch (const std::exception &e) {
+            logCritical(Log::ApiServer) << "ApiServer internal error in start()" << e;
+            sendFailedMessage(message, "Internal Error " + std::string(e.what()));
+        }
+        return;
+    }
     auto *directParser = dynamic_cast<Api::DirectParser*>(parser.get());
     assert(directParser);
     if (directParser) {
@@ -323,6 +385,10 @@ void Api::Server::Connection::incomingMessage(const Message &message)
             logWarning(Log::ApiServer) << "calculateMessageSize() threw:" << e;
             sendFailedMessage(message, e.what());
             return;
+        } catch (const std::exception &e) {
+            logCritical(Log::ApiServer) << "ApiServer internal error in calculateMessageSize()" << e;
+            sendFailedMessage(message, "Internal Error " + std::string(e.what()));
+            return;
         }
         logInfo(Log::ApiServer) << message.serviceId() << '/' << message.messageId();
         Streaming::MessageBuilder builder(m_bufferPool);
@@ -339,22 +405,17 @@ void Api::Server::Connection::incomingMessage(const Message &message)
             logWarning(Log::ApiServer) << e;
             sendFailedMessage(message, e.what());
             return;
+        } catch (const std::exception &e) {
+            logCritical(Log::ApiServer) << "ApiServer internal error in buildReply()" << e;
+            (void) m_bufferPool.commit(); // make sure the partial message is discarded
+            sendFailedMessage(message, "Internal Error " + std::string(e.what()));
         }
     }
 }
 
 void Api::Server::Connection::sendFailedMessage(const Message &origin, const std::string &failReason)
 {
-    m_bufferPool.reserve(failReason.size() + 40);
-    Streaming::MessageBuilder builder(m_bufferPool);
-    builder.add(Meta::FailedReason, failReason);
-    builder.add(Meta::FailedCommandServiceId, origin.serviceId());
-    builder.add(Meta::FailedCommandId, origin.messageId());
-    Message answer = builder.message(APIService, Meta::CommandFailed);
-    const int requestId = origin.headerInt(RequestId);
-    if (requestId != -1)
-        answer.setHeaderInt(RequestId, requestId);
-    m_connection.send(answer);
+    m_connection.send(createFailedMessage(origin, failReason, m_bufferPool));
 }
 
 
@@ -53,7 +53,7 @@ private:
 
     class Connection {
     public:
-        Connection(NetworkConnection && connection);
+        Connection(NetworkConnection && connection, NetworkManager *manager);
         ~Connection();
         void incomingMessage(const Message &message);
 
@@ -62,6 +62,7 @@ private:
     private:
         void sendFailedMessage(const Message &origin, const std::string &failReason);
 
+        NetworkManager *m_manager;
         Streaming::BufferPool m_bufferPool;
         std::map<uint32_t, SessionData*> m_properties;
     };
@@ -38,22 +38,27 @@ AddressMonitorService::AddressMonitorService()
     : NetworkService(Api::AddressMonitorService)
 {
     ValidationNotifier().addListener(this);
+    BlockScanDispatcher::instance()->addListener(this, "AddressMonitorService");
 }
 
 AddressMonitorService::~AddressMonitorService()
 {
     ValidationNotifier().removeListener(this);
+    BlockScanDispatcher::instance()->removeListener(this);
 }
 
 void AddressMonitorService::SyncTx(const Tx &tx)
 {
-    const auto rem = remotes();
     std::map<int, Match> matches;
     Tx::Iterator iter(tx);
-    if (!match(iter, rem, matches))
+    if (!match(iter, matches) || matches.empty())
         return;
 
+    const auto rem = remotesById();
     for (auto i = matches.begin(); i != matches.end(); ++i) {
+        auto remote = rem.find(i->first);
+        if (remote == rem.end()) // disconnected in the mean time
+            continue;
         Match &match = i->second;
         std::lock_guard<std::mutex> guard(m_poolMutex);
         m_pool.reserve(match.hashes.size() * 35 + match.amounts.size() * 10 + 40);
@@ -64,19 +69,20 @@ void AddressMonitorService::SyncTx(const Tx &tx)
             builder.add(Api::AddressMonitor::Amount, amount);
         builder.add(Api::AddressMonitor::TxId, tx.createHash());
         logDebug(Log::MonitorService) << "Remote" << i->first << "gets" << match.hashes.size() << "tx notification(s)";
-        rem[i->first]->connection.send(builder.message(Api::AddressMonitorService, Api::AddressMonitor::TransactionFound));
+        remote->second->connection.send(builder.message(Api::AddressMonitorService, Api::AddressMonitor::TransactionFound));
     }
 }
 
-bool AddressMonitorService::match(Tx::Iterator &iter, const std::deque<NetworkService::Remote *> &remotes, std::map<int, Match> &matchingRemotes) const
+bool AddressMonitorService::match(Tx::Iterator &iter, std::map<int, Match> &matchingRemotes) const
 {
-    if (remotes.empty())
+    if (m_index.isEmpty())
         return false;
     auto type = iter.next();
     if (type == Tx::End) // then the second end means end of block
         return false;
 
     uint64_t amount = 0;
+    std::vector<int> connectionIds;
     while (type != Tx::End) {
         if (type == Tx::OutputValue) {
             amount = iter.longData();
@@ -84,11 +90,10 @@ bool AddressMonitorService::match(Tx::Iterator &iter, const std::deque<NetworkSe
         else if (type == Tx::OutputScript) {
             uint256 hashedOutScript;
             iter.hashByteData(hashedOutScript);
-            for (size_t i = 0; i < remotes.size(); ++i) {
-                assert(i < INT_MAX);
-                RemoteWithKeys *rwk = static_cast<RemoteWithKeys*>(remotes.at(i));
-                if (rwk->hashes.find(hashedOutScript) != rwk->hashes.end()) {
-                    Match &m = matchingRemotes[static_cast<int>(i)];
+            connectionIds.clear();
+            if (m_index.find(hashedOutScript, connectionIds)) {
+                for (const int id : connectionIds) {
+                    Match &m = matchingRemotes[id];
                     m.amounts.push_back(amount);
                     m.hashes.push_back(hashedOutScript);
                 }
@@ -99,16 +104,39 @@ bool AddressMonitorService::match(Tx::Iterator &iter, const std::deque<NetworkSe
     return true;
 }
 
-void AddressMonitorService::SyncAllTransactionsInBlock(const FastBlock &block, CBlockIndex *index)
+AddressMonitorService::RemotesById AddressMonitorService::remotesById() const
 {
-    assert(index);
-    Tx::Iterator iter(block);
-    auto rem = remotes();
-    while (true) {
+    RemotesById answer;
+    for (auto remote : remotes()) {
+        answer.insert(std::make_pair(remote->connection.connectionId(), remote));
+    }
+    return answer;
+}
+
+void AddressMonitorService::blockScanned(const ScannedBlock &block)
+{
+    if (m_index.isEmpty())
+        return;
+    RemotesById rem;
+    std::vector<int> connectionIds;
+    for (const ScannedBlock::Transaction &tx : block.transactions) {
         std::map<int, Match> matches;
-        if (!match(iter, rem, matches))
-            break;
+        for (const ScannedBlock::Output &output : tx.outputs) {
+            connectionIds.clear();
+            if (m_index.find(output.scriptHash, connectionIds)) {
+                for (const int id : connectionIds) {
+                    Match &m = matches[id];
+                    m.amounts.push_back(output.amount);
+                    m.hashes.push_back(output.scriptHash);
+                }
+            }
+        }
+        if (!matches.empty() && rem.empty())
+            rem = remotesById();
         for (auto i = matches.begin(); i != matches.end(); ++i) {
+            auto remote = rem.find(i->first);
+            if (remote == rem.end())
+                continue;
             Match &match = i->second;
             std::lock_guard<std::mutex> guard(m_poolMutex);
             m_pool.reserve(match.hashes.size() * 35 + match.amounts.size() * 10 + 20);
@@ -117,10 +145,10 @@ void AddressMonitorService::SyncAllTransactionsInBlock(const FastBlock &block, C
                 builder.add(Api::AddressMonitor::BitcoinScriptHashed, hash);
             for (auto amount : match.amounts)
                 builder.add(Api::AddressMonitor::Amount, amount);
-            builder.add(Api::AddressMonitor::OffsetInBlock, static_cast<uint64_t>(iter.prevTx().offsetInBlock(block)));
-            builder.add(Api::AddressMonitor::BlockHeight, index->nHeight);
+            builder.add(Api::AddressMonitor::OffsetInBlock, static_cast<uint64_t>(tx.offsetInBlock));
+            builder.add(Api::AddressMonitor::BlockHeight, block.blockHeight);
             logDebug(Log::MonitorService) << "Remote" << i->first << "gets" << match.hashes.size() << "tx notification(s) from block";
-            rem[i->first]->connection.send(builder.message(Api::AddressMonitorService, Api::AddressMonitor::TransactionFound));
+            remote->second->connection.send(builder.message(Api::AddressMonitorService, Api::AddressMonitor::TransactionFound));
         }
     }
 }
@@ -128,17 +156,22 @@ void AddressMonitorService::SyncAllTransactionsInBlock(const FastBlock &block, C
 void AddressMonitorService::DoubleSpendFound(const Tx &first, const Tx &duplicate)
 {
     logDebug(Log::MonitorService) << "Double spend found" << first.createHash() << duplicate.createHash();
-    const auto rem = remotes();
     std::map<int, Match> matches;
     Tx::Iterator iter(first);
-    if (!match(iter, rem, matches))
+    if (!match(iter, matches))
         return; // returns false if no listeners
 
     Tx::Iterator iter2(duplicate);
-    bool m = match(iter2, rem, matches);
+    bool m = match(iter2, matches);
     assert(m); // our duplicate tx object should have data
+    if (matches.empty())
+        return;
 
+    const auto rem = remotesById();
     for (auto i = matches.begin(); i != matches.end(); ++i) {
+        auto remote = rem.find(i->first);
+        if (remote == rem.end())
+            continue;
         Match &match = i->second;
         std::lock_guard<std::mutex> guard(m_poolMutex);
         m_pool.reserve(match.hashes.size() * 35 + match.amounts.size() * 10 + 30 + duplicate.size());
@@ -149,24 +182,27 @@ void AddressMonitorService::DoubleSpendFound(const Tx &first, const Tx &duplicat
             builder.add(Api::AddressMonitor::Amount, amount);
         builder.add(Api::AddressMonitor::TxId, first.createHash());
         builder.add(Api::AddressMonitor::TransactionData, duplicate.data());
-        rem[i->first]->connection.send(builder.message(Api::AddressMonitorService, Api::AddressMonitor::DoubleSpendFound));
+        remote->second->connection.send(builder.message(Api::AddressMonitorService, Api::AddressMonitor::DoubleSpendFound));
     }
 }
 
 void AddressMonitorService::DoubleSpendFound(const Tx &txInMempool, const DoubleSpendProof &proof)
 {
     logDebug(Log::MonitorService) << "Double spend proof found. TxId:" << txInMempool.createHash();
-    const auto rem = remotes();
     std::map<int, Match> matches;
     Tx::Iterator iter(txInMempool);
-    if (!match(iter, rem, matches))
+    if (!match(iter, matches) || matches.empty())
         return; // returns false if no listeners
 
     CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
     stream << proof;
     const std::vector<uint8_t> serializedProof(stream.begin(), stream.end());
 
+    const auto rem = remotesById();
     for (auto i = matches.begin(); i != matches.end(); ++i) {
+        auto remote = rem.find(i->first);
+        if (remote == rem.end())
+            continue;
         Match &match = i->second;
         std::lock_guard<std::mutex> guard(m_poolMutex);
         m_pool.reserve(match.hashes.size() * 35 + match.amounts.size() * 10 + 35 + serializedProof.size());
@@ -177,7 +213,7 @@ void AddressMonitorService::DoubleSpendFound(const Tx &txInMempool, const Double
             builder.add(Api::AddressMonitor::Amount, amount);
         builder.add(Api::AddressMonitor::TxId, txInMempool.createHash());
         builder.addByteArray(Api::AddressMonitor::DoubleSpendProofData, &serializedProof[0], serializedProof.size());
-        rem[i->first]->connection.send(builder.message(Api::AddressMonitorService, Api::AddressMonitor::DoubleSpendFound));
+        remote->second->connection.send(builder.message(Api::AddressMonitorService, Api::AddressMonitor::DoubleSpendFound));
     }
 }
 
@@ -199,11 +235,12 @@ void AddressMonitorService::onIncomingMessage(Remote *remote_, const Message &me
 
                     ++done;
                     if (message.messageId() == Api::AddressMonitor::Subscribe) {
-                        remote->hashes.insert(hash);
+                        if (remote->hashes.insert(hash).second)
+                            m_index.subscribe(hash, remote->connection.connectionId());
                         remote->connection.postOnStrand(std::bind(&AddressMonitorService::findTxInMempool,
                                                                   this, remote->connection.connectionId(), hash));
-                    } else {
-                        remote->hashes.erase(hash);
+                    } else if (remote->hashes.erase(hash) == 1) {
+                        m_index.unsubscribe(hash, remote->connection.connectionId());
                     }
                 }
                 else {
@@ -222,17 +259,16 @@ void AddressMonitorService::onIncomingMessage(Remote *remote_, const Message &me
         if (!error.empty())
             builder.add(Api::AddressMonitor::ErrorMessage, error);
         remote->connection.send(builder.reply(message));
-        updateBools();
     }
 }
 
-
-void AddressMonitorService::updateBools()
+void AddressMonitorService::remoteDisconnected(Remote *remote_)
 {
-    m_findByHash = false;
-    for (auto remote : remotes()) {
-        RemoteWithKeys *rwk = static_cast<RemoteWithKeys*>(remote);
-        m_findByHash = m_findByHash || !rwk->hashes.empty();
+    assert(dynamic_cast<RemoteWithKeys*>(remote_));
+    RemoteWithKeys *remote = static_cast<RemoteWithKeys*>(remote_);
+    const int connectionId = remote->connection.connectionId();
+    for (auto hash : remote->hashes) {
+        m_index.unsubscribe(hash, connectionId);
     }
 }
 
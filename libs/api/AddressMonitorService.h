@@ -18,6 +18,9 @@
 #ifndef ADDRESSMONITORSERVICE_H
 #define ADDRESSMONITORSERVICE_H
 
+#include "BlockScanDispatcher.h"
+#include "SubscriptionIndex.h"
+
 #include <primitives/pubkey.h>
 
 #include <validationinterface.h>
@@ -30,7 +33,7 @@
 
 class CTxMemPool;
 
-class AddressMonitorService : public ValidationInterface, public NetworkService
+class AddressMonitorService : public ValidationInterface, public BlockScanListener, public NetworkService
 {
 public:
     AddressMonitorService();
@@ -38,7 +41,7 @@ public:
 
     // the hub pushed a transaction into its mempool
     void SyncTx(const Tx &tx) override;
-    void SyncAllTransactionsInBlock(const FastBlock &block, CBlockIndex *index) override;
+    void blockScanned(const ScannedBlock &block) override;
     void DoubleSpendFound(const Tx &first, const Tx &duplicate) override;
     void DoubleSpendFound(const Tx &txInMempool, const DoubleSpendProof &proof) override;
 
@@ -58,6 +61,7 @@ protected:
     Remote *createRemote() override {
         return new RemoteWithKeys();
     }
+    void remoteDisconnected(Remote *remote) override;
 
 private:
     struct Match {
@@ -65,17 +69,20 @@ private:
         std::deque<uint256> hashes;
     };
 
-    bool match(Tx::Iterator &iter, const std::deque<NetworkService::Remote *> &remotes, std::map<int, Match> &matchingRemotes) const;
+    /// finds the outputs of the next transaction in \a iter that remotes subscribed to, keyed by connection-id.
+    bool match(Tx::Iterator &iter, std::map<int, Match> &matchingRemotes) const;
+
+    typedef boost::unordered_map<int, Remote*> RemotesById;
+    RemotesById remotesById() const;
 
-    void updateBools();
     /// Callback for just subscribed addresses to find if there is a hit in the mempool.
     void findTxInMempool(int connectionId, const uint256 &hash);
 
     std::mutex m_poolMutex;
     Streaming::BufferPool m_pool;
 
-    // true if any remote added a watch
-    bool m_findByHash = false;
+    // script-hash to the connections that watch it
+    SubscriptionIndex m_index;
 
     CTxMemPool *m_mempool = nullptr;
 };
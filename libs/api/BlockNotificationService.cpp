@@ -20,7 +20,6 @@
 
 #include <Logger.h>
 #include <Message.h>
-#include <chain.h>
 
 #include <streaming/MessageBuilder.h>
 #include <streaming/MessageParser.h>
@@ -30,23 +29,23 @@
 BlockNotificationService::BlockNotificationService()
     : NetworkService(Api::BlockNotificationService)
 {
-    ValidationNotifier().addListener(this);
+    BlockScanDispatcher::instance()->addListener(this, "BlockNotificationService");
 }
 
 BlockNotificationService::~BlockNotificationService()
 {
-    ValidationNotifier().removeListener(this);
+    BlockScanDispatcher::instance()->removeListener(this);
 }
 
-void BlockNotificationService::SyncAllTransactionsInBlock(const FastBlock &, CBlockIndex *index)
+void BlockNotificationService::blockScanned(const ScannedBlock &block)
 {
     const auto remotes_ = remotes();
     if (remotes_.empty())
         return;
     m_pool.reserve(45);
     Streaming::MessageBuilder builder(m_pool);
-    builder.add(Api::BlockNotification::BlockHash, index->GetBlockHash());
-    builder.add(Api::BlockNotification::BlockHeight, index->nHeight);
+    builder.add(Api::BlockNotification::BlockHash, block.blockHash);
+    builder.add(Api::BlockNotification::BlockHeight, block.blockHeight);
     Message message(builder.message(Api::BlockNotificationService, Api::BlockNotification::NewBlockOnChain));
 
     for (auto remote : remotes_) {
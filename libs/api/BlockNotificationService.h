@@ -18,17 +18,17 @@
 #ifndef BLOCKNOTIFICATIONSERVICE_H
 #define BLOCKNOTIFICATIONSERVICE_H
 
-#include <validationinterface.h>
+#include "BlockScanDispatcher.h"
 #include <NetworkService.h>
 
-class BlockNotificationService : public ValidationInterface, public NetworkService
+class BlockNotificationService : public BlockScanListener, public NetworkService
 {
 public:
     BlockNotificationService();
     ~BlockNotificationService();
 
-    // the hub pushed a transaction into its mempool
-    void SyncAllTransactionsInBlock(const FastBlock &block, CBlockIndex *index) override;
+    // the hub appended a block to the chain
+    void blockScanned(const ScannedBlock &block) override;
     void onIncomingMessage(Remote *con, const Message &message, const EndPoint &ep) override;
 
 protected:
@@ -0,0 +1,276 @@
+/*
+ * This file is part of the Flowee project
+ * Copyright (C) 2020 Tom Zander <tomz@freedommail.ch>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "BlockScanDispatcher.h"
+
+#include <Application.h>
+#include <Logger.h>
+#include <SettingsDefaults.h>
+#include <chain.h>
+#include <util.h>
+#include <utiltime.h>
+
+#include <algorithm>
+#include <chrono>
+
+BlockScanListener::~BlockScanListener()
+{
+}
+
+BlockScanDispatcher::Listener::Listener(BlockScanListener *l, const std::string &n)
+    : listener(l),
+      name(n),
+      maxBacklog(0),
+      delivered(0),
+      totalTime(0),
+      maxTime(0)
+{
+}
+
+BlockScanDispatcher::BlockScanDispatcher()
+    : m_maxBacklog(std::max(1, static_cast<int>(GetArg("-apiblockbacklog", Settings::DefaultApiBlockBacklog))))
+{
+    Application::instance(); // make sure it outlives us
+    ValidationNotifier().addListener(this);
+}
+
+BlockScanDispatcher::~BlockScanDispatcher()
+{
+    ValidationNotifier().removeListener(this);
+}
+
+BlockScanDispatcher *BlockScanDispatcher::instance()
+{
+    static BlockScanDispatcher s_instance;
+    return &s_instance;
+}
+
+void BlockScanDispatcher::SyncAllTransactionsInBlock(const FastBlock &block, CBlockIndex *index)
+{
+    assert(index);
+    std::lock_guard<std::mutex> lock(m_lock);
+    if (m_listeners.empty())
+        return;
+    auto scannedBlock = std::make_shared<ScannedBlock>();
+    scannedBlock->block = block;
+    scannedBlock->blockHash = index->GetBlockHash();
+    scannedBlock->blockHeight = index->nHeight;
+    m_toScan.push_back(scannedBlock);
+    startScanning();
+}
+
+void BlockScanDispatcher::startScanning()
+{
+    if (!m_scanning && !m_toScan.empty() && !listenerIsFull()) {
+        m_scanning = true;
+        Application::instance()->ioService().post(std::bind(&BlockScanDispatcher::scanBlocks, this));
+    }
+}
+
+bool BlockScanDispatcher::listenerIsFull() const
+{
+    for (auto listener : m_listeners) {
+        std::lock_guard<std::mutex> queueLock(listener->lock);
+        if (static_cast<int>(listener->queue.size()) >= m_maxBacklog)
+            return true;
+    }
+    return false;
+}
+
+void BlockScanDispatcher::addListener(BlockScanListener *listener, const std::string &name)
+{
+    assert(listener);
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_listeners.push_back(std::make_shared<Listener>(listener, name));
+}
+
+void BlockScanDispatcher::removeListener(BlockScanListener *listener)
+{
+    std::shared_ptr<Listener> item;
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        for (auto i = m_listeners.begin(); i != m_listeners.end(); ++i) {
+            if ((*i)->listener == listener) {
+                item = *i;
+                m_listeners.erase(i);
+                break;
+            }
+        }
+    }
+    if (item.get() == nullptr)
+        return;
+
+    std::unique_lock<std::mutex> lock(item->lock);
+    item->removed = true;
+    item->queue.clear();
+    // wait for a notification in progress, unless the thread-pool has stopped and it never will.
+    while (item->running && !Application::isClosingDown())
+        item->idle.wait_for(lock, std::chrono::milliseconds(100));
+    lock.unlock();
+
+    // the scanning may have been waiting for the removed listener.
+    std::lock_guard<std::mutex> dispatcherLock(m_lock);
+    startScanning();
+}
+
+std::vector<BlockScanDispatcher::ListenerStatistics> BlockScanDispatcher::statistics() const
+{
+    std::vector<ListenerStatistics> answer;
+    std::lock_guard<std::mutex> lock(m_lock);
+    for (auto listener : m_listeners) {
+        ListenerStatistics stats;
+        stats.name = listener->name;
+        {
+            std::lock_guard<std::mutex> queueLock(listener->lock);
+            stats.backlog = static_cast<int>(listener->queue.size());
+        }
+        stats.maxBacklog = listener->maxBacklog.load();
+        stats.delivered = listener->delivered.load();
+        stats.totalTime = listener->totalTime.load();
+        stats.maxTime = listener->maxTime.load();
+        answer.push_back(stats);
+    }
+    return answer;
+}
+
+int BlockScanDispatcher::maxBacklog() const
+{
+    return m_maxBacklog.load();
+}
+
+void BlockScanDispatcher::setMaxBacklog(int maxBacklog)
+{
+    assert(maxBacklog > 0);
+    std::lock_guard<std::mutex> lock(m_lock);
+    m_maxBacklog = maxBacklog;
+    startScanning();
+}
+
+void BlockScanDispatcher::scanBlocks()
+{
+    while (true) {
+        std::shared_ptr<ScannedBlock> block;
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            if (m_toScan.empty() || listenerIsFull()) {
+                // processQueue() restarts us when the listener catches up.
+                m_scanning = false;
+                return;
+            }
+            block = m_toScan.front();
+            m_toScan.pop_front();
+        }
+
+        try {
+            Tx::Iterator iter(block->block);
+            ScannedBlock::Transaction tx;
+            uint64_t amount = 0;
+            Tx::Input input;
+            bool seenOneEnd = false;
+            while (true) {
+                const auto type = iter.next();
+                if (type == Tx::End) {
+                    if (seenOneEnd) // the second end means end of block
+                        break;
+                    seenOneEnd = true;
+                    Tx prevTx = iter.prevTx();
+                    tx.txid = prevTx.createHash();
+                    tx.offsetInBlock = prevTx.offsetInBlock(block->block);
+                    block->transactions.push_back(std::move(tx));
+                    tx = ScannedBlock::Transaction();
+                    continue;
+                }
+                seenOneEnd = false;
+                if (type == Tx::PrevTxHash) {
+                    input.txid = iter.uint256Data();
+                } else if (type == Tx::PrevTxIndex) {
+                    input.index = iter.intData();
+                    tx.inputs.push_back(input);
+                } else if (type == Tx::OutputValue) {
+                    amount = iter.longData();
+                } else if (type == Tx::OutputScript) {
+                    tx.outputs.push_back({iter.hashedByteData(), amount});
+                }
+            }
+        } catch (const std::exception &e) {
+            logCritical(Log::ApiServer) << "Failed to scan block" << block->blockHeight << e;
+            continue;
+        }
+        deliver(block);
+    }
+}
+
+void BlockScanDispatcher::deliver(const std::shared_ptr<const ScannedBlock> &block)
+{
+    std::list<std::shared_ptr<Listener> > listeners;
+    {
+        std::lock_guard<std::mutex> lock(m_lock);
+        listeners = m_listeners;
+    }
+    for (auto listener : listeners) {
+        std::lock_guard<std::mutex> lock(listener->lock);
+        if (listener->removed)
+            continue;
+        listener->queue.push_back(block);
+        const int backlog = static_cast<int>(listener->queue.size());
+        if (backlog > listener->maxBacklog.load()) {
+            listener->maxBacklog.store(backlog);
+            if (backlog >= m_maxBacklog.load())
+                logWarning(Log::ApiServer) << "Block notifications for" << listener->name << "are falling behind, block scanning waits. Backlog:" << backlog;
+            else if (backlog > 5)
+                logWarning(Log::ApiServer) << "Block notifications for" << listener->name << "are falling behind. Backlog:" << backlog;
+        }
+        if (!listener->running) {
+            listener->running = true;
+            Application::instance()->ioService().post(std::bind(&BlockScanDispatcher::processQueue, this, listener));
+        }
+    }
+}
+
+void BlockScanDispatcher::processQueue(const std::shared_ptr<Listener> &listener)
+{
+    while (true) {
+        std::shared_ptr<const ScannedBlock> block;
+        bool wasFull;
+        {
+            std::lock_guard<std::mutex> lock(listener->lock);
+            if (listener->queue.empty() || listener->removed) {
+                listener->running = false;
+                listener->idle.notify_all();
+                return;
+            }
+            wasFull = static_cast<int>(listener->queue.size()) >= m_maxBacklog;
+            block = listener->queue.front();
+            listener->queue.pop_front();
+        }
+        if (wasFull) { // the scanning may be waiting for us
+            std::lock_guard<std::mutex> lock(m_lock);
+            startScanning();
+        }
+        const int64_t start = GetTimeMicros();
+        try {
+            listener->listener->blockScanned(*block);
+        } catch (const std::exception &e) {
+            logCritical(Log::ApiServer) << "Block notification of" << listener->name << "failed:" << e;
+        }
+        const uint64_t duration = static_cast<uint64_t>(GetTimeMicros() - start);
+        listener->delivered.fetch_add(1);
+        listener->totalTime.fetch_add(duration);
+        if (duration > listener->maxTime.load())
+            listener->maxTime.store(duration);
+    }
+}
@@ -0,0 +1,146 @@
+/*
+ * This file is part of the Flowee project
+ * Copyright (C) 2020 Tom Zander <tomz@freedommail.ch>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef BLOCKSCANDISPATCHER_H
+#define BLOCKSCANDISPATCHER_H
+
+#include <validationinterface.h>
+#include <primitives/FastBlock.h>
+#include <primitives/FastTransaction.h>
+#include <uint256.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * The result of walking over a block once, shared by all the API services.
+ */
+struct ScannedBlock
+{
+    struct Output {
+        uint256 scriptHash; ///< sha256 of the output script.
+        uint64_t amount;
+    };
+    struct Transaction {
+        uint256 txid;
+        int64_t offsetInBlock;
+        std::vector<Tx::Input> inputs;
+        std::vector<Output> outputs;
+    };
+
+    FastBlock block;
+    uint256 blockHash;
+    int blockHeight = -1;
+    std::vector<Transaction> transactions;
+};
+
+class BlockScanListener
+{
+public:
+    virtual ~BlockScanListener();
+
+    /**
+     * Called from a worker thread for each block appended to the chain.
+     * Blocks are delivered one at a time and in chain order, different
+     * listeners are called in parallel.
+     */
+    virtual void blockScanned(const ScannedBlock &block) = 0;
+};
+
+/**
+ * The BlockScanDispatcher takes new blocks from the validation engine
+ * and notifies the API services about them without making the engine wait.
+ *
+ * A block is tokenized only once, in a worker thread, and the resulting
+ * ScannedBlock is queued for each listener. Every listener has its own
+ * queue, which is drained by a worker thread, so a slow listener only
+ * delays itself.
+ *
+ * To bound the memory used, the queue of a listener holds at most
+ * maxBacklog() blocks. When any listener is at that limit no more blocks
+ * are scanned until it catches up, new blocks wait unscanned in the meantime.
+ */
+class BlockScanDispatcher : public ValidationInterface
+{
+public:
+    ~BlockScanDispatcher();
+
+    static BlockScanDispatcher *instance();
+
+    void SyncAllTransactionsInBlock(const FastBlock &block, CBlockIndex *index) override;
+
+    /// Add a listener, the name is used for the statistics.
+    void addListener(BlockScanListener *listener, const std::string &name);
+    /// Remove the listener, waiting for a running notification to finish.
+    void removeListener(BlockScanListener *listener);
+
+    struct ListenerStatistics {
+        std::string name;
+        int backlog = 0;        ///< Blocks queued but not yet handled.
+        int maxBacklog = 0;
+        uint64_t delivered = 0; ///< Blocks handled.
+        uint64_t totalTime = 0; ///< microseconds spent in the listener.
+        uint64_t maxTime = 0;
+    };
+    std::vector<ListenerStatistics> statistics() const;
+
+    /// Returns the amount of blocks a listener can have queued, from -apiblockbacklog.
+    int maxBacklog() const;
+    void setMaxBacklog(int maxBacklog);
+
+private:
+    BlockScanDispatcher();
+
+    struct Listener {
+        Listener(BlockScanListener *l, const std::string &n);
+        BlockScanListener *listener;
+        std::string name;
+
+        std::mutex lock;
+        std::condition_variable idle;
+        std::deque<std::shared_ptr<const ScannedBlock> > queue;
+        bool running = false;
+        bool removed = false;
+
+        std::atomic<int> maxBacklog;
+        std::atomic<uint64_t> delivered;
+        std::atomic<uint64_t> totalTime;
+        std::atomic<uint64_t> maxTime;
+    };
+
+    void scanBlocks();
+    /// Restart the scanning of blocks if we have some and it is not running, called with m_lock held.
+    void startScanning();
+    /// Returns true if a listener has maxBacklog() blocks queued, called with m_lock held.
+    bool listenerIsFull() const;
+    void deliver(const std::shared_ptr<const ScannedBlock> &block);
+    void processQueue(const std::shared_ptr<Listener> &listener);
+
+    mutable std::mutex m_lock;
+    std::list<std::shared_ptr<Listener> > m_listeners;
+    std::deque<std::shared_ptr<ScannedBlock> > m_toScan;
+    bool m_scanning = false;
+    std::atomic<int> m_maxBacklog;
+};
+
+#endif
@@ -0,0 +1,102 @@
+/*
+ * This file is part of the Flowee project
+ * Copyright (C) 2020 Tom Zander <tomz@freedommail.ch>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "HubControlService.h"
+#include "BlockScanDispatcher.h"
+#include <APIProtocol.h>
+#include <Application.h>
+
+#include <Logger.h>
+#include <Message.h>
+#include <networkmanager/NetworkManager.h>
+#include <validation/Engine.h>
+
+#include <streaming/MessageBuilder.h>
+
+HubControlService::HubControlService()
+    : NetworkService(Api::HubControlService)
+{
+}
+
+void HubControlService::onIncomingMessage(Remote *remote, const Message &message, const EndPoint &ep)
+{
+    if (message.messageId() == Api::Hub::GetValidationStatistics) {
+        logInfo(Log::ApiServer) << "Remote" << ep.connectionId << "requests validation statistics";
+        const Validation::Statistics stats = Application::instance()->validation()->statistics();
+
+        remote->pool.reserve(60 + Validation::Statistics::StageCount
+                             * (40 + 9 * Validation::Statistics::HistogramBuckets));
+        Streaming::MessageBuilder builder(remote->pool);
+        for (int i = 0; i < Validation::Statistics::StageCount; ++i) {
+            const auto stage = static_cast<Validation::Statistics::Stage>(i);
+            const Validation::Statistics::StageTimes &times = stats.stages[static_cast<size_t>(i)];
+            builder.add(Api::Hub::ValidationStage, i);
+            builder.add(Api::Hub::StageName, Validation::Statistics::stageName(stage));
+            builder.add(Api::Hub::Count, times.count);
+            builder.add(Api::Hub::TotalTime, times.totalTime);
+            builder.add(Api::Hub::MaxTime, times.maxTime);
+            for (auto bucket : times.histogram) {
+                builder.add(Api::Hub::HistogramBucket, bucket);
+            }
+            builder.add(Api::Hub::Separator, true);
+        }
+        builder.add(Api::Hub::BlocksValidated, stats.blocks);
+        builder.add(Api::Hub::TransactionsValidated, stats.transactions);
+        builder.add(Api::Hub::UtxoLookups, stats.utxoLookups);
+        builder.add(Api::Hub::UtxoLookupsPerSecond, stats.utxoLookupsPerSecond());
+        builder.add(Api::Hub::SigChecks, stats.sigChecks);
+        builder.add(Api::Hub::SigChecksPerSecond, stats.sigChecksPerSecond());
+        builder.add(Api::Hub::ChunkImbalanceTime, stats.chunkImbalanceTime);
+        remote->connection.send(builder.reply(message, Api::Hub::GetValidationStatisticsReply));
+    }
+    else if (message.messageId() == Api::Hub::GetNotificationStatistics) {
+        const auto stats = BlockScanDispatcher::instance()->statistics();
+        size_t size = 10;
+        for (auto &service : stats) {
+            size += service.name.size() + 50;
+        }
+        remote->pool.reserve(size);
+        Streaming::MessageBuilder builder(remote->pool);
+        for (auto &service : stats) {
+            builder.add(Api::Hub::ServiceName, service.name);
+            builder.add(Api::Hub::Backlog, service.backlog);
+            builder.add(Api::Hub::MaxBacklog, service.maxBacklog);
+            builder.add(Api::Hub::BlocksDelivered, service.delivered);
+            builder.add(Api::Hub::TotalTime, service.totalTime);
+            builder.add(Api::Hub::MaxTime, service.maxTime);
+            builder.add(Api::Hub::Separator, true);
+        }
+        remote->connection.send(builder.reply(message, Api::Hub::GetNotificationStatisticsReply));
+    }
+    else if (message.messageId() == Api::Hub::GetCompressionStatistics) {
+        if (manager() == nullptr)
+            return;
+        const auto stats = manager()->compressionStatistics();
+        remote->pool.reserve(10 + 60 * static_cast<int>(stats.size()));
+        Streaming::MessageBuilder builder(remote->pool);
+        for (auto &service : stats) {
+            builder.add(Api::Hub::NetworkServiceId, service.serviceId);
+            builder.add(Api::Hub::MessagesCompressed, service.messagesCompressed);
+            builder.add(Api::Hub::MessagesDecompressed, service.messagesDecompressed);
+            builder.add(Api::Hub::BytesSaved, static_cast<uint64_t>(service.bytesSaved()));
+            builder.add(Api::Hub::CompressTime, service.compressTime);
+            builder.add(Api::Hub::DecompressTime, service.decompressTime);
+            builder.add(Api::Hub::Separator, true);
+        }
+        remote->connection.send(builder.reply(message, Api::Hub::GetCompressionStatisticsReply));
+    }
+}
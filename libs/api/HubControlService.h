@@ -0,0 +1,34 @@
+/*
+ * This file is part of the Flowee project
+ * Copyright (C) 2020 Tom Zander <tomz@freedommail.ch>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef HUBCONTROLSERVICE_H
+#define HUBCONTROLSERVICE_H
+
+#include <NetworkService.h>
+
+/**
+ * The Hub control service answers questions about the internals of the running Hub.
+ */
+class HubControlService : public NetworkService
+{
+public:
+    HubControlService();
+
+    void onIncomingMessage(Remote *con, const Message &message, const EndPoint &ep) override;
+};
+
+#endif
@@ -0,0 +1,64 @@
+/*
+ * This file is part of the Flowee project
+ * Copyright (C) 2020 Tom Zander <tomz@freedommail.ch>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "SubscriptionIndex.h"
+
+#include <algorithm>
+
+SubscriptionIndex::SubscriptionIndex()
+    : m_count(0)
+{
+}
+
+void SubscriptionIndex::subscribe(const uint256 &hash, int connectionId)
+{
+    Shard &s = shard(hash);
+    boost::unique_lock<boost::shared_mutex> lock(s.lock);
+    std::vector<int> &ids = s.subscriptions[hash];
+    if (std::find(ids.begin(), ids.end(), connectionId) != ids.end())
+        return;
+    ids.push_back(connectionId);
+    m_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+void SubscriptionIndex::unsubscribe(const uint256 &hash, int connectionId)
+{
+    Shard &s = shard(hash);
+    boost::unique_lock<boost::shared_mutex> lock(s.lock);
+    auto iter = s.subscriptions.find(hash);
+    if (iter == s.subscriptions.end())
+        return;
+    std::vector<int> &ids = iter->second;
+    auto id = std::find(ids.begin(), ids.end(), connectionId);
+    if (id == ids.end())
+        return;
+    ids.erase(id);
+    if (ids.empty())
+        s.subscriptions.erase(iter);
+    m_count.fetch_sub(1, std::memory_order_relaxed);
+}
+
+bool SubscriptionIndex::find(const uint256 &hash, std::vector<int> &connectionIds) const
+{
+    const Shard &s = shard(hash);
+    boost::shared_lock<boost::shared_mutex> lock(s.lock);
+    auto iter = s.subscriptions.find(hash);
+    if (iter == s.subscriptions.end())
+        return false;
+    connectionIds.insert(connectionIds.end(), iter->second.begin(), iter->second.end());
+    return true;
+}
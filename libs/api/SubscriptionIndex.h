@@ -0,0 +1,79 @@
+/*
+ * This file is part of the Flowee project
+ * Copyright (C) 2020 Tom Zander <tomz@freedommail.ch>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef SUBSCRIPTIONINDEX_H
+#define SUBSCRIPTIONINDEX_H
+
+#include <uint256.h>
+
+#include <boost/thread/shared_mutex.hpp>
+#include <boost/unordered_map.hpp>
+
+#include <atomic>
+#include <vector>
+
+/**
+ * Maps a hash (script-hash or txid) to the connection-ids of the remotes
+ * that subscribed to it.
+ *
+ * The monitor services use this to do a single lookup per output or
+ * transaction instead of one lookup per connected remote.
+ * The index is split into shards that each have their own lock, which means
+ * that the validation threads doing lookups will not block each other and
+ * are only briefly blocked by a remote (un)subscribing.
+ */
+class SubscriptionIndex
+{
+public:
+    SubscriptionIndex();
+
+    /// register \a connectionId to be interested in \a hash.
+    void subscribe(const uint256 &hash, int connectionId);
+    /// remove the registration of \a connectionId for \a hash.
+    void unsubscribe(const uint256 &hash, int connectionId);
+
+    /**
+     * Append the connection-ids that subscribed to \a hash to \a connectionIds.
+     * @returns true if at least one was found.
+     */
+    bool find(const uint256 &hash, std::vector<int> &connectionIds) const;
+
+    /// returns true if nobody subscribed to anything.
+    inline bool isEmpty() const {
+        return m_count.load(std::memory_order_relaxed) == 0;
+    }
+
+private:
+    enum { ShardCount = 64 };
+
+    struct Shard {
+        mutable boost::shared_mutex lock;
+        boost::unordered_map<uint256, std::vector<int>, HashShortener> subscriptions;
+    };
+
+    inline Shard &shard(const uint256 &hash) {
+        return m_shards[*(hash.begin() + 31) % ShardCount];
+    }
+    inline const Shard &shard(const uint256 &hash) const {
+        return m_shards[*(hash.begin() + 31) % ShardCount];
+    }
+
+    Shard m_shards[ShardCount];
+    std::atomic<int> m_count;
+};
+
+#endif
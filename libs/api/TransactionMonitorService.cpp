@@ -35,32 +35,40 @@
 #include <streaming/streams.h>
 #include <primitives/FastBlock.h>
 
+#include <algorithm>
+
 TransactionMonitorService::TransactionMonitorService()
     : NetworkService(Api::TransactionMonitorService)
 {
     ValidationNotifier().addListener(this);
+    BlockScanDispatcher::instance()->addListener(this, "TransactionMonitorService");
 }
 
 TransactionMonitorService::~TransactionMonitorService()
 {
     ValidationNotifier().removeListener(this);
+    BlockScanDispatcher::instance()->removeListener(this);
 }
 
 void TransactionMonitorService::SyncTx(const Tx &tx)
 {
-    if (!m_findByHash)
+    if (m_index.isEmpty())
         return;
     auto txHash = tx.createHash();
-    for (auto remote_ : remotes()) {
-        auto remote = dynamic_cast<RemoteWithHashes*>(remote_);
-        assert(remote);
-        if (remote->hashes.find(txHash) != remote->hashes.end()) {
-            remote->pool.reserve(75);
-            Streaming::MessageBuilder builder(remote->pool);
-            builder.add(Api::TxId, txHash);
-            logDebug(Log::MonitorService) << "Remote gets tx notification for" << txHash;
-            remote->connection.send(builder.message(Api::TransactionMonitorService, Api::TransactionMonitor::TransactionFound));
-        }
+    std::vector<int> connectionIds;
+    if (!m_index.find(txHash, connectionIds))
+        return;
+    const auto rem = remotesById();
+    for (const int id : connectionIds) {
+        auto iter = rem.find(id);
+        if (iter == rem.end()) // disconnected in the mean time
+            continue;
+        auto remote = iter->second;
+        remote->pool.reserve(75);
+        Streaming::MessageBuilder builder(remote->pool);
+        builder.add(Api::TxId, txHash);
+        logDebug(Log::MonitorService) << "Remote gets tx notification for" << txHash;
+        remote->connection.send(builder.message(Api::TransactionMonitorService, Api::TransactionMonitor::TransactionFound));
     }
 }
 
@@ -72,67 +80,61 @@ namespace  {
     };
 }
 
-void TransactionMonitorService::SyncAllTransactionsInBlock(const FastBlock &block, CBlockIndex *index)
+void TransactionMonitorService::blockScanned(const ScannedBlock &block)
 {
-    if (!m_findByHash)
+    if (m_index.isEmpty())
         return;
 
-    Tx::Iterator iter(block);
-    auto type = iter.next();
-    assert(type != Tx::End); // empty block (not even coinbase) is invalid.
-
-    auto remotes = this->remotes();
-    std::vector<std::deque<Match> > matches;
-    matches.resize(remotes.size());
-    bool seenOneEnd = false;
-    while (true) {
-        if (type == Tx::End) {
-            if (seenOneEnd)
-                break; // block done.
-            seenOneEnd = true;
-
-            auto txId = iter.prevTx().createHash();
-            for (size_t i = 0; i < remotes.size(); ++i) {
-                auto remote = static_cast<RemoteWithHashes*>(remotes[i]);
-                if (remote->hashes.find(txId) != remote->hashes.end())
-                    matches[i].push_back({iter.prevTx().offsetInBlock(block), txId});
+    std::map<int, std::deque<Match> > matches; // connection-id to matches
+    std::vector<int> connectionIds;
+    for (const ScannedBlock::Transaction &tx : block.transactions) {
+        connectionIds.clear();
+        if (m_index.find(tx.txid, connectionIds)) {
+            for (const int id : connectionIds) {
+                matches[id].push_back({tx.offsetInBlock, tx.txid});
             }
         }
-        else {
-            seenOneEnd = false;
-        }
-        type = iter.next();
     }
+    if (matches.empty())
+        return;
 
-    for (size_t i = 0; i < matches.size(); ++i) {
-        const std::deque<Match> &matchesForRemote = matches[i];
-        if (!matchesForRemote.empty()) {
-            assert(remotes.size() > i);
-            auto remote = remotes[i];
-            remote->pool.reserve(matchesForRemote.size() * 35 + 20);
-            Streaming::MessageBuilder builder(remote->pool);
-            for (auto m : matchesForRemote) {
-                builder.add(Api::TransactionMonitor::TxId, m.hash);
-                builder.add(Api::TransactionMonitor::OffsetInBlock, m.offsetInBlock);
-            }
-            logDebug(Log::MonitorService) << "Remote" << i << "gets" << matchesForRemote.size() << "txid notification(s) from block";
-            builder.add(Api::TransactionMonitor::BlockHeight, index->nHeight);
-            remote->connection.send(builder.message(Api::TransactionMonitorService, Api::TransactionMonitor::TransactionFound));
+    const auto rem = remotesById();
+    for (auto i = matches.begin(); i != matches.end(); ++i) {
+        auto iter = rem.find(i->first);
+        if (iter == rem.end())
+            continue;
+        auto remote = iter->second;
+        const std::deque<Match> &matchesForRemote = i->second;
+        remote->pool.reserve(matchesForRemote.size() * 35 + 20);
+        Streaming::MessageBuilder builder(remote->pool);
+        for (auto m : matchesForRemote) {
+            builder.add(Api::TransactionMonitor::TxId, m.hash);
+            builder.add(Api::TransactionMonitor::OffsetInBlock, m.offsetInBlock);
         }
+        logDebug(Log::MonitorService) << "Remote" << i->first << "gets" << matchesForRemote.size() << "txid notification(s) from block";
+        builder.add(Api::TransactionMonitor::BlockHeight, block.blockHeight);
+        remote->connection.send(builder.message(Api::TransactionMonitorService, Api::TransactionMonitor::TransactionFound));
     }
 }
 
 void TransactionMonitorService::DoubleSpendFound(const Tx &first, const Tx &duplicate)
 {
-    if (!m_findByHash)
+    if (m_index.isEmpty())
         return;
     auto tx1Hash = first.createHash();
     auto tx2Hash = duplicate.createHash();
+    std::vector<int> matches1, matches2;
+    m_index.find(tx1Hash, matches1);
+    m_index.find(tx2Hash, matches2);
+    if (matches1.empty() && matches2.empty())
+        return;
+
     for (auto remote_ : remotes()) {
         auto remote = dynamic_cast<RemoteWithHashes*>(remote_);
         assert(remote);
-        bool match1 = remote->hashes.find(tx1Hash) != remote->hashes.end();
-        bool match2 = remote->hashes.find(tx2Hash) != remote->hashes.end();
+        const int id = remote->connection.connectionId();
+        bool match1 = std::find(matches1.begin(), matches1.end(), id) != matches1.end();
+        bool match2 = std::find(matches2.begin(), matches2.end(), id) != matches2.end();
         if (match1 || match2) {
             remote->pool.reserve(duplicate.size() + 70);
             Streaming::MessageBuilder builder(remote->pool);
@@ -152,27 +154,29 @@ void TransactionMonitorService::DoubleSpendFound(const Tx &first, const Tx &dupl
 
 void TransactionMonitorService::DoubleSpendFound(const Tx &txInMempool, const DoubleSpendProof &proof)
 {
-    if (!m_findByHash)
+    if (m_index.isEmpty())
         return;
     auto txHash = txInMempool.createHash();
-    std::vector<uint8_t> serializedProof;
+    std::vector<int> connectionIds;
+    if (!m_index.find(txHash, connectionIds))
+        return;
 
-    for (auto remote_ : remotes()) {
-        auto remote = dynamic_cast<RemoteWithHashes*>(remote_);
-        assert(remote);
-        if (remote->hashes.find(txHash) != remote->hashes.end()) {
-            if (serializedProof.empty()) {
-                CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
-                stream << proof;
-                serializedProof = std::vector<uint8_t>(stream.begin(), stream.end());
-            }
-            remote->pool.reserve(serializedProof.size() + 40);
-            Streaming::MessageBuilder builder(remote->pool);
-            builder.add(Api::TxId, txHash); // txid subscribed to
-            builder.addByteArray(Api::TransactionMonitor::DoubleSpendProofData, &serializedProof[0], serializedProof.size());
-            logDebug(Log::MonitorService) << "Remote gets DSP notification for" << txHash;
-            remote->connection.send(builder.message(Api::TransactionMonitorService, Api::TransactionMonitor::DoubleSpendFound));
-        }
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << proof;
+    const std::vector<uint8_t> serializedProof(stream.begin(), stream.end());
+
+    const auto rem = remotesById();
+    for (const int id : connectionIds) {
+        auto iter = rem.find(id);
+        if (iter == rem.end())
+            continue;
+        auto remote = iter->second;
+        remote->pool.reserve(serializedProof.size() + 40);
+        Streaming::MessageBuilder builder(remote->pool);
+        builder.add(Api::TxId, txHash); // txid subscribed to
+        builder.addByteArray(Api::TransactionMonitor::DoubleSpendProofData, &serializedProof[0], serializedProof.size());
+        logDebug(Log::MonitorService) << "Remote gets DSP notification for" << txHash;
+        remote->connection.send(builder.message(Api::TransactionMonitorService, Api::TransactionMonitor::DoubleSpendFound));
     }
 }
 
@@ -194,11 +198,12 @@ void TransactionMonitorService::onIncomingMessage(Remote *remote_, const Message
 
                     ++done;
                     if (message.messageId() == Api::TransactionMonitor::Subscribe) {
-                        remote->hashes.insert(hash);
+                        if (remote->hashes.insert(hash).second)
+                            m_index.subscribe(hash, remote->connection.connectionId());
                         remote->connection.postOnStrand(std::bind(&TransactionMonitorService::findTxInMempool,
                                                                   this, remote->connection.connectionId(), hash));
-                    } else {
-                        remote->hashes.erase(hash);
+                    } else if (remote->hashes.erase(hash) == 1) {
+                        m_index.unsubscribe(hash, remote->connection.connectionId());
                     }
                 }
                 else {
@@ -217,17 +222,26 @@ void TransactionMonitorService::onIncomingMessage(Remote *remote_, const Message
         if (!error.empty())
             builder.add(Api::TransactionMonitor::ErrorMessage, error);
         remote->connection.send(builder.reply(message, Api::TransactionMonitor::SubscribeReply));
-        updateBools();
     }
 }
 
-void TransactionMonitorService::updateBools()
+void TransactionMonitorService::remoteDisconnected(Remote *remote_)
+{
+    assert(dynamic_cast<RemoteWithHashes*>(remote_));
+    RemoteWithHashes *remote = static_cast<RemoteWithHashes*>(remote_);
+    const int connectionId = remote->connection.connectionId();
+    for (auto hash : remote->hashes) {
+        m_index.unsubscribe(hash, connectionId);
+    }
+}
+
+TransactionMonitorService::RemotesById TransactionMonitorService::remotesById() const
 {
-    m_findByHash = false;
+    RemotesById answer;
     for (auto remote : remotes()) {
-        RemoteWithHashes *rwk = static_cast<RemoteWithHashes*>(remote);
-        m_findByHash = m_findByHash || !rwk->hashes.empty();
+        answer.insert(std::make_pair(remote->connection.connectionId(), remote));
     }
+    return answer;
 }
 
 void TransactionMonitorService::findTxInMempool(int connectionId, const uint256 &hash)
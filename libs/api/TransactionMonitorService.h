@@ -18,6 +18,9 @@
 #ifndef TRANSACTIONMONITORSERVICE_H
 #define TRANSACTIONMONITORSERVICE_H
 
+#include "BlockScanDispatcher.h"
+#include "SubscriptionIndex.h"
+
 #include <primitives/pubkey.h>
 
 #include <validationinterface.h>
@@ -30,7 +33,7 @@
 
 class CTxMemPool;
 
-class TransactionMonitorService : public ValidationInterface, public NetworkService
+class TransactionMonitorService : public ValidationInterface, public BlockScanListener, public NetworkService
 {
 public:
     TransactionMonitorService();
@@ -38,7 +41,7 @@ public:
 
     // the hub pushed a transaction into its mempool
     void SyncTx(const Tx &tx) override;
-    void SyncAllTransactionsInBlock(const FastBlock &block, CBlockIndex *index) override;
+    void blockScanned(const ScannedBlock &block) override;
     void DoubleSpendFound(const Tx &first, const Tx &duplicate) override;
     void DoubleSpendFound(const Tx &txInMempool, const DoubleSpendProof &proof) override;
 
@@ -58,17 +61,20 @@ protected:
     Remote *createRemote() override {
         return new RemoteWithHashes();
     }
+    void remoteDisconnected(Remote *remote) override;
 
 private:
-    void updateBools();
+    typedef boost::unordered_map<int, Remote*> RemotesById;
+    RemotesById remotesById() const;
+
     /// Callback for just subscribed addresses to find if there is a hit in the mempool.
     void findTxInMempool(int connectionId, const uint256 &hash);
 
     std::mutex m_poolMutex;
     Streaming::BufferPool m_pool;
 
-    // true if any remote added a watch
-    bool m_findByHash = false;
+    // txid to the connections that watch it
+    SubscriptionIndex m_index;
 
     CTxMemPool *m_mempool = nullptr;
 };
@@ -145,8 +145,9 @@ enum MessageIds {
     IsUnspent,
     IsUnspentReply,
     GetUnspentOutput,
-    GetUnspentOutputReply
-
+    GetUnspentOutputReply,
+    SendTransactions,
+    SendTransactionsReply
 };
 enum Tags {
     Separator = Api::Separator,
@@ -159,7 +160,8 @@ enum Tags {
     Transaction = 20,
     OutIndex,
     UnspentState, // bool
-    OutputScript
+    OutputScript,
+    RejectReason // string
 };
 }
 
@@ -251,6 +253,12 @@ enum Tags {
 // Hub Control Service
 namespace Hub {
 enum MessageIds {
+    GetValidationStatistics,
+    GetValidationStatisticsReply,
+    GetNotificationStatistics,
+    GetNotificationStatisticsReply,
+    GetCompressionStatistics,
+    GetCompressionStatisticsReply,
 //   == Network ==
 //   addnode "node" "add|remove|onetry"
 //   clearbanned
@@ -271,6 +279,39 @@ enum Tags {
     Separator = Api::Separator,
     GenericByteData = Api::GenericByteData,
 
+    // GetValidationStatisticsReply tags. All times are in microseconds.
+    // Every stage starts with a ValidationStage tag and ends with a Separator.
+    ValidationStage = 20,   ///< int. The Validation::Statistics::Stage the tags that follow describe.
+    StageName,              ///< string.
+    Count,                  ///< long. The amount of measurements.
+    TotalTime,              ///< long.
+    MaxTime,                ///< long.
+    HistogramBucket,        ///< long. Repeated. Bucket n counts durations between 2^(n-1) and 2^n.
+
+    BlocksValidated = 40,   ///< long.
+    TransactionsValidated,  ///< long.
+    UtxoLookups,            ///< long.
+    UtxoLookupsPerSecond,   ///< double.
+    SigChecks,              ///< long.
+    SigChecksPerSecond,     ///< double.
+    ChunkImbalanceTime,     ///< long.
+
+    // GetNotificationStatisticsReply tags.
+    // Every service starts with a ServiceName tag and ends with a Separator,
+    // TotalTime and MaxTime are used as well.
+    ServiceName = 60,       ///< string.
+    Backlog,                ///< int. Blocks waiting to be handled by the service.
+    MaxBacklog,             ///< int.
+    BlocksDelivered,        ///< long.
+
+    // GetCompressionStatisticsReply tags. All times are in microseconds.
+    // Every service starts with a NetworkServiceId tag and ends with a Separator.
+    NetworkServiceId = 80,  ///< int. The Api::ServiceIds the tags that follow describe.
+    MessagesCompressed,     ///< long.
+    MessagesDecompressed,   ///< long.
+    BytesSaved,             ///< long. Sent plus received.
+    CompressTime,           ///< long.
+    DecompressTime,         ///< long.
 };
 }
 
@@ -27,6 +27,22 @@ enum HeaderTags {
     LastInSequence = 4,  ///< bool. If present indicates its part of a sequence. If true, last in sequence.
     Ping = 5,
     Pong = 6,
+    /**
+     * int. The body of this message is not in this packet but follows it
+     * on the stream as one frame of the indicated size.
+     * Only sent to peers that announced LargeFramesSupported.
+     */
+    LargeFrameSize = 7,
+    /// bool. A SystemServiceId message that announces the peer accepts LargeFrameSize messages.
+    LargeFramesSupported = 8,
+    /// bool. A SystemServiceId message that announces the peer accepts Lz4 compressed message bodies.
+    CompressionSupported = 9,
+    /**
+     * int. The body of this message is Lz4 compressed, the value is the uncompressed size.
+     * For chunked messages the compression covers the combined body.
+     * Only sent to peers that announced CompressionSupported.
+     */
+    CompressedSize = 10,
 };
 
 enum ServiceTypes {
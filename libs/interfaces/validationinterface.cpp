@@ -45,6 +45,15 @@ void ValidationInterfaceBroadcaster::SyncAllTransactionsInBlock(const FastBlock
     for (auto i : m_listeners) i->SyncAllTransactionsInBlock(block, index);
 }
 
+bool ValidationInterfaceBroadcaster::NeedsOldBlock() const
+{
+    for (auto i : m_listeners) {
+        if (i->NeedsOldBlock())
+            return true;
+    }
+    return false;
+}
+
 void ValidationInterfaceBroadcaster::SetBestChain(const CBlockLocator &locator)
 {
     for (auto i : m_listeners) i->SetBestChain(locator);
@@ -45,6 +45,12 @@ public:
     /** Notifies listeners of updated transaction data, on a new accepted block. */
     virtual void SyncAllTransactionsInBlock(const CBlock *pblock) {}
 
+    /**
+     * Return true if this listener implements SyncAllTransactionsInBlock(const CBlock*).
+     * Creating a CBlock is expensive, it is skipped if no listener needs it.
+     */
+    virtual bool NeedsOldBlock() const { return false; }
+
     /** Notifies listeners of updated transaction data, on a new accepted block. */
     virtual void SyncAllTransactionsInBlock(const FastBlock &, CBlockIndex *) {}
 
@@ -83,6 +89,7 @@ public:
     void SyncTx(const Tx &) override;
     void SyncAllTransactionsInBlock(const CBlock *pblock) override;
     void SyncAllTransactionsInBlock(const FastBlock &block, CBlockIndex *index) override;
+    bool NeedsOldBlock() const override;
     void SetBestChain(const CBlockLocator &locator) override;
     void UpdatedTransaction(const uint256 &hash) override;
     void Inventory(const uint256 &hash) override;
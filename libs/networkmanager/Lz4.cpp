@@ -0,0 +1,186 @@
+/*
+ * This file is part of the Flowee project
+ * Copyright (C) 2020 Tom Zander <tomz@freedommail.ch>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "Lz4.h"
+
+#include <cstdint>
+#include <cstring>
+
+namespace {
+constexpr int MinMatch = 4;
+constexpr int LastLiterals = 5; // the last 5 bytes of a block are always literals
+constexpr int MatchFindLimit = 12; // the last match starts at least 12 bytes before the end
+constexpr int MaxOffset = 0xFFFF;
+constexpr int HashLog = 12;
+
+inline uint32_t read32(const uint8_t *p) {
+    uint32_t answer;
+    memcpy(&answer, p, 4);
+    return answer;
+}
+
+inline uint32_t hash(uint32_t sequence) {
+    return (sequence * 2654435761U) >> (32 - HashLog);
+}
+
+// writes the 255-byte continuation of a length that didn't fit in the token.
+inline uint8_t *writeLength(uint8_t *out, int length) {
+    while (length >= 255) {
+        *out++ = 255;
+        length -= 255;
+    }
+    *out++ = static_cast<uint8_t>(length);
+    return out;
+}
+
+// reads the 255-byte continuation of a length, returns false on malformed input.
+inline bool readLength(const uint8_t *&in, const uint8_t *end, int &length, int limit) {
+    uint8_t byte;
+    do {
+        if (in >= end)
+            return false;
+        byte = *in++;
+        length += byte;
+        if (length > limit)
+            return false;
+    } while (byte == 255);
+    return true;
+}
+}
+
+int Lz4::compress(const char *input, int inputSize, char *output, int outputCapacity)
+{
+    const uint8_t *const begin = reinterpret_cast<const uint8_t*>(input);
+    const uint8_t *const end = begin + inputSize;
+    const uint8_t *const matchStartLimit = end - MatchFindLimit;
+    const uint8_t *const matchEndLimit = end - LastLiterals;
+    uint8_t *op = reinterpret_cast<uint8_t*>(output);
+    uint8_t *const outEnd = op + outputCapacity;
+
+    const uint8_t *anchor = begin; // start of the literals not yet written
+    if (inputSize > MatchFindLimit) {
+        int32_t table[1 << HashLog];
+        memset(table, 0xFF, sizeof(table)); // all -1
+
+        const uint8_t *ip = begin;
+        while (ip < matchStartLimit) {
+            const uint32_t sequence = read32(ip);
+            const uint32_t h = hash(sequence);
+            const int32_t candidate = table[h];
+            table[h] = static_cast<int32_t>(ip - begin);
+            if (candidate < 0 || ip - (begin + candidate) > MaxOffset || read32(begin + candidate) != sequence) {
+                // skip faster through data that doesn't compress.
+                ip += 1 + ((ip - anchor) >> 6);
+                continue;
+            }
+            const uint8_t *match = begin + candidate;
+            while (ip > anchor && match > begin && ip[-1] == match[-1]) {
+                --ip;
+                --match;
+            }
+            int matchLength = MinMatch;
+            while (ip + matchLength < matchEndLimit && ip[matchLength] == match[matchLength])
+                ++matchLength;
+
+            const int literals = static_cast<int>(ip - anchor);
+            if (op + 1 + literals / 255 + 1 + literals + 2 + (matchLength - MinMatch) / 255 + 1 > outEnd)
+                return 0;
+            uint8_t *token = op++;
+            if (literals >= 15) {
+                *token = 15 << 4;
+                op = writeLength(op, literals - 15);
+            } else {
+                *token = static_cast<uint8_t>(literals << 4);
+            }
+            memcpy(op, anchor, static_cast<size_t>(literals));
+            op += literals;
+            const int offset = static_cast<int>(ip - match);
+            *op++ = static_cast<uint8_t>(offset & 0xFF);
+            *op++ = static_cast<uint8_t>(offset >> 8);
+            const int extraLength = matchLength - MinMatch;
+            if (extraLength >= 15) {
+                *token |= 15;
+                op = writeLength(op, extraLength - 15);
+            } else {
+                *token |= static_cast<uint8_t>(extraLength);
+            }
+
+            ip += matchLength;
+            anchor = ip;
+            if (ip < matchStartLimit) // remember a position inside the match to improve the ratio
+                table[hash(read32(ip - 2))] = static_cast<int32_t>(ip - 2 - begin);
+        }
+    }
+
+    const int literals = static_cast<int>(end - anchor);
+    if (op + 1 + literals / 255 + 1 + literals > outEnd)
+        return 0;
+    if (literals >= 15) {
+        *op++ = 15 << 4;
+        op = writeLength(op, literals - 15);
+    } else {
+        *op++ = static_cast<uint8_t>(literals << 4);
+    }
+    memcpy(op, anchor, static_cast<size_t>(literals));
+    op += literals;
+    return static_cast<int>(op - reinterpret_cast<uint8_t*>(output));
+}
+
+int Lz4::decompress(const char *input, int inputSize, char *output, int outputCapacity)
+{
+    const uint8_t *ip = reinterpret_cast<const uint8_t*>(input);
+    const uint8_t *const end = ip + inputSize;
+    uint8_t *const outBegin = reinterpret_cast<uint8_t*>(output);
+    uint8_t *op = outBegin;
+    uint8_t *const outEnd = op + outputCapacity;
+
+    while (ip < end) {
+        const uint8_t token = *ip++;
+        int literals = token >> 4;
+        if (literals == 15 && !readLength(ip, end, literals, outputCapacity))
+            return -1;
+        if (literals > end - ip || literals > outEnd - op)
+            return -1;
+        memcpy(op, ip, static_cast<size_t>(literals));
+        ip += literals;
+        op += literals;
+        if (ip == end) // the last sequence has only literals
+            break;
+
+        if (end - ip < 2)
+            return -1;
+        const int offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > op - outBegin)
+            return -1;
+        int matchLength = token & 15;
+        if (matchLength == 15 && !readLength(ip, end, matchLength, outputCapacity))
+            return -1;
+        matchLength += MinMatch;
+        if (matchLength > outEnd - op)
+            return -1;
+        const uint8_t *match = op - offset;
+        if (offset >= matchLength) {
+            memcpy(op, match, static_cast<size_t>(matchLength));
+            op += matchLength;
+        } else { // overlapping copy, repeats the pattern
+            for (int i = 0; i < matchLength; ++i)
+                *op++ = *match++;
+        }
+    }
+    return static_cast<int>(op - outBegin);
+}
@@ -0,0 +1,49 @@
+/*
+ * This file is part of the Flowee project
+ * Copyright (C) 2020 Tom Zander <tomz@freedommail.ch>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef LZ4_H
+#define LZ4_H
+
+/**
+ * A small implementation of the LZ4 block format, used to compress message bodies.
+ *
+ * The data follows the LZ4 block format specification, which allows peers
+ * in other languages to use a standard library instead.
+ * The compressor is a simple greedy one, optimized for speed over ratio.
+ */
+namespace Lz4
+{
+/// Returns the maximum size compress() may need for an input of \a inputSize bytes.
+inline int compressBound(int inputSize) {
+    return inputSize + inputSize / 255 + 16;
+}
+
+/**
+ * Compress \a inputSize bytes from \a input into \a output.
+ * @returns the amount of bytes written to output, or zero if the result would not fit in \a outputCapacity.
+ */
+int compress(const char *input, int inputSize, char *output, int outputCapacity);
+
+/**
+ * Decompress \a inputSize bytes from \a input into \a output.
+ * This method is safe to use on untrusted data, it never reads or writes outside of the buffers passed in.
+ * @returns the amount of bytes written to output, or -1 if the input is malformed or does not fit.
+ */
+int decompress(const char *input, int inputSize, char *output, int outputCapacity);
+}
+
+#endif
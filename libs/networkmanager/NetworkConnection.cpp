@@ -238,3 +238,24 @@ void NetworkConnection::setMessageQueueSizes(int main, int priority)
     if (d)
         d->setMessageQueueSizes(static_cast<short>(main), static_cast<short>(priority));
 }
+
+std::vector<CompressionStatistics> NetworkConnection::compressionStatistics() const
+{
+    auto d = m_parent.lock();
+    if (d)
+        return d->compressionStatistics();
+    return std::vector<CompressionStatistics>();
+}
+
+void CompressionStatistics::add(const CompressionStatistics &other)
+{
+    messagesCompressed += other.messagesCompressed;
+    messagesNotCompressible += other.messagesNotCompressible;
+    bytesBeforeCompression += other.bytesBeforeCompression;
+    bytesAfterCompression += other.bytesAfterCompression;
+    compressTime += other.compressTime;
+    messagesDecompressed += other.messagesDecompressed;
+    bytesBeforeDecompression += other.bytesBeforeDecompression;
+    bytesAfterDecompression += other.bytesAfterDecompression;
+    decompressTime += other.decompressTime;
+}
@@ -22,11 +22,40 @@
 
 #include <memory>
 #include <functional>
+#include <cstdint>
+#include <vector>
 
 class NetworkManager;
 class NetworkManagerConnection;
 class Message;
 
+/**
+ * Statistics on the compression of message bodies for one service.
+ * All times are in microseconds.
+ * @see NetworkManager::setCompressionEnabled()
+ */
+struct CompressionStatistics
+{
+    int serviceId = -1;
+    uint64_t messagesCompressed = 0;
+    uint64_t messagesNotCompressible = 0; ///< messages where compression did not save enough to be used.
+    uint64_t bytesBeforeCompression = 0;
+    uint64_t bytesAfterCompression = 0;
+    uint64_t compressTime = 0; ///< includes the time spent on messages that turned out to be not compressible.
+    uint64_t messagesDecompressed = 0;
+    uint64_t bytesBeforeDecompression = 0;
+    uint64_t bytesAfterDecompression = 0;
+    uint64_t decompressTime = 0;
+
+    /// the amount of bytes that did not have to be sent or received thanks to compression.
+    inline int64_t bytesSaved() const {
+        return static_cast<int64_t>(bytesBeforeCompression - bytesAfterCompression)
+                + static_cast<int64_t>(bytesAfterDecompression - bytesBeforeDecompression);
+    }
+
+    void add(const CompressionStatistics &other);
+};
+
 /**
  * An instance gives access to a client-server connection.
  * The NetworkManager has getters to create NetworkConnection instances, once
@@ -180,6 +209,12 @@ public:
      */
     void setMessageQueueSizes(int main, int priority);
 
+    /**
+     * Returns the compression statistics of this connection, one item per service that
+     * sent or received compressed messages.
+     */
+    std::vector<CompressionStatistics> compressionStatistics() const;
+
 private:
     NetworkConnection(const NetworkConnection&);
     NetworkConnection& operator=(NetworkConnection&);
@@ -19,6 +19,7 @@
 #include "NetworkManager_p.h"
 #include "NetworkQueueFullError.h"
 #include "NetworkServiceBase.h"
+#include "Lz4.h"
 #include <NetworkEnums.h>
 #include <APIProtocol.h>
 
@@ -28,6 +29,7 @@
 #include <boost/lexical_cast.hpp>
 #include <boost/make_shared.hpp>
 
+#include <chrono>
 #include <fstream>
 
 // #define DEBUG_CONNECTIONS
@@ -35,6 +37,7 @@
 constexpr int RECEIVE_STREAM_SIZE = 200000;
 constexpr int CHUNK_SIZE = 8000;
 constexpr int MAX_MESSAGE_SIZE = 9000;
+constexpr int MAX_LARGE_FRAME_SIZE = 64 * 1024 * 1024;
 constexpr int LEGACY_HEADER_SIZE = 24;
 
 namespace {
@@ -45,6 +48,11 @@ inline Streaming::BufferPool &pool(int reserveSize) {
     return m_buffer;
 }
 
+// The Lz4 block format can not expand data more than 255 times, a larger uncompressed size is bogus.
+inline bool isPlausibleCompression(int uncompressedSize, int compressedSize) {
+    return static_cast<int64_t>(uncompressedSize) <= static_cast<int64_t>(compressedSize) * 255 + 16;
+}
+
 int reconnectTimeoutForStep(short step) {
     if (step < 5)
         return step*step*step / 2;
@@ -62,6 +70,40 @@ Message buildPingMessage(bool outgoingConnection) {
     return builder.message();
 }
 
+Message buildFeaturesMessage(bool largeFrames, bool compression) {
+    Streaming::MessageBuilder builder(Streaming::HeaderOnly, 14);
+    builder.add(Network::ServiceId, Network::SystemServiceId);
+    if (largeFrames)
+        builder.add(Network::LargeFramesSupported, true);
+    if (compression)
+        builder.add(Network::CompressionSupported, true);
+    builder.add(Network::HeaderEnd, true);
+    return builder.message();
+}
+
+inline uint64_t microsecondsSince(std::chrono::steady_clock::time_point start) {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - start).count());
+}
+
+std::vector<CompressionStatistics> toList(const std::map<int, CompressionStatistics> &statistics) {
+    std::vector<CompressionStatistics> answer;
+    answer.reserve(statistics.size());
+    for (auto iter = statistics.begin(); iter != statistics.end(); ++iter) {
+        answer.push_back(iter->second);
+    }
+    return answer;
+}
+
+void addTo(std::map<int, CompressionStatistics> &statistics, int serviceId, const CompressionStatistics &stats) {
+    auto iter = statistics.find(serviceId);
+    if (iter == statistics.end()) {
+        iter = statistics.insert(std::make_pair(serviceId, CompressionStatistics())).first;
+        iter->second.serviceId = serviceId;
+    }
+    iter->second.add(stats);
+}
+
 }
 
 
@@ -195,6 +237,28 @@ void NetworkManager::setLegacyNetworkId(const std::vector<uint8_t> &magic)
         d->networkId[i] = magic[i];
 }
 
+void NetworkManager::setLargeFramesEnabled(bool on)
+{
+    d->largeFramesEnabled = on;
+}
+
+void NetworkManager::setCompressionEnabled(bool on)
+{
+    d->compressionEnabled = on;
+}
+
+void NetworkManager::setCompressionThreshold(int bytes)
+{
+    assert(bytes >= 0);
+    d->compressionThreshold = bytes;
+}
+
+std::vector<CompressionStatistics> NetworkManager::compressionStatistics() const
+{
+    std::lock_guard<std::mutex> lock(d->statisticsLock);
+    return toList(d->compressionStatistics);
+}
+
 std::weak_ptr<NetworkManagerPrivate> NetworkManager::priv()
 {
     return d;
@@ -277,7 +341,8 @@ NetworkManagerConnection::NetworkManagerConnection(const std::shared_ptr<Network
     m_reconnectDelay(parent->ioService),
     m_pingTimer(parent->ioService),
     m_sendTimer(parent->ioService),
-    m_chunkedMessageBuffer(0)
+    m_chunkedMessageBuffer(0),
+    m_peerAcceptsCompression(false)
 {
     m_remote.ipAddress = m_socket.remote_endpoint().address();
     m_remote.announcePort = m_socket.remote_endpoint().port();
@@ -298,7 +363,8 @@ NetworkManagerConnection::NetworkManagerConnection(const std::shared_ptr<Network
     m_isConnected(false),
     m_reconnectDelay(parent->ioService),
     m_pingTimer(parent->ioService),
-    m_sendTimer(parent->ioService)
+    m_sendTimer(parent->ioService),
+    m_peerAcceptsCompression(false)
 {
     if (m_remote.peerPort == 0)
         m_remote.peerPort = m_remote.announcePort;
@@ -380,6 +446,7 @@ void NetworkManagerConnection::onConnectComplete(const boost::system::error_code
     m_isConnected = true;
     assert(m_strand.running_in_this_thread());
     logInfo(Log::NWM) << "Successfully made TCP connection to" << m_remote.hostname.c_str() << m_remote.announcePort;
+    announceFeatures();
 
     for (auto it = m_onConnectedCallbacks.begin(); it != m_onConnectedCallbacks.end(); ++it) {
         try {
@@ -449,6 +516,26 @@ Streaming::ConstBuffer NetworkManagerConnection::createHeader(const Message &mes
     }
 }
 
+Streaming::ConstBuffer NetworkManagerConnection::createLargeFrameHeader(const Message &message)
+{
+    assert(message.serviceId() >= 0);
+    assert(message.serviceId() != Api::LegacyP2P);
+    assert(!message.hasHeader());
+    const auto headerData = message.headerData();
+    auto &sendHelperBuffer = pool(20 + 8 * static_cast<int>(headerData.size()));
+    Streaming::MessageBuilder builder(sendHelperBuffer, Streaming::HeaderOnly);
+    builder.add(Network::ServiceId, message.serviceId());
+    for (auto iter = headerData.begin(); iter != headerData.end(); ++iter) {
+        if (iter->first == Network::ServiceId) // forced to be first.
+            continue;
+        builder.add(static_cast<uint32_t>(iter->first), iter->second);
+    }
+    builder.add(Network::LargeFrameSize, message.body().size());
+    builder.add(Network::HeaderEnd, true);
+    builder.setMessageSize(sendHelperBuffer.size());
+    return builder.buffer();
+}
+
 void NetworkManagerConnection::errorDetected(const boost::system::error_code &error)
 {
     if (error == boost::asio::error::operation_aborted || !error) // no need to push those up the stack
@@ -517,7 +604,23 @@ void NetworkManagerConnection::runMessageQueue()
         if (m_sendQHeaders->isFull())
             break;
         const Message &message = m_messageQueue->unreadTip();
-        if (message.rawData().size() > CHUNK_SIZE && message.serviceId() != Api::LegacyP2P) {
+        if (m_peerAcceptsLargeFrames && m_messageBytesSend == 0
+                && message.rawData().size() > CHUNK_SIZE && message.serviceId() != Api::LegacyP2P) {
+            assert(!message.hasHeader()); // should have been blocked from entering in queueMessage();
+            /*
+             * The peer accepts large frames, we send a header-only packet announcing the size of the
+             * body and then the body itself, straight from the message buffer.
+             */
+            const Streaming::ConstBuffer header = createLargeFrameHeader(message);
+            bytesLeft -= header.size();
+            socketQueue.push_back(header);
+            m_sendQHeaders->append(header);
+
+            socketQueue.push_back(message.body());
+            bytesLeft -= message.body().size();
+            m_messageQueue->markRead();
+        }
+        else if (message.rawData().size() > CHUNK_SIZE && message.serviceId() != Api::LegacyP2P) {
             assert(!message.hasHeader()); // should have been blocked from entering in queueMessage();
 
             /*
@@ -714,11 +817,68 @@ void NetworkManagerConnection::receivedSomeBytes(const boost::system::error_code
             if (!processPacket(m_receiveStream.internal_buffer(), data.begin()))
                 return;
             m_receiveStream.forget(packetLength);
+            if (m_largeFrameRemaining > 0 && !receiveLargeFrame())
+                return;
         }
     }
     requestMoreBytes_callback(boost::system::error_code());
 }
 
+bool NetworkManagerConnection::receiveLargeFrame()
+{
+    assert(m_strand.running_in_this_thread());
+    assert(m_largeFrameRemaining > 0);
+    // the start of the body may already have been received.
+    const int available = std::min(m_receiveStream.size(), m_largeFrameRemaining);
+    if (available > 0) {
+        memcpy(m_chunkedMessageBuffer.data(), m_receiveStream.begin(), static_cast<size_t>(available));
+        m_chunkedMessageBuffer.markUsed(available);
+        m_receiveStream.forget(available);
+        m_largeFrameRemaining -= available;
+    }
+    if (m_largeFrameRemaining > 0) {
+        // read the rest directly into the target buffer.
+        boost::asio::async_read(m_socket, boost::asio::buffer(m_chunkedMessageBuffer.data(),
+                                                              static_cast<size_t>(m_largeFrameRemaining)),
+                m_strand.wrap(std::bind(&NetworkManagerConnection::receivedLargeFrame, shared_from_this(),
+                                        std::placeholders::_1, std::placeholders::_2)));
+        return false;
+    }
+
+    Message message(m_chunkedMessageBuffer.commit(), m_chunkedServiceId);
+    message.setMessageId(m_chunkedMessageId);
+    for (auto iter = m_chunkedHeaderData.begin(); iter != m_chunkedHeaderData.end(); ++iter) {
+        message.setHeaderInt(iter->first, iter->second);
+    }
+    message.remote = m_remote.connectionId;
+    const int compressedSize = m_chunkedCompressedSize;
+    m_chunkedMessageId = -1;
+    m_chunkedServiceId = -1;
+    m_chunkedCompressedSize = -1;
+    m_chunkedHeaderData.clear();
+    m_chunkedMessageBuffer.clear();
+    if (compressedSize != -1 && !decompress(message, compressedSize))
+        return false;
+    return deliverMessage(message);
+}
+
+void NetworkManagerConnection::receivedLargeFrame(const boost::system::error_code &error, std::size_t bytes_transferred)
+{
+    if (m_isClosingDown)
+        return;
+    if (error) {
+        receivedSomeBytes(error, 0); // handles the disconnect
+        return;
+    }
+    assert(m_strand.running_in_this_thread());
+    assert(static_cast<int>(bytes_transferred) == m_largeFrameRemaining);
+    m_chunkedMessageBuffer.markUsed(static_cast<int>(bytes_transferred));
+    m_largeFrameRemaining = 0;
+    if (!receiveLargeFrame())
+        return;
+    receivedSomeBytes(error, 0); // process what is left in the receive-stream and continue receiving.
+}
+
 /*
  * when we generate more messages than can be sent, we start throttling the incoming
  * message flow. The basic thought is that more incoming messages means more outgoing
@@ -771,7 +931,11 @@ bool NetworkManagerConnection::processPacket(const std::shared_ptr<char> &buffer
     int serviceId = -1;
     int lastInSequence = -1;
     int sequenceSize = -1;
+    int largeFrameSize = -1;
+    int compressedSize = -1;
     bool isPing = false;
+    bool largeFramesSupported = false;
+    bool compressionSupported = false;
     // TODO have a variable on the NetworkManger that indicates the maximum allowed combined message-size.
 
     std::map<int, int> messageHeaderData;
@@ -810,9 +974,29 @@ bool NetworkManagerConnection::processPacket(const std::shared_ptr<char> &buffer
             }
             sequenceSize = parser.intData();
             break;
+        case Network::LargeFrameSize:
+            if (!parser.isInt()) {
+                close();
+                return false;
+            }
+            largeFrameSize = parser.intData();
+            break;
+        case Network::CompressedSize:
+            if (!parser.isInt()) {
+                close();
+                return false;
+            }
+            compressedSize = parser.intData();
+            break;
         case Network::Ping:
             isPing = true;
             break;
+        case Network::LargeFramesSupported:
+            largeFramesSupported = true;
+            break;
+        case Network::CompressionSupported:
+            compressionSupported = true;
+            break;
         default:
             if (parser.isInt() && parser.tag() < 0xFFFFFF) {
                 if (parser.tag() <= 10) { // illegal header tag for users.
@@ -840,6 +1024,14 @@ bool NetworkManagerConnection::processPacket(const std::shared_ptr<char> &buffer
     }
 
     if (serviceId == Network::SystemServiceId) { // Handle System level messages
+        if (largeFramesSupported) {
+            logDebug(Log::NWM) << "Peer accepts large frames";
+            m_peerAcceptsLargeFrames = true;
+        }
+        if (compressionSupported) {
+            logDebug(Log::NWM) << "Peer accepts compressed messages";
+            m_peerAcceptsCompression = true;
+        }
         if (isPing) {
             if (m_remote.peerPort == m_remote.announcePort) {
                 // we should never get pings from a remote when we initiated the connection.
@@ -856,6 +1048,45 @@ bool NetworkManagerConnection::processPacket(const std::shared_ptr<char> &buffer
         return true;
     }
 
+    if (compressedSize != -1 && (!d->compressionEnabled || compressedSize <= 0
+                                 || compressedSize > MAX_LARGE_FRAME_SIZE)) {
+        logWarning(Log::NWM) << "peer sent an unacceptable compressed message. Size:" << compressedSize;
+        close();
+        return false;
+    }
+    if (compressedSize != -1) {
+        // check before we allocate the uncompressed size, the body can't be more than this small.
+        int bodySize = packetLength - headerSize - 2;
+        if (largeFrameSize != -1)
+            bodySize = largeFrameSize;
+        else if (sequenceSize != -1)
+            bodySize = sequenceSize;
+        if (!isPlausibleCompression(compressedSize, bodySize)) {
+            logWarning(Log::NWM) << "peer sent a compressed message with an impossible size:" << compressedSize
+                                 << "body:" << bodySize;
+            close();
+            return false;
+        }
+    }
+
+    if (largeFrameSize != -1) {
+        if (!d->largeFramesEnabled || largeFrameSize <= 0 || largeFrameSize > MAX_LARGE_FRAME_SIZE
+                || lastInSequence != -1 || m_chunkedServiceId != -1) {
+            logWarning(Log::NWM) << "peer sent an unacceptable large frame. Size:" << largeFrameSize;
+            close();
+            return false;
+        }
+        logDebug(Log::NWM) << "Large frame announced, size:" << largeFrameSize;
+        // The body follows this packet, receivedSomeBytes() continues with receiveLargeFrame()
+        m_chunkedMessageId = messageId;
+        m_chunkedServiceId = serviceId;
+        m_chunkedHeaderData = messageHeaderData;
+        m_chunkedCompressedSize = compressedSize;
+        m_chunkedMessageBuffer = Streaming::BufferPool(largeFrameSize);
+        m_largeFrameRemaining = largeFrameSize;
+        return true;
+    }
+
     Message message;
     // we assume they are in sequence (which is Ok with TCP sockets), but we don't assume that
     // each packet is part of the sequence.
@@ -870,6 +1101,7 @@ bool NetworkManagerConnection::processPacket(const std::shared_ptr<char> &buffer
             m_chunkedServiceId = serviceId;
             m_chunkedMessageBuffer = Streaming::BufferPool(sequenceSize);
             m_chunkedHeaderData = messageHeaderData;
+            m_chunkedCompressedSize = compressedSize;
         }
         else if (m_chunkedMessageId != messageId || m_chunkedServiceId != serviceId) { // Changed. Thats illegal.
             close();
@@ -891,8 +1123,10 @@ bool NetworkManagerConnection::processPacket(const std::shared_ptr<char> &buffer
 
         message = Message(m_chunkedMessageBuffer.commit(), m_chunkedServiceId);
         messageHeaderData = m_chunkedHeaderData;
+        compressedSize = m_chunkedCompressedSize;
         m_chunkedMessageId = -1;
         m_chunkedServiceId = -1;
+        m_chunkedCompressedSize = -1;
         m_chunkedMessageBuffer.clear();
     }
     else {
@@ -904,7 +1138,13 @@ bool NetworkManagerConnection::processPacket(const std::shared_ptr<char> &buffer
         message.setHeaderInt(iter->first, iter->second);
     }
     message.remote = m_remote.connectionId;
+    if (compressedSize != -1 && !decompress(message, compressedSize))
+        return false;
+    return deliverMessage(message);
+}
 
+bool NetworkManagerConnection::deliverMessage(const Message &message)
+{
     // first copy to avoid problems if a callback removes its callback or closes the connection.
     std::vector<std::function<void(const Message&)> > callbacks;
     callbacks.reserve(m_onIncomingMessageCallbacks.size());
@@ -931,7 +1171,7 @@ bool NetworkManagerConnection::processPacket(const std::shared_ptr<char> &buffer
     for (auto service : servicesCopy) {
         if (!m_socket.is_open())
             break;
-        if (service->id() == serviceId) {
+        if (service->id() == message.serviceId()) {
             try {
                 service->onIncomingMessage(message, m_remote);
             } catch (const std::exception &ex) {
@@ -1023,6 +1263,18 @@ void NetworkManagerConnection::queueMessage(const Message &message, NetworkConne
     if (message.headerData().size() > 95)
         NetworkException("queueMessage: Can't send message with too much header items");
 
+    if (m_peerAcceptsCompression && d->compressionEnabled && !message.hasHeader()
+            && message.serviceId() != Api::LegacyP2P && message.serviceId() != Network::SystemServiceId
+            && message.body().size() >= d->compressionThreshold
+            && message.headerInt(Network::CompressedSize) == -1) {
+        // compress in the thread of the caller, not on the strand.
+        Message compressed;
+        if (compress(message, compressed)) {
+            queueMessage(compressed, priority);
+            return;
+        }
+    }
+
     if (m_strand.running_in_this_thread()) {
         allocateBuffers();
         if (priority == NetworkConnection::NormalPriority) {
@@ -1060,6 +1312,10 @@ void NetworkManagerConnection::close(bool reconnect)
     m_chunkedMessageId = -1;
     m_chunkedServiceId = -1;
     m_chunkedHeaderData.clear();
+    m_chunkedCompressedSize = -1;
+    m_largeFrameRemaining = 0;
+    m_peerAcceptsLargeFrames = false;
+    m_peerAcceptsCompression = false;
     m_messageBytesSend = 0;
     m_messageBytesSent = 0;
     m_reconnectDelay.cancel();
@@ -1126,6 +1382,94 @@ void NetworkManagerConnection::allocateBuffers()
     }
 }
 
+void NetworkManagerConnection::announceFeatures()
+{
+    assert(m_strand.running_in_this_thread());
+    if (m_messageHeaderType != FloweeNative || !(d->largeFramesEnabled || d->compressionEnabled))
+        return;
+    queueMessage(buildFeaturesMessage(d->largeFramesEnabled, d->compressionEnabled), NetworkConnection::HighPriority);
+}
+
+bool NetworkManagerConnection::compress(const Message &message, Message &compressed)
+{
+    const auto start = std::chrono::steady_clock::now();
+    const Streaming::ConstBuffer body = message.body();
+    // we require a saving of at least 1/16th, or its not worth the CPU time of the receiver.
+    const int capacity = body.size() - body.size() / 16;
+    auto &buffer = pool(capacity);
+    const int size = Lz4::compress(body.begin(), body.size(), buffer.data(), capacity);
+
+    CompressionStatistics stats;
+    if (size > 0) {
+        compressed = Message(buffer.commit(size), message.serviceId(), message.messageId());
+        const auto &headerData = message.headerData();
+        for (auto iter = headerData.begin(); iter != headerData.end(); ++iter) {
+            if (iter->first > 10)
+                compressed.setHeaderInt(iter->first, iter->second);
+        }
+        compressed.setCompressedSize(body.size());
+        stats.messagesCompressed = 1;
+        stats.bytesBeforeCompression = static_cast<uint64_t>(body.size());
+        stats.bytesAfterCompression = static_cast<uint64_t>(size);
+    } else {
+        stats.messagesNotCompressible = 1;
+    }
+    stats.compressTime = microsecondsSince(start);
+    addStatistics(message.serviceId(), stats);
+    return size > 0;
+}
+
+bool NetworkManagerConnection::decompress(Message &message, int uncompressedSize)
+{
+    assert(m_strand.running_in_this_thread());
+    const auto start = std::chrono::steady_clock::now();
+    const Streaming::ConstBuffer body = message.body();
+    if (!isPlausibleCompression(uncompressedSize, body.size())) {
+        logWarning(Log::NWM) << "peer sent a compressed message with an impossible size";
+        close();
+        return false;
+    }
+    Streaming::BufferPool buffer(uncompressedSize);
+    const int size = Lz4::decompress(body.begin(), body.size(), buffer.data(), uncompressedSize);
+    if (size != uncompressedSize) {
+        logWarning(Log::NWM) << "peer sent a malformed compressed message";
+        close();
+        return false;
+    }
+    Message answer(buffer.commit(size), message.serviceId(), message.messageId());
+    const auto &headerData = message.headerData();
+    for (auto iter = headerData.begin(); iter != headerData.end(); ++iter) {
+        if (iter->first > 10)
+            answer.setHeaderInt(iter->first, iter->second);
+    }
+    answer.remote = message.remote;
+
+    CompressionStatistics stats;
+    stats.messagesDecompressed = 1;
+    stats.bytesBeforeDecompression = static_cast<uint64_t>(body.size());
+    stats.bytesAfterDecompression = static_cast<uint64_t>(size);
+    stats.decompressTime = microsecondsSince(start);
+    addStatistics(message.serviceId(), stats);
+    message = answer;
+    return true;
+}
+
+void NetworkManagerConnection::addStatistics(int serviceId, const CompressionStatistics &stats)
+{
+    {
+        std::lock_guard<std::mutex> lock(m_statisticsLock);
+        addTo(m_compressionStatistics, serviceId, stats);
+    }
+    std::lock_guard<std::mutex> lock(d->statisticsLock);
+    addTo(d->compressionStatistics, serviceId, stats);
+}
+
+std::vector<CompressionStatistics> NetworkManagerConnection::compressionStatistics() const
+{
+    std::lock_guard<std::mutex> lock(m_statisticsLock);
+    return toList(m_compressionStatistics);
+}
+
 void NetworkManagerConnection::reconnectWithCheck(const boost::system::error_code& error)
 {
     if (!error) {
@@ -1178,6 +1522,8 @@ void NetworkManagerConnection::accept()
         m_strand.wrap(std::bind(&NetworkManagerConnection::receivedSomeBytes, shared_from_this(),
                                 std::placeholders::_1, std::placeholders::_2)));
 
+    runOnStrand(std::bind(&NetworkManagerConnection::announceFeatures, shared_from_this()));
+
     // for incoming connections, take action when no ping comes in.
     m_pingTimer.expires_from_now(boost::posix_time::seconds(120));
     m_pingTimer.async_wait(m_strand.wrap(std::bind(&NetworkManagerConnection::pingTimeout, this, std::placeholders::_1)));
@@ -1192,6 +1538,10 @@ void NetworkManagerConnection::recycleConnection()
     m_onErrorCallbacks.clear();
     setMessageQueueSizes(2000, 20); // set back to defaults.
     m_punishment = 0;
+    {
+        std::lock_guard<std::mutex> lock(m_statisticsLock);
+        m_compressionStatistics.clear();
+    }
     close(false);
     std::lock_guard<std::recursive_mutex> lock(d->mutex); // protects connections maps
     if (d->connections.erase(m_remote.connectionId))
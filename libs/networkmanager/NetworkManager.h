@@ -99,6 +99,31 @@ public:
      */
     void setLegacyNetworkId(const std::vector<uint8_t> &magic);
 
+    /**
+     * Large messages are by default sent as one large frame to peers that support it,
+     * instead of being split into chunks.
+     * Setting this to false makes new connections not announce support and always chunk.
+     */
+    void setLargeFramesEnabled(bool on);
+
+    /**
+     * Enables Lz4 compression of message bodies, which is off by default.
+     * Connections announce support when they connect, and only message bodies sent to a peer
+     * that announced support are compressed. Bodies smaller than the threshold are never compressed.
+     * This should be called before connections are made.
+     * @see setCompressionThreshold()
+     */
+    void setCompressionEnabled(bool on);
+
+    /// Set the minimum body size, in bytes, of a message we try to compress. Default is 1000.
+    void setCompressionThreshold(int bytes);
+
+    /**
+     * Returns the compression statistics of all connections made by this manager since its creation,
+     * one item per service that sent or received compressed messages.
+     */
+    std::vector<CompressionStatistics> compressionStatistics() const;
+
     std::weak_ptr<NetworkManagerPrivate> priv(); ///< \internal
 
 private:
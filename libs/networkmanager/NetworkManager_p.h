@@ -36,6 +36,7 @@
 #include <list>
 #include <deque>
 #include <atomic>
+#include <mutex>
 #include <boost/date_time/posix_time/ptime.hpp>
 #include <boost/asio.hpp>
 
@@ -233,6 +234,9 @@ public:
     }
     void close(bool reconnect = true); // close down connection
 
+    /// thread-safe
+    std::vector<CompressionStatistics> compressionStatistics() const;
+
     short m_punishment = 0; // aka ban-sore
     // used to check incoming messages being actually for us
     MessageHeaderType m_messageHeaderType = FloweeNative;
@@ -253,6 +257,11 @@ private:
     void receivedSomeBytes(const boost::system::error_code& error, std::size_t bytes_transferred);
 
     bool processPacket(const std::shared_ptr<char> &buffer, const char *data);
+    /// read the rest of a large frame, returns false if we are waiting for the network.
+    bool receiveLargeFrame();
+    void receivedLargeFrame(const boost::system::error_code& error, std::size_t bytes_transferred);
+    /// calls the message callbacks and services, returns false if the connection got closed.
+    bool deliverMessage(const Message &message);
     bool processLegacyPacket(const std::shared_ptr<char> &buffer, const char *data);
     void connect_priv(); // thread-unsafe version of connect
     void reconnectWithCheck(const boost::system::error_code& error); // called from the m_reconectDelay timer
@@ -260,12 +269,21 @@ private:
     void sendPing(const boost::system::error_code& error);
     void pingTimeout(const boost::system::error_code& error);
     void allocateBuffers();
+    /// tell the peer about the optional protocol features we support.
+    void announceFeatures();
+
+    /// Compresses the body of \a message into \a compressed, returns false if that is not worth it.
+    bool compress(const Message &message, Message &compressed);
+    /// Replaces the body of \a message with its decompressed version, returns false if the connection got closed.
+    bool decompress(Message &message, int uncompressedSize);
+    void addStatistics(int serviceId, const CompressionStatistics &stats);
 
     inline bool isOutgoing() const {
         return m_remote.announcePort == m_remote.peerPort;
     }
 
     Streaming::ConstBuffer createHeader(const Message &message);
+    Streaming::ConstBuffer createLargeFrameHeader(const Message &message);
 
     void errorDetected(const boost::system::error_code& error);
 
@@ -304,10 +322,18 @@ private:
     Message m_pingMessage;
 
     // chunked messages can be recombined.
+    // Large frames use the same buffer, but are received in one go.
     Streaming::BufferPool m_chunkedMessageBuffer;
     int m_chunkedServiceId = -1;
     int m_chunkedMessageId = -1;
     std::map<int, int> m_chunkedHeaderData;
+    int m_chunkedCompressedSize = -1; // the uncompressed size of a compressed chunked message or large frame
+    int m_largeFrameRemaining = 0; // bytes of the large frame still to be received
+    bool m_peerAcceptsLargeFrames = false;
+    std::atomic<bool> m_peerAcceptsCompression;
+
+    mutable std::mutex m_statisticsLock;
+    std::map<int, CompressionStatistics> m_compressionStatistics;
 };
 
 class NetworkManagerServer
@@ -365,6 +391,13 @@ public:
 
     // support for the p2p legacy envelope design
     uint8_t networkId[4] = { 0xE3, 0xE1, 0xF3, 0xE8};
+
+    bool largeFramesEnabled = true;
+    bool compressionEnabled = false;
+    int compressionThreshold = 1000;
+
+    mutable std::mutex statisticsLock; // protects compressionStatistics
+    std::map<int, CompressionStatistics> compressionStatistics;
     std::map<int, std::string> messageIds;
     std::map<std::string, int> messageIdsReverse;
 };
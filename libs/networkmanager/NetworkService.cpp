@@ -85,6 +85,7 @@ void NetworkService::onDisconnected(const EndPoint &endPoint)
     for (auto remote : remotes()) {
         if (remote->connection.endPoint().connectionId == endPoint.connectionId) {
             removeRemote(remote);
+            remoteDisconnected(remote);
             delete remote;
             return;
         }
@@ -96,6 +97,10 @@ NetworkService::Remote *NetworkService::createRemote()
     return new Remote();
 }
 
+void NetworkService::remoteDisconnected(Remote *)
+{
+}
+
 std::deque<NetworkService::Remote *> NetworkService::remotes() const
 {
     RemoteContainer *c;
@@ -63,6 +63,9 @@ protected:
     /// factory method, please return a subclass of Remote with your own data in it
     virtual Remote *createRemote();
 
+    /// called when the remote disconnected, just before it is deleted.
+    virtual void remoteDisconnected(Remote *remote);
+
     std::deque<Remote*> remotes() const;
 
 private:
@@ -18,6 +18,9 @@
 #include "BlocksDB.h"
 #include "UnspentOutputData.h"
 #include "chain.h"
+#include "compressor.h"
+
+#include <streaming/streams.h>
 
 #include <primitives/FastBlock.h>
 #include <primitives/FastTransaction.h>
@@ -29,18 +32,60 @@ UnspentOutputData::UnspentOutputData(const UnspentOutput &uo)
         return;
     assert(uo.offsetInBlock() > 80);
 
+    if (uo.hasOutputData()) { // the UTXO stored a copy, avoid reading the block.
+        try {
+            CScript script;
+            CDataStream stream(uo.outputScript().begin(), uo.outputScript().end(), SER_DISK, 0);
+            stream >> REF(CScriptCompressor(script));
+            if (!script.empty())
+                m_outputScript = Streaming::ConstBuffer::create(reinterpret_cast<const char*>(&script[0]), script.size());
+            m_outputValue = static_cast<std::int64_t>(CTxOutCompressor::DecompressAmount(uo.outputAmount()));
+            return;
+        } catch (const std::exception &e) {
+            logWarning() << "UTXO stored output data failed to parse, falling back to the block" << e.what();
+        }
+    }
+    loadFromBlock();
+}
+
+UnspentOutputDatabase::OutputData UnspentOutputData::createOutputData(Streaming::BufferPool &pool, int64_t amount, const Streaming::ConstBuffer &outputScript)
+{
+    assert(amount >= 0);
+    CScript script(outputScript);
+    CDataStream stream(SER_DISK, 0);
+    stream << CScriptCompressor(script);
+    pool.reserve(static_cast<int>(stream.size()));
+    memcpy(pool.begin(), &stream[0], stream.size());
+    return UnspentOutputDatabase::OutputData(CTxOutCompressor::CompressAmount(static_cast<uint64_t>(amount)),
+                                             pool.commit(static_cast<int>(stream.size())));
+}
+
+int UnspentOutputData::prevTxVersion() const
+{
+    if (m_txVer == -1 && m_uo.isValid()) {
+        // the output-data stored in the UTXO doesn't include the version.
+        UnspentOutputData copy;
+        copy.m_uo = m_uo;
+        copy.loadFromBlock();
+        m_txVer = copy.m_txVer;
+    }
+    return m_txVer;
+}
+
+void UnspentOutputData::loadFromBlock()
+{
     Blocks::DB *blockDb = Blocks::DB::instance();
-    auto blockIndex = blockDb->headerChain()[uo.blockHeight()];
+    auto blockIndex = blockDb->headerChain()[m_uo.blockHeight()];
     if (blockIndex == nullptr)
         return;
 
     auto block = blockDb->loadBlock(blockIndex->GetBlockPos());
     if (!block.isFullBlock())
         return;
-    assert(block.size() > uo.offsetInBlock());
+    assert(block.size() > m_uo.offsetInBlock());
 
     std::int64_t outputValue = -1;
-    Tx::Iterator iter(block, uo.offsetInBlock());
+    Tx::Iterator iter(block, m_uo.offsetInBlock());
     int outputs = 0;
     auto type = iter.next();
     while (type != Tx::End) {
@@ -27,8 +27,16 @@ public:
     UnspentOutputData(const UnspentOutput &uo);
     UnspentOutputData() = default;
 
+    /**
+     * Create the output data as stored in the UTXO leaf, for when the UTXO has
+     * the UnspentOutputDatabase::storesOutputData() enabled.
+     * This compresses the amount and the script to save space.
+     */
+    static UnspentOutputDatabase::OutputData createOutputData(Streaming::BufferPool &pool, int64_t amount,
+                                                              const Streaming::ConstBuffer &outputScript);
+
     inline bool isValid() const {
-        return m_uo.isValid() && m_txVer >= 0 && m_outputValue >= 0;
+        return m_uo.isValid() && m_outputValue >= 0;
     }
 
     inline uint256 prevTxId() const {
@@ -53,9 +61,8 @@ public:
         return m_uo.data();
     }
 
-    inline int prevTxVersion() const {
-        return m_txVer;
-    }
+    /// return the version of the transaction. Notice this may need to read the block.
+    int prevTxVersion() const;
     inline std::int64_t outputValue() const {
         return m_outputValue;
     }
@@ -71,8 +78,10 @@ public:
     }
 
 private:
+    void loadFromBlock();
+
     UnspentOutput m_uo;
-    int m_txVer = -1;
+    mutable int m_txVer = -1;
     std::int64_t m_outputValue = -1;
     Streaming::ConstBuffer m_outputScript;
 };
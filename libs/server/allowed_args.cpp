@@ -238,6 +238,7 @@ static void addGeneralOptions(AllowedArgs& allowedArgs, HelpMessageMode mode)
 #endif
         .addArg("reindex", optionalBool, _("Rebuild block chain index from current blk000??.dat files on startup"))
         .addArg("blockdatadir=<dir>", requiredStr, "List a fallback directory to find blocks/blk* files")
+        .addArg("utxostoreoutputs", optionalBool, strprintf(_("Store the amount and script of outputs in the UTXO, avoiding block-file reads during validation at the cost of a larger UTXO (default: %u)"), DefaultUtxoStoreOutputs))
         ;
 }
 
@@ -361,6 +362,7 @@ static void addDebuggingOptions(AllowedArgs& allowedArgs, HelpMessageMode)
         .addDebugArg("limitfreerelay=<n>", optionalInt, strprintf("Continuously rate-limit free transactions to <n>*1000 bytes per minute (default: %u)", DefaultLimitFreeRelay))
         .addDebugArg("relaypriority", optionalBool, strprintf("Require high priority for relaying free or low-fee transactions (default: %u)", DefaultRelayPriority))
         .addDebugArg("maxsigcachesize=<n>", requiredInt, strprintf("Limit size of signature cache to <n> MiB (default: %u)", DefaultMaxSigCacheSize))
+        .addDebugArg("batchschnorr", optionalBool, strprintf("Verify the Schnorr signatures of a block in batches (default: %u)", DefaultSchnorrBatchVerification))
         .addArg("printtoconsole", optionalBool, _("Send trace/debug info to console as well as to hub.log file"))
         .addDebugArg("printpriority", optionalBool, strprintf("Log transaction priority and fee per kB when mining blocks (default: %u)", DefaultGeneratePriorityLogging))
 #ifdef ENABLE_WALLET
@@ -424,7 +426,9 @@ static void addApiServerOptions(AllowedArgs& allowedArgs)
     allowedArgs
         .addHeader("Api server options:")
         .addArg("api", optionalBool, _("Accept API connections (default true)"))
-        .addArg("apilisten=<addr>", requiredStr, strprintf("Bind to given address to listen for api server connections. Use [host]:port notation for IPv6. This option can be specified multiple times (default 127.0.0.1:%s and [::1]:%s)", BaseParams(CBaseChainParams::MAIN).ApiServerPort(), BaseParams(CBaseChainParams::MAIN).ApiServerPort()));
+        .addArg("apilisten=<addr>", requiredStr, strprintf("Bind to given address to listen for api server connections. Use [host]:port notation for IPv6. This option can be specified multiple times (default 127.0.0.1:%s and [::1]:%s)", BaseParams(CBaseChainParams::MAIN).ApiServerPort(), BaseParams(CBaseChainParams::MAIN).ApiServerPort()))
+        .addArg("apicompression", optionalBool, strprintf("Compress large messages for API clients that support it (default: %u)", DefaultApiCompression))
+        .addArg("apiblockbacklog=<n>", requiredInt, strprintf("Maximum amount of new blocks queued for an API service before block scanning waits for it (default: %u)", DefaultApiBlockBacklog));
 }
 
 static void addUiOptions(AllowedArgs& allowedArgs)
@@ -828,6 +828,7 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
                     }
                 }
                 g_utxo = new UnspentOutputDatabase(Application::instance()->ioService(), utxoDir);
+                g_utxo->setStoreOutputData(GetBoolArg("-utxostoreoutputs", Settings::DefaultUtxoStoreOutputs));
                 mempool.setUtxo(g_utxo);
                 if (fReindex)
                     Blocks::DB::instance()->setReindexing(Blocks::ScanningFiles);
@@ -200,7 +200,7 @@ CBlockTemplate* Mining::CreateNewBlock(Validation::Engine &validationEngine) con
             {
                 double dPriority = mi->GetPriority(nHeight);
                 CAmount dummy;
-                mempool->ApplyDeltas(mi->GetTx().GetHash(), dPriority, dummy);
+                mempool->ApplyDeltas(mi->GetTxId(), dPriority, dummy);
                 vecPriority.push_back(TxCoinAgePriority(dPriority, mi));
             }
             std::make_heap(vecPriority.begin(), vecPriority.end(), pricomparer);
@@ -231,8 +231,6 @@ CBlockTemplate* Mining::CreateNewBlock(Validation::Engine &validationEngine) con
             if (inBlock.count(iter))
                 continue; // could have been added to the priorityBlock
 
-            const CTransaction& tx = iter->GetTx();
-
             bool fOrphan = false;
             for (CTxMemPool::txiter parent : mempool->GetMemPoolParents(iter)) {
                 if (!inBlock.count(parent)) {
@@ -270,6 +268,8 @@ CBlockTemplate* Mining::CreateNewBlock(Validation::Engine &validationEngine) con
                 continue;
             }
 
+            // only deserialize the transactions that fit in the block
+            const CTransaction tx = iter->createOldTransaction();
             if (!IsFinalTx(tx, nHeight, nLockTimeCutoff))
                 continue;
 
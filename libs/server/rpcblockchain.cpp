@@ -205,7 +205,7 @@ UniValue mempoolToJSON(bool fVerbose = false)
         UniValue o(UniValue::VOBJ);
         BOOST_FOREACH(const CTxMemPoolEntry& e, mempool.mapTx)
         {
-            const uint256& hash = e.GetTx().GetHash();
+            const uint256& hash = e.GetTxId();
             UniValue info(UniValue::VOBJ);
             info.push_back(Pair("size", (int)e.GetTxSize()));
             info.push_back(Pair("fee", ValueFromAmount(e.GetFee())));
@@ -217,12 +217,9 @@ UniValue mempoolToJSON(bool fVerbose = false)
             info.push_back(Pair("descendantcount", e.GetCountWithDescendants()));
             info.push_back(Pair("descendantsize", e.GetSizeWithDescendants()));
             info.push_back(Pair("descendantfees", e.GetModFeesWithDescendants()));
-            const CTransaction& tx = e.GetTx();
             std::set<std::string> setDepends;
-            BOOST_FOREACH(const CTxIn& txin, tx.vin)
-            {
-                if (mempool.exists(txin.prevout.hash))
-                    setDepends.insert(txin.prevout.hash.ToString());
+            for (const CTxMemPool::txiter &parent : mempool.GetMemPoolParents(mempool.mapTx.iterator_to(e))) {
+                setDepends.insert(parent->GetTxId().ToString());
             }
 
             UniValue depends(UniValue::VARR);
@@ -627,6 +624,65 @@ UniValue getblockchaininfo(const UniValue& params, bool fHelp)
     return obj;
 }
 
+UniValue getvalidationstats(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw std::runtime_error(
+            "getvalidationstats\n"
+            "Returns an object containing statistics on block validation since the start of the node.\n"
+            "All times are in microseconds.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"blocks\": xxxxxx,         (numeric) the number of blocks that passed validation\n"
+            "  \"transactions\": xxxxxx,   (numeric) the number of transactions in those blocks\n"
+            "  \"utxolookups\": xxxxxx,    (numeric) the number of inputs looked up in the UTXO\n"
+            "  \"utxolookupspersecond\": xxxx, (numeric) lookups per second spent in the UTXO\n"
+            "  \"sigchecks\": xxxxxx,      (numeric) the number of signature checks done\n"
+            "  \"sigcheckspersecond\": xxxx, (numeric) signature checks per second spent validating\n"
+            "  \"chunkimbalance\": xxxxxx, (numeric) total time the slowest chunk of a block was slower than the average\n"
+            "  \"stages\": [               (array) the time spent in each stage of validation\n"
+            "     {\n"
+            "        \"name\": \"xxxx\",      (string) name of the stage\n"
+            "        \"count\": xx,         (numeric) the number of measurements\n"
+            "        \"total\": xx,         (numeric) the total time spent\n"
+            "        \"max\": xx,           (numeric) the longest single measurement\n"
+            "        \"histogram\": [ xx, ...] (array) bucket n counts durations between 2^(n-1) and 2^n\n"
+            "     }, ...\n"
+            "  ]\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getvalidationstats", "")
+            + HelpExampleRpc("getvalidationstats", "")
+        );
+
+    const Validation::Statistics stats = Application::instance()->validation()->statistics();
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("blocks",                stats.blocks));
+    obj.push_back(Pair("transactions",          stats.transactions));
+    obj.push_back(Pair("utxolookups",           stats.utxoLookups));
+    obj.push_back(Pair("utxolookupspersecond",  stats.utxoLookupsPerSecond()));
+    obj.push_back(Pair("sigchecks",             stats.sigChecks));
+    obj.push_back(Pair("sigcheckspersecond",    stats.sigChecksPerSecond()));
+    obj.push_back(Pair("chunkimbalance",        stats.chunkImbalanceTime));
+    UniValue stages(UniValue::VARR);
+    for (int i = 0; i < Validation::Statistics::StageCount; ++i) {
+        const Validation::Statistics::StageTimes &times = stats.stages[static_cast<size_t>(i)];
+        UniValue stage(UniValue::VOBJ);
+        stage.push_back(Pair("name", Validation::Statistics::stageName(static_cast<Validation::Statistics::Stage>(i))));
+        stage.push_back(Pair("count", times.count));
+        stage.push_back(Pair("total", times.totalTime));
+        stage.push_back(Pair("max", times.maxTime));
+        UniValue histogram(UniValue::VARR);
+        for (auto bucket : times.histogram) {
+            histogram.push_back(bucket);
+        }
+        stage.push_back(Pair("histogram", histogram));
+        stages.push_back(stage);
+    }
+    obj.push_back(Pair("stages", stages));
+    return obj;
+}
+
 /** Comparison function for sorting the getchaintips heads.  */
 struct CompareBlocksByHeight
 {
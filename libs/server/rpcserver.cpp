@@ -298,6 +298,7 @@ static const CRPCCommand vRPCCommands[] =
     { "blockchain",         "gettxout",               &gettxout,               true  },
     { "blockchain",         "verifytxoutproof",       &verifytxoutproof,       true  },
     { "blockchain",         "verifychain",            &verifychain,            true  },
+    { "blockchain",         "getvalidationstats",     &getvalidationstats,     true  },
 
     /* Mining */
     { "mining",             "setcoinbase",            &setcoinbase,            true  },
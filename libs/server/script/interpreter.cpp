@@ -31,6 +31,7 @@
 #include <primitives/pubkey.h>
 #include <primitives/script.h>
 #include "uint256.h"
+#include <amount.h>
 #include <cstdint>
 
 #include <boost/atomic.hpp>
@@ -1629,8 +1630,114 @@ uint256 GetOutputsHash(const CTransaction &txTo)
     return ss.GetHash();
 }
 
+void serializeOutput(CHashWriter &ss, const TxView::Output &output)
+{
+    ss << output.amount;
+    WriteCompactSize(ss, static_cast<uint64_t>(output.script.size()));
+    ss.write(output.script.begin(), static_cast<size_t>(output.script.size()));
+}
+
+uint256 GetPrevoutHash(const TxView &txTo)
+{
+    CHashWriter ss(SER_GETHASH, 0);
+    for (const TxView::Input &input : txTo.inputs) {
+        ss << input.prevTxId << input.prevIndex;
+    }
+    return ss.GetHash();
+}
+
+uint256 GetSequenceHash(const TxView &txTo)
+{
+    CHashWriter ss(SER_GETHASH, 0);
+    for (const TxView::Input &input : txTo.inputs) {
+        ss << input.sequence;
+    }
+    return ss.GetHash();
+}
+
+uint256 GetOutputsHash(const TxView &txTo)
+{
+    CHashWriter ss(SER_GETHASH, 0);
+    for (const TxView::Output &output : txTo.outputs) {
+        serializeOutput(ss, output);
+    }
+    return ss.GetHash();
+}
+
 } // anon namespace
 
+TxView::TxView(const Tx &tx)
+    : tx(tx)
+{
+    Tx::Iterator iter(tx);
+    auto type = iter.next();
+    while (type != Tx::End) {
+        switch (type) {
+        case Tx::TxVersion:
+            version = iter.intData();
+            break;
+        case Tx::PrevTxHash:
+            inputs.resize(inputs.size() + 1);
+            inputs.back().prevTxId = iter.uint256Data();
+            break;
+        case Tx::PrevTxIndex:
+            inputs.back().prevIndex = iter.uintData();
+            break;
+        case Tx::TxInScript:
+            inputs.back().script = iter.byteData();
+            break;
+        case Tx::Sequence:
+            inputs.back().sequence = iter.uintData();
+            break;
+        case Tx::OutputValue:
+            outputs.resize(outputs.size() + 1);
+            outputs.back().amount = static_cast<int64_t>(iter.longData());
+            break;
+        case Tx::OutputScript:
+            outputs.back().script = iter.byteData();
+            break;
+        case Tx::LockTime:
+            lockTime = iter.uintData();
+            break;
+        default:
+            break;
+        }
+        type = iter.next();
+    }
+}
+
+int64_t TxView::valueOut() const
+{
+    int64_t answer = 0;
+    for (const Output &output : outputs) {
+        answer += output.amount;
+        if (!MoneyRange(output.amount) || !MoneyRange(answer))
+            throw std::runtime_error("TxView::valueOut(): value out of range");
+    }
+    return answer;
+}
+
+const CTransaction &TxView::oldTransaction() const
+{
+    if (!m_oldTx)
+        m_oldTx.reset(new CTransaction(tx.createOldTransaction()));
+    return *m_oldTx;
+}
+
+PrecomputedTransactionData::PrecomputedTransactionData(const CTransaction &tx)
+    : hashPrevouts(GetPrevoutHash(tx)),
+      hashSequence(GetSequenceHash(tx)),
+      hashOutputs(GetOutputsHash(tx))
+{
+}
+
+PrecomputedTransactionData::PrecomputedTransactionData(const TxView &tx)
+    : hashPrevouts(GetPrevoutHash(tx)),
+      hashSequence(GetSequenceHash(tx)),
+      hashOutputs(GetOutputsHash(tx))
+{
+}
+
 /**
  * SignatureHash is a helper method to hash a certain subset of the /a txTo transactions content
  * which is then used to pass to the signing function of a CKey private key, a process used to
@@ -1644,8 +1751,10 @@ uint256 GetOutputsHash(const CTransaction &txTo)
  * \param amount the amount of satoshis that the input contains
  * \param nHashType is a binary flags field indicating  what kind of payment this is. See SIGHASH_SINGLE and others.
  * \param flags a binary flags field indicating the state of the (bitcoin) macro system.
+ * \param txData optional pre-calculated hashes of \a txTo, avoids calculating them for each input.
  */
-uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsigned int nIn, CAmount amount, int nHashType, uint32_t flags)
+uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsigned int nIn, CAmount amount, int nHashType, uint32_t flags,
+                      const PrecomputedTransactionData *txData)
 {
     if ((nHashType & SIGHASH_FORKID) && (flags & SCRIPT_ENABLE_SIGHASH_FORKID)) {
         uint256 hashPrevouts;
@@ -1653,18 +1762,18 @@ uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsig
         uint256 hashOutputs;
 
         if (!(nHashType & SIGHASH_ANYONECANPAY)) {
-            hashPrevouts = GetPrevoutHash(txTo);
+            hashPrevouts = txData ? txData->hashPrevouts : GetPrevoutHash(txTo);
         }
 
         if (!(nHashType & SIGHASH_ANYONECANPAY) &&
             (nHashType & 0x1f) != SIGHASH_SINGLE &&
             (nHashType & 0x1f) != SIGHASH_NONE) {
-            hashSequence = GetSequenceHash(txTo);
+            hashSequence = txData ? txData->hashSequence : GetSequenceHash(txTo);
         }
 
         if ((nHashType & 0x1f) != SIGHASH_SINGLE &&
             (nHashType & 0x1f) != SIGHASH_NONE) {
-            hashOutputs = GetOutputsHash(txTo);
+            hashOutputs = txData ? txData->hashOutputs : GetOutputsHash(txTo);
         } else if ((nHashType & 0x1f) == SIGHASH_SINGLE &&
                    nIn < txTo.vout.size()) {
             CHashWriter ss(SER_GETHASH, 0);
@@ -1718,6 +1827,67 @@ uint256 SignatureHash(const CScript& scriptCode, const CTransaction& txTo, unsig
     return ss.GetHash();
 }
 
+/**
+ * The zero-copy variant of SignatureHash, producing identical results.
+ * Only the forkid algorithm is implemented on the TxView, for the legacy algorithm a CTransaction is created.
+ */
+uint256 SignatureHash(const CScript &scriptCode, const TxView &txTo, unsigned int nIn, CAmount amount, int nHashType, uint32_t flags,
+                      const PrecomputedTransactionData *txData)
+{
+    if (!(nHashType & SIGHASH_FORKID) || !(flags & SCRIPT_ENABLE_SIGHASH_FORKID))
+        return SignatureHash(scriptCode, txTo.oldTransaction(), nIn, amount, nHashType, flags);
+
+    assert(nIn < txTo.inputs.size());
+    uint256 hashPrevouts;
+    uint256 hashSequence;
+    uint256 hashOutputs;
+
+    if (!(nHashType & SIGHASH_ANYONECANPAY)) {
+        hashPrevouts = txData ? txData->hashPrevouts : GetPrevoutHash(txTo);
+    }
+
+    if (!(nHashType & SIGHASH_ANYONECANPAY) &&
+        (nHashType & 0x1f) != SIGHASH_SINGLE &&
+        (nHashType & 0x1f) != SIGHASH_NONE) {
+        hashSequence = txData ? txData->hashSequence : GetSequenceHash(txTo);
+    }
+
+    if ((nHashType & 0x1f) != SIGHASH_SINGLE &&
+        (nHashType & 0x1f) != SIGHASH_NONE) {
+        hashOutputs = txData ? txData->hashOutputs : GetOutputsHash(txTo);
+    } else if ((nHashType & 0x1f) == SIGHASH_SINGLE &&
+               nIn < txTo.outputs.size()) {
+        CHashWriter ss(SER_GETHASH, 0);
+        serializeOutput(ss, txTo.outputs[nIn]);
+        hashOutputs = ss.GetHash();
+    }
+
+    const TxView::Input &input = txTo.inputs[nIn];
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << txTo.version;
+    ss << hashPrevouts;
+    ss << hashSequence;
+    ss << input.prevTxId << input.prevIndex;
+    ss << static_cast<const CScriptBase &>(scriptCode);
+    ss << amount;
+    ss << input.sequence;
+    ss << hashOutputs;
+    ss << txTo.lockTime;
+    ss << nHashType;
+
+    return ss.GetHash();
+}
+
+uint32_t TransactionSignatureChecker::txLockTime() const
+{
+    return txTo ? txTo->nLockTime : txView->lockTime;
+}
+
+uint32_t TransactionSignatureChecker::inputSequence() const
+{
+    return txTo ? txTo->vin[nIn].nSequence : txView->inputs[nIn].sequence;
+}
+
 bool TransactionSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash, uint32_t flags) const
 {
     if ((flags & SCRIPT_ENABLE_SCHNORR) && (vchSig.size() == 64)) {
@@ -1740,7 +1910,8 @@ bool TransactionSignatureChecker::CheckSig(const std::vector<unsigned char>& vch
     int nHashType = vchSig.back();
     vchSig.pop_back();
 
-    uint256 sighash = SignatureHash(scriptCode, *txTo, nIn, amount, nHashType, flags);
+    const uint256 sighash = txTo ? SignatureHash(scriptCode, *txTo, nIn, amount, nHashType, flags, txData)
+                                 : SignatureHash(scriptCode, *txView, nIn, amount, nHashType, flags, txData);
 
     if (!VerifySignature(vchSig, pubkey, sighash, flags))
         return false;
@@ -1757,15 +1928,16 @@ bool TransactionSignatureChecker::CheckLockTime(const CScriptNum& nLockTime) con
     // We want to compare apples to apples, so fail the script
     // unless the type of nLockTime being tested is the same as
     // the nLockTime in the transaction.
+    const uint32_t txToLockTime = txLockTime();
     if (!(
-        (txTo->nLockTime <  LOCKTIME_THRESHOLD && nLockTime <  LOCKTIME_THRESHOLD) ||
-        (txTo->nLockTime >= LOCKTIME_THRESHOLD && nLockTime >= LOCKTIME_THRESHOLD)
+        (txToLockTime <  LOCKTIME_THRESHOLD && nLockTime <  LOCKTIME_THRESHOLD) ||
+        (txToLockTime >= LOCKTIME_THRESHOLD && nLockTime >= LOCKTIME_THRESHOLD)
     ))
         return false;
 
     // Now that we know we're comparing apples-to-apples, the
     // comparison is a simple numeric one.
-    if (nLockTime > (int64_t)txTo->nLockTime)
+    if (nLockTime > (int64_t)txToLockTime)
         return false;
 
     // Finally the nLockTime feature can be disabled and thus
@@ -1778,7 +1950,7 @@ bool TransactionSignatureChecker::CheckLockTime(const CScriptNum& nLockTime) con
     // prevent this condition. Alternatively we could test all
     // inputs, but testing just this input minimizes the data
     // required to prove correct CHECKLOCKTIMEVERIFY execution.
-    if (CTxIn::SEQUENCE_FINAL == txTo->vin[nIn].nSequence)
+    if (CTxIn::SEQUENCE_FINAL == inputSequence())
         return false;
 
     return true;
@@ -1788,11 +1960,11 @@ bool TransactionSignatureChecker::CheckSequence(const CScriptNum& nSequence) con
 {
     // Relative lock times are supported by comparing the passed
     // in operand to the sequence number of the input.
-    const int64_t txToSequence = (int64_t)txTo->vin[nIn].nSequence;
+    const int64_t txToSequence = (int64_t)inputSequence();
 
     // Fail if the transaction's version number is not set high
     // enough to trigger BIP 68 rules.
-    if (static_cast<uint32_t>(txTo->nVersion) < 2)
+    if (static_cast<uint32_t>(txTo ? txTo->nVersion : txView->version) < 2)
         return false;
 
     // Sequence numbers with their most significant bit set are not
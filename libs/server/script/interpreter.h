@@ -22,6 +22,9 @@
 
 #include "script_error.h"
 #include "primitives/transaction.h"
+#include <primitives/FastTransaction.h>
+
+#include <memory>
 
 class CPubKey;
 class CScript;
@@ -120,7 +123,63 @@ enum
     SCRIPT_ENABLE_OP_REVERSEBYTES = (1U << 21),
 };
 
-uint256 SignatureHash(const CScript &scriptCode, const CTransaction& txTo, unsigned int nIn, CAmount amount, int nHashType, uint32_t flags = SCRIPT_ENABLE_SIGHASH_FORKID);
+/**
+ * A parsed, zero-copy view on a serialized transaction (Tx) with the data script validation needs.
+ * The scripts are not copied but refer to the buffer the transaction lives in, typically the block.
+ * This allows validating the inputs of a transaction without creating a CTransaction for it.
+ */
+struct TxView
+{
+    explicit TxView(const Tx &tx);
+
+    struct Input {
+        uint256 prevTxId;
+        uint32_t prevIndex = 0;
+        uint32_t sequence = 0;
+        Streaming::ConstBuffer script;
+    };
+    struct Output {
+        int64_t amount = 0;
+        Streaming::ConstBuffer script;
+    };
+
+    /// Returns the sum of all output amounts.
+    int64_t valueOut() const;
+
+    /**
+     * Returns the transaction as a CTransaction, created on first usage.
+     * Only needed for the (pre-forkid) signature hash algorithm.
+     */
+    const CTransaction &oldTransaction() const;
+
+    Tx tx;
+    int32_t version = 0;
+    uint32_t lockTime = 0;
+    std::vector<Input> inputs;
+    std::vector<Output> outputs;
+
+private:
+    mutable std::unique_ptr<CTransaction> m_oldTx;
+};
+
+/**
+ * The parts of the (forkid) signature-hash that are the same for every input of a transaction.
+ * Calculating them once per transaction avoids the cost growing quadratically with the amount of inputs.
+ */
+struct PrecomputedTransactionData
+{
+    explicit PrecomputedTransactionData(const CTransaction &tx);
+    explicit PrecomputedTransactionData(const TxView &tx);
+
+    uint256 hashPrevouts;
+    uint256 hashSequence;
+    uint256 hashOutputs;
+};
+
+uint256 SignatureHash(const CScript &scriptCode, const CTransaction& txTo, unsigned int nIn, CAmount amount, int nHashType,
+                      uint32_t flags = SCRIPT_ENABLE_SIGHASH_FORKID, const PrecomputedTransactionData *txData = nullptr);
+uint256 SignatureHash(const CScript &scriptCode, const TxView &txTo, unsigned int nIn, CAmount amount, int nHashType,
+                      uint32_t flags = SCRIPT_ENABLE_SIGHASH_FORKID, const PrecomputedTransactionData *txData = nullptr);
 
 class BaseSignatureChecker
 {
@@ -145,16 +204,24 @@ public:
 
 class TransactionSignatureChecker : public BaseSignatureChecker
 {
-private:
+protected:
     const CTransaction* txTo;
+    const TxView *txView;
     unsigned int nIn;
     CAmount amount;
+    const PrecomputedTransactionData *txData;
+
+    uint32_t txLockTime() const;
+    uint32_t inputSequence() const;
 
 protected:
     virtual bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash, uint32_t flags) const;
 
 public:
-    TransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn, const CAmount& amountIn) : txTo(txToIn), nIn(nInIn), amount(amountIn) {}
+    TransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn, const CAmount& amountIn, const PrecomputedTransactionData *txDataIn = nullptr)
+        : txTo(txToIn), txView(nullptr), nIn(nInIn), amount(amountIn), txData(txDataIn) {}
+    TransactionSignatureChecker(const TxView* txToIn, unsigned int nInIn, const CAmount& amountIn, const PrecomputedTransactionData *txDataIn = nullptr)
+        : txTo(nullptr), txView(txToIn), nIn(nInIn), amount(amountIn), txData(txDataIn) {}
     bool CheckSig(const std::vector<unsigned char>& scriptSig, const std::vector<unsigned char>& vchPubKey, const CScript& scriptCode, uint32_t flags) const override;
     bool CheckLockTime(const CScriptNum& nLockTime) const override;
     bool CheckSequence(const CScriptNum& nSequence) const override;
@@ -100,6 +100,8 @@ bool CachingTransactionSignatureChecker::VerifySignature(const std::vector<unsig
     signatureCache.ComputeEntry(entry, sighash, vchSig, pubkey);
     if (signatureCache.Get(entry, !store))
         return true;
+    if (m_batch && vchSig.size() == 64 && (flags & SCRIPT_ENABLE_SCHNORR) && (flags & SCRIPT_VERIFY_NULLFAIL))
+        return m_batch->add(pubkey, sighash, vchSig, static_cast<int>(nIn));
     if (!TransactionSignatureChecker::VerifySignature(vchSig, pubkey, sighash, flags))
         return false;
     if (store)
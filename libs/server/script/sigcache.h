@@ -25,6 +25,7 @@
 #include <vector>
 
 class CPubKey;
+class SchnorrBatch;
 
 /**
  * We're hashing a nonce into the entries themselves, so we don't need extra
@@ -51,11 +52,25 @@ class CachingTransactionSignatureChecker : public TransactionSignatureChecker
 {
 private:
     bool store;
+    SchnorrBatch *m_batch = nullptr;
 
 public:
-    CachingTransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn, const CAmount& amount, bool storeIn=true) : TransactionSignatureChecker(txToIn, nInIn, amount), store(storeIn) {}
+    CachingTransactionSignatureChecker(const CTransaction* txToIn, unsigned int nInIn, const CAmount& amount, bool storeIn = true,
+                                       const PrecomputedTransactionData *txData = nullptr)
+        : TransactionSignatureChecker(txToIn, nInIn, amount, txData), store(storeIn) {}
+    CachingTransactionSignatureChecker(const TxView* txToIn, unsigned int nInIn, const CAmount& amount, bool storeIn = true,
+                                       const PrecomputedTransactionData *txData = nullptr)
+        : TransactionSignatureChecker(txToIn, nInIn, amount, txData), store(storeIn) {}
 
     bool VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& vchPubKey, const uint256& sighash, uint32_t flags) const override;
+
+    /**
+     * Add Schnorr signatures to \a batch instead of verifying them, the caller has to verify the batch.
+     * Signatures are only deferred when the NULLFAIL rule makes any failure fail the script.
+     */
+    inline void setSchnorrBatch(SchnorrBatch *batch) {
+        m_batch = batch;
+    }
 };
 
 void InitSignatureCache();
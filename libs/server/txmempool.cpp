@@ -31,21 +31,62 @@
 #include "utilmoneystr.h"
 #include "utiltime.h"
 #include "version.h"
-#include <core_memusage.h>
+#include <primitives/FastBlock.h>
+#include <memusage.h>
 
 #include <utxo/UnspentOutputDatabase.h>
 #include <validation/ValidationException.h>
 #include <validationinterface.h>
 
+namespace {
+// returns the outputs the transaction spends
+std::vector<COutPoint> findPrevOuts(const Tx &tx)
+{
+    std::vector<COutPoint> answer;
+    Tx::Iterator iter(tx);
+    uint256 prevTxId;
+    auto type = iter.next(Tx::PrevTxHash | Tx::PrevTxIndex | Tx::OutputValue);
+    while (type == Tx::PrevTxHash || type == Tx::PrevTxIndex) {
+        if (type == Tx::PrevTxHash)
+            prevTxId = iter.uint256Data();
+        else
+            answer.push_back(COutPoint(prevTxId, iter.uintData()));
+        type = iter.next(Tx::PrevTxHash | Tx::PrevTxIndex | Tx::OutputValue);
+    }
+    return answer;
+}
+
+uint32_t countOutputs(const Tx &tx)
+{
+    uint32_t answer = 0;
+    Tx::Iterator iter(tx);
+    while (iter.next(Tx::OutputValue) == Tx::OutputValue)
+        ++answer;
+    return answer;
+}
+}
+
 CTxMemPoolEntry::CTxMemPoolEntry(const Tx &tx)
+    : CTxMemPoolEntry(tx, tx.createHash())
+{
+}
+
+CTxMemPoolEntry::CTxMemPoolEntry(const Tx &tx, const uint256 &txid)
     : tx(tx),
+    txid(txid),
     nModFeesWithDescendants(0)
 {
-    oldTx = tx.createOldTransaction();
     nTime = ::GetTime();
     nTxSize = tx.size();
-    nModSize = oldTx.CalculateModifiedSize(nTxSize);
-    nUsageSize = RecursiveDynamicUsage(oldTx);
+    // same as CTransaction::CalculateModifiedSize()
+    nModSize = nTxSize;
+    Tx::Iterator iter(tx);
+    while (iter.next(Tx::TxInScript | Tx::OutputValue) == Tx::TxInScript) {
+        const size_t offset = 41 + std::min(110, iter.dataLength());
+        if (nModSize > offset)
+            nModSize -= offset;
+    }
+    nUsageSize = memusage::MallocUsage(nTxSize);
     nCountWithDescendants = 1;
     nSizeWithDescendants = nTxSize;
 
@@ -56,7 +97,7 @@ CTxMemPoolEntry::CTxMemPoolEntry(const CTransaction &tx, const CAmount& _nFee,
                                  int64_t _nTime, double _entryPriority, unsigned int _entryHeight,
                                  bool poolHasNoInputsOf, CAmount _inChainInputValue,
                                  bool _spendsCoinbase, LockPoints lp)
-    : CTxMemPoolEntry(Tx::fromOldTransaction(tx))
+    : CTxMemPoolEntry(Tx::fromOldTransaction(tx), tx.GetHash())
 {
     nFee = _nFee;
     nModFeesWithDescendants = nFee;
@@ -68,7 +109,7 @@ CTxMemPoolEntry::CTxMemPoolEntry(const CTransaction &tx, const CAmount& _nFee,
     spendsCoinbase = _spendsCoinbase;
     lockPoints = lp;
 
-    assert(inChainInputValue <= oldTx.GetValueOut() + nFee);
+    assert(inChainInputValue <= tx.GetValueOut() + nFee);
 }
 
 CTxMemPoolEntry::CTxMemPoolEntry(const CTxMemPoolEntry& other)
@@ -127,14 +168,14 @@ bool CTxMemPool::UpdateForDescendants(txiter updateIt, int maxDescendantsToVisit
                     // update visit count only for new child transactions
                     // (outside of setExclude and stageEntries)
                     if (setAllDescendants.insert(cacheEntry).second &&
-                            !setExclude.count(cacheEntry->GetTx().GetHash()) &&
+                            !setExclude.count(cacheEntry->GetTxId()) &&
                             !stageEntries.count(cacheEntry)) {
                         nChildrenToVisit++;
                     }
                 }
             } else if (!setAllDescendants.count(childEntry)) {
                 // Schedule for later processing and update our visit count
-                if (stageEntries.insert(childEntry).second && !setExclude.count(childEntry->GetTx().GetHash())) {
+                if (stageEntries.insert(childEntry).second && !setExclude.count(childEntry->GetTxId())) {
                         nChildrenToVisit++;
                 }
             }
@@ -149,7 +190,7 @@ bool CTxMemPool::UpdateForDescendants(txiter updateIt, int maxDescendantsToVisit
     CAmount modifyFee = 0;
     int64_t modifyCount = 0;
     for (txiter cit : setAllDescendants) {
-        if (!setExclude.count(cit->GetTx().GetHash())) {
+        if (!setExclude.count(cit->GetTxId())) {
             modifySize += cit->GetTxSize();
             modifyFee += cit->GetModifiedFee();
             modifyCount++;
@@ -189,11 +230,14 @@ void CTxMemPool::UpdateTransactionsFromBlock(const std::vector<uint256> &vHashes
         if (it == mapTx.end()) {
             continue;
         }
-        std::map<COutPoint, CInPoint>::iterator iter = mapNextTx.lower_bound(COutPoint(hash, 0));
         // First calculate the children, and update setMemPoolChildren to
         // include them, and update their setMemPoolParents to include this tx.
-        for (; iter != mapNextTx.end() && iter->first.hash == hash; ++iter) {
-            const uint256 &childHash = iter->second.ptx->GetHash();
+        const uint32_t outputCount = countOutputs(it->tx);
+        for (uint32_t i = 0; i < outputCount; ++i) {
+            auto iter = mapNextTx.find(COutPoint(hash, i));
+            if (iter == mapNextTx.end())
+                continue;
+            const uint256 &childHash = *iter->second.ptxid;
             txiter childIter = mapTx.find(childHash);
             assert(childIter != mapTx.end());
             // We can skip updating entries we've encountered before or that
@@ -213,14 +257,13 @@ void CTxMemPool::UpdateTransactionsFromBlock(const std::vector<uint256> &vHashes
 bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntries &setAncestors, uint64_t limitAncestorCount, uint64_t limitAncestorSize, uint64_t limitDescendantCount, uint64_t limitDescendantSize, std::string &errString, bool fSearchForParents /* = true */)
 {
     setEntries parentHashes;
-    const CTransaction &tx = entry.GetTx();
 
     if (fSearchForParents) {
         // Get parents of this transaction that are in the mempool
         // GetMemPoolParents() is only valid for entries in the mempool, so we
         // iterate mapTx to find parents.
-        for (unsigned int i = 0; i < tx.vin.size(); i++) {
-            txiter piter = mapTx.find(tx.vin[i].prevout.hash);
+        for (const COutPoint &prevout : findPrevOuts(entry.tx)) {
+            txiter piter = mapTx.find(prevout.hash);
             if (piter != mapTx.end()) {
                 parentHashes.insert(piter);
                 if (parentHashes.size() + 1 > limitAncestorCount) {
@@ -246,10 +289,10 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
         totalSizeWithAncestors += stageit->GetTxSize();
 
         if (stageit->GetSizeWithDescendants() + entry.GetTxSize() > limitDescendantSize) {
-            errString = strprintf("exceeds descendant size limit for tx %s [limit: %u]", stageit->GetTx().GetHash().ToString(), limitDescendantSize);
+            errString = strprintf("exceeds descendant size limit for tx %s [limit: %u]", stageit->GetTxId().ToString(), limitDescendantSize);
             return false;
         } else if (stageit->GetCountWithDescendants() + 1 > limitDescendantCount) {
-            errString = strprintf("too many descendants for tx %s [limit: %u]", stageit->GetTx().GetHash().ToString(), limitDescendantCount);
+            errString = strprintf("too many descendants for tx %s [limit: %u]", stageit->GetTxId().ToString(), limitDescendantCount);
             return false;
         } else if (totalSizeWithAncestors > limitAncestorSize) {
             errString = strprintf("exceeds ancestor size limit [limit: %u]", limitAncestorSize);
@@ -387,6 +430,11 @@ void CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry,
     // all the appropriate checks.
     LOCK(cs);
     indexed_transaction_set::iterator newit = mapTx.insert(entry).first;
+    {
+        TxShard &s = shard(hash);
+        boost::unique_lock<boost::shared_mutex> lock(s.lock);
+        s.txs.insert(&*newit);
+    }
     mapLinks.insert(make_pair(newit, TxLinks()));
 
     // Update transaction for any feeDelta created by PrioritiseTransaction
@@ -405,11 +453,11 @@ void CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry,
     // further updated.)
     cachedInnerUsage += entry.DynamicMemoryUsage();
 
-    const CTransaction& tx = newit->GetTx();
     std::set<uint256> setParentTransactions;
-    for (unsigned int i = 0; i < tx.vin.size(); i++) {
-        mapNextTx[tx.vin[i].prevout] = CInPoint(&tx, entry.tx, i);
-        setParentTransactions.insert(tx.vin[i].prevout.hash);
+    uint32_t inputIndex = 0;
+    for (const COutPoint &prevout : findPrevOuts(entry.tx)) {
+        mapNextTx[prevout] = CInPoint(&newit->txid, newit->tx, inputIndex++);
+        setParentTransactions.insert(prevout.hash);
     }
     // Don't bother worrying about child transactions of this one.
     // Normal case of a new transaction arriving is that there can't be any
@@ -437,38 +485,36 @@ bool CTxMemPool::insertTx(CTxMemPoolEntry &entry)
     assert(entry.dsproof == -1);
     LOCK(cs);
 
-    uint256 hash = entry.tx.createHash();
+    const uint256 hash = entry.txid;
 
     if (exists(hash))
         return false;
 
     std::list<std::pair<int, int> > rescuedOrphans;
-    for (const CTxIn &txin : entry.oldTx.vin) { // find double spends.
-        auto orphans = m_dspStorage->findOrphans(txin.prevout);
+    for (const COutPoint &prevout : findPrevOuts(entry.tx)) { // find double spends.
+        auto orphans = m_dspStorage->findOrphans(prevout);
         if (!orphans.empty()) {
             for (auto o : orphans)
                 rescuedOrphans.push_back(o);
             // if we find this here, AS AN ORPHAN, then nothing has entered the mempool yet
             // that claimed it. As such we don't have to check for conflicts.
-            assert(mapNextTx.find(txin.prevout) == mapNextTx.end()); // Check anyway
+            assert(mapNextTx.find(prevout) == mapNextTx.end()); // Check anyway
             continue;
         }
-        auto oldTx = mapNextTx.find(txin.prevout);
+        auto oldTx = mapNextTx.find(prevout);
         if (oldTx != mapNextTx.end()) { // double spend detected!
-            auto iter = mapTx.find(oldTx->second.tx.createHash());
+            auto iter = mapTx.find(*oldTx->second.ptxid);
             assert(mapTx.end() != iter);
             int newProofId = -1;
             try {
                 if (iter->dsproof == -1) { // no DS proof exists, lets make one.
-                    auto item = *iter;
                     logWarning(Log::DSProof) << "Double spend found, creating double spend proof"
-                                           << oldTx->second.tx.createHash()
-                                           << entry.tx.createHash();
-                    item.dsproof = m_dspStorage->add(DoubleSpendProof::create(oldTx->second.tx, entry.tx));
-                    mapTx.replace(iter, item);
-                    newProofId = item.dsproof;
+                                           << *oldTx->second.ptxid
+                                           << hash;
+                    newProofId = m_dspStorage->add(DoubleSpendProof::create(oldTx->second.tx, entry.tx));
+                    mapTx.modify(iter, set_dsproof(newProofId));
 #ifndef NDEBUG
-                    auto newIter = mapTx.find(oldTx->second.tx.createHash());
+                    auto newIter = mapTx.find(*oldTx->second.ptxid);
                     assert(newIter->dsproof == newProofId);
 #endif
                 }
@@ -480,14 +526,14 @@ bool CTxMemPool::insertTx(CTxMemPoolEntry &entry)
             throw Validation::DoubleSpendException(oldTx->second.tx, newProofId);
         }
 
-        auto iter = mapTx.find(txin.prevout.hash);
+        auto iter = mapTx.find(prevout.hash);
         if (iter != mapTx.end()) {
-            const CTransaction &prevTx = iter->GetTx();
-            if (txin.prevout.n < prevTx.vout.size() && !prevTx.vout[txin.prevout.n].IsNull())
+            const int outIndex = static_cast<int>(prevout.n);
+            if (outIndex >= 0 && iter->tx.output(outIndex).outputValue != -1)
                 continue; // found it in mempool.
         }
 
-        const UnspentOutput uo = m_utxo->find(txin.prevout.hash, txin.prevout.n);
+        const UnspentOutput uo = m_utxo->find(prevout.hash, prevout.n);
         if (!uo.isValid())
             return false;
     }
@@ -508,7 +554,7 @@ bool CTxMemPool::insertTx(CTxMemPoolEntry &entry)
             m_dspStorage->claimOrphan(proofId);
             entry.dsproof = proofId;
             txiter iter = mapTx.find(hash);
-            mapTx.replace(iter, entry);
+            mapTx.modify(iter, set_dsproof(proofId));
 
             while (++i != rescuedOrphans.end()) {
                 logDebug(Log::DSProof) << "Killing orphans, we don't need more than one";
@@ -531,13 +577,18 @@ void CTxMemPool::removeUnchecked(txiter it)
 {
     if (it->dsproof != -1)
         m_dspStorage->remove(it->dsproof);
-    for (const CTxIn& txin : it->GetTx().vin)
-        mapNextTx.erase(txin.prevout);
+    for (const COutPoint &prevout : findPrevOuts(it->tx))
+        mapNextTx.erase(prevout);
 
     totalTxSize -= it->GetTxSize();
     cachedInnerUsage -= it->DynamicMemoryUsage();
     cachedInnerUsage -= memusage::DynamicUsage(mapLinks[it].parents) + memusage::DynamicUsage(mapLinks[it].children);
     mapLinks.erase(it);
+    {
+        TxShard &s = shard(it->txid);
+        boost::unique_lock<boost::shared_mutex> lock(s.lock);
+        s.txs.erase(&*it);
+    }
     mapTx.erase(it);
     nTransactionsUpdated++;
 }
@@ -586,10 +637,10 @@ void CTxMemPool::remove(const CTransaction &origTx, std::list<CTransaction>& rem
             // happen during chain re-orgs if origTx isn't re-accepted into
             // the mempool for any reason.
             for (unsigned int i = 0; i < origTx.vout.size(); i++) {
-                std::map<COutPoint, CInPoint>::iterator it = mapNextTx.find(COutPoint(origTx.GetHash(), i));
+                auto it = mapNextTx.find(COutPoint(origTx.GetHash(), i));
                 if (it == mapNextTx.end())
                     continue;
-                txiter nextit = mapTx.find(it->second.ptx->GetHash());
+                txiter nextit = mapTx.find(*it->second.ptxid);
                 assert(nextit != mapTx.end());
                 txToRemove.insert(nextit);
             }
@@ -603,7 +654,7 @@ void CTxMemPool::remove(const CTransaction &origTx, std::list<CTransaction>& rem
             setAllRemoves.swap(txToRemove);
         }
         for (txiter it : setAllRemoves) {
-            removed.push_back(it->GetTx());
+            removed.push_back(it->createOldTransaction());
         }
         RemoveStaged(setAllRemoves);
     }
@@ -615,7 +666,7 @@ void CTxMemPool::removeForReorg(unsigned int nMemPoolHeight, int flags)
     LOCK(cs);
     std::list<CTransaction> transactionsToRemove;
     for (indexed_transaction_set::const_iterator it = mapTx.begin(); it != mapTx.end(); it++) {
-        const CTransaction& tx = it->GetTx();
+        const CTransaction tx = it->createOldTransaction();
         LockPoints lp = it->GetLockPoints();
         bool validLP =  TestLockPointValidity(&lp);
         if (!CheckFinalTx(tx, flags) || !CheckSequenceLocks(*this, tx, flags, &lp, validLP)) {
@@ -650,10 +701,10 @@ void CTxMemPool::removeConflicts(const CTransaction &tx, std::list<CTransaction>
     // Remove transactions which depend on inputs of tx, recursively
     LOCK(cs);
     for (const CTxIn &txin : tx.vin) {
-        std::map<COutPoint, CInPoint>::iterator it = mapNextTx.find(txin.prevout);
+        auto it = mapNextTx.find(txin.prevout);
         if (it != mapNextTx.end()) {
-            const CTransaction &txConflict = *it->second.ptx;
-            if (txConflict != tx) {
+            if (*it->second.ptxid != tx.GetHash()) {
+                const CTransaction txConflict = it->second.tx.createOldTransaction();
                 remove(txConflict, removed, true);
                 ClearPrioritisation(txConflict.GetHash());
             }
@@ -663,21 +714,49 @@ void CTxMemPool::removeConflicts(const CTransaction &tx, std::list<CTransaction>
 
 /**
  * Called when a block is connected. Removes from mempool and updates the miner fee estimator.
+ * This walks over the block's buffer instead of deserializing it into CTransactions.
  */
-void CTxMemPool::removeForBlock(const std::vector<CTransaction> &vtx, std::list<CTransaction> &conflicts)
+void CTxMemPool::removeForBlock(const FastBlock &block, const std::vector<uint256> &txids, std::list<CTransaction> &conflicts)
 {
+    assert(txids.size() == block.transactions().size());
     LOCK(cs);
-    for (const CTransaction& tx : vtx) {
-        std::list<CTransaction> dummy;
-        remove(tx, dummy, false);
-        removeConflicts(tx, conflicts);
-        ClearPrioritisation(tx.GetHash());
+    Tx::Iterator iter(block);
+    size_t txIndex = 0;
+    uint256 prevTxHash;
+    while (txIndex < txids.size()) {
+        const auto type = iter.next(Tx::PrevTxHash | Tx::PrevTxIndex);
+        if (type == Tx::End) {
+            const uint256 &txid = txids.at(txIndex++);
+            txiter it = mapTx.find(txid);
+            if (it != mapTx.end()) {
+                setEntries stage;
+                stage.insert(it);
+                RemoveStaged(stage);
+            }
+            ClearPrioritisation(txid);
+        }
+        else if (type == Tx::PrevTxHash) {
+            prevTxHash = iter.uint256Data();
+        }
+        else if (type == Tx::PrevTxIndex && txIndex > 0) { // the coinbase spends nothing
+            // Remove transactions which spend the same output as this one, recursively
+            auto spender = mapNextTx.find(COutPoint(prevTxHash, iter.uintData()));
+            if (spender != mapNextTx.end() && *spender->second.ptxid != txids.at(txIndex)) {
+                const CTransaction txConflict = spender->second.tx.createOldTransaction();
+                remove(txConflict, conflicts, true);
+                ClearPrioritisation(txConflict.GetHash());
+            }
+        }
     }
 }
 
 void CTxMemPool::_clear()
 {
     mapLinks.clear();
+    for (int i = 0; i < ShardCount; ++i) {
+        boost::unique_lock<boost::shared_mutex> lock(m_shards[i].lock);
+        m_shards[i].txs.clear();
+    }
     mapTx.clear();
     mapNextTx.clear();
     totalTxSize = 0;
@@ -698,24 +777,26 @@ void CTxMemPool::queryHashes(std::vector<uint256>& vtxid)
     LOCK(cs);
     vtxid.reserve(mapTx.size());
     for (indexed_transaction_set::iterator mi = mapTx.begin(); mi != mapTx.end(); ++mi)
-        vtxid.push_back(mi->GetTx().GetHash());
+        vtxid.push_back(mi->GetTxId());
 }
 
 bool CTxMemPool::lookup(const uint256 &hash, CTransaction &result) const
 {
-    LOCK(cs);
-    indexed_transaction_set::const_iterator i = mapTx.find(hash);
-    if (i == mapTx.end()) return false;
-    result = i->GetTx();
+    Tx tx;
+    if (!lookup(hash, tx))
+        return false;
+    result = tx.createOldTransaction(); // outside of the lock
     return true;
 }
 
 bool CTxMemPool::lookup(const uint256 &hash, Tx& result) const
 {
-    LOCK(cs);
-    indexed_transaction_set::const_iterator i = mapTx.find(hash);
-    if (i == mapTx.end()) return false;
-    result = i->tx;
+    const TxShard &s = shard(hash);
+    boost::shared_lock<boost::shared_mutex> lock(s.lock);
+    auto i = s.find(hash);
+    if (i == s.txs.end())
+        return false;
+    result = (*i)->tx;
     return true;
 }
 
@@ -780,8 +861,10 @@ bool CTxMemPool::HasNoInputsOf(const CTransaction &tx) const
 
 size_t CTxMemPool::DynamicMemoryUsage() const {
     LOCK(cs);
-    // Estimate the overhead of mapTx to be 12 pointers + an allocation, as no exact formula for boost::multi_index_contained is implemented.
-    return memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 12 * sizeof(void*)) * mapTx.size() + memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) + memusage::DynamicUsage(mapLinks) + cachedInnerUsage;
+    // Estimate the overhead of mapTx to be 11 pointers + an allocation, plus the buckets of the hashed index, as no exact formula for boost::multi_index_contained is implemented.
+    // The shards add a node of two pointers and about one bucket per transaction.
+    const size_t shardsUsage = (memusage::MallocUsage(2 * sizeof(void*)) + sizeof(void*)) * mapTx.size();
+    return memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 11 * sizeof(void*)) * mapTx.size() + memusage::MallocUsage(sizeof(void*) * mapTx.bucket_count()) + memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) + memusage::DynamicUsage(mapLinks) + shardsUsage + cachedInnerUsage;
 }
 
 void CTxMemPool::RemoveStaged(setEntries &stage) {
@@ -867,14 +950,12 @@ Tx CTxMemPool::addDoubleSpendProof(const DoubleSpendProof &proof)
     if (oldTx == mapNextTx.end())
         return Tx();
 
-    auto iter = mapTx.find(oldTx->second.tx.createHash());
+    auto iter = mapTx.find(*oldTx->second.ptxid);
     assert(mapTx.end() != iter);
     if (iter->dsproof != -1)   // A DSProof already exists for this tx.
         return Tx(); // don't propagate new one.
 
-    auto item = *iter;
-    item.dsproof = m_dspStorage->add(proof);
-    mapTx.replace(iter, item);
+    mapTx.modify(iter, set_dsproof(m_dspStorage->add(proof)));
 
     return oldTx->second.tx;
 }
@@ -901,33 +982,13 @@ CFeeRate CTxMemPool::GetMinFee() const
     return CFeeRate();
 }
 
-void CTxMemPool::TrimToSize(size_t sizelimit, std::vector<uint256>* pvNoSpendsRemaining) {
+void CTxMemPool::TrimToSize(size_t sizelimit) {
     LOCK(cs);
 
-    unsigned nTxnRemoved = 0;
-    while (DynamicMemoryUsage() > sizelimit) {
+    while (!mapTx.empty() && DynamicMemoryUsage() > sizelimit) {
         indexed_transaction_set::nth_index<1>::type::iterator it = mapTx.get<1>().begin();
         setEntries stage;
         CalculateDescendants(mapTx.project<0>(it), stage);
-        nTxnRemoved += stage.size();
-
-        std::vector<CTransaction> txn;
-        if (pvNoSpendsRemaining) {
-            txn.reserve(stage.size());
-            for (txiter it : stage)
-                txn.push_back(it->GetTx());
-        }
         RemoveStaged(stage);
-        if (pvNoSpendsRemaining) {
-            for (const CTransaction& tx : txn) {
-                for (const CTxIn& txin : tx.vin) {
-                    if (exists(txin.prevout.hash))
-                        continue;
-                    std::map<COutPoint, CInPoint>::iterator it = mapNextTx.lower_bound(COutPoint(txin.prevout.hash, 0));
-                    if (it == mapNextTx.end() || it->first.hash != txin.prevout.hash)
-                        pvNoSpendsRemaining->push_back(txin.prevout.hash);
-                }
-            }
-        }
     }
 }
@@ -30,13 +30,18 @@
 #include "primitives/FastTransaction.h"
 
 #include "boost/multi_index_container.hpp"
+#include "boost/multi_index/hashed_index.hpp"
 #include "boost/multi_index/ordered_index.hpp"
+#include "boost/unordered_map.hpp"
+#include "boost/unordered_set.hpp"
+#include "boost/thread/shared_mutex.hpp"
 
 class CAutoFile;
 class CBlockIndex;
 class UnspentOutputDatabase;
 class DoubleSpendProofStorage;
 class DoubleSpendProof;
+class FastBlock;
 
 inline double AllowFreeThreshold()
 {
@@ -91,7 +96,7 @@ class CTxMemPoolEntry
 {
 public:
     Tx tx;
-    CTransaction oldTx;
+    uint256 txid; //! Cached to avoid hashing the transaction for every lookup
     CAmount nFee; //! Cached to avoid expensive parent-transaction lookups
     size_t nTxSize; //! ... and avoid recomputing tx size
     size_t nModSize; //! ... and modified size for priority
@@ -116,6 +121,7 @@ public:
     int dsproof = -1;
 
     CTxMemPoolEntry(const Tx &tx);
+    CTxMemPoolEntry(const Tx &tx, const uint256 &txid);
 
     CTxMemPoolEntry(const CTransaction &tx, const CAmount& _nFee,
                     int64_t _nTime, double _entryPriority, unsigned int _entryHeight,
@@ -123,7 +129,9 @@ public:
                     LockPoints lp);
     CTxMemPoolEntry(const CTxMemPoolEntry& other);
 
-    const CTransaction& GetTx() const { return this->oldTx; }
+    const uint256& GetTxId() const { return txid; }
+    /// Deserializes the transaction, this is relatively expensive so use the Tx where possible.
+    CTransaction createOldTransaction() const { return tx.createOldTransaction(); }
     /**
      * Fast calculation of lower bound of current priority as update
      * from entry priority. Only inputs that were originally in-chain will age.
@@ -202,13 +210,31 @@ private:
     const LockPoints& lp;
 };
 
+struct set_dsproof
+{
+    set_dsproof(int _dsproof) : dsproof(_dsproof) { }
+
+    void operator() (CTxMemPoolEntry &e) { e.dsproof = dsproof; }
+
+private:
+    int dsproof;
+};
+
 // extracts a TxMemPoolEntry's transaction hash
 struct mempoolentry_txid
 {
     typedef uint256 result_type;
     result_type operator() (const CTxMemPoolEntry &entry) const
     {
-        return entry.GetTx().GetHash();
+        return entry.GetTxId();
+    }
+};
+
+// hashes an outpoint for the mempool's spent-outputs index
+struct OutPointShortener
+{
+    inline size_t operator()(const COutPoint &outpoint) const {
+        return outpoint.hash.GetCheapHash() + outpoint.n;
     }
 };
 
@@ -261,7 +287,7 @@ public:
         double f1 = (double)a.GetModifiedFee() * b.GetTxSize();
         double f2 = (double)b.GetModifiedFee() * a.GetTxSize();
         if (f1 == f2) {
-            return b.GetTx().GetHash() < a.GetTx().GetHash();
+            return b.GetTxId() < a.GetTxId();
         }
         return f1 > f2;
     }
@@ -280,14 +306,14 @@ public:
 class CInPoint
 {
 public:
-    const CTransaction* ptx;
+    const uint256* ptxid; //! points to the txid of the mempool entry
     Tx tx;
     uint32_t n;
 
     CInPoint() { SetNull(); }
-    CInPoint(const CTransaction* ptxIn, const Tx &txIn, uint32_t nIn) { ptx = ptxIn; tx = txIn; n = nIn; }
-    void SetNull() { ptx = NULL; n = (uint32_t) -1; }
-    bool IsNull() const { return (ptx == NULL && n == (uint32_t) -1); }
+    CInPoint(const uint256* ptxidIn, const Tx &txIn, uint32_t nIn) { ptxid = ptxidIn; tx = txIn; n = nIn; }
+    void SetNull() { ptxid = NULL; n = (uint32_t) -1; }
+    bool IsNull() const { return (ptxid == NULL && n == (uint32_t) -1); }
 };
 
 /**
@@ -382,8 +408,8 @@ public:
     typedef boost::multi_index_container<
         CTxMemPoolEntry,
         boost::multi_index::indexed_by<
-            // sorted by txid
-            boost::multi_index::ordered_unique<mempoolentry_txid>,
+            // hashed by txid
+            boost::multi_index::hashed_unique<mempoolentry_txid, HashShortener>,
             // sorted by fee rate
             boost::multi_index::ordered_non_unique<
                 boost::multi_index::identity<CTxMemPoolEntry>,
@@ -407,7 +433,7 @@ public:
     typedef indexed_transaction_set::nth_index<0>::type::iterator txiter;
     struct CompareIteratorByHash {
         bool operator()(const txiter &a, const txiter &b) const {
-            return a->GetTx().GetHash() < b->GetTx().GetHash();
+            return a->GetTxId() < b->GetTxId();
         }
     };
     typedef std::set<txiter, CompareIteratorByHash> setEntries;
@@ -449,11 +475,51 @@ private:
     typedef std::map<txiter, TxLinks, CompareIteratorByHash> txlinksMap;
     txlinksMap mapLinks;
 
+    /*
+     * Every transaction we validate looks up itself and its inputs in the mempool.
+     * To make those not wait for the mempool lock, we index the entries of mapTx
+     * in shards that each have their own lock.
+     * The shards are only changed while holding 'cs', so a shard lock is always taken
+     * after 'cs' and code holding 'cs' can read the shards without their locks.
+     * An entry is removed from its shard before it is erased from mapTx and its tx
+     * is never changed while in the mempool, so readers can copy it under the shard lock.
+     */
+    enum { ShardCount = 64 };
+    struct EntryHash {
+        inline size_t operator()(const CTxMemPoolEntry *entry) const {
+            return entry->txid.GetCheapHash();
+        }
+    };
+    struct EntryEquals {
+        inline bool operator()(const CTxMemPoolEntry *a, const CTxMemPoolEntry *b) const {
+            return a->txid == b->txid;
+        }
+        inline bool operator()(const uint256 &txid, const CTxMemPoolEntry *entry) const {
+            return entry->txid == txid;
+        }
+    };
+    struct TxShard {
+        mutable boost::shared_mutex lock;
+        boost::unordered_set<const CTxMemPoolEntry*, EntryHash, EntryEquals> txs;
+
+        inline boost::unordered_set<const CTxMemPoolEntry*, EntryHash, EntryEquals>::const_iterator find(const uint256 &txid) const {
+            return txs.find(txid, HashShortener(), EntryEquals());
+        }
+    };
+    inline TxShard &shard(const uint256 &hash) {
+        return m_shards[*(hash.begin() + 31) % ShardCount];
+    }
+    inline const TxShard &shard(const uint256 &hash) const {
+        return m_shards[*(hash.begin() + 31) % ShardCount];
+    }
+    TxShard m_shards[ShardCount];
+
     void UpdateParent(txiter entry, txiter parent, bool add);
     void UpdateChild(txiter entry, txiter child, bool add);
 
 public:
-    std::map<COutPoint, CInPoint> mapNextTx;
+    typedef boost::unordered_map<COutPoint, CInPoint, OutPointShortener> NextTxMap;
+    NextTxMap mapNextTx;
     std::map<uint256, std::pair<double, CAmount> > mapDeltas;
 
     /** Create a new CTxMemPool.
@@ -485,10 +551,11 @@ public:
     void removeConflicts(const CTransaction &tx, std::list<CTransaction>& removed);
     /**
      * @brief removeForBlock should be called when a block is accepted on-chain which would remove all conflicting transactions from mempool.
-     * @param vtx the list of transactions contained in the block.
+     * @param block the block, with its transactions already found.
+     * @param txids the txid of each transaction in the block, in order.
      * @param conflicts out-variable to be filled with conflicting transactions.
      */
-    void removeForBlock(const std::vector<CTransaction>& vtx, std::list<CTransaction>& conflicts);
+    void removeForBlock(const FastBlock &block, const std::vector<uint256> &txids, std::list<CTransaction>& conflicts);
     void clear();
     void _clear(); //lock free
     void queryHashes(std::vector<uint256>& vtxid);
@@ -539,10 +606,8 @@ public:
     CFeeRate GetMinFee() const;
 
     /** Remove transactions from the mempool until its dynamic size is <= sizelimit.
-      *  pvNoSpendsRemaining, if set, will be populated with the list of transactions
-      *  which are not in mempool which no longer have any spends in this mempool.
       */
-    void TrimToSize(size_t sizelimit, std::vector<uint256>* pvNoSpendsRemaining=NULL);
+    void TrimToSize(size_t sizelimit);
 
     /** Expire all transaction (and their dependencies) in the mempool older than time. Return the number of removed transactions. */
     int Expire(int64_t time);
@@ -559,13 +624,17 @@ public:
         return totalTxSize;
     }
 
-    bool exists(uint256 hash) const
+    /// Returns true if the txid is in the mempool, this doesn't lock the mempool.
+    bool exists(const uint256 &hash) const
     {
-        LOCK(cs);
-        return (mapTx.count(hash) != 0);
+        const TxShard &s = shard(hash);
+        boost::shared_lock<boost::shared_mutex> lock(s.lock);
+        return s.find(hash) != s.txs.end();
     }
 
+    /// Finds the transaction by txid, this doesn't lock the mempool.
     bool lookup(const uint256 &hash, CTransaction& result) const;
+    /// Finds the transaction by txid, this doesn't lock the mempool.
     bool lookup(const uint256 &hash, Tx& result) const;
     bool lookup(const COutPoint &outpoint, Tx& result) const;
 
@@ -43,6 +43,8 @@
 #include <utxo/UnspentOutputDatabase.h>
 
 #include <UnspentOutputData.h>
+#include <primitives/pubkey.h>
+#include <script/script_error.h>
 #include <fstream>
 
 #include <streaming/MessageBuilder.h>
@@ -56,6 +58,18 @@
 
 using Validation::Exception;
 
+namespace {
+// A rough estimate of the time needed to validate a transaction, which is dominated by its inputs.
+inline uint32_t txValidationCost(int inputCount, int txSize)
+{
+    return static_cast<uint32_t>(4 + inputCount * 16 + txSize / 64);
+}
+
+// The amount of Schnorr signatures we collect before verifying them as a batch.
+// Larger batches hardly get cheaper per signature, but they use more memory.
+constexpr size_t SchnorrBatchSize = 128;
+}
+
 //---------------------------------------------------------
 
 ValidationEnginePrivate::ValidationEnginePrivate(Validation::EngineType type)
@@ -67,18 +81,59 @@ ValidationEnginePrivate::ValidationEnginePrivate(Validation::EngineType type)
     mempool(nullptr),
     recentTxRejects(120000, 0.000001),
     engineType(type),
-    lastFullBlockScheduled(-1)
-#ifdef ENABLE_BENCHMARKS
-    , m_headerCheckTime(0),
-    m_basicValidityChecks(0),
-    m_contextCheckTime(0),
-    m_utxoTime(0),
-    m_validationTime(0),
-    m_loadingTime(0),
-    m_mempoolTime(0),
-    m_walletTime(0)
-#endif
+    batchSchnorr(GetBoolArg("-batchschnorr", Settings::DefaultSchnorrBatchVerification)),
+    lastFullBlockScheduled(-1),
+    m_blocksValidated(0),
+    m_transactionsValidated(0),
+    m_utxoLookups(0),
+    m_sigChecks(0),
+    m_chunkImbalanceTime(0)
 {
+    for (auto &stage : m_stages) {
+        stage.count = 0;
+        stage.totalTime = 0;
+        stage.maxTime = 0;
+        for (auto &bucket : stage.histogram) {
+            bucket = 0;
+        }
+    }
+}
+
+void ValidationEnginePrivate::addStageTime(Validation::Statistics::Stage stage, int64_t microSeconds)
+{
+    assert(stage >= 0 && stage < Validation::Statistics::StageCount);
+    const uint64_t duration = static_cast<uint64_t>(std::max<int64_t>(0, microSeconds));
+    StageCounter &counter = m_stages[stage];
+    counter.count.fetch_add(1, std::memory_order_relaxed);
+    counter.totalTime.fetch_add(duration, std::memory_order_relaxed);
+    uint64_t max = counter.maxTime.load(std::memory_order_relaxed);
+    while (duration > max && !counter.maxTime.compare_exchange_weak(max, duration, std::memory_order_relaxed));
+
+    int bucket = 0;
+    for (uint64_t i = duration; i > 0 && bucket < Validation::Statistics::HistogramBuckets - 1; i >>= 1)
+        ++bucket;
+    counter.histogram[bucket].fetch_add(1, std::memory_order_relaxed);
+}
+
+Validation::Statistics ValidationEnginePrivate::statistics() const
+{
+    Validation::Statistics answer;
+    for (int i = 0; i < Validation::Statistics::StageCount; ++i) {
+        const StageCounter &counter = m_stages[i];
+        Validation::Statistics::StageTimes &times = answer.stages[static_cast<size_t>(i)];
+        times.count = counter.count.load(std::memory_order_relaxed);
+        times.totalTime = counter.totalTime.load(std::memory_order_relaxed);
+        times.maxTime = counter.maxTime.load(std::memory_order_relaxed);
+        for (int bucket = 0; bucket < Validation::Statistics::HistogramBuckets; ++bucket) {
+            times.histogram[static_cast<size_t>(bucket)] = counter.histogram[bucket].load(std::memory_order_relaxed);
+        }
+    }
+    answer.blocks = m_blocksValidated.load(std::memory_order_relaxed);
+    answer.transactions = m_transactionsValidated.load(std::memory_order_relaxed);
+    answer.utxoLookups = m_utxoLookups.load(std::memory_order_relaxed);
+    answer.sigChecks = m_sigChecks.load(std::memory_order_relaxed);
+    answer.chunkImbalanceTime = m_chunkImbalanceTime.load(std::memory_order_relaxed);
+    return answer;
 }
 
 /**
@@ -539,6 +594,7 @@ void ValidationEnginePrivate::processNewBlock(std::shared_ptr<BlockValidationSta
 
     const bool isNextChainTip = index->nHeight == blockchain->Height() + 1; // If a parent was rejected for some reason, this is false
     bool addToChain = isNextChainTip && blockValid && Blocks::DB::instance()->headerChain().Contains(index);
+    int64_t mempoolTime = 0;
     try {
         if (!isNextChainTip)
             index->nStatus |= BLOCK_FAILED_CHILD;
@@ -559,10 +615,17 @@ void ValidationEnginePrivate::processNewBlock(std::shared_ptr<BlockValidationSta
                 if (state->m_sigChecksCounted > maxSigChecks)
                     throw Exception("bad-blk-sigcheck");
 
-                CBlock block = state->m_block.createOldBlock();
                 if (state->flags.enableValidation) {
                     CAmount blockReward = state->m_blockFees.load() + GetBlockSubsidy(index->nHeight, Params().GetConsensus());
-                    if (block.vtx[0].GetValueOut() > blockReward)
+                    CAmount coinbaseValue = 0;
+                    Tx::Iterator iter(state->m_block.transactions().at(0));
+                    while (iter.next(Tx::OutputValue) == Tx::OutputValue) {
+                        const CAmount value = static_cast<CAmount>(iter.longData());
+                        coinbaseValue += value;
+                        if (!MoneyRange(value) || !MoneyRange(coinbaseValue))
+                            throw Exception("bad-cb-amount");
+                    }
+                    if (coinbaseValue > blockReward)
                         throw Exception("bad-cb-amount");
                 }
 
@@ -577,23 +640,25 @@ void ValidationEnginePrivate::processNewBlock(std::shared_ptr<BlockValidationSta
                 index->RaiseValidity(BLOCK_VALID_SCRIPTS); // done
                 MarkIndexUnsaved(index);
 
-#ifdef ENABLE_BENCHMARKS
                 int64_t end, start = GetTimeMicros();
-#endif
                 bool savedState = mempool->utxo()->blockFinished(index->nHeight, hash);
-#ifdef ENABLE_BENCHMARKS
                 end = GetTimeMicros();
-                m_utxoTime.fetch_add(end - start);
+                addStageTime(Validation::Statistics::UtxoUpdate, state->m_utxoTime + end - start);
                 start = end;
-#endif
                 CValidationState val;
                 // if savedState is true then the UTXO just wrote a checkpoint, use this opportunity to also
                 // write all block-index state.
                 if (!FlushStateToDisk(val, savedState ? FLUSH_STATE_ALWAYS : FLUSH_STATE_IF_NEEDED))
                     fatal(val.GetRejectReason().c_str());
 
+                if (state->m_txids.size() != state->m_block.transactions().size()) {
+                    state->m_txids.clear();
+                    for (const Tx &tx : state->m_block.transactions()) {
+                        state->m_txids.push_back(tx.createHash());
+                    }
+                }
                 std::list<CTransaction> txConflicted;
-                mempool->removeForBlock(block.vtx, txConflicted);
+                mempool->removeForBlock(state->m_block, state->m_txids, txConflicted);
                 state->signalChildren(); // start tx-validation of next one.
 
                 blockchain->SetTip(index);
@@ -601,11 +666,9 @@ void ValidationEnginePrivate::processNewBlock(std::shared_ptr<BlockValidationSta
                 mempool->AddTransactionsUpdated(1);
                 mempool->doubleSpendProofStorage()->newBlockFound();
                 cvBlockChange.notify_all();
-#ifdef ENABLE_BENCHMARKS
                 end = GetTimeMicros();
-                m_mempoolTime.fetch_add(end - start);
+                mempoolTime = end - start;
                 start = end;
-#endif
                 if (!farBehind) {
                     // ^ The Hub doesn't accept transactions on IBD, so avoid doing unneeded work.
                     std::lock_guard<std::mutex> rejects(recentRejectsLock);
@@ -618,12 +681,12 @@ void ValidationEnginePrivate::processNewBlock(std::shared_ptr<BlockValidationSta
                     ValidationNotifier().SyncTx(Tx::fromOldTransaction(tx, &pool));
                 }
                 ValidationNotifier().SyncAllTransactionsInBlock(state->m_block, index); // ... and about transactions that got confirmed:
-                ValidationNotifier().SyncAllTransactionsInBlock(&block);
+                if (ValidationNotifier().NeedsOldBlock()) { // creating a CBlock is expensive, only do it if someone uses it.
+                    CBlock block = state->m_block.createOldBlock();
+                    ValidationNotifier().SyncAllTransactionsInBlock(&block);
+                }
 
-#ifdef ENABLE_BENCHMARKS
-                end = GetTimeMicros();
-                m_walletTime.fetch_add(end - start);
-#endif
+                addStageTime(Validation::Statistics::Wallet, GetTimeMicros() - start);
             }
         } else {
             logDebug(Log::BlockValidation) << "Not appending: isNextChainTip" << isNextChainTip << "blockValid:" << blockValid << "addToChain" << addToChain;
@@ -655,28 +718,22 @@ void ValidationEnginePrivate::processNewBlock(std::shared_ptr<BlockValidationSta
             << " tx=" << blockchain->Tip()->nChainTx
             << " date=" << DateTimeStrFormat("%Y-%m-%d %H:%M:%S", index->GetBlockTime()).c_str()
             << Log::Fixed << Log::precision(1);
-#ifdef ENABLE_BENCHMARKS
     if ((index->nHeight % 1000) == 0) {
-        logCritical(Log::Bench) << "Times. Header:" << m_headerCheckTime
-                                << "Structure:" << m_basicValidityChecks
-                                << "Context:" << m_contextCheckTime
-                                << "UTXO:" << m_utxoTime
-                                << "validation:" << m_validationTime
-                                << "loading:" << m_loadingTime
-                                << "mempool:" << m_mempoolTime
-                                << "wallet:" << m_walletTime;
+        auto log = logInfo(Log::Bench) << "Times.";
+        for (int i = 0; i < Validation::Statistics::StageCount; ++i) {
+            log << Validation::Statistics::stageName(static_cast<Validation::Statistics::Stage>(i))
+                << m_stages[i].totalTime.load(std::memory_order_relaxed);
+        }
+        log << "chunk-imbalance:" << m_chunkImbalanceTime.load(std::memory_order_relaxed);
     }
     int64_t start = GetTimeMicros();
-#endif
     uiInterface.NotifyBlockTip(farBehind, index);
     {
         LOCK(cs_main);
         ValidationNotifier().UpdatedTransaction(hashPrevBestCoinBase);
     }
     hashPrevBestCoinBase = state->m_block.transactions().at(0).createHash();
-#ifdef ENABLE_BENCHMARKS
-    m_mempoolTime.fetch_add(GetTimeMicros() - start);
-#endif
+    addStageTime(Validation::Statistics::Mempool, mempoolTime + GetTimeMicros() - start);
     if (state->m_onResultFlags & Validation::ForwardGoodToPeers) {
         int totalBlocks = Blocks::DB::instance()->headerChain().Height();
         LOCK(cs_vNodes);
@@ -1051,6 +1108,7 @@ BlockValidationState::BlockValidationState(const std::weak_ptr<ValidationEngineP
       m_validationStatus(BlockValidityUnknown),
       m_blockFees(0),
       m_sigChecksCounted(0),
+      m_utxoTime(0),
       m_parent(parent)
 {
     assert(onResultFlags < 0x100);
@@ -1078,16 +1136,11 @@ BlockValidationState::~BlockValidationState()
 
 void BlockValidationState::load()
 {
-#ifdef ENABLE_BENCHMARKS
     int64_t start = GetTimeMicros();
-#endif
     m_block = Blocks::DB::instance()->loadBlock(m_blockPos);
-#ifdef ENABLE_BENCHMARKS
-    int64_t end = GetTimeMicros();
     auto parent = m_parent.lock();
     if (parent)
-        parent->m_loadingTime.fetch_add(end - start);
-#endif
+        parent->addStageTime(Validation::Statistics::Loading, GetTimeMicros() - start);
     DEBUGBV << "succeeded;" << m_block.createHash() << '/' << m_block.size();
 }
 
@@ -1160,9 +1213,7 @@ void BlockValidationState::checks1NoContext()
         }
         return;
     }
-#ifdef ENABLE_BENCHMARKS
     int64_t start2, end2, end, start; start2 = end2 = start = end = GetTimeMicros();
-#endif
 
     DEBUGBV << "Starting" << m_block.createHash() << "CheckPOW:" << m_checkPow << "CheckMerkleRoot:" << m_checkMerkleRoot << "ValidityOnly:" << m_checkValidityOnly;
 
@@ -1175,9 +1226,7 @@ void BlockValidationState::checks1NoContext()
         if (m_block.timestamp() > GetAdjustedTime() + 2 * 60 * 60)
             throw Exception("time-too-new");
 
-#ifdef ENABLE_BENCHMARKS
         start2 = end = GetTimeMicros();
-#endif
         // if this is a full block, test the transactions too.
         if (m_block.isFullBlock() && m_checkTransactionValidity) {
             m_block.findTransactions(); // find out if the block and its transactions are well formed and parsable.
@@ -1231,9 +1280,7 @@ void BlockValidationState::checks1NoContext()
         }
 
         m_validationStatus.fetch_or(BlockValidHeader);
-#ifdef ENABLE_BENCHMARKS
         end2 = GetTimeMicros();
-#endif
     } catch (const Exception &ex) {
         blockFailed(ex.punishment(), ex.what(), ex.rejectCode(), ex.corruptionPossible());
     } catch (const std::runtime_error &ex) {
@@ -1243,10 +1290,9 @@ void BlockValidationState::checks1NoContext()
 
     std::shared_ptr<ValidationEnginePrivate> parent = m_parent.lock();
     if (parent) {
-#ifdef ENABLE_BENCHMARKS
-        parent->m_headerCheckTime.fetch_add(end - start);
-        parent->m_basicValidityChecks.fetch_add(end2 - start2);
-#endif
+        parent->addStageTime(Validation::Statistics::HeaderCheck, end - start);
+        if (end2 > start2)
+            parent->addStageTime(Validation::Statistics::StructureCheck, end2 - start2);
         parent->strand.dispatch(std::bind(&ValidationEnginePrivate::blockHeaderValidated, parent, shared_from_this()));
     }
 }
@@ -1258,9 +1304,7 @@ void BlockValidationState::checks2HaveParentHeaders()
     assert(m_block.isFullBlock());
     DEBUGBV << m_blockIndex->nHeight << m_block.createHash();
 
-#ifdef ENABLE_BENCHMARKS
-    int64_t start = GetTimeMicros();
-#endif
+    const int64_t start = GetTimeMicros();
     try {
         m_block.findTransactions();
         CBlock block = m_block.createOldBlock();
@@ -1312,16 +1356,26 @@ void BlockValidationState::checks2HaveParentHeaders()
     }
 
     flags.updateForBlock(m_blockIndex);
-#ifdef ENABLE_BENCHMARKS
-    int64_t end = GetTimeMicros();
-#endif
-
+    if (m_blockIndex->pprev) { // genesis doesn't touch the UTXO
+        // This only needs our own block, doing it here means it overlaps with the validation of our parent.
+        try {
+            prepareUtxoData();
+        } catch (const Exception &e) {
+            blockFailed(e.punishment(), e.what(), e.rejectCode(), e.corruptionPossible());
+            finishUp();
+            return;
+        } catch (std::runtime_error &e) {
+            assert(false);
+            blockFailed(100, e.what(), Validation::RejectInternal);
+            finishUp();
+            return;
+        }
+    }
     int status = m_validationStatus.load();
     auto parent = m_parent.lock();
+    if (parent)
+        parent->addStageTime(Validation::Statistics::ContextCheck, GetTimeMicros() - start);
     while (parent) {
-#ifdef ENABLE_BENCHMARKS
-        parent->m_contextCheckTime.fetch_add(end - start);
-#endif
         int newStatus = status | BlockValidChainHeaders;
         if  (m_validationStatus.compare_exchange_weak(status, newStatus, std::memory_order_relaxed, std::memory_order_relaxed)) {
             if ((status & BlockValidParent) || (status & BlockInvalid)) { // we just added the last bit.
@@ -1330,12 +1384,100 @@ void BlockValidationState::checks2HaveParentHeaders()
                 assert(!m_checkValidityOnly); // why did we get here if the
                 DEBUGBV << "  saving block for later, no parent yet" << m_block.createHash()
                         << '@' << m_blockIndex->nHeight << "parent:" << m_blockIndex->pprev->GetBlockHash();
+                Application::instance()->ioService().post(std::bind(&BlockValidationState::prefetchInputs, shared_from_this()));
             }
             return;
         }
     }
 }
 
+void BlockValidationState::prepareUtxoData()
+{
+    assert(!m_utxoDataPrepared);
+    assert(m_blockIndex);
+    auto parent = m_parent.lock();
+    if (!parent)
+        return;
+    UnspentOutputDatabase::BlockData &data = m_utxoData;
+    data.blockHeight = m_blockIndex->nHeight;
+    data.outputs.reserve(m_block.transactions().size());
+    // when the UTXO wants it, we pass in the amount and script of each output too.
+    const bool storeOutputData = !m_checkValidityOnly && parent->mempool->utxo()->storesOutputData();
+    Streaming::BufferPool outputDataPool;
+    std::vector<UnspentOutputDatabase::OutputData> outputData;
+    int64_t outputAmount = 0;
+    m_txCosts.clear();
+    m_txCosts.reserve(m_block.transactions().size());
+    Tx::Iterator iter = Tx::Iterator(m_block);
+    int outputCount = 0, inputCount = 0, txIndex = 0;
+    uint256 prevTxHash;
+    while (true) {
+        const auto type = iter.next();
+        if (type == Tx::End) {
+            Tx tx = iter.prevTx();
+            const int offsetInBlock = tx.offsetInBlock(m_block);
+            assert(tx.isValid());
+            m_txCosts.push_back(txValidationCost(inputCount, tx.size()));
+            inputCount = 0;
+            const uint256 txHash = tx.createHash();
+            if (flags.hf201811Active && txIndex > 1 && txHash.Compare(prevTxHash) <= 0)
+                throw Exception("tx-ordering-not-CTOR");
+            data.outputs.push_back(UnspentOutputDatabase::BlockData::TxOutputs(txHash, offsetInBlock, 0, outputCount - 1));
+            if (storeOutputData) {
+                assert(outputData.size() == static_cast<size_t>(outputCount));
+                data.outputs.back().outputData = std::move(outputData);
+                outputData.clear();
+            }
+            outputCount = 0;
+            if (flags.hf201811Active)
+                prevTxHash = txHash;
+            ++txIndex;
+            if (iter.next() == Tx::End) // double end: last tx in block
+                break;
+        }
+        else if (iter.tag() == Tx::OutputValue) { // next output!
+            // if (iter.longData() == 0) logDebug(Log::BlockValidation) << "Output with zero value";
+            outputCount++;
+            if (storeOutputData)
+                outputAmount = static_cast<int64_t>(iter.longData());
+        }
+        else if (iter.tag() == Tx::PrevTxHash) {
+            ++inputCount;
+        }
+        else if (storeOutputData && iter.tag() == Tx::OutputScript) {
+            outputData.push_back(UnspentOutputData::createOutputData(outputDataPool, outputAmount, iter.byteData()));
+        }
+    }
+    m_utxoDataPrepared = true;
+}
+
+void BlockValidationState::prefetchInputs()
+{
+    auto parent = m_parent.lock();
+    if (!parent)
+        return;
+    UnspentOutputDatabase *utxo = parent->mempool->utxo();
+    const size_t txCount = m_block.transactions().size();
+    try {
+        for (size_t i = 1; i < txCount;) {
+            // once our parent is done the real validation starts, stop competing with it.
+            if (m_validationStatus.load() & (BlockValidParent | BlockInvalid))
+                return;
+            std::vector<Tx::Input> inputs;
+            for (const size_t end = std::min(txCount, i + 1000); i < end; ++i) {
+                auto txIter = Tx::Iterator(m_block.transactions().at(i));
+                for (auto &input : Tx::findInputs(txIter)) {
+                    inputs.push_back(input);
+                }
+            }
+            utxo->findAll(inputs);
+        }
+    } catch (const std::exception &e) {
+        // the actual validation will find and report any issues.
+        DEBUGBV << "prefetch stopped:" << e.what();
+    }
+}
+
 void BlockValidationState::updateUtxoAndStartValidation()
 {
     DEBUGBV << m_block.createHash();
@@ -1353,42 +1495,15 @@ void BlockValidationState::updateUtxoAndStartValidation()
 
     try {
         assert (m_block.transactions().size() > 0);
-        // inserting all outputs that are created in this block first.
-        // we do this in a single thread since inserting massively parallel will just cause a huge overhead
-        // and we'd end up being no faster while competing for the scarce resources that are the UTXO DB
-        UnspentOutputDatabase::BlockData data;
-        data.blockHeight = m_blockIndex->nHeight;
-        data.outputs.reserve(m_block.transactions().size());
-        Tx::Iterator iter = Tx::Iterator(m_block);
-        int outputCount = 0, txIndex = 0;
-        uint256 prevTxHash;
-        while (true) {
-            const auto type = iter.next();
-            if (type == Tx::End) {
-                Tx tx = iter.prevTx();
-                const int offsetInBlock = tx.offsetInBlock(m_block);
-                assert(tx.isValid());
-                const uint256 txHash = tx.createHash();
-                if (flags.hf201811Active && txIndex > 1 && txHash.Compare(prevTxHash) <= 0)
-                    throw Exception("tx-ordering-not-CTOR");
-                data.outputs.push_back(UnspentOutputDatabase::BlockData::TxOutputs(txHash, offsetInBlock, 0, outputCount - 1));
-                outputCount = 0;
-                if (flags.hf201811Active)
-                    prevTxHash = txHash;
-                ++txIndex;
-                if (iter.next() == Tx::End) // double end: last tx in block
-                    break;
-            }
-            else if (iter.tag() == Tx::OutputValue) { // next output!
-                // if (iter.longData() == 0) logDebug(Log::BlockValidation) << "Output with zero value";
-                outputCount++;
-            }
-        }
+        if (!m_utxoDataPrepared)
+            prepareUtxoData();
+        const UnspentOutputDatabase::BlockData &data = m_utxoData;
 
-        int chunks, itemsPerChunk;
+        int chunks;
         if (m_checkValidityOnly) { // no UTXO interaction allowed.
             chunks = 1;
-            itemsPerChunk = m_block.transactions().size();
+            m_chunkBoundaries = { 0, static_cast<int>(m_block.transactions().size()) };
+            m_chunkOrder = { 0 };
 
             for (auto tx : data.outputs) {
                 assert(tx.firstOutput == 0);
@@ -1401,22 +1516,28 @@ void BlockValidationState::updateUtxoAndStartValidation()
             }
         }
         else {
-            calculateTxCheckChunks(chunks, itemsPerChunk);
-#ifdef ENABLE_BENCHMARKS
-            int64_t start = GetTimeMicros();
-#endif
+            chunks = calculateTxCheckChunks();
+            const int64_t start = GetTimeMicros();
+            // inserting all outputs that are created in this block first.
+            // The UTXO spreads the insert of huge blocks over the thread pool itself, partitioned by
+            // shortHash to avoid competing for the same buckets. Smaller blocks are inserted by this thread.
             parent->mempool->utxo()->insertAll(data);
-#ifdef ENABLE_BENCHMARKS
-            int64_t end = GetTimeMicros();
-            parent->m_utxoTime.fetch_add(end - start);
-#endif
+            m_utxoTime.fetch_add(GetTimeMicros() - start);
         }
+        m_txids.reserve(data.outputs.size());
+        for (const auto &tx : data.outputs) {
+            m_txids.push_back(tx.txid);
+        }
+        m_utxoData = UnspentOutputDatabase::BlockData(); // free memory, no longer needed.
         m_txChunkLeftToFinish.store(chunks);
         m_txChunkLeftToStart.store(chunks);
         m_undoItems.resize(static_cast<size_t>(chunks));
+        m_chunkDurations.resize(static_cast<size_t>(chunks));
+        m_checkSignaturesStart = GetTimeMicros();
 
-        for (int i = 0; i < chunks; ++i) {
-            Application::instance()->ioService().post(std::bind(&BlockValidationState::checkSignaturesChunk,
+        const int jobs = std::min<int>(chunks, std::max(1u, boost::thread::hardware_concurrency()));
+        for (int i = 0; i < jobs; ++i) {
+            Application::instance()->ioService().post(std::bind(&BlockValidationState::checkSignatures,
                                                                 shared_from_this()));
         }
     } catch(const UTXOInternalError &ex) {
@@ -1431,58 +1552,156 @@ void BlockValidationState::updateUtxoAndStartValidation()
     }
 }
 
-void BlockValidationState::checkSignaturesChunk()
+int BlockValidationState::calculateTxCheckChunks()
 {
-#ifdef ENABLE_BENCHMARKS
-    int64_t start = GetTimeMicros();
+    const int txCount = static_cast<int>(m_block.transactions().size());
+    assert(m_txCosts.size() == static_cast<size_t>(txCount));
+    uint64_t totalCost = 0;
+    for (auto cost : m_txCosts) {
+        totalCost += cost;
+    }
+    const int threads = static_cast<int>(std::max(1u, boost::thread::hardware_concurrency()));
+    const int maxChunks = std::max(1, std::min((txCount + 9) / 10, threads * 4));
+    const uint64_t costPerChunk = std::max<uint64_t>(1, (totalCost + static_cast<uint64_t>(maxChunks) - 1) / static_cast<uint64_t>(maxChunks));
+
+    m_chunkBoundaries.clear();
+    m_chunkBoundaries.push_back(0);
+    std::vector<uint64_t> chunkCosts;
+    uint64_t cost = 0;
+    for (int i = 0; i < txCount; ++i) {
+        const uint32_t txCost = m_txCosts.at(static_cast<size_t>(i));
+        // a single expensive transaction gets its own chunk
+        if (cost > 0 && cost + txCost > costPerChunk && txCost >= costPerChunk) {
+            m_chunkBoundaries.push_back(i);
+            chunkCosts.push_back(cost);
+            cost = 0;
+        }
+        cost += txCost;
+        if (cost >= costPerChunk && i + 1 < txCount) {
+            m_chunkBoundaries.push_back(i + 1);
+            chunkCosts.push_back(cost);
+            cost = 0;
+        }
+    }
+    m_chunkBoundaries.push_back(txCount);
+    chunkCosts.push_back(cost);
+    const int chunks = static_cast<int>(chunkCosts.size());
+    assert(m_chunkBoundaries.size() == chunkCosts.size() + 1);
+
+    // start the expensive ones first, the cheap ones fill up the tail.
+    m_chunkOrder.resize(static_cast<size_t>(chunks));
+    for (int i = 0; i < chunks; ++i) {
+        m_chunkOrder[static_cast<size_t>(i)] = i;
+    }
+    std::stable_sort(m_chunkOrder.begin(), m_chunkOrder.end(), [&chunkCosts](int a, int b) {
+        return chunkCosts.at(static_cast<size_t>(a)) > chunkCosts.at(static_cast<size_t>(b));
+    });
+    m_txCosts = std::vector<uint32_t>(); // free memory
+    return chunks;
+}
+
+void BlockValidationState::checkSignatures()
+{
+    // Each job keeps taking chunks until all are started, as such threads that finish early take over the work
+    // that would otherwise be queued up behind a slow chunk.
+    while (true) {
+        const int left = m_txChunkLeftToStart.fetch_sub(1) - 1;
+        if (left < 0)
+            return;
+        checkSignaturesChunk(m_chunkOrder.at(m_chunkOrder.size() - 1 - static_cast<size_t>(left)));
+    }
+}
+
+void BlockValidationState::checkSignaturesChunk(int chunkToStart)
+{
+    const int64_t start = GetTimeMicros();
     int64_t utxoStart, utxoDuration = 0;
-#endif
     auto parent = m_parent.lock();
     if (!parent)
         return;
     assert(parent->mempool);
     UnspentOutputDatabase *utxo = parent->mempool->utxo();
     assert(utxo);
-    const int totalTxCount = static_cast<int>(m_block.transactions().size());
 
-    int chunkToStart = m_txChunkLeftToStart.fetch_sub(1) - 1;
     assert(chunkToStart >= 0);
+    assert(static_cast<size_t>(chunkToStart) + 1 < m_chunkBoundaries.size());
     DEBUGBV << chunkToStart << m_block.createHash();
 
-    int chunks, itemsPerChunk;
-    if (m_checkValidityOnly) {
-        chunks = 1; itemsPerChunk = totalTxCount;
-    } else {
-        calculateTxCheckChunks(chunks, itemsPerChunk);
-    }
     bool blockValid = (m_validationStatus.load() & BlockInvalid) == 0;
-    int txIndex = itemsPerChunk * chunkToStart;
-    const int txMax = std::min(txIndex + itemsPerChunk, totalTxCount);
+    int txIndex = m_chunkBoundaries.at(static_cast<size_t>(chunkToStart));
+    const int txMax = m_chunkBoundaries.at(static_cast<size_t>(chunkToStart) + 1);
     uint32_t chunkSigChecks = 0;
     CAmount chunkFees = 0;
     std::unique_ptr<std::deque<FastUndoBlock::Item> >undoItems(new std::deque<FastUndoBlock::Item>());
 
+    // Schnorr signatures of this chunk get verified in batches, which is cheaper than one by one.
+    SchnorrBatch schnorrBatch;
+    std::vector<std::pair<size_t, int> > batchedTxs; // first index in the batch, and the txIndex.
+    auto verifySchnorrBatch = [&]() {
+        if (schnorrBatch.empty())
+            return;
+        if (!schnorrBatch.verify()) {
+            // find the culprit.
+            const int invalid = schnorrBatch.findInvalid();
+            if (invalid >= 0) {
+                int badTx = -1;
+                for (auto item : batchedTxs) {
+                    if (item.first > static_cast<size_t>(invalid))
+                        break;
+                    badTx = item.second;
+                }
+                logCritical(Log::BlockValidation) << "Rejecting block" << m_block.createHash() << "due to bad signature";
+                logInfo(Log::BlockValidation) << " + tx:" << badTx << "input:" << schnorrBatch.tag(invalid);
+                throw Exception(strprintf("mandatory-script-verify-flag-failed (%s)",
+                                          ScriptErrorString(SCRIPT_ERR_SIG_NULLFAIL)));
+            }
+        }
+        schnorrBatch.clear();
+        batchedTxs.clear();
+    };
+
     try {
-        for (;blockValid && txIndex < txMax; ++txIndex) {
+        // Collect the inputs of all transactions in this chunk and do the UTXO lookups
+        // in one batch, which allows the UTXO to optimize disk access.
+        std::vector<Tx::Input> chunkInputs;
+        std::vector<int> firstInputOfTx; // index in chunkInputs
+        for (int i = txIndex; blockValid && i < txMax; ++i) {
+            firstInputOfTx.push_back(static_cast<int>(chunkInputs.size()));
+            if (i == 0) // skip inputs check for coinbase
+                continue;
+            auto txIter = Tx::Iterator(m_block.transactions().at(static_cast<size_t>(i)));
+            for (auto &input : Tx::findInputs(txIter)) {
+                chunkInputs.push_back(input);
+            }
+        }
+        firstInputOfTx.push_back(static_cast<int>(chunkInputs.size()));
+        utxoStart = GetTimeMicros();
+        const std::vector<UnspentOutput> chunkUnspents = utxo->findAll(chunkInputs);
+        std::vector<SpentOutput> chunkRemoved;
+        if (!m_checkValidityOnly) {
+            std::vector<uint64_t> rmHints;
+            rmHints.reserve(chunkUnspents.size());
+            for (const auto &unspentOutput : chunkUnspents) {
+                rmHints.push_back(unspentOutput.rmHint());
+            }
+            chunkRemoved = utxo->removeAll(chunkInputs, rmHints);
+        }
+        utxoDuration += GetTimeMicros() - utxoStart;
+        parent->m_utxoLookups.fetch_add(chunkInputs.size(), std::memory_order_relaxed);
+
+        for (int chunkTx = 0; blockValid && txIndex < txMax; ++txIndex, ++chunkTx) {
             CAmount fees = 0;
             Tx tx = m_block.transactions().at(static_cast<size_t>(txIndex));
             const uint256 hash = tx.createHash();
 
             std::vector<ValidationPrivate::UnspentOutput> unspents; // list of prev outputs
             auto txIter = Tx::Iterator(tx);
-            auto inputs = Tx::findInputs(txIter);
-            if (txIndex == 0)
-                inputs.clear(); // skip inputs check for coinbase
+            txIter.next(Tx::OutputValue + Tx::End); // skip inputs, we already looked them up
             std::vector<int> prevheights; // the height of each input
-            for (auto input : inputs) { // find inputs
+            for (int inputIndex = firstInputOfTx[chunkTx]; inputIndex < firstInputOfTx[chunkTx + 1]; ++inputIndex) {
+                const Tx::Input &input = chunkInputs[inputIndex];
                 ValidationPrivate::UnspentOutput prevOut;
-#ifdef ENABLE_BENCHMARKS
-                utxoStart = GetTimeMicros();
-#endif
-                UnspentOutput unspentOutput = utxo->find(input.txid, input.index);
-#ifdef ENABLE_BENCHMARKS
-                utxoDuration += GetTimeMicros() - utxoStart;
-#endif
+                const UnspentOutput &unspentOutput = chunkUnspents[inputIndex];
                 bool validUtxo = unspentOutput.isValid();
                 bool validInterBlockSpent = validUtxo; // ONLY used when m_validityOnly is true!
                 if (!validUtxo && m_checkValidityOnly) {
@@ -1550,13 +1769,7 @@ void BlockValidationState::checkSignaturesChunk()
                 }
 
                 if (!m_checkValidityOnly) {
-#ifdef ENABLE_BENCHMARKS
-                    utxoStart = GetTimeMicros();
-#endif
-                    SpentOutput removed = utxo->remove(input.txid, input.index, unspentOutput.rmHint());
-#ifdef ENABLE_BENCHMARKS
-                    utxoDuration += GetTimeMicros() - utxoStart;
-#endif
+                    const SpentOutput &removed = chunkRemoved[inputIndex];
                     if (!removed.isValid()) {
                         logCritical(Log::BlockValidation) << "Rejecting block" << m_block.createHash() << "due to deleted input";
                         logInfo(Log::BlockValidation) << " + txid:" << tx.createHash() << "needs input:" << input.txid << input.index;
@@ -1571,20 +1784,25 @@ void BlockValidationState::checkSignaturesChunk()
             }
 
             if (flags.enableValidation && txIndex > 0) {
-                CTransaction old = tx.createOldTransaction();
+                const TxView view(tx);
                 // Check that transaction is BIP68 final
                 int nLockTimeFlags = 0;
                 if (flags.nLocktimeVerifySequence)
                     nLockTimeFlags |= LOCKTIME_VERIFY_SEQUENCE;
-                if (!SequenceLocks(old, nLockTimeFlags, &prevheights, *m_blockIndex))
+                if (!SequenceLocks(view, nLockTimeFlags, &prevheights, *m_blockIndex))
                     throw Exception("bad-txns-nonfinal");
 
                 bool spendsCoinBase;
                 uint32_t sigChecks = 0;
-                ValidationPrivate::validateTransactionInputs(old, unspents, m_blockIndex->nHeight, flags, fees,
-                                                             sigChecks, spendsCoinBase, /* requireStandard */ false);
+                if (parent->batchSchnorr)
+                    batchedTxs.push_back(std::make_pair(schnorrBatch.size(), txIndex));
+                ValidationPrivate::validateTransactionInputs(view, unspents, m_blockIndex->nHeight, flags, fees,
+                                                             sigChecks, spendsCoinBase, /* requireStandard */ false,
+                                                             parent->batchSchnorr ? &schnorrBatch : nullptr);
                 chunkSigChecks += sigChecks;
                 chunkFees += fees;
+                if (schnorrBatch.size() >= SchnorrBatchSize)
+                    verifySchnorrBatch();
             }
 
             if (!m_checkValidityOnly) {
@@ -1602,6 +1820,7 @@ void BlockValidationState::checkSignaturesChunk()
                 }
             }
         }
+        verifySchnorrBatch();
     } catch(const UTXOInternalError &ex) {
         parent->fatal(ex.what());
     } catch (const Exception &e) {
@@ -1617,16 +1836,28 @@ void BlockValidationState::checkSignaturesChunk()
     m_sigChecksCounted.fetch_add(chunkSigChecks );
     m_undoItems[static_cast<size_t>(chunkToStart)] = undoItems.release();
 
-#ifdef ENABLE_BENCHMARKS
-    int64_t end = GetTimeMicros();
-    if (blockValid) {
-        parent->m_validationTime.fetch_add(end - start - utxoDuration);
-        parent->m_utxoTime.fetch_add(utxoDuration);
-    }
-    logDebug(Log::BlockValidation) << "batch:" << chunkToStart << '/' << chunks << (end - start)/1000. << "ms" << "success so far:" << blockValid;
-#endif
+    const int64_t end = GetTimeMicros();
+    m_utxoTime.fetch_add(utxoDuration);
+    m_chunkDurations[static_cast<size_t>(chunkToStart)] = end - start;
+    DEBUGBV << "batch:" << chunkToStart << '/' << m_undoItems.size() << (end - start)/1000. << "ms" << "success so far:" << blockValid;
 
     const int chunksLeft = m_txChunkLeftToFinish.fetch_sub(1) - 1;
-    if (chunksLeft <= 0) // I'm the last one to finish
+    if (chunksLeft <= 0) { // I'm the last one to finish
+        if ((m_validationStatus.load() & BlockInvalid) == 0) {
+            int64_t total = 0, slowest = 0;
+            for (auto duration : m_chunkDurations) {
+                total += duration;
+                slowest = std::max(slowest, duration);
+            }
+            const int64_t average = total / static_cast<int64_t>(m_chunkDurations.size());
+            parent->m_chunkImbalanceTime.fetch_add(static_cast<uint64_t>(slowest - average), std::memory_order_relaxed);
+            parent->addStageTime(Validation::Statistics::ScriptValidation, end - m_checkSignaturesStart);
+            parent->m_blocksValidated.fetch_add(1, std::memory_order_relaxed);
+            parent->m_transactionsValidated.fetch_add(m_block.transactions().size(), std::memory_order_relaxed);
+            parent->m_sigChecks.fetch_add(m_sigChecksCounted.load(), std::memory_order_relaxed);
+            logDebug(Log::Bench) << "Block" << m_blockIndex->nHeight << "chunks:" << m_chunkDurations.size()
+                                 << "average:" << average / 1000. << "ms slowest:" << slowest / 1000. << "ms";
+        }
         finishUp();
+    }
 }
@@ -38,13 +38,12 @@
 #include <chain.h>
 #include <bloom.h>
 #include <txmempool.h>
+#include <utxo/UnspentOutputDatabase.h>
 
 #include <boost/thread.hpp>
 #include <boost/unordered_map.hpp>
 #include <boost/asio/io_context_strand.hpp>
 
-// #define ENABLE_BENCHMARKS
-
 struct ValidationFlags {
     ValidationFlags();
     bool strictPayToScriptHash;
@@ -67,6 +66,9 @@ struct ValidationFlags {
     void updateForBlock(CBlockIndex *index);
 };
 
+struct TxView;
+class SchnorrBatch;
+
 // implemented in TxValidation.cpp
 namespace ValidationPrivate {
 struct UnspentOutput {
@@ -75,8 +77,14 @@ struct UnspentOutput {
     int blockheight = 0;
     bool isCoinbase = false;
 };
-void validateTransactionInputs(CTransaction &tx, const std::vector<UnspentOutput> &unspents, int blockHeight,
-                                      ValidationFlags flags, int64_t &fees, uint32_t &txSigops, bool &spendsCoinbase, bool requireStandard);
+/**
+ * Validate the inputs of a transaction, throwing an Exception on failure.
+ * When \a schnorrBatch is passed, Schnorr signatures may be added to it instead of being verified
+ * and the caller has to verify the batch before considering the transaction valid.
+ */
+void validateTransactionInputs(const TxView &tx, const std::vector<UnspentOutput> &unspents, int blockHeight,
+                                      ValidationFlags flags, int64_t &fees, uint32_t &txSigops, bool &spendsCoinbase, bool requireStandard,
+                                      SchnorrBatch *schnorrBatch = nullptr);
 }
 
 struct Output {
@@ -121,7 +129,6 @@ public:
 
     void checks1NoContext();
     void checks2HaveParentHeaders();
-    void checkSignaturesChunk();
 
     void blockFailed(int punishment, const std::string &error, Validation::RejectCodes code, bool corruptionPossible = false);
 
@@ -144,15 +151,32 @@ public:
     void updateUtxoAndStartValidation();
 
     /**
-     * @brief calculateTxCheckChunks returns the amount of 'chunks' we split the transaction pool into for parallel validation.
-     * @param[out] chunks the chunk-count.
-     * @param[out] itemsPerChunk the number of transactions to be processed in a single chunk
+     * Parses the transactions into m_utxoData, the part of updateUtxoAndStartValidation() that
+     * doesn't depend on the parent block being finished.
+     * Called from checks2HaveParentHeaders() so it overlaps with the validation of the parent.
      */
-    inline void calculateTxCheckChunks(int &chunks, int &itemsPerChunk) const {
-        size_t txCount = m_block.transactions().size();
-        chunks = std::min<int>((txCount+9) / 10, boost::thread::hardware_concurrency());
-        itemsPerChunk = std::lrint(std::ceil(txCount / static_cast<float>(chunks)));
-    }
+    void prepareUtxoData();
+
+    /**
+     * Looks up the inputs of this block in the UTXO while the parent block is still being validated.
+     * The results are not used, this only makes sure the data is loaded from disk before we need it.
+     */
+    void prefetchInputs();
+
+    /**
+     * @brief calculateTxCheckChunks splits the transactions into chunks for parallel validation.
+     * The chunks are of about equal validation cost, based on the input-count and size of each
+     * transaction as counted in m_txCosts.
+     * We create several chunks per thread which allows a thread that is done to take over
+     * the remaining chunks from busy threads.
+     * @returns the amount of chunks, the boundaries are stored in m_chunkBoundaries.
+     */
+    int calculateTxCheckChunks();
+
+    /// Checks chunks until all have been started, the job posted on the thread pool.
+    void checkSignatures();
+    /// Checks the inputs, including scripts, of all transactions in chunk \a chunk.
+    void checkSignaturesChunk(int chunk);
 
     FastBlock m_block;
     CDiskBlockPos m_blockPos;
@@ -182,6 +206,22 @@ public:
 
     std::vector<std::deque<FastUndoBlock::Item> *> m_undoItems;
 
+    // the outputs created in this block, filled by prepareUtxoData()
+    UnspentOutputDatabase::BlockData m_utxoData;
+    bool m_utxoDataPrepared = false;
+    // the validation cost of each transaction, filled by prepareUtxoData()
+    std::vector<std::uint32_t> m_txCosts;
+    // the txid of each transaction, kept from the m_utxoData for processNewBlock()
+    std::vector<uint256> m_txids;
+    // the index of the first transaction of each chunk, and the transaction count as the last item.
+    std::vector<int> m_chunkBoundaries;
+    // the chunks in the order they should be started, most expensive first.
+    std::vector<int> m_chunkOrder;
+    std::vector<std::int64_t> m_chunkDurations;
+    // time spent in the UTXO for this block, summed over all threads.
+    std::atomic<std::int64_t> m_utxoTime;
+    std::int64_t m_checkSignaturesStart = 0;
+
     std::weak_ptr<ValidationEnginePrivate> m_parent;
     std::weak_ptr<ValidationSettingsPrivate> m_settings;
     // These children are waiting to be notified when I reach the conclusion
@@ -255,7 +295,7 @@ public:
      * The fact that there are two checks here is because blocksInFlight is used for blocks that end up in the sequence of
      *  * checks2HaveParentHeaders
      *  * updateUtxoAndStartValidation
-     *  ** checkSignaturesChunk
+     *  ** checkSignatures
      *
      * The step to go from check2 to the utxo method is serialized, meaning only one at a time is doing an utxo check.
      * This would hinder the total thoughput if we made this stop the headersInFlight additions, and as such there are
@@ -283,22 +323,31 @@ public:
     std::weak_ptr<ValidationEnginePrivate> me;
 
     const Validation::EngineType engineType;
+    // defer Schnorr signatures of a block into batches, see -batchschnorr
+    const bool batchSchnorr;
 
 private:
     int lastFullBlockScheduled;
     int previousPrintedHeaderHeight = 0;
-#ifdef ENABLE_BENCHMARKS
 
 public:
-    std::atomic<long> m_headerCheckTime;
-    std::atomic<long> m_basicValidityChecks;
-    std::atomic<long> m_contextCheckTime;
-    std::atomic<long> m_utxoTime;
-    std::atomic<long> m_validationTime;
-    std::atomic<long> m_loadingTime;
-    std::atomic<long> m_mempoolTime;
-    std::atomic<long> m_walletTime;
-#endif
+    struct StageCounter {
+        std::atomic<std::uint64_t> count;
+        std::atomic<std::uint64_t> totalTime;
+        std::atomic<std::uint64_t> maxTime;
+        std::atomic<std::uint64_t> histogram[Validation::Statistics::HistogramBuckets];
+    };
+    void addStageTime(Validation::Statistics::Stage stage, std::int64_t microSeconds);
+    Validation::Statistics statistics() const;
+
+    // runtime statistics, see Validation::Engine::statistics()
+    StageCounter m_stages[Validation::Statistics::StageCount];
+    std::atomic<std::uint64_t> m_blocksValidated;
+    std::atomic<std::uint64_t> m_transactionsValidated;
+    std::atomic<std::uint64_t> m_utxoLookups;
+    std::atomic<std::uint64_t> m_sigChecks;
+    // the sum of the time the slowest chunk of a block took longer than the average chunk.
+    std::atomic<std::uint64_t> m_chunkImbalanceTime;
 };
 
 #endif
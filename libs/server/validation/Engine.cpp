@@ -29,6 +29,9 @@
 #include <server/BlocksDB.h>
 #include <WaitUntilFinishedHelper.h>
 
+#include <boost/unordered_map.hpp>
+#include <set>
+
 // #define DEBUG_BLOCK_VALIDATION
 #ifdef DEBUG_BLOCK_VALIDATION
 # define DEBUGBV logCritical(Log::BlockValidation)
@@ -130,6 +133,117 @@ std::future<std::string> Validation::Engine::addTransaction(const Tx &tx, uint32
     return state->m_promise.get_future();
 }
 
+std::vector<std::future<std::string> > Validation::Engine::addTransactions(const std::vector<Tx> &transactions, uint32_t onResultFlags)
+{
+    assert(onResultFlags < 0x40);
+    assert((onResultFlags & SaveGoodToDisk) == 0);
+    std::vector<std::future<std::string> > answer;
+    answer.reserve(transactions.size());
+    if (!d.get() || d->shuttingDown) {
+        for (size_t i = 0; i < transactions.size(); ++i) {
+            std::promise<std::string> promise;
+            promise.set_value(std::string());
+            answer.push_back(promise.get_future());
+        }
+        return answer;
+    }
+
+    std::vector<std::shared_ptr<TxValidationState> > states;
+    states.reserve(transactions.size());
+    for (const Tx &tx : transactions) {
+        states.push_back(std::shared_ptr<TxValidationState>(new TxValidationState(priv(), tx, onResultFlags)));
+        answer.push_back(states.back()->m_promise.get_future());
+    }
+    startTransactions(states);
+    return answer;
+}
+
+void Validation::Engine::addTransactions(const std::vector<Tx> &transactions, const BatchCallback &onFinished, uint32_t onResultFlags)
+{
+    assert(onResultFlags < 0x40);
+    assert((onResultFlags & SaveGoodToDisk) == 0);
+    if (!d.get() || d->shuttingDown) {
+        onFinished(std::vector<std::string>(transactions.size()));
+        return;
+    }
+
+    // one extra for the scheduling below, to avoid calling onFinished before all are started.
+    std::shared_ptr<TxValidationBatch> batch(new TxValidationBatch(transactions.size()));
+    ++batch->pending;
+    batch->onFinished = onFinished;
+    std::vector<std::shared_ptr<TxValidationState> > states;
+    states.reserve(transactions.size());
+    for (const Tx &tx : transactions) {
+        states.push_back(std::shared_ptr<TxValidationState>(new TxValidationState(priv(), tx, onResultFlags)));
+        states.back()->m_batch = batch;
+        states.back()->m_batchIndex = states.size() - 1;
+    }
+    startTransactions(states);
+    batch->finished();
+}
+
+void Validation::Engine::startTransactions(const std::vector<std::shared_ptr<TxValidationState> > &states)
+{
+    std::vector<uint256> hashes;
+    hashes.reserve(states.size());
+    boost::unordered_map<uint256, size_t, HashShortener> batchIndex;
+    for (auto &state : states) {
+        hashes.push_back(state->m_tx.createHash());
+        batchIndex.insert(std::make_pair(hashes.back(), hashes.size() - 1));
+    }
+
+    // link each transaction to the ones in the batch it spends, those have to be validated first.
+    for (size_t i = 0; i < states.size(); ++i) {
+        std::set<size_t> parents;
+        Tx::Iterator iter(states.at(i)->m_tx);
+        auto type = iter.next();
+        while (type != Tx::End && type != Tx::OutputValue) {
+            if (type == Tx::PrevTxHash) {
+                auto parent = batchIndex.find(iter.uint256Data());
+                if (parent != batchIndex.end() && parent->second != i)
+                    parents.insert(parent->second);
+            }
+            type = iter.next();
+        }
+        for (size_t parent : parents) {
+            states.at(parent)->m_dependents.push_back(states.at(i));
+            ++states.at(i)->m_parentsPending;
+        }
+    }
+
+    std::vector<std::shared_ptr<TxValidationState> > ready;
+    for (size_t i = 0; i < states.size(); ++i) {
+        auto &state = states.at(i);
+        bool start = true;
+        {
+            std::lock_guard<std::mutex> rejects(d->recentRejectsLock);
+            if (d->recentTxRejects.contains(hashes.at(i))) {
+                state->setResult("recently rejected");
+                start = false;
+            }
+        }
+        if (start && CTxOrphanCache::contains(hashes.at(i))) {
+            // already waiting for its inputs to show up.
+            state->setResult(strprintf("%i: %s", Validation::RejectInvalid, "missing-inputs"));
+            start = false;
+        }
+        DEBUGTX << hashes.at(i) << state->m_tx.size() << "will start:" << start << "waits for:" << state->m_parentsPending;
+        if (!start) {
+            // mark it as done, but only after all tasks are linked to avoid them being started twice
+            state->m_parentsPending = -1;
+        } else if (state->m_parentsPending == 0) {
+            ready.push_back(state);
+        }
+    }
+    for (auto &state : states) {
+        if (state->m_parentsPending == -1)
+            state->startDependents();
+    }
+    for (auto &state : ready) {
+        Application::instance()->ioService().post(std::bind(&TxValidationState::checkTransaction, state));
+    }
+}
+
 void Validation::Engine::waitForSpace()
 {
     std::shared_ptr<ValidationEnginePrivate> dd(d); // Make sure this method is re-entrant
@@ -259,3 +373,41 @@ uint32_t Validation::Engine::tipValidationFlags(bool requireStandard) const
 {
     return priv().lock()->tipFlags.scriptValidationFlags(requireStandard);
 }
+
+Validation::Statistics Validation::Engine::statistics() const
+{
+    if (!d.get())
+        return Statistics();
+    return d->statistics();
+}
+
+const char *Validation::Statistics::stageName(Stage stage)
+{
+    switch (stage) {
+    case HeaderCheck: return "header";
+    case StructureCheck: return "structure";
+    case ContextCheck: return "context";
+    case UtxoUpdate: return "utxo";
+    case ScriptValidation: return "validation";
+    case Loading: return "loading";
+    case Mempool: return "mempool";
+    case Wallet: return "wallet";
+    default: return "unknown";
+    }
+}
+
+double Validation::Statistics::utxoLookupsPerSecond() const
+{
+    const auto time = stages[UtxoUpdate].totalTime;
+    if (time == 0)
+        return 0;
+    return utxoLookups * 1E6 / time;
+}
+
+double Validation::Statistics::sigChecksPerSecond() const
+{
+    const auto time = stages[ScriptValidation].totalTime;
+    if (time == 0)
+        return 0;
+    return sigChecks * 1E6 / time;
+}
@@ -29,13 +29,18 @@ class FastBlock;
 class CTxMemPool;
 class CTransaction;
 class Tx;
+class TxValidationState;
 
 namespace Blocks {
 class DB;
 }
 
+#include <array>
+#include <cstdint>
+#include <functional>
 #include <memory>
 #include <future>
+#include <vector>
 #include <uint256.h>
 
 namespace Validation {
@@ -65,6 +70,49 @@ enum EngineType {
     SkipAutoBlockProcessing
 };
 
+/**
+ * Runtime statistics of block validation, collected for every block the engine validates.
+ * All times are in microseconds.
+ */
+struct Statistics
+{
+    enum Stage {
+        HeaderCheck,        ///< checks of the header that need no context (POW, timestamp).
+        StructureCheck,     ///< context-free checks of the block and its transactions.
+        ContextCheck,       ///< checks against the parent headers.
+        UtxoUpdate,         ///< insert, lookup and removal of outputs, summed over all threads.
+        ScriptValidation,   ///< from start to finish of the transaction validation of a block.
+        Loading,            ///< loading the block from disk.
+        Mempool,            ///< updating the mempool after a block has been added to the chain.
+        Wallet,             ///< notifying the wallet and other listeners of a new block.
+        StageCount
+    };
+    static const char *stageName(Stage stage);
+
+    enum { HistogramBuckets = 24 };
+    struct StageTimes {
+        std::uint64_t count = 0;
+        std::uint64_t totalTime = 0;
+        std::uint64_t maxTime = 0;
+        /// bucket 0 counts durations below 1µs, bucket n counts durations in [2^(n-1), 2^n).
+        /// The last bucket counts everything longer.
+        std::array<std::uint64_t, HistogramBuckets> histogram = {};
+    };
+    std::array<StageTimes, StageCount> stages;
+
+    std::uint64_t blocks = 0;           ///< number of blocks that passed validation.
+    std::uint64_t transactions = 0;     ///< number of transactions in those blocks.
+    std::uint64_t utxoLookups = 0;      ///< number of inputs looked up in the UTXO.
+    std::uint64_t sigChecks = 0;        ///< number of signature checks done.
+    /// sum of the time the slowest chunk of a block took longer than the average chunk.
+    std::uint64_t chunkImbalanceTime = 0;
+
+    /// UTXO lookups per second spent in the UtxoUpdate stage.
+    double utxoLookupsPerSecond() const;
+    /// Signature checks per second spent in the ScriptValidation stage.
+    double sigChecksPerSecond() const;
+};
+
 /**
  * @brief The Engine class does all block & transaction validation and processing.
  * This class is an abstraction to simplify the validation process of foreign data being shared
@@ -104,6 +152,25 @@ public:
      */
     std::future<std::string> addTransaction(const Tx &tx, std::uint32_t onResultFlags = 0, CNode *pFrom = nullptr);
 
+    /**
+     * Schedule the validation of a batch of transactions, which may spend each other.
+     * Transactions that do not depend on others in the batch are validated in parallel, a
+     * transaction spending outputs of another in the batch is only started after that one finished.
+     * @return a result per transaction, in the same order as \a transactions.
+     * @see addTransaction
+     */
+    std::vector<std::future<std::string> > addTransactions(const std::vector<Tx> &transactions, std::uint32_t onResultFlags = 0);
+
+    /// Called with a result per transaction, in the order they were passed to addTransactions().
+    typedef std::function<void(const std::vector<std::string> &results)> BatchCallback;
+
+    /**
+     * Schedule the validation of a batch of transactions, like the method above.
+     * Instead of returning futures, \a onFinished is called once all transactions finished validation.
+     * This can be from any thread, including this one before the method returns.
+     */
+    void addTransactions(const std::vector<Tx> &transactions, const BatchCallback &onFinished, std::uint32_t onResultFlags = 0);
+
     /**
      * @brief waitForSpace is a potentially blocking method that waits until the job count drops to an acceptable level.
      * Due to addBlock() starting an async process it returns immediately and as such a user that expects to add
@@ -170,10 +237,17 @@ public:
      */
     uint32_t tipValidationFlags(bool requireStandard = false) const;
 
+    /**
+     * Return a snapshot of the statistics collected since the engine was created.
+     */
+    Statistics statistics() const;
+
     /// \internal
     std::weak_ptr<ValidationEnginePrivate> priv() const;
 
 private:
+    void startTransactions(const std::vector<std::shared_ptr<TxValidationState> > &states);
+
     std::shared_ptr<ValidationEnginePrivate> d;
 };
 }
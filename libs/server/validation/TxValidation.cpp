@@ -44,23 +44,24 @@
 
 using Validation::Exception;
 
-void ValidationPrivate::validateTransactionInputs(CTransaction &tx, const std::vector<UnspentOutput> &unspents, int blockHeight, ValidationFlags flags, int64_t &fees, uint32_t &txSigChecks, bool &spendsCoinbase, bool requireStandard)
+void ValidationPrivate::validateTransactionInputs(const TxView &tx, const std::vector<UnspentOutput> &unspents, int blockHeight, ValidationFlags flags, int64_t &fees, uint32_t &txSigChecks, bool &spendsCoinbase, bool requireStandard, SchnorrBatch *schnorrBatch)
 {
-    assert(unspents.size() == tx.vin.size());
+    assert(unspents.size() == tx.inputs.size());
     txSigChecks = 0;
 
     int64_t valueIn = 0;
-    for (size_t i = 0; i < tx.vin.size(); ++i) {
+    for (size_t i = 0; i < tx.inputs.size(); ++i) {
         const ValidationPrivate::UnspentOutput &prevout = unspents.at(i);
         assert(prevout.amount >= 0);
         valueIn += prevout.amount;
     }
 
-    if (valueIn < tx.GetValueOut())
+    const int64_t valueOut = tx.valueOut();
+    if (valueIn < valueOut)
         throw Exception("bad-txns-in-belowout");
     if (!MoneyRange(valueIn)) // Check for negative or overflow input values
         throw Exception("bad-txns-inputvalues-outofrange");
-    fees = valueIn - tx.GetValueOut();
+    fees = valueIn - valueOut;
     if (fees < 0)
         throw Exception("bad-txns-fee-negative");
     if (!MoneyRange(fees))
@@ -68,7 +69,11 @@ void ValidationPrivate::validateTransactionInputs(CTransaction &tx, const std::v
 
     spendsCoinbase = false;
     const uint32_t scriptValidationFlags = flags.scriptValidationFlags(requireStandard);
-    for (unsigned int i = 0; i < tx.vin.size(); i++) {
+    // the parts of the signature-hash that are the same for every input get calculated only once.
+    std::unique_ptr<PrecomputedTransactionData> txData;
+    if (scriptValidationFlags & SCRIPT_ENABLE_SIGHASH_FORKID)
+        txData.reset(new PrecomputedTransactionData(tx));
+    for (unsigned int i = 0; i < tx.inputs.size(); i++) {
         const ValidationPrivate::UnspentOutput &prevout = unspents.at(i);
         if (prevout.isCoinbase) { // If prev is coinbase, check that it's matured
             spendsCoinbase = true;
@@ -81,8 +86,10 @@ void ValidationPrivate::validateTransactionInputs(CTransaction &tx, const std::v
 
         // Verify signature
         Script::State strict(scriptValidationFlags);
-        if (!Script::verify(tx.vin[i].scriptSig, prevout.outputScript,
-                            CachingTransactionSignatureChecker(&tx, i, prevout.amount, true), strict)) {
+        const CScript scriptSig(tx.inputs[i].script);
+        CachingTransactionSignatureChecker checker(&tx, i, prevout.amount, true, txData.get());
+        checker.setSchnorrBatch(schnorrBatch);
+        if (!Script::verify(scriptSig, prevout.outputScript, checker, strict)) {
             // Failures of other flags indicate a transaction that is
             // invalid in new blocks, e.g. a invalid P2SH. We DoS ban
             // such nodes as they are not following the protocol. That
@@ -99,7 +106,7 @@ void ValidationPrivate::validateTransactionInputs(CTransaction &tx, const std::v
                 // avoid splitting the network between upgraded and
                 // non-upgraded nodes.
                 Script::State flexible(scriptValidationFlags & ~STANDARD_NOT_MANDATORY_VERIFY_FLAGS);
-                if (Script::verify(tx.vin[i].scriptSig, prevout.outputScript, TransactionSignatureChecker(&tx, i, prevout.amount), flexible))
+                if (Script::verify(scriptSig, prevout.outputScript, TransactionSignatureChecker(&tx, i, prevout.amount, txData.get()), flexible))
                     throw Exception(strprintf("non-mandatory-script-verify-flag (%s)", strict.errorString()), Validation::RejectNonstandard, 0);
             }
 
@@ -159,17 +166,33 @@ TxValidationState::TxValidationState(const std::weak_ptr<ValidationEnginePrivate
       m_tx(transaction),
       m_validationFlags(onValidationFlags),
       m_originatingNodeId(-1),
-      m_originalInsertTime(0)
+      m_originalInsertTime(0),
+      m_parentsPending(0)
 {
 }
 
 TxValidationState::~TxValidationState()
 {
     try {
-        m_promise.set_value(std::string());
+        setResult(std::string());
     } catch (std::exception &) {}
 }
 
+void TxValidationState::setResult(const std::string &result)
+{
+    m_promise.set_value(result);
+    if (m_batch) {
+        m_batch->results[m_batchIndex] = result;
+        m_batch->finished();
+    }
+}
+
+void TxValidationBatch::finished()
+{
+    if (--pending == 0 && onFinished)
+        onFinished(results);
+}
+
 void TxValidationState::checkTransaction()
 {
     std::shared_ptr<ValidationEnginePrivate> parent = m_parent.lock();
@@ -178,14 +201,15 @@ void TxValidationState::checkTransaction()
     const ValidationFlags flags = parent->tipFlags;
     std::string result;
     struct RAII {
-        RAII(std::promise<std::string> *promise) : promise(promise) {}
+        RAII(TxValidationState *state) : state(state) {}
         ~RAII() {
-            promise->set_value(result);
+            state->setResult(result);
+            state->startDependents();
         }
-        std::promise<std::string> *promise;
+        TxValidationState *state;
         std::string result;
     };
-    RAII raii(&m_promise);
+    RAII raii(this);
 
     if (flags.hf201811Active && m_tx.size() < 100)
         throw Exception("bad-txns-undersize", 2);
@@ -220,7 +244,7 @@ void TxValidationState::checkTransaction()
         if (!IsFinalTx(tx, tip->nHeight + 1, tip->GetMedianTimePast()))
             throw Exception("non-final", Validation::RejectNonstandard, 0);
 
-        CTxMemPoolEntry entry(m_tx);
+        CTxMemPoolEntry entry(m_tx, txid);
         entry.entryHeight = static_cast<std::uint32_t>(tip->nHeight);
         entry.inChainInputValue = 0;
 
@@ -234,20 +258,18 @@ void TxValidationState::checkTransaction()
              * its a tad harder to follow.  I am only sorry for not being sorry.
              */
 
+            // These lookups don't take the mempool lock, insertTx() checks again while holding it.
             std::vector<Tx> mempoolTransactions;
             mempoolTransactions.resize(tx.vin.size());
-            {
-                LOCK(parent->mempool->cs);
-                // do we already have the input tx?
-                if (parent->mempool->exists(txid))
-                    throw Exception("txn-already-known", Validation::RejectAlreadyKnown, 0);
-
-                // find the ones in the mempool
-                for (size_t i = 0; i < tx.vin.size(); ++i) {
-                    Tx prevTx;
-                    if (parent->mempool->lookup(tx.vin[i].prevout.hash, prevTx))
-                        mempoolTransactions[i] = prevTx;
-                }
+            // do we already have the input tx?
+            if (parent->mempool->exists(txid))
+                throw Exception("txn-already-known", Validation::RejectAlreadyKnown, 0);
+
+            // find the ones in the mempool
+            for (size_t i = 0; i < tx.vin.size(); ++i) {
+                Tx prevTx;
+                if (parent->mempool->lookup(tx.vin[i].prevout.hash, prevTx))
+                    mempoolTransactions[i] = prevTx;
             }
 
             std::vector<ValidationPrivate::UnspentOutput> unspents; // list of outputs
@@ -255,7 +277,7 @@ void TxValidationState::checkTransaction()
             double txPriority = 0;
             for (size_t i = 0; i < tx.vin.size(); ++i) {
                 ValidationPrivate::UnspentOutput &prevOut = unspents[i];
-                if (mempoolTransactions.at(i).isValid()) { // we found it in the mempool above, in the mempool->lock!
+                if (mempoolTransactions.at(i).isValid()) { // we found it in the mempool above
                     // check if the referenced output exists
                     // we do that here, outside of the mempool lock, so we don't have to do that later.
                     Tx::Iterator iter(mempoolTransactions.at(i));
@@ -309,7 +331,7 @@ void TxValidationState::checkTransaction()
                 throw Exception("non-BIP68-final", Validation::RejectNonstandard, 0);
 
             uint32_t txSigChecks = 0;
-            ValidationPrivate::validateTransactionInputs(tx, unspents, static_cast<int>(entry.entryHeight) + 1, flags, entry.nFee, txSigChecks , entry.spendsCoinbase, fRequireStandard);
+            ValidationPrivate::validateTransactionInputs(TxView(m_tx), unspents, static_cast<int>(entry.entryHeight) + 1, flags, entry.nFee, txSigChecks , entry.spendsCoinbase, fRequireStandard);
             if (fRequireStandard && txSigChecks > Policy::MAX_SIGCHEKCS_PER_TX) {
                 throw Exception("bad-blk-sigcheck", Validation::RejectNonstandard, 0);
             }
@@ -318,7 +340,7 @@ void TxValidationState::checkTransaction()
             CAmount nModifiedFees = entry.nFee;
             double nPriorityDummy = 0;
             parent->mempool->ApplyDeltas(txid, nPriorityDummy, nModifiedFees);
-            entry.entryPriority = entry.oldTx.ComputePriority(txPriority, entry.tx.size());
+            entry.entryPriority = tx.ComputePriority(txPriority, entry.tx.size());
             entry.hadNoDependencies = parent->mempool->HasNoInputsOf(tx);
 
             const size_t nSize = entry.GetTxSize();
@@ -468,6 +490,15 @@ void TxValidationState::checkTransaction()
     }
 }
 
+void TxValidationState::startDependents()
+{
+    for (auto &dependent : m_dependents) {
+        if (--dependent->m_parentsPending == 0)
+            Application::instance()->ioService().post(std::bind(&TxValidationState::checkTransaction, dependent));
+    }
+    m_dependents.clear();
+}
+
 void TxValidationState::sync()
 {
     std::shared_ptr<ValidationEnginePrivate> parent = m_parent.lock();
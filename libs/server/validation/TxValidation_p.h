@@ -31,11 +31,25 @@
 
 
 #include "BlockValidation_p.h"
+#include "Engine.h"
 #include <primitives/FastTransaction.h>
+#include <atomic>
 #include <mutex>
+#include <vector>
 
 class CTransaction;
 
+/// Shared by the transactions of one Engine::addTransactions() call, to report when all of them are done.
+struct TxValidationBatch {
+    TxValidationBatch(size_t size) : pending(static_cast<int>(size)), results(size) {}
+    std::atomic<int> pending;
+    std::vector<std::string> results;
+    Validation::Engine::BatchCallback onFinished;
+
+    /// Count one transaction (or the scheduling itself) as done, calls onFinished for the last one.
+    void finished();
+};
+
 class TxValidationState  : public std::enable_shared_from_this<TxValidationState> {
 public:
     enum InternalFlags {
@@ -54,7 +68,19 @@ public:
     Tx m_doubleSpendTx;
     int m_doubleSpendProofId = -1;
 
+    // Transactions from the same batch (see Engine::addTransactions()) that spend our outputs.
+    std::vector<std::shared_ptr<TxValidationState> > m_dependents;
+    /// The amount of transactions in our batch we spend and that still need to finish validation.
+    std::atomic<int> m_parentsPending;
+    std::shared_ptr<TxValidationBatch> m_batch;
+    size_t m_batchIndex = 0;
+
+    /// Fulfills the promise and reports to the batch. Throws if the result was set before.
+    void setResult(const std::string &result);
+
     void checkTransaction();
+    /// Schedule validation of the dependents whose in-batch parents have all finished.
+    void startDependents();
     /// Only called when fully successful, to be called in the strand.
     void sync();
 
@@ -180,3 +180,8 @@ void CZMQNotificationInterface::SyncAllTransactionsInBlock(const CBlock *pblock)
         SyncTransaction(tx);
     }
 }
+
+bool CZMQNotificationInterface::NeedsOldBlock() const
+{
+    return !notifiers.empty();
+}
@@ -40,6 +40,7 @@ protected:
     // CValidationInterface
     void SyncTransaction(const CTransaction &tx) override;
     void SyncAllTransactionsInBlock(const CBlock *pblock) override;
+    bool NeedsOldBlock() const override;
     void SyncAllTransactionsInBlock(const FastBlock &block, CBlockIndex *index) override;
 
 private:
@@ -128,6 +128,14 @@ public:
         return headerInt(Network::ServiceId);
     }
 
+    /**
+     * \internal
+     * Used by the NetworkManager to mark the body as compressed, \a size is the uncompressed size.
+     */
+    inline void setCompressedSize(int size) {
+        m_headerData[Network::CompressedSize] = size;
+    }
+
     inline int size() const {
         return static_cast<int>(m_end - m_start);
     }
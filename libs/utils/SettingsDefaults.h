@@ -27,6 +27,8 @@ namespace Settings {
 // /////// Validation
 static const signed int DefaultCheckBlocks = 5;
 static const unsigned int DefaultCheckLevel = 3;
+/** Default for -utxostoreoutputs */
+static const bool DefaultUtxoStoreOutputs = false;
 
 // /////// NET
 
@@ -54,6 +56,11 @@ static const int DefaultHttpThreads=4;
 static const int DefaultHttpWorkQueue=16;
 static const int DefaultHttpServerTimeout=30;
 
+/// compress large messages to API clients that announce support for it
+static const bool DefaultApiCompression = true;
+/// the amount of scanned blocks queued for a slow API service before we stop scanning new ones
+static const int DefaultApiBlockBacklog = 10;
+
 /// Tor
 static const bool DefaultListenOnion = false;
 static const std::string DefaultTorControl = "127.0.0.1:9051";
@@ -182,6 +189,8 @@ static const std::string DefaultUIPlatform =
 // systems). Due to how we count cache size, actual memory usage is slightly
 // more (~32.25 MB)
 static const unsigned int DefaultMaxSigCacheSize = 32;
+// verify the Schnorr signatures in a block in batches.
+static const bool DefaultSchnorrBatchVerification = true;
 
 static const bool DefaultRestEnable = false;
 static const bool DefaultDisableSafemode = false;
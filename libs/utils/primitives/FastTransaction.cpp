@@ -193,10 +193,10 @@ Tx::Component TxTokenizer::next() {
         m_numInputsLeft = readCompactSize(&m_currentTokenEnd, m_data.end());
         // we immediately go to the next token
         m_currentTokenStart = m_currentTokenEnd;
-        startInput = true;
+        startInput = m_numInputsLeft > 0;
     }
-    if (m_tag == Tx::Sequence) {
-        if (--m_numInputsLeft > 0) {
+    if (m_tag == Tx::Sequence || (m_tag == Tx::TxVersion && !startInput)) {
+        if (m_tag == Tx::Sequence && --m_numInputsLeft > 0) {
             startInput = true;
         } else {
             m_numOutputsLeft = readCompactSize(&m_currentTokenEnd, m_data.end());
@@ -237,6 +237,11 @@ Tx::Component TxTokenizer::next() {
             return checkSpaceForTag();
         }
     }
+    if (startOutput && m_numOutputsLeft == 0) {
+        m_currentTokenEnd += 4;
+        m_tag = Tx::LockTime;
+        return checkSpaceForTag();
+    }
     if (startOutput) {
         m_currentTokenEnd += 8;
         m_tag = Tx::OutputValue;
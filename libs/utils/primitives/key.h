@@ -149,6 +149,9 @@ public:
      */
     bool SignCompact(const uint256& hash, std::vector<unsigned char>& vchSig) const;
 
+    //! Create a 64-byte Schnorr signature.
+    bool SignSchnorr(const uint256& hash, std::vector<unsigned char>& vchSig) const;
+
     //! Derive BIP32 child key.
     bool Derive(CKey& keyChild, ChainCode &ccChild, unsigned int nChild, const ChainCode& cc) const;
 
@@ -213,6 +213,51 @@ bool CPubKey::verifySchnorr(const uint256 &hash, const std::vector<uint8_t> &vch
     return secp256k1_schnorr_verify(secp256k1_context_verify, &vchSig[0], hash.begin(), &pubkey);
 }
 
+bool SchnorrBatch::add(const CPubKey &pubkey, const uint256 &hash, const std::vector<uint8_t> &sig, int tag)
+{
+    if (!pubkey.IsValid() || sig.size() != 64)
+        return false;
+    static_assert(sizeof(secp256k1_pubkey) == sizeof(Item::pubkey), "secp256k1_pubkey size changed");
+    secp256k1_pubkey parsed;
+    if (!secp256k1_ec_pubkey_parse(secp256k1_context_verify, &parsed, pubkey.begin(), pubkey.size()))
+        return false;
+    m_items.push_back(Item());
+    Item &item = m_items.back();
+    memcpy(item.pubkey, &parsed, sizeof(parsed));
+    memcpy(item.sig, sig.data(), 64);
+    item.hash = hash;
+    item.tag = tag;
+    return true;
+}
+
+bool SchnorrBatch::verify() const
+{
+    std::vector<const unsigned char*> sigs;
+    std::vector<const unsigned char*> hashes;
+    std::vector<const secp256k1_pubkey*> pubkeys;
+    sigs.reserve(m_items.size());
+    hashes.reserve(m_items.size());
+    pubkeys.reserve(m_items.size());
+    for (const Item &item : m_items) {
+        sigs.push_back(item.sig);
+        hashes.push_back(item.hash.begin());
+        pubkeys.push_back(reinterpret_cast<const secp256k1_pubkey*>(item.pubkey));
+    }
+    return secp256k1_schnorr_verify_batch(secp256k1_context_verify, sigs.data(), hashes.data(),
+                                          pubkeys.data(), m_items.size());
+}
+
+int SchnorrBatch::findInvalid() const
+{
+    for (size_t i = 0; i < m_items.size(); ++i) {
+        const Item &item = m_items.at(i);
+        if (!secp256k1_schnorr_verify(secp256k1_context_verify, item.sig, item.hash.begin(),
+                                      reinterpret_cast<const secp256k1_pubkey*>(item.pubkey)))
+            return static_cast<int>(i);
+    }
+    return -1;
+}
+
 bool CPubKey::RecoverCompact(const uint256 &hash, const std::vector<unsigned char>& vchSig) {
     if (vchSig.size() != 65)
         return false;
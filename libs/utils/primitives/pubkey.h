@@ -200,6 +200,54 @@ private:
     }
 };
 
+/**
+ * Collects Schnorr signatures to verify them in one go, which is considerably
+ * cheaper than verifying them one at a time.
+ */
+class SchnorrBatch
+{
+public:
+    /**
+     * Add a signature to the batch.
+     * @param tag is a user-supplied value to find back the signature in case of failure.
+     * @return false if the public key is not valid.
+     */
+    bool add(const CPubKey &pubkey, const uint256 &hash, const std::vector<uint8_t> &sig, int tag = 0);
+
+    /// Return true if all signatures in the batch are valid.
+    bool verify() const;
+
+    /**
+     * Verify the signatures one at a time and return the index of the first invalid one.
+     * Returns -1 if all are valid.
+     */
+    int findInvalid() const;
+
+    /// Return the tag that was passed to add() for the signature at \a index.
+    inline int tag(int index) const {
+        return m_items.at(static_cast<size_t>(index)).tag;
+    }
+
+    inline size_t size() const {
+        return m_items.size();
+    }
+    inline bool empty() const {
+        return m_items.empty();
+    }
+    inline void clear() {
+        m_items.clear();
+    }
+
+private:
+    struct Item {
+        unsigned char pubkey[64]; // the parsed secp256k1_pubkey
+        unsigned char sig[64];
+        uint256 hash;
+        int tag;
+    };
+    std::vector<Item> m_items;
+};
+
 struct CExtPubKey {
     unsigned char nDepth;
     unsigned char vchFingerprint[4];
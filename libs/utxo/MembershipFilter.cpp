@@ -0,0 +1,173 @@
+/*
+ * This file is part of the Flowee project
+ * Copyright (C) 2020 Tom Zander <tomz@freedommail.ch>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "MembershipFilter.h"
+
+#include <utils/hash.h>
+
+#include <vector>
+#include <algorithm>
+#include <cassert>
+
+namespace {
+// amount of bits we set per inserted item.
+constexpr int HashCount = 3;
+// amount of 64-bit words we copy at a time for reading and writing
+constexpr uint32_t WordsPerChunk = 0x10000;
+
+inline uint64_t secondHash(uint64_t cheapHash)
+{
+    // the cheapHash is the first 8 bytes of a sha256, all bits are equally random.
+    return ((cheapHash >> 32) | (cheapHash << 32)) | 1;
+}
+}
+
+void MembershipFilter::reset(uint32_t bits)
+{
+    assert(bits >= 64);
+    assert((bits & (bits - 1)) == 0); // power of two
+    const uint32_t words = bits / 64;
+    m_words.reset(new std::atomic<uint64_t>[words]);
+    for (uint32_t i = 0; i < words; ++i) {
+        m_words[i].store(0, std::memory_order_relaxed);
+    }
+    m_mask = bits - 1;
+}
+
+void MembershipFilter::invalidate()
+{
+    m_mask = 0;
+    m_words.reset();
+}
+
+void MembershipFilter::insert(uint64_t cheapHash)
+{
+    if (m_mask == 0)
+        return;
+    const uint64_t step = secondHash(cheapHash);
+    uint64_t hash = cheapHash;
+    for (int i = 0; i < HashCount; ++i) {
+        const uint32_t bit = static_cast<uint32_t>(hash) & m_mask;
+        m_words[bit >> 6].fetch_or(uint64_t(1) << (bit & 63), std::memory_order_relaxed);
+        hash += step;
+    }
+}
+
+bool MembershipFilter::mayContain(uint64_t cheapHash) const
+{
+    if (m_mask == 0)
+        return true;
+    const uint64_t step = secondHash(cheapHash);
+    uint64_t hash = cheapHash;
+    for (int i = 0; i < HashCount; ++i) {
+        const uint32_t bit = static_cast<uint32_t>(hash) & m_mask;
+        if ((m_words[bit >> 6].load(std::memory_order_relaxed) & (uint64_t(1) << (bit & 63))) == 0)
+            return false;
+        hash += step;
+    }
+    return true;
+}
+
+uint32_t MembershipFilter::bits() const
+{
+    return m_mask == 0 ? 0 : m_mask + 1;
+}
+
+int MembershipFilter::fillPercentage() const
+{
+    if (m_mask == 0)
+        return 100;
+    const uint32_t words = bits() / 64;
+    uint64_t setBits = 0;
+    for (uint32_t i = 0; i < words; ++i) {
+        setBits += static_cast<uint64_t>(__builtin_popcountll(m_words[i].load(std::memory_order_relaxed)));
+    }
+    return static_cast<int>(setBits * 100 / bits());
+}
+
+uint256 MembershipFilter::checksum() const
+{
+    assert(m_mask);
+    CHash256 ctx;
+    const uint32_t words = bits() / 64;
+    std::vector<uint64_t> chunk;
+    chunk.reserve(std::min(words, WordsPerChunk));
+    for (uint32_t i = 0; i < words;) {
+        chunk.clear();
+        for (; i < words && chunk.size() < WordsPerChunk; ++i) {
+            chunk.push_back(m_words[i].load(std::memory_order_relaxed));
+        }
+        ctx.Write(reinterpret_cast<const unsigned char*>(chunk.data()), chunk.size() * sizeof(uint64_t));
+    }
+    uint256 result;
+    ctx.Finalize(reinterpret_cast<unsigned char*>(&result));
+    return result;
+}
+
+void MembershipFilter::write(std::ostream &out) const
+{
+    assert(m_mask);
+    const uint32_t words = bits() / 64;
+    std::vector<uint64_t> chunk;
+    chunk.reserve(std::min(words, WordsPerChunk));
+    for (uint32_t i = 0; i < words;) {
+        chunk.clear();
+        for (; i < words && chunk.size() < WordsPerChunk; ++i) {
+            chunk.push_back(m_words[i].load(std::memory_order_relaxed));
+        }
+        out.write(reinterpret_cast<const char*>(chunk.data()), static_cast<std::streamsize>(chunk.size() * sizeof(uint64_t)));
+    }
+}
+
+bool MembershipFilter::read(std::istream &in, uint32_t bits, const uint256 &checksum)
+{
+    invalidate();
+    if (bits < 64 || (bits & (bits - 1)) != 0)
+        return false;
+    std::unique_ptr<std::atomic<uint64_t>[]> newWords(new std::atomic<uint64_t>[bits / 64]);
+    CHash256 ctx;
+    const uint32_t words = bits / 64;
+    std::vector<uint64_t> chunk;
+    for (uint32_t i = 0; i < words;) {
+        chunk.resize(std::min(WordsPerChunk, words - i));
+        const auto size = static_cast<std::streamsize>(chunk.size() * sizeof(uint64_t));
+        in.read(reinterpret_cast<char*>(chunk.data()), size);
+        if (in.gcount() != size)
+            return false;
+        ctx.Write(reinterpret_cast<const unsigned char*>(chunk.data()), static_cast<size_t>(size));
+        for (auto word : chunk) {
+            newWords[i++].store(word, std::memory_order_relaxed);
+        }
+    }
+    uint256 result;
+    ctx.Finalize(reinterpret_cast<unsigned char*>(&result));
+    if (result != checksum)
+        return false;
+    m_words = std::move(newWords);
+    m_mask = bits - 1;
+    return true;
+}
+
+uint32_t MembershipFilter::bitsFor(int itemCount)
+{
+    // at 16 bits per item and 3 hashes we have a false-positive rate of about 0.5%
+    uint64_t wanted = static_cast<uint64_t>(std::max(itemCount, 1)) * 16;
+    uint32_t bits = 0x10000;
+    while (bits < wanted && bits < 0x80000000)
+        bits <<= 1;
+    return bits;
+}
@@ -0,0 +1,84 @@
+/*
+ * This file is part of the Flowee project
+ * Copyright (C) 2020 Tom Zander <tomz@freedommail.ch>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef MEMBERSHIPFILTER_H
+#define MEMBERSHIPFILTER_H
+
+#include <uint256.h>
+
+#include <atomic>
+#include <memory>
+#include <istream>
+#include <ostream>
+
+/*
+ * WARNING USAGE OF THIS HEADER IS RESTRICTED.
+ * This Header file is part of the private API and is meant to be used solely by the UTXO component.
+ */
+
+/**
+ * A bloom-filter on the cheapHash of transaction-ids stored in a DataFile.
+ *
+ * Each DataFile keeps one of these to be able to tell that a certain txid
+ * is definitely not stored in it, which allows the UnspentOutputDatabase
+ * to skip the jumptable and bucket lookup in that file.
+ *
+ * The filter never forgets, removing an output doesn't clear any bits.
+ * Only the Pruner creates a new, smaller, filter when it rewrites a DataFile.
+ *
+ * An invalid filter (the default) is used for files that have no filter stored
+ * and it answers 'maybe' to every question.
+ */
+class MembershipFilter
+{
+public:
+    MembershipFilter() = default;
+    MembershipFilter(const MembershipFilter &other) = delete;
+
+    /// Make this a valid and empty filter of \a bits size. Bits should be a power of 2.
+    void reset(uint32_t bits);
+    /// forget all content, making the filter answer 'maybe' to everything
+    void invalidate();
+    inline bool isValid() const {
+        return m_mask != 0;
+    }
+
+    /// Add the cheapHash of a transaction-id. Safe to call from multiple threads.
+    void insert(uint64_t cheapHash);
+    /// Returns false only if the cheapHash was never inserted
+    bool mayContain(uint64_t cheapHash) const;
+
+    /// the amount of bits this filter has, or zero if the filter is invalid
+    uint32_t bits() const;
+    /// return the percentage of bits that are set
+    int fillPercentage() const;
+
+    /// The checksum of the data as written by write()
+    uint256 checksum() const;
+    void write(std::ostream &out) const;
+    /// Replace our content by reading the filter from \a in. Returns false on failure.
+    bool read(std::istream &in, uint32_t bits, const uint256 &checksum);
+
+    /// return a suitable amount of bits for a filter with the amount of items.
+    static uint32_t bitsFor(int itemCount);
+
+private:
+    std::unique_ptr<std::atomic<uint64_t>[]> m_words;
+    uint32_t m_mask = 0;
+};
+
+#endif
@@ -30,6 +30,7 @@
 #include <stdlib.h>
 #include <fstream>
 #include <deque>
+#include <algorithm>
 
 namespace {
 static void nothing(const char *){}
@@ -99,6 +100,10 @@ void copyLeafs(const std::shared_ptr<char> &inputBuf, size_t bufSize, Streaming:
         }
         if (leaf.outIndex() != 0)
             builder.add(UODB::OutIndex, leaf.outIndex());
+        if (leaf.hasOutputData()) {
+            builder.add(UODB::OutputAmount, leaf.outputAmount());
+            builder.add(UODB::OutputScript, leaf.outputScript());
+        }
         builder.add(UODB::Separator, true);
     }
 }
@@ -178,6 +183,7 @@ void Pruner::prune()
     uint256 lastBlockHash;
     int posInFile = 0;
     bool isTip = false;
+    uint64_t probesAvoided = 0;
     std::deque<uint256> invalidBlocks;
 
     int posOfJumptable = 0;
@@ -201,6 +207,8 @@ void Pruner::prune()
                 isTip = parser.boolData();
             else if (parser.tag() == UODB::InvalidBlockHash)
                 invalidBlocks.push_back(parser.uint256Data());
+            else if (parser.tag() == UODB::ProbesAvoided)
+                probesAvoided = parser.longData();
             else if (parser.tag() == UODB::Separator)
                 break;
         }
@@ -247,6 +255,22 @@ void Pruner::prune()
     }
     logInfo() << "Pruner found" << buckets.size() << "buckets";
 
+    // rebuild the membership filter to contain only the leafs we keep.
+    int leafCount = 0;
+    for (const Bucket &bucket : buckets) {
+        leafCount += static_cast<int>(bucket.unspentOutputs.size());
+    }
+    uint32_t filterBits = MembershipFilter::bitsFor(leafCount);
+    if (isTip) // the tip will see more inserts, use at least the default size
+        filterBits = std::max(filterBits, UODBPrivate::limits.FilterBits);
+    MembershipFilter filter;
+    filter.reset(filterBits);
+    for (const Bucket &bucket : buckets) {
+        for (const OutputRef &ref : bucket.unspentOutputs) {
+            filter.insert(ref.cheapHash);
+        }
+    }
+
     memset(jumptable, 0, sizeof(jumptable));
     const std::string outFilename(m_dbFile + m_tmpExtension);
     {
@@ -367,10 +391,14 @@ void Pruner::prune()
         ctx.Finalize(reinterpret_cast<unsigned char*>(&result));
         builder.add(UODB::JumpTableHash, result);
     }
+    builder.add(UODB::MembershipFilterBits, static_cast<uint64_t>(filter.bits()));
+    builder.add(UODB::MembershipFilterHash, filter.checksum());
+    builder.add(UODB::ProbesAvoided, probesAvoided);
     builder.add(UODB::Separator, true);
     Streaming::ConstBuffer header = builder.buffer();
     outInfo.write(header.constData(), header.size());
     outInfo.write(reinterpret_cast<const char*>(jumptable), sizeof(jumptable));
+    filter.write(outInfo);
     outInfo.flush();
     outInfo.close();
 }
@@ -27,6 +27,8 @@
 #include <iostream>
 #include <fstream>
 #include <functional>
+#include <condition_variable>
+#include <thread>
 
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
@@ -91,6 +93,23 @@ static bool matchesOutput(const Streaming::ConstBuffer &buffer, const uint256 &t
     return indexMatched && txidMatched;
 }
 
+// returns the indexes into inputs, sorted by the position of the input in the jumptable.
+static std::vector<int> sortedByShortHash(const std::vector<Tx::Input> &inputs)
+{
+    std::vector<std::pair<uint32_t, int> > sorted;
+    sorted.reserve(inputs.size());
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        sorted.push_back(std::make_pair(createShortHash(inputs[i].txid), static_cast<int>(i)));
+    }
+    std::sort(sorted.begin(), sorted.end());
+    std::vector<int> answer;
+    answer.reserve(sorted.size());
+    for (auto item : sorted) {
+        answer.push_back(item.second);
+    }
+    return answer;
+}
+
 //////////////////////////////////////////////////////////////
 
 UnspentOutput::UnspentOutput(Streaming::BufferPool &pool, const uint256 &txid, int outIndex, int blockHeight, int offsetInBlock)
@@ -112,6 +131,39 @@ UnspentOutput::UnspentOutput(Streaming::BufferPool &pool, const uint256 &txid, i
     m_data = pool.commit();
 }
 
+UnspentOutput::UnspentOutput(Streaming::BufferPool &pool, const uint256 &txid, int outIndex, int blockHeight, int offsetInBlock,
+                             uint64_t outputAmount, const Streaming::ConstBuffer &outputScript)
+    : m_outputAmount(outputAmount),
+      m_outIndex(outIndex),
+      m_offsetInBlock(offsetInBlock),
+      m_blockHeight(blockHeight)
+{
+    assert(outIndex >= 0);
+    assert(blockHeight > 0);
+    assert(offsetInBlock > 80);
+    assert(outputScript.size() > 0);
+    pool.reserve(70 + outputScript.size());
+    Streaming::MessageBuilder builder(pool);
+    builder.add(UODB::BlockHeight, blockHeight);
+    builder.add(UODB::OffsetInBlock, offsetInBlock);
+    builder.add(UODB::TXID, txid);
+    if (outIndex != 0)
+        builder.add(UODB::OutIndex, outIndex);
+    builder.add(UODB::OutputAmount, outputAmount);
+    builder.add(UODB::OutputScript, outputScript);
+    builder.add(UODB::Separator, true);
+    m_data = pool.commit();
+
+    // find the script in our own copy
+    Streaming::MessageParser parser(m_data);
+    while (parser.next() == Streaming::FoundTag) {
+        if (parser.tag() == UODB::OutputScript) {
+            m_outputScript = parser.bytesDataBuffer();
+            break;
+        }
+    }
+}
+
 UnspentOutput::UnspentOutput(uint64_t cheapHash, const Streaming::ConstBuffer &buffer)
     : m_data(buffer),
       m_outIndex(0),
@@ -128,6 +180,10 @@ UnspentOutput::UnspentOutput(uint64_t cheapHash, const Streaming::ConstBuffer &b
             m_offsetInBlock = parser.intData();
         else if (!hitSeparator && parser.tag() == UODB::OutIndex)
             m_outIndex = parser.intData();
+        else if (!hitSeparator && parser.tag() == UODB::OutputAmount)
+            m_outputAmount = parser.longData();
+        else if (!hitSeparator && parser.tag() == UODB::OutputScript)
+            m_outputScript = parser.bytesDataBuffer();
         else if (parser.tag() == UODB::TXID)
             foundUtxo = true;
         else if (parser.tag() == UODB::Separator)
@@ -222,6 +278,8 @@ void UnspentOutputDatabase::setSmallLimits()
     UODBPrivate::limits.DBFileSize = 50000000;
     UODBPrivate::limits.FileFull = 30000000;
     UODBPrivate::limits.ChangesToSave = 50000;
+    UODBPrivate::limits.FilterBits = 0x100000;
+    UODBPrivate::limits.ParallelInsertMin = 1000;
 }
 
 void UnspentOutputDatabase::setChangeCountCausesStore(int count)
@@ -230,11 +288,24 @@ void UnspentOutputDatabase::setChangeCountCausesStore(int count)
     UODBPrivate::limits.ChangesToSave = count;
 }
 
+void UnspentOutputDatabase::setStoreOutputData(bool on)
+{
+    d->storeOutputData = on;
+}
+
+bool UnspentOutputDatabase::storesOutputData() const
+{
+    return d->storeOutputData;
+}
+
 void UnspentOutputDatabase::insertAll(const UnspentOutputDatabase::BlockData &data)
 {
-    for (size_t i = 0; i < data.outputs.size(); i += 2000) {
+    // huge blocks get inserted in parallel, which is worth it only in big batches.
+    const size_t batchSize = data.outputs.size() >= UODBPrivate::limits.ParallelInsertMin
+            ? std::max<size_t>(2000, UODBPrivate::limits.ParallelInsertMin) : 2000;
+    for (size_t i = 0; i < data.outputs.size(); i += batchSize) {
         auto df = d->checkCapacity();
-        df->insertAll(d, data, i, std::min(data.outputs.size(), i + 2000));
+        df->insertAll(d, data, i, std::min(data.outputs.size(), i + batchSize));
     }
 }
 
@@ -257,6 +328,28 @@ UnspentOutput UnspentOutputDatabase::find(const uint256 &txid, int index) const
     return UnspentOutput();
 }
 
+std::vector<UnspentOutput> UnspentOutputDatabase::findAll(const std::vector<Tx::Input> &inputs) const
+{
+    std::vector<UnspentOutput> answer(inputs.size());
+    const std::vector<int> order = sortedByShortHash(inputs);
+    DataFileList dataFiles(d->dataFiles);
+    for (int i = dataFiles.size(); i > 0; --i) {
+        dataFiles.at(i - 1)->findAll(inputs, order, answer, i);
+    }
+    return answer;
+}
+
+std::vector<SpentOutput> UnspentOutputDatabase::removeAll(const std::vector<Tx::Input> &inputs, const std::vector<uint64_t> &rmHints)
+{
+    assert(rmHints.empty() || rmHints.size() == inputs.size());
+    std::vector<SpentOutput> answer(inputs.size());
+    for (int i : sortedByShortHash(inputs)) {
+        const Tx::Input &input = inputs.at(static_cast<size_t>(i));
+        answer[static_cast<size_t>(i)] = remove(input.txid, input.index, rmHints.empty() ? 0 : rmHints.at(static_cast<size_t>(i)));
+    }
+    return answer;
+}
+
 SpentOutput UnspentOutputDatabase::remove(const uint256 &txid, int index, uint64_t rmHint)
 {
     SpentOutput done;
@@ -438,11 +531,14 @@ uint256 UnspentOutputDatabase::blockId() const
 // ///////////////////////////////////////////////////////////////////////
 #ifdef linux
 # include <sys/ioctl.h>
+# include <sys/mman.h>
 # include <linux/fs.h>
+# include <unistd.h>
 #endif
 
 UODBPrivate::UODBPrivate(boost::asio::io_service &service, const boost::filesystem::path &basedir, int beforeHeight)
     : ioService(service),
+      insertThreads(std::max(1, static_cast<int>(std::thread::hardware_concurrency()))),
       basedir(basedir)
 {
     boost::filesystem::create_directories(basedir);
@@ -565,6 +661,7 @@ DataFile::DataFile(const boost::filesystem::path &filename, int beforeHeight)
       m_changeCountBlock(0),
       m_changeCount(0),
       m_fragmentationCalcTimestamp(boost::gregorian::date(1970,1,1)),
+      m_probesAvoided(0),
       m_flushScheduled(false),
       m_usageCount(1)
 {
@@ -594,15 +691,22 @@ DataFile::DataFile(const boost::filesystem::path &filename, int beforeHeight)
     }
 }
 
-void DataFile::insert(const UODBPrivate *priv, const uint256 &txid, int firstOutput, int lastOutput, int blockHeight, int offsetInBlock)
+void DataFile::insert(const UODBPrivate *priv, const uint256 &txid, int firstOutput, int lastOutput, int blockHeight, int offsetInBlock,
+                      const std::vector<UnspentOutputDatabase::OutputData> *outputData, Streaming::BufferPool *pool)
 {
     assert(offsetInBlock > 80);
     assert(blockHeight > 0);
     assert(firstOutput >= 0);
     assert(lastOutput >= firstOutput);
     assert(!txid.IsNull());
+    assert(outputData == nullptr || outputData->empty() || outputData->size() == size_t(lastOutput - firstOutput + 1));
+    if (outputData && outputData->empty())
+        outputData = nullptr;
+    if (pool == nullptr)
+        pool = &m_memBuffers;
     LockGuard delLock(this);
     const uint32_t shortHash = createShortHash(txid);
+    m_filter.insert(txid.GetCheapHash());
     uint32_t bucketId;
     {
         BucketHolder bucket;
@@ -635,7 +739,7 @@ void DataFile::insert(const UODBPrivate *priv, const uint256 &txid, int firstOut
                 bucket->unspentOutputs.push_back(
                             OutputRef(txid.GetCheapHash(),
                                       static_cast<std::uint32_t>(leafPos) + MEMBIT,
-                                      new UnspentOutput(m_memBuffers, txid, i, blockHeight, offsetInBlock)));
+                                      createLeaf(*pool, txid, i, blockHeight, offsetInBlock, outputData, i - firstOutput)));
             }
             bucket->saveAttempt = 0;
             bucket.unlock();
@@ -670,7 +774,7 @@ void DataFile::insert(const UODBPrivate *priv, const uint256 &txid, int firstOut
     bucketId = m_jumptables[shortHash];
     if ((bucketId & MEMBIT) || bucketId == 0) {// it got loaded into mem in parallel to our attempt
         lock.unlock();
-        return insert(priv, txid, firstOutput, lastOutput, blockHeight, offsetInBlock);
+        return insert(priv, txid, firstOutput, lastOutput, blockHeight, offsetInBlock, outputData, pool);
     }
 
     m_committedBucketLocations.insert(std::make_pair(shortHash, bucketId));
@@ -687,19 +791,103 @@ void DataFile::insert(const UODBPrivate *priv, const uint256 &txid, int firstOut
         bucket->unspentOutputs.push_back(
                     OutputRef(txid.GetCheapHash(),
                               static_cast<std::uint32_t>(leafPos) + MEMBIT,
-                              new UnspentOutput(m_memBuffers, txid, i, blockHeight, offsetInBlock)));
+                              createLeaf(*pool, txid, i, blockHeight, offsetInBlock, outputData, i - firstOutput)));
     }
     bucket->saveAttempt = 0;
     bucket.unlock();
     addChange();
 }
 
+UnspentOutput *DataFile::createLeaf(Streaming::BufferPool &pool, const uint256 &txid, int outIndex, int blockHeight, int offsetInBlock,
+                                    const std::vector<UnspentOutputDatabase::OutputData> *outputData, int dataIndex)
+{
+    if (outputData) {
+        const auto &item = outputData->at(static_cast<size_t>(dataIndex));
+        return new UnspentOutput(pool, txid, outIndex, blockHeight, offsetInBlock, item.amount, item.script);
+    }
+    return new UnspentOutput(pool, txid, outIndex, blockHeight, offsetInBlock);
+}
+
+namespace {
+/*
+ * The shared state of a DataFile::insertAll() that is spread over multiple threads.
+ * Each partition is a range of shortHashes and as such of jumptable entries, which means that the threads
+ * practically never wait for each other on a bucket.
+ * Workers claim partitions until none are left, the thread that started the insert is a worker too, which
+ * makes it safe to wait for completion even if the thread pool is busy.
+ */
+struct ParallelInsert
+{
+    void run() {
+        while (true) {
+            const int index = nextPartition.fetch_add(1);
+            if (index >= static_cast<int>(partitions.size()))
+                return;
+            // the BufferPool is not thread safe, use one per partition
+            Streaming::BufferPool pool;
+            try {
+                for (size_t i : partitions.at(static_cast<size_t>(index))) {
+                    const auto &o = data->outputs.at(i);
+                    dataFile->insert(priv, o.txid, o.firstOutput, o.lastOutput, data->blockHeight, o.offsetInBlock,
+                                     &o.outputData, &pool);
+                }
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(mutex);
+                if (!error)
+                    error = std::current_exception();
+            }
+            std::lock_guard<std::mutex> lock(mutex);
+            if (++finished == static_cast<int>(partitions.size()))
+                done.notify_all();
+        }
+    }
+
+    std::vector<std::vector<size_t> > partitions;
+    std::atomic<int> nextPartition;
+    int finished = 0;
+    std::mutex mutex;
+    std::condition_variable done;
+    std::exception_ptr error;
+
+    DataFile *dataFile = nullptr;
+    const UODBPrivate *priv = nullptr;
+    const UnspentOutputDatabase::BlockData *data = nullptr;
+};
+}
+
 void DataFile::insertAll(const UODBPrivate *priv, const UnspentOutputDatabase::BlockData &data, size_t start, size_t end)
 {
-    for (size_t i = start; i < end; ++i) {
-        assert(data.outputs.size() > i);
-        const auto &o = data.outputs.at(i);
-        insert(priv, o.txid, o.firstOutput, o.lastOutput, data.blockHeight, o.offsetInBlock);
+    assert(end <= data.outputs.size());
+    const int threads = priv->insertThreads;
+    if (threads > 1 && end - start >= UODBPrivate::limits.ParallelInsertMin) {
+        auto work = std::make_shared<ParallelInsert>();
+        // a couple of partitions per thread evens out the differences in size.
+        const uint32_t partitionCount = static_cast<uint32_t>(threads) * 4;
+        work->partitions.resize(partitionCount);
+        for (auto &partition : work->partitions) {
+            partition.reserve((end - start) / partitionCount + 10);
+        }
+        for (size_t i = start; i < end; ++i) {
+            const uint32_t shortHash = createShortHash(data.outputs.at(i).txid);
+            work->partitions[(static_cast<uint64_t>(shortHash) * partitionCount) >> 20].push_back(i);
+        }
+        work->nextPartition = 0;
+        work->dataFile = this;
+        work->priv = priv;
+        work->data = &data;
+        for (int i = 1; i < threads; ++i) {
+            priv->ioService.post(std::bind(&ParallelInsert::run, work));
+        }
+        work->run();
+        std::unique_lock<std::mutex> lock(work->mutex);
+        work->done.wait(lock, [&work] { return work->finished == static_cast<int>(work->partitions.size()); });
+        if (work->error)
+            std::rethrow_exception(work->error);
+    } else {
+        for (size_t i = start; i < end; ++i) {
+            const auto &o = data.outputs.at(i);
+            insert(priv, o.txid, o.firstOutput, o.lastOutput, data.blockHeight, o.offsetInBlock, &o.outputData);
+        }
     }
     int spaceLeft = UODBPrivate::limits.FileFull - m_writeBuffer.offset();
     if (m_changeCountBlock.load() * 120 > spaceLeft) {
@@ -712,23 +900,89 @@ void DataFile::insertAll(const UODBPrivate *priv, const UnspentOutputDatabase::B
 UnspentOutput DataFile::find(const uint256 &txid, int index) const
 {
     LockGuard delLock(this);
-    const uint32_t shortHash = createShortHash(txid);
     const auto cheapHash = txid.GetCheapHash();
+    if (!m_filter.mayContain(cheapHash)) {
+        ++m_probesAvoided;
+        return UnspentOutput();
+    }
+    const uint32_t shortHash = createShortHash(txid);
     uint32_t bucketId;
+    {
+        std::lock_guard<std::recursive_mutex> lock(m_lock);
+        bucketId = m_jumptables[shortHash];
+    }
+    return findInBucket(txid, index, bucketId);
+}
+
+void DataFile::findAll(const std::vector<Tx::Input> &inputs, const std::vector<int> &order,
+                       std::vector<UnspentOutput> &answers, int fileIndex) const
+{
+    LockGuard delLock(this);
+    std::vector<int> todo;
+    todo.reserve(order.size());
+    for (int i : order) {
+        if (answers[i].isValid()) // found in a newer file
+            continue;
+        if (!m_filter.mayContain(inputs[i].txid.GetCheapHash())) {
+            ++m_probesAvoided;
+            continue;
+        }
+        todo.push_back(i);
+    }
+    if (todo.empty())
+        return;
+
+    // fetch the bucket-ids of all in one go.
+    std::vector<uint32_t> bucketIds(todo.size());
+    {
+        std::lock_guard<std::recursive_mutex> lock(m_lock);
+        for (size_t i = 0; i < todo.size(); ++i) {
+            bucketIds[i] = m_jumptables[createShortHash(inputs[todo[i]].txid)];
+        }
+    }
+#ifdef linux
+    // Tell the kernel which on-disk buckets we are about to read, to avoid
+    // stalling on each page-fault in turn.
+    static const uintptr_t pageSize = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+    uintptr_t prevPage = 0;
+    for (uint32_t bucketId : bucketIds) {
+        if (bucketId == 0 || bucketId >= MEMBIT || bucketId >= m_file.size())
+            continue;
+        const uintptr_t page = reinterpret_cast<uintptr_t>(m_buffer.get() + bucketId) & ~(pageSize - 1);
+        if (page != prevPage) // inputs are sorted by shortHash, which makes duplicates be neighbours.
+            madvise(reinterpret_cast<void*>(page), pageSize, MADV_WILLNEED);
+        prevPage = page;
+    }
+#endif
+    for (size_t i = 0; i < todo.size(); ++i) {
+        const Tx::Input &input = inputs[todo[i]];
+        UnspentOutput answer = findInBucket(input.txid, input.index, bucketIds[i]);
+        if (answer.isValid()) {
+            answer.setRmHint(answer.rmHint() + (static_cast<uint64_t>(fileIndex) << 32));
+            answers[todo[i]] = answer;
+        }
+    }
+}
+
+UnspentOutput DataFile::findInBucket(const uint256 &txid, int index, uint32_t bucketId) const
+{
+    const uint32_t shortHash = createShortHash(txid);
+    const auto cheapHash = txid.GetCheapHash();
     DEBUGUTXO << txid << index << Log::Hex << shortHash;
     BucketHolder bucketHolder;
-    do {
-        bucketHolder.unlock();
-        {
-            std::lock_guard<std::recursive_mutex> lock(m_lock);
-            bucketId = m_jumptables[shortHash];
-            if (bucketId == 0) // not found
-                return UnspentOutput();
-        }
+    while (true) {
+        if (bucketId == 0) // not found
+            return UnspentOutput();
         if (bucketId < MEMBIT) // not in memory
             break;
         bucketHolder = m_buckets.lock(static_cast<int>(bucketId & MEMMASK));
-    } while (*bucketHolder == nullptr);
+        if (*bucketHolder)
+            break;
+        // bucket got saved or deleted in parallel, re-fetch its position.
+        bucketHolder.unlock();
+        std::lock_guard<std::recursive_mutex> lock(m_lock);
+        bucketId = m_jumptables[shortHash];
+    }
 
     Bucket bucket;
     if (*bucketHolder) {
@@ -783,6 +1037,10 @@ SpentOutput DataFile::remove(const UODBPrivate *priv, const uint256 &txid, int i
     LockGuard delLock(this);
     SpentOutput answer;
     const auto cheapHash = txid.GetCheapHash();
+    if (!m_filter.mayContain(cheapHash)) {
+        ++m_probesAvoided;
+        return answer;
+    }
     const uint32_t shortHash = createShortHash(cheapHash);
 
     uint32_t bucketId;
@@ -1477,6 +1735,8 @@ DataFile *DataFile::createDatafile(const boost::filesystem::path &filename, int
     }
 
     DataFile *df = new DataFile(filename);
+    if (df->m_writeBuffer.offset() == 0) // a totally empty file gets an empty filter
+        df->m_filter.reset(UODBPrivate::limits.FilterBits);
     df->m_initialBlockHeight = firstBlockHeight;
     df->m_lastBlockHeight = firstBlockHeight;
     df->m_lastBlockHash = firstHash;
@@ -1587,10 +1847,17 @@ std::string DataFileCache::writeInfoFile(DataFile *source)
     uint256 result;
     ctx.Finalize(reinterpret_cast<unsigned char*>(&result));
     builder.add(UODB::JumpTableHash, result);
+    if (source->m_filter.isValid()) {
+        builder.add(UODB::MembershipFilterBits, static_cast<uint64_t>(source->m_filter.bits()));
+        builder.add(UODB::MembershipFilterHash, source->m_filter.checksum());
+    }
+    builder.add(UODB::ProbesAvoided, static_cast<uint64_t>(source->m_probesAvoided.load()));
     builder.add(UODB::Separator, true);
     Streaming::ConstBuffer header = builder.buffer();
     out.write(header.constData(), header.size());
     out.write(reinterpret_cast<const char*>(source->m_jumptables), sizeof(source->m_jumptables));
+    if (source->m_filter.isValid())
+        source->m_filter.write(out);
     out.flush();
 
     return outFile;
@@ -1606,6 +1873,8 @@ bool DataFileCache::load(const DataFileCache::InfoFile &info, DataFile *target)
 
     int posOfJumptable = 0;
     uint256 checksum;
+    uint32_t filterBits = 0;
+    uint256 filterChecksum;
     {
         std::shared_ptr<char> buf(new char[256], std::default_delete<char[]>());
         in.read(buf.get(), 256);
@@ -1613,6 +1882,12 @@ bool DataFileCache::load(const DataFileCache::InfoFile &info, DataFile *target)
         while (parser.next() == Streaming::FoundTag) {
             if (parser.tag() == UODB::LastBlockHeight)
                 target->m_lastBlockHeight = parser.intData();
+            else if (parser.tag() == UODB::MembershipFilterBits)
+                filterBits = static_cast<uint32_t>(parser.longData());
+            else if (parser.tag() == UODB::MembershipFilterHash)
+                filterChecksum = parser.uint256Data();
+            else if (parser.tag() == UODB::ProbesAvoided)
+                target->m_probesAvoided = parser.longData();
             else if (parser.tag() == UODB::FirstBlockHeight)
                 target->m_initialBlockHeight = parser.intData();
             else if (parser.tag() == UODB::LastBlockId)
@@ -1641,6 +1916,11 @@ bool DataFileCache::load(const DataFileCache::InfoFile &info, DataFile *target)
     }
     in.seekg(posOfJumptable);
     in.read(reinterpret_cast<char*>(target->m_jumptables), sizeof(target->m_jumptables));
+    // A missing or broken filter is not fatal, an invalid filter just means we always search the file.
+    if (filterBits == 0 || !target->m_filter.read(in, filterBits, filterChecksum)) {
+        target->m_filter.invalidate();
+        logInfo() << "No usable membership filter in" << filenameFor(info.index).string();
+    }
 
     logDebug() << "Loaded" << filenameFor(info.index).string();
     logDebug() << "Block from" << target->m_initialBlockHeight << "to" << target->m_lastBlockHeight
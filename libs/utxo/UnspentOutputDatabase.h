@@ -22,6 +22,7 @@
 
 #include <uint256.h>
 
+#include <primitives/FastTransaction.h>
 #include <streaming/ConstBuffer.h>
 #include <streaming/BufferPool.h>
 
@@ -42,6 +43,8 @@ class UnspentOutput {
 public:
     UnspentOutput() = default;
     UnspentOutput(Streaming::BufferPool &pool, const uint256 &txid, int outIndex, int blockHeight, int offsetInBlock);
+    UnspentOutput(Streaming::BufferPool &pool, const uint256 &txid, int outIndex, int blockHeight, int offsetInBlock,
+                  uint64_t outputAmount, const Streaming::ConstBuffer &outputScript);
     UnspentOutput(uint64_t cheapHash, const Streaming::ConstBuffer &buffer);
     UnspentOutput(const UnspentOutput &other) = default;
 
@@ -63,6 +66,22 @@ public:
 
     bool isCoinbase() const;
 
+    /**
+     * Returns true if this leaf has a copy of the output amount and script stored.
+     * @see UnspentOutputDatabase::setStoreOutputData()
+     */
+    inline bool hasOutputData() const {
+        return m_outputScript.size() > 0;
+    }
+    /// return the amount as stored, only usable if hasOutputData() returns true.
+    inline uint64_t outputAmount() const {
+        return m_outputAmount;
+    }
+    /// return the script as stored, only usable if hasOutputData() returns true.
+    inline const Streaming::ConstBuffer &outputScript() const {
+        return m_outputScript;
+    }
+
     inline const Streaming::ConstBuffer &data() const {
         return m_data;
     }
@@ -81,6 +100,8 @@ public:
 private:
     friend class UnspentOutputDatabase;
     Streaming::ConstBuffer m_data;
+    Streaming::ConstBuffer m_outputScript;
+    uint64_t m_outputAmount = 0;
     int m_outIndex = 0;
     int m_offsetInBlock = 0; // in bytes. 2GB blocks is enough for a while.
     int m_blockHeight = 0;
@@ -126,6 +147,28 @@ public:
      */
     static void setChangeCountCausesStore(int count);
 
+    /**
+     * When enabled, the user of the database is asked to provide the amount and script of
+     * each output it inserts and those are stored in the leaf.
+     *
+     * The database doesn't interpret the amount or the script, it just stores them for
+     * later retrieval via UnspentOutput::outputAmount() and UnspentOutput::outputScript().
+     * This avoids having to go back to the block to find out those details, which is
+     * useful when the blocks don't fit in memory.
+     *
+     * The setting can be changed at any time, leafs stored without output data
+     * will continue to work.
+     */
+    void setStoreOutputData(bool on);
+    bool storesOutputData() const;
+
+    /// An (optional) copy of the output data to be stored in the leaf.
+    struct OutputData {
+        OutputData(uint64_t amount, const Streaming::ConstBuffer &script) : amount(amount), script(script) {}
+        uint64_t amount = 0;
+        Streaming::ConstBuffer script;
+    };
+
     struct BlockData {
         struct TxOutputs { // can hold all the data for a single transaction
             TxOutputs(const uint256 &id, int offsetInBlock, int firstOutput, int lastOutput = -1)
@@ -137,6 +180,8 @@ public:
             uint256 txid;
             int firstOutput = 0, lastOutput = 0;
             int offsetInBlock = 0;
+            /// either empty, or one item for each output from firstOutput to lastOutput.
+            std::vector<OutputData> outputData;
         };
         int blockHeight = -1;
         std::vector<TxOutputs> outputs;
@@ -160,6 +205,16 @@ public:
      */
     UnspentOutput find(const uint256 &txid, int index) const;
 
+    /**
+     * @brief findAll is a batched version of find().
+     * Looking up a large set of outputs in one go allows the database to sort
+     * the work for locality and to pre-fetch the on-disk data.
+     * @param inputs the outputs to find, in the form of the inputs spending them.
+     * @return a list of the same size as inputs, in the same order.
+     *      Each item is either a filled UnspentOutput or an invalid one.
+     */
+    std::vector<UnspentOutput> findAll(const std::vector<Tx::Input> &inputs) const;
+
     /**
      * @brief remove an output from the unspend database.
      * This spends an output, forgetting it from the latest tree of the DB.
@@ -169,6 +224,14 @@ public:
      */
     SpentOutput remove(const uint256 &txid, int index, uint64_t rmHint = 0);
 
+    /**
+     * @brief removeAll is a batched version of remove().
+     * @param inputs the outputs to remove, in the form of the inputs spending them.
+     * @param rmHints either empty or one hint for each input, as returned by findAll().
+     * @return a list of the same size as inputs, in the same order.
+     */
+    std::vector<SpentOutput> removeAll(const std::vector<Tx::Input> &inputs, const std::vector<uint64_t> &rmHints);
+
     /**
      * The blockFinished should be called after every block to update the UnspentOutput DB
      * about which block we just finished.
@@ -31,6 +31,7 @@
 #include "UnspentOutputDatabase.h"
 #include "BucketMap.h"
 #include "DataFileList.h"
+#include "MembershipFilter.h"
 #include <streaming/BufferPool.h>
 
 #include <boost/iostreams/device/mapped_file.hpp>
@@ -116,7 +117,17 @@ namespace UODB {
 
         // In the worldvie wof this UTXO a block stored in the 'block-index'
         // that was invalid stores its sha256 blockId here.
-        InvalidBlockHash
+        InvalidBlockHash,
+
+        // Membership filter stored in the info file, directly after the jumptable.
+        MembershipFilterBits,
+        MembershipFilterHash,
+        // Amount of lookups in this file that the membership filter made unneeded.
+        ProbesAvoided,
+
+        // Optional tags in the leaf, stored before the separator.
+        OutputAmount,
+        OutputScript
     };
 }
 
@@ -164,9 +175,23 @@ class DataFile {
 public:
     DataFile(const boost::filesystem::path &filename, int beforeHeight = INT_MAX);
 
-    void insert(const UODBPrivate *priv, const uint256 &txid, int firstOutput, int lastOutput, int blockHeight, int offsetInBlock);
+    /// insert a transactions outputs, leafs are allocated from \a pool, or our m_memBuffers when none is passed.
+    void insert(const UODBPrivate *priv, const uint256 &txid, int firstOutput, int lastOutput, int blockHeight, int offsetInBlock,
+                const std::vector<UnspentOutputDatabase::OutputData> *outputData = nullptr, Streaming::BufferPool *pool = nullptr);
+    /**
+     * Insert the outputs in range \a start to \a end.
+     * Large ranges are partitioned by shortHash and inserted using the thread pool, the calling thread
+     * takes part and this method returns only after all are inserted.
+     */
     void insertAll(const UODBPrivate *priv, const UnspentOutputDatabase::BlockData &data, size_t start, size_t end);
+    /// find the output in the bucket found in the jumptable as \a bucketId
+    UnspentOutput findInBucket(const uint256 &txid, int index, uint32_t bucketId) const;
+    UnspentOutput *createLeaf(Streaming::BufferPool &pool, const uint256 &txid, int outIndex, int blockHeight, int offsetInBlock,
+                              const std::vector<UnspentOutputDatabase::OutputData> *outputData, int dataIndex);
     UnspentOutput find(const uint256 &txid, int index) const;
+    /// find the items from \a inputs in the sequence of \a order. Skipping ones already valid in \a answers.
+    void findAll(const std::vector<Tx::Input> &inputs, const std::vector<int> &order,
+                 std::vector<UnspentOutput> &answers, int fileIndex) const;
     SpentOutput remove(const UODBPrivate *priv, const uint256 &txid, int index, uint32_t leafHint = 0);
 
     /// checks jumptable fragmentation, returns amount of bytes its larger than after latest prune
@@ -194,6 +219,8 @@ public:
     Streaming::BufferPool m_memBuffers;
     uint32_t m_jumptables[0x100000];
     mutable BucketMap m_buckets;
+    MembershipFilter m_filter;
+    mutable std::atomic<uint64_t> m_probesAvoided;
     std::atomic_int m_nextBucketIndex;
     std::atomic_int m_nextLeafIndex;
 
@@ -264,6 +291,8 @@ struct Limits
     int32_t FileFull = 1800000000; // 1.8GB
     uint32_t AutoFlush = 5000000; // every 5 million inserts/deletes, auto-flush jumptables
     int32_t ChangesToSave = 200000; // every 200K inserts/deletes, start a save-round.
+    uint32_t FilterBits = 0x8000000; // size of the membership filter of a new datafile. 16MiB.
+    uint32_t ParallelInsertMin = 20000; // insertAll() batches with this many transactions get inserted multi-threaded.
 };
 
 class UODBPrivate
@@ -281,6 +310,8 @@ public:
 
     bool memOnly = false; //< if true, we never flush to disk.
     bool doPrune = false;
+    bool storeOutputData = false; //< if true, leafs get the output amount and script stored.
+    int insertThreads = 1; //< the amount of threads insertAll() may use, including the calling one.
 
     const boost::filesystem::path basedir;
 
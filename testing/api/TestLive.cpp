@@ -22,6 +22,7 @@
 
 #include <streaming/MessageBuilder.h>
 #include <streaming/MessageParser.h>
+#include <primitives/FastTransaction.h>
 
 void TestApiLive::testBasic()
 {
@@ -75,6 +76,46 @@ void TestApiLive::testSendTx()
     }
 }
 
+void TestApiLive::testSendTxs()
+{
+    startHubs();
+    generate100();
+    Streaming::MessageBuilder builder(Streaming::NoHeader, 100000);
+    builder.add(Api::BlockChain::BlockHeight, 2);
+    Message m = waitForReply(0, builder.message(Api::BlockChainService, Api::BlockChain::GetBlock), Api::BlockChain::GetBlockReply);
+    Streaming::ConstBuffer coinbase;
+    Streaming::MessageParser parser(m.body());
+    while (parser.next() == Streaming::FoundTag) {
+        if (parser.tag() == Api::BlockChain::GenericByteData) {
+            coinbase = parser.bytesDataBuffer();
+            break;
+        }
+    }
+    QVERIFY(coinbase.size() > 0);
+    const uint256 txid = Tx(coinbase).createHash();
+    for (int i = 0; i < 10; ++i) {
+        builder.add(Api::LiveTransactions::Transaction, coinbase);
+    }
+    m = waitForReply(0, builder.message(Api::LiveTransactionService, Api::LiveTransactions::SendTransactions),
+                     Api::LiveTransactions::SendTransactionsReply);
+    QCOMPARE(m.serviceId(), (int) Api::LiveTransactionService);
+    QCOMPARE(m.messageId(), (int) Api::LiveTransactions::SendTransactionsReply);
+    int txCount = 0, rejectCount = 0;
+    Streaming::MessageParser parser2(m.body());
+    while (parser2.next() == Streaming::FoundTag) {
+        if (parser2.tag() == Api::LiveTransactions::TxId) {
+            ++txCount;
+            QCOMPARE(parser2.uint256Data(), txid);
+        } else if (parser2.tag() == Api::LiveTransactions::RejectReason) {
+            ++rejectCount;
+            QVERIFY(!parser2.stringData().empty());
+        }
+    }
+    // a coinbase is never accepted as a loose transaction
+    QCOMPARE(txCount, 10);
+    QCOMPARE(rejectCount, 10);
+}
+
 void TestApiLive::testUtxo()
 {
     startHubs();
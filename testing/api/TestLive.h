@@ -26,6 +26,7 @@ class TestApiLive : public BlackBoxTest
 private slots:
     void testBasic();
     void testSendTx();
+    void testSendTxs();
     void testUtxo();
 
 private:
@@ -462,4 +462,63 @@ void TestBlockValidation::minimalPush()
     QCOMPARE(bv->blockchain()->Height(), 110);
 }
 
+void TestBlockValidation::sighashCache_data()
+{
+    QTest::addColumn<bool>("precomputed");
+    QTest::newRow("per input") << false;
+    QTest::newRow("precomputed") << true;
+}
+
+void TestBlockValidation::sighashCache()
+{
+    QFETCH(bool, precomputed);
+    // a consolidation transaction with 1000 inputs.
+    CMutableTransaction tx;
+    tx.vin.resize(1000);
+    for (size_t i = 0; i < tx.vin.size(); ++i) {
+        tx.vin[i].prevout = COutPoint(GetRandHash(), i % 3);
+    }
+    tx.vout.resize(2);
+    tx.vout[0].nValue = 20 * COIN;
+    tx.vout[0].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << std::vector<uint8_t>(20, 1) << OP_EQUALVERIFY << OP_CHECKSIG;
+    tx.vout[1].nValue = 5 * COIN;
+    tx.vout[1].scriptPubKey = tx.vout[0].scriptPubKey;
+    const CTransaction transaction(tx);
+    const CScript &scriptCode = tx.vout[0].scriptPubKey;
+    const int hashType = SIGHASH_ALL | SIGHASH_FORKID;
+
+    uint256 result;
+    QBENCHMARK {
+        std::unique_ptr<PrecomputedTransactionData> txData;
+        if (precomputed)
+            txData.reset(new PrecomputedTransactionData(transaction));
+        for (size_t i = 0; i < transaction.vin.size(); ++i) {
+            result = SignatureHash(scriptCode, transaction, i, COIN, hashType, SCRIPT_ENABLE_SIGHASH_FORKID, txData.get());
+        }
+    }
+    QCOMPARE(result, SignatureHash(scriptCode, transaction, transaction.vin.size() - 1, COIN, hashType));
+}
+
+void TestBlockValidation::statistics()
+{
+    const Validation::Statistics before = bv->statistics();
+    bv->appendChain(5);
+    QCOMPARE(bv->blockchain()->Height(), 5);
+    const Validation::Statistics after = bv->statistics();
+    QCOMPARE(after.blocks - before.blocks, (uint64_t) 5);
+    QCOMPARE(after.transactions - before.transactions, (uint64_t) 5);
+    QCOMPARE(after.utxoLookups, before.utxoLookups); // coinbases have no inputs to look up.
+    for (int i = 0; i < Validation::Statistics::StageCount; ++i) {
+        const Validation::Statistics::StageTimes &times = after.stages[static_cast<size_t>(i)];
+        uint64_t histogramTotal = 0;
+        for (auto bucket : times.histogram) {
+            histogramTotal += bucket;
+        }
+        QCOMPARE(histogramTotal, times.count);
+        QVERIFY(times.maxTime <= times.totalTime);
+    }
+    QVERIFY(after.stages[Validation::Statistics::HeaderCheck].count >= 5);
+    QVERIFY(after.stages[Validation::Statistics::ScriptValidation].count >= 5);
+}
+
 QTEST_MAIN(TestBlockValidation)
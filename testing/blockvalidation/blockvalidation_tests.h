@@ -35,6 +35,9 @@ private slots:
     void CTOR();
     void rollback();
     void minimalPush();
+    void sighashCache_data();
+    void sighashCache();
+    void statistics();
 
 private:
     FastBlock createHeader(const FastBlock &full) const;
@@ -27,6 +27,23 @@ public:
     HashStoragePrivate *d;
 };
 
+namespace {
+// a cheap, evenly distributed, hash for \a index. Just like the sha256 based ones we store.
+uint256 createHash(uint64_t index)
+{
+    uint256 answer;
+    uint64_t *words = reinterpret_cast<uint64_t*>(answer.begin());
+    for (int i = 0; i < 4; ++i) {
+        // splitmix64
+        uint64_t z = (index * 4 + static_cast<uint64_t>(i) + 1) * 0x9e3779b97f4a7c15ULL;
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+        words[i] = z ^ (z >> 31);
+    }
+    return answer;
+}
+}
+
 void TestHashStorage::init()
 {
     m_testPath = strprintf("test_flowee_%lu", (unsigned long)GetTime());
@@ -155,4 +172,76 @@ void TestHashStorage::multipleDbs()
     }
 }
 
+void TestHashStorage::backgroundFinalize()
+{
+    constexpr int Count = 200000;
+    {
+        HashStorage hs(m_testPath);
+        HashStoragePrivate *d = reinterpret_cast<OpenHashStorage*>(&hs)->d;
+        auto db = d->dbs.first();
+        for (int i = 0; i < Count; ++i) {
+            QCOMPARE(hs.append(createHash(static_cast<uint64_t>(i))).row, i);
+            if (i % 50000 == 49999)
+                db->stabilize();
+        }
+        QCOMPARE(db->m_parts.size(), 4);
+
+        db->startFinalize();
+        // lookups keep working while the merge runs.
+        for (int i = 0; i < Count; i += 1000) {
+            QCOMPARE(hs.lookup(createHash(static_cast<uint64_t>(i))), HashIndexPoint(0, i));
+            QCOMPARE(hs.find(HashIndexPoint(0, i)), createHash(static_cast<uint64_t>(i)));
+        }
+        db->waitForFinalize();
+        QCOMPARE(db->m_parts.size(), 0);
+        QVERIFY(db->m_sorted);
+        for (int i = 0; i < Count; ++i) {
+            QCOMPARE(hs.lookup(createHash(static_cast<uint64_t>(i))), HashIndexPoint(0, i));
+        }
+        QCOMPARE(hs.find(HashIndexPoint(0, 1234)), createHash(1234));
+        QCOMPARE(hs.lookup(createHash(Count)), HashIndexPoint());
+    }
+    HashStorage hs(m_testPath);
+    QCOMPARE(hs.lookup(createHash(4321)), HashIndexPoint(0, 4321));
+    QCOMPARE(hs.find(HashIndexPoint(0, Count - 1)), createHash(Count - 1));
+}
+
+void TestHashStorage::benchLookup_data()
+{
+    QTest::addColumn<int>("count");
+    QTest::newRow("1M") << 1000000;
+    QTest::newRow("120M") << 120000000;
+}
+
+void TestHashStorage::benchLookup()
+{
+    QFETCH(int, count);
+    if (count > 1000000 && qgetenv("FLOWEE_LARGE_BENCHMARKS").isEmpty())
+        QSKIP("Set FLOWEE_LARGE_BENCHMARKS to run, this needs about 10GB of diskspace");
+
+    HashStorage hs(m_testPath);
+    for (int i = 0; i < count; ++i) {
+        hs.append(createHash(static_cast<uint64_t>(i)));
+    }
+    hs.finalize(); // make all lookups go to the sorted files.
+
+    // Half the lookups are for hashes we have, half for hashes we don't have.
+    constexpr int Lookups = 100000;
+    const int step = count / Lookups;
+    int found = 0;
+    int missing = 0;
+    QBENCHMARK {
+        found = 0;
+        missing = 0;
+        for (int i = 0; i < Lookups; ++i) {
+            if (hs.lookup(createHash(static_cast<uint64_t>(i * step))).row >= 0)
+                ++found;
+            if (hs.lookup(createHash(static_cast<uint64_t>(count + i))).row < 0)
+                ++missing;
+        }
+    }
+    QCOMPARE(found, Lookups);
+    QCOMPARE(missing, Lookups);
+}
+
 QTEST_MAIN(TestHashStorage)
@@ -34,6 +34,10 @@ private slots:
     void basic();
 
     void multipleDbs();
+    void backgroundFinalize();
+
+    void benchLookup_data();
+    void benchLookup();
 
 private:
     boost::filesystem::path m_testPath;
@@ -19,9 +19,13 @@
 
 #include <networkmanager/NetworkManager.h>
 #include <networkmanager/NetworkManager_p.h>
+#include <networkmanager/Lz4.h>
 #include <WorkerThreads.h>
 #include <Message.h>
 
+#include <QElapsedTimer>
+#include <atomic>
+
 void TestNWM::testBigMessage()
 {
     auto localhost = boost::asio::ip::address_v4::loopback();
@@ -61,6 +65,283 @@ void TestNWM::testBigMessage()
     QTRY_COMPARE(messageSize, BigSize);
 }
 
+void TestNWM::testLargeFrame_data()
+{
+    QTest::addColumn<bool>("serverLargeFrames");
+    QTest::addColumn<bool>("clientLargeFrames");
+    QTest::newRow("both") << true << true;
+    QTest::newRow("server-only") << true << false;
+    QTest::newRow("client-only") << false << true;
+}
+
+void TestNWM::testLargeFrame()
+{
+    QFETCH(bool, serverLargeFrames);
+    QFETCH(bool, clientLargeFrames);
+    auto localhost = boost::asio::ip::address_v4::loopback();
+    const int port = std::max(1100, rand() % 32000);
+
+    QMutex writeLock;
+    std::list<Message> messages;
+
+    WorkerThreads threads;
+    NetworkManager server(threads.ioService());
+    server.setLargeFramesEnabled(serverLargeFrames);
+    std::list<NetworkConnection> stash;
+    server.bind(boost::asio::ip::tcp::endpoint(localhost, port), [&stash, &messages, &writeLock](NetworkConnection &connection) {
+        connection.setOnIncomingMessage([&messages, &writeLock](const Message &message) {
+            QMutexLocker l(&writeLock);
+            messages.push_back(message);
+        });
+        connection.accept();
+        stash.push_back(std::move(connection));
+    });
+
+    NetworkManager client(threads.ioService());
+    client.setLargeFramesEnabled(clientLargeFrames);
+    auto con = client.connection(EndPoint(localhost, port));
+    con.connect();
+    QTest::qWait(200); // allow the peers to tell each other about large-frame support
+
+    // a large message sandwiched between small ones.
+    const int sizes[] = { 100, 3000000, 200 };
+    for (int i = 0; i < 3; ++i) {
+        Streaming::BufferPool pool(sizes[i]);
+        for (int x = 0; x < sizes[i]; ++x) {
+            pool.data()[x] = 0xFF & (x + i);
+        }
+        Message message(pool.commit(sizes[i]), 1);
+        message.setMessageId(i + 2);
+        message.setHeaderInt(11, 312 + i);
+        con.send(message);
+    }
+
+    QTRY_COMPARE_WITH_TIMEOUT(static_cast<int>(messages.size()), 3, 20000);
+    int i = 0;
+    for (const Message &message : messages) {
+        QCOMPARE(message.serviceId(), 1);
+        QCOMPARE(message.messageId(), i + 2);
+        QCOMPARE(message.headerInt(11), 312 + i);
+        QCOMPARE(message.body().size(), sizes[i]);
+        for (int x = 0; x < sizes[i]; ++x) {
+            QCOMPARE(static_cast<uint8_t>(message.body().begin()[x]), static_cast<uint8_t>(0xFF & (x + i)));
+        }
+        ++i;
+    }
+}
+
+void TestNWM::testCompression_data()
+{
+    QTest::addColumn<bool>("serverCompression");
+    QTest::addColumn<bool>("clientCompression");
+    QTest::addColumn<bool>("largeFrames");
+    QTest::newRow("both") << true << true << true;
+    QTest::newRow("both-chunked") << true << true << false;
+    QTest::newRow("server-only") << true << false << true;
+    QTest::newRow("client-only") << false << true << true;
+}
+
+void TestNWM::testCompression()
+{
+    QFETCH(bool, serverCompression);
+    QFETCH(bool, clientCompression);
+    QFETCH(bool, largeFrames);
+    auto localhost = boost::asio::ip::address_v4::loopback();
+    const int port = std::max(1100, rand() % 32000);
+
+    QMutex writeLock;
+    std::list<Message> messages;
+
+    WorkerThreads threads;
+    NetworkManager server(threads.ioService());
+    server.setCompressionEnabled(serverCompression);
+    server.setLargeFramesEnabled(largeFrames);
+    std::list<NetworkConnection> stash;
+    server.bind(boost::asio::ip::tcp::endpoint(localhost, port), [&stash, &messages, &writeLock](NetworkConnection &connection) {
+        connection.setOnIncomingMessage([&messages, &writeLock](const Message &message) {
+            QMutexLocker l(&writeLock);
+            messages.push_back(message);
+        });
+        connection.accept();
+        stash.push_back(std::move(connection));
+    });
+
+    NetworkManager client(threads.ioService());
+    client.setCompressionEnabled(clientCompression);
+    auto con = client.connection(EndPoint(localhost, port));
+    con.connect();
+    QTest::qWait(200); // allow the peers to tell each other about compression support
+
+    // compressible, too small and large.
+    const int sizes[] = { 5000, 100, 500000 };
+    for (int i = 0; i < 3; ++i) {
+        Streaming::BufferPool pool(sizes[i]);
+        for (int x = 0; x < sizes[i]; ++x) {
+            pool.data()[x] = 0xFF & (x % 64 < 20 ? x * 7919 : x + i);
+        }
+        Message message(pool.commit(sizes[i]), 1);
+        message.setMessageId(i + 2);
+        message.setHeaderInt(11, 312 + i);
+        con.send(message);
+    }
+
+    QTRY_COMPARE_WITH_TIMEOUT(static_cast<int>(messages.size()), 3, 20000);
+    int i = 0;
+    for (const Message &message : messages) {
+        QCOMPARE(message.serviceId(), 1);
+        QCOMPARE(message.messageId(), i + 2);
+        QCOMPARE(message.headerInt(11), 312 + i);
+        QCOMPARE(message.headerInt(Network::CompressedSize), -1);
+        QCOMPARE(message.body().size(), sizes[i]);
+        for (int x = 0; x < sizes[i]; ++x) {
+            QCOMPARE(static_cast<uint8_t>(message.body().begin()[x]),
+                     static_cast<uint8_t>(0xFF & (x % 64 < 20 ? x * 7919 : x + i)));
+        }
+        ++i;
+    }
+
+    const auto clientStats = con.compressionStatistics();
+    if (serverCompression && clientCompression) {
+        QCOMPARE(clientStats.size(), 1ul);
+        QCOMPARE(clientStats.front().serviceId, 1);
+        QCOMPARE(clientStats.front().messagesCompressed, 2ul);
+        QVERIFY(clientStats.front().bytesSaved() > 0);
+        const auto serverStats = server.compressionStatistics();
+        QCOMPARE(serverStats.size(), 1ul);
+        QCOMPARE(serverStats.front().messagesDecompressed, 2ul);
+        QCOMPARE(serverStats.front().bytesSaved(), clientStats.front().bytesSaved());
+    } else {
+        QVERIFY(clientStats.empty());
+    }
+}
+
+void TestNWM::testBogusCompression()
+{
+    auto localhost = boost::asio::ip::address_v4::loopback();
+    const int port = std::max(1100, rand() % 32000);
+
+    QMutex writeLock;
+    std::list<Message> messages;
+
+    WorkerThreads threads;
+    NetworkManager server(threads.ioService());
+    server.setCompressionEnabled(true);
+    std::list<NetworkConnection> stash;
+    server.bind(boost::asio::ip::tcp::endpoint(localhost, port), [&stash, &messages, &writeLock](NetworkConnection &connection) {
+        connection.setOnIncomingMessage([&messages, &writeLock](const Message &message) {
+            QMutexLocker l(&writeLock);
+            messages.push_back(message);
+        });
+        connection.accept();
+        stash.push_back(std::move(connection));
+    });
+
+    NetworkManager client(threads.ioService());
+    client.setCompressionEnabled(true);
+    auto con = client.connection(EndPoint(localhost, port));
+    con.connect();
+    QTest::qWait(200);
+    QVERIFY(con.isConnected());
+
+    // a tiny body claiming to decompress to 64MB can't be valid Lz4 and is rejected before allocating.
+    Streaming::BufferPool pool(40);
+    memset(pool.data(), 0, 40);
+    Message message(pool.commit(40), 1);
+    message.setMessageId(2);
+    message.setCompressedSize(64 * 1024 * 1024);
+    con.send(message);
+
+    QTest::qWait(500); // the server closes the connection, the client may reconnect.
+    QVERIFY(messages.empty());
+}
+
+void TestNWM::testLz4()
+{
+    std::vector<char> input(100000);
+    for (size_t i = 0; i < input.size(); ++i) {
+        input[i] = static_cast<char>(i % 100 < 30 ? rand() : i % 7);
+    }
+    std::vector<char> compressed(static_cast<size_t>(Lz4::compressBound(static_cast<int>(input.size()))));
+    const int size = Lz4::compress(input.data(), static_cast<int>(input.size()), compressed.data(), static_cast<int>(compressed.size()));
+    QVERIFY(size > 0);
+    QVERIFY(size < static_cast<int>(input.size()));
+    // too small target
+    QCOMPARE(Lz4::compress(input.data(), static_cast<int>(input.size()), compressed.data(), size - 1), 0);
+
+    std::vector<char> output(input.size());
+    QCOMPARE(Lz4::decompress(compressed.data(), size, output.data(), static_cast<int>(output.size())), static_cast<int>(input.size()));
+    QVERIFY(output == input);
+    // the output doesn't fit
+    QCOMPARE(Lz4::decompress(compressed.data(), size, output.data(), static_cast<int>(output.size()) - 1), -1);
+    // truncated input
+    QVERIFY(Lz4::decompress(compressed.data(), size - 3, output.data(), static_cast<int>(output.size())) < static_cast<int>(input.size()));
+
+    // tiny inputs are stored as literals
+    const char tiny[] = "abc";
+    QCOMPARE(Lz4::compress(tiny, 3, compressed.data(), static_cast<int>(compressed.size())), 4);
+    QCOMPARE(Lz4::decompress(compressed.data(), 4, output.data(), 3), 3);
+    QCOMPARE(output[2], 'c');
+}
+
+void TestNWM::benchThroughput_data()
+{
+    QTest::addColumn<bool>("largeFrames");
+    QTest::addColumn<int>("messageSize");
+    QTest::newRow("chunked 100KB") << false << 100000;
+    QTest::newRow("large-frame 100KB") << true << 100000;
+    QTest::newRow("chunked 1MB") << false << 1000000;
+    QTest::newRow("large-frame 1MB") << true << 1000000;
+    QTest::newRow("chunked 32MB") << false << 32000000;
+    QTest::newRow("large-frame 32MB") << true << 32000000;
+}
+
+void TestNWM::benchThroughput()
+{
+    QFETCH(bool, largeFrames);
+    QFETCH(int, messageSize);
+    auto localhost = boost::asio::ip::address_v4::loopback();
+    const int port = std::max(1100, rand() % 32000);
+    const int count = std::min(1000, 100000000 / messageSize); // ~100MB per iteration
+
+    std::atomic<int> received(0);
+    WorkerThreads threads;
+    NetworkManager server(threads.ioService());
+    server.setLargeFramesEnabled(largeFrames);
+    std::list<NetworkConnection> stash;
+    server.bind(boost::asio::ip::tcp::endpoint(localhost, port), [&stash, &received](NetworkConnection &connection) {
+        connection.setOnIncomingMessage([&received](const Message &) {
+            ++received;
+        });
+        connection.accept();
+        stash.push_back(std::move(connection));
+    });
+
+    NetworkManager client(threads.ioService());
+    auto con = client.connection(EndPoint(localhost, port));
+    con.connect();
+    QTest::qWait(200);
+
+    Streaming::BufferPool pool(messageSize);
+    for (int i = 0; i < messageSize; ++i) {
+        pool.data()[i] = 0xFF & i;
+    }
+    Message message(pool.commit(messageSize), 1);
+
+    QElapsedTimer timer;
+    qint64 bytes = 0;
+    timer.start();
+    QBENCHMARK {
+        received = 0;
+        for (int i = 0; i < count; ++i) {
+            con.send(message);
+        }
+        QTRY_COMPARE_WITH_TIMEOUT(received.load(), count, 60000);
+        bytes += qint64(count) * messageSize;
+    }
+    qInfo() << (largeFrames ? "large-frame" : "chunked") << messageSize << "bytes per message:"
+            << (bytes / std::max<qint64>(1, timer.elapsed()) / 1000) << "MB/s";
+}
+
 void TestNWM::testRingBuffer()
 {
     RingBuffer<int> buf(2000);
@@ -29,6 +29,14 @@ public:
 
 private slots:
     void testBigMessage();
+    void testLargeFrame_data();
+    void testLargeFrame();
+    void testCompression_data();
+    void testCompression();
+    void testBogusCompression();
+    void testLz4();
+    void benchThroughput_data();
+    void benchThroughput();
 
     void testRingBuffer();
 
@@ -0,0 +1,138 @@
+/*
+ * This file is part of the Flowee project
+ * Copyright (C) 2020 Tom Zander <tomz@freedommail.ch>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "test_postingstorage.h"
+
+#include "../../indexer/PostingStorage.h"
+#include "../../indexer/PostingStorage_p.h"
+
+#include <utiltime.h>
+
+class OpenPostingStorage {
+public:
+    PostingStoragePrivate *d;
+};
+
+namespace {
+PostingStorage::Entry createEntry(int db, int row, int height, int offsetInBlock, int outIndex)
+{
+    PostingStorage::Entry entry;
+    entry.address = HashIndexPoint(db, row);
+    entry.posting.blockHeight = height;
+    entry.posting.offsetInBlock = offsetInBlock;
+    entry.posting.outIndex = static_cast<short>(outIndex);
+    return entry;
+}
+}
+
+void TestPostingStorage::init()
+{
+    m_testPath = strprintf("test_flowee_%lu", (unsigned long)GetTime());
+    boost::filesystem::remove_all(m_testPath);
+    boost::filesystem::create_directories(m_testPath);
+}
+
+void TestPostingStorage::cleanup()
+{
+    boost::filesystem::remove_all(m_testPath);
+}
+
+void TestPostingStorage::basic()
+{
+    {
+        PostingStorage ps(m_testPath);
+        QCOMPARE(ps.blockHeight(), -1);
+        QVERIFY(ps.find(HashIndexPoint(0, 1)).empty());
+
+        std::vector<PostingStorage::Entry> entries;
+        entries.push_back(createEntry(0, 12, 110, 2000, 1));
+        entries.push_back(createEntry(0, 12, 100, 81, 0));
+        entries.push_back(createEntry(1, 12, 100, 500, 3));
+        entries.push_back(createEntry(0, 12, 110, 1000, 1));
+        entries.push_back(createEntry(0, 12, 110, 1000, 1)); // duplicates are ignored
+        ps.append(entries, 110);
+        QCOMPARE(ps.blockHeight(), 110);
+
+        auto postings = ps.find(HashIndexPoint(0, 12));
+        QCOMPARE(postings.size(), 3ul);
+        QCOMPARE(postings.at(0).blockHeight, 100);
+        QCOMPARE(postings.at(0).offsetInBlock, 81);
+        QCOMPARE(postings.at(0).outIndex, (short) 0);
+        QCOMPARE(postings.at(1).blockHeight, 110);
+        QCOMPARE(postings.at(1).offsetInBlock, 1000);
+        QCOMPARE(postings.at(2).blockHeight, 110);
+        QCOMPARE(postings.at(2).offsetInBlock, 2000);
+
+        postings = ps.find(HashIndexPoint(1, 12));
+        QCOMPARE(postings.size(), 1ul);
+        QCOMPARE(postings.at(0).offsetInBlock, 500);
+        QCOMPARE(postings.at(0).outIndex, (short) 3);
+        QVERIFY(ps.find(HashIndexPoint(0, 13)).empty());
+
+        // a batch of blocks without any addresses still remembers the height.
+        entries.clear();
+        ps.append(entries, 120);
+        QCOMPARE(ps.blockHeight(), 120);
+    }
+    {
+        PostingStorage ps(m_testPath);
+        QCOMPARE(ps.blockHeight(), 120);
+        auto postings = ps.find(HashIndexPoint(0, 12));
+        QCOMPARE(postings.size(), 3ul);
+        QCOMPARE(postings.at(2).offsetInBlock, 2000);
+    }
+}
+
+void TestPostingStorage::merge()
+{
+    {
+        PostingStorage ps(m_testPath);
+        PostingStoragePrivate *d = reinterpret_cast<OpenPostingStorage*>(&ps)->d;
+        int height = 0;
+        for (int batch = 0; batch < 20; ++batch) {
+            std::vector<PostingStorage::Entry> entries;
+            for (int i = 0; i < 100; ++i) {
+                entries.push_back(createEntry(0, i, height + 1, 100 + i, batch));
+            }
+            height += 10;
+            ps.append(entries, height);
+            // segments are merged while appending
+            QVERIFY(d->segments.size() < 6);
+        }
+        QCOMPARE(ps.blockHeight(), 200);
+        for (int i = 0; i < 100; ++i) {
+            auto postings = ps.find(HashIndexPoint(0, i));
+            QCOMPARE(postings.size(), 20ul);
+            for (int batch = 0; batch < 20; ++batch) {
+                QCOMPARE(postings.at(batch).blockHeight, batch * 10 + 1);
+                QCOMPARE(postings.at(batch).outIndex, (short) batch);
+            }
+        }
+        ps.compact();
+        QCOMPARE(d->segments.size(), 1ul);
+        QCOMPARE(ps.find(HashIndexPoint(0, 50)).size(), 20ul);
+    }
+    {
+        PostingStorage ps(m_testPath);
+        PostingStoragePrivate *d = reinterpret_cast<OpenPostingStorage*>(&ps)->d;
+        QCOMPARE(d->segments.size(), 1ul);
+        QCOMPARE(ps.blockHeight(), 200);
+        QCOMPARE(ps.find(HashIndexPoint(0, 99)).size(), 20ul);
+    }
+}
+
+QTEST_MAIN(TestPostingStorage)
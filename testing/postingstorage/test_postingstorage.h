@@ -0,0 +1,41 @@
+/*
+ * This file is part of the Flowee project
+ * Copyright (C) 2020 Tom Zander <tomz@freedommail.ch>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef TEST_POSTINGSTORAGE_H
+#define TEST_POSTINGSTORAGE_H
+
+#include <common/TestFloweeBase.h>
+#include <boost/filesystem.hpp>
+
+class TestPostingStorage : public TestFloweeBase
+{
+    Q_OBJECT
+public:
+    TestPostingStorage() {}
+
+private slots:
+    void init();
+    void cleanup();
+
+    void basic();
+    void merge();
+
+private:
+    boost::filesystem::path m_testPath;
+};
+
+#endif
@@ -0,0 +1,157 @@
+/*
+ * This file is part of the Flowee project
+ * Copyright (C) 2020 Tom Zander <tomz@freedommail.ch>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <BlockScanDispatcher.h>
+#include <chain.h>
+#include <chainparams.h>
+#include <utiltime.h>
+
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+namespace {
+class CollectingListener : public BlockScanListener
+{
+public:
+    void blockScanned(const ScannedBlock &block) override {
+        std::lock_guard<std::mutex> lock(mutex);
+        blocks.push_back(block);
+    }
+
+    size_t count() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return blocks.size();
+    }
+
+    std::mutex mutex;
+    std::vector<ScannedBlock> blocks;
+};
+
+class GatedListener : public CollectingListener
+{
+public:
+    void blockScanned(const ScannedBlock &block) override {
+        std::unique_lock<std::mutex> lock(gateMutex);
+        while (closed)
+            gate.wait(lock);
+        lock.unlock();
+        CollectingListener::blockScanned(block);
+    }
+
+    void open() {
+        std::lock_guard<std::mutex> lock(gateMutex);
+        closed = false;
+        gate.notify_all();
+    }
+
+    std::mutex gateMutex;
+    std::condition_variable gate;
+    bool closed = true;
+};
+}
+
+BOOST_FIXTURE_TEST_SUITE(blockscandispatcher_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(blockscandispatcher_basic)
+{
+    const CBlock &genesis = Params().GenesisBlock();
+    const FastBlock block = FastBlock::fromOldBlock(genesis);
+    CBlockIndex index;
+    index.nHeight = 0;
+    const uint256 hash = genesis.GetHash();
+    index.phashBlock = &hash;
+
+    CollectingListener listener1, listener2;
+    BlockScanDispatcher *dispatcher = BlockScanDispatcher::instance();
+    dispatcher->addListener(&listener1, "one");
+    dispatcher->addListener(&listener2, "two");
+    for (int i = 0; i < 3; ++i) {
+        dispatcher->SyncAllTransactionsInBlock(block, &index);
+    }
+    for (int i = 0; i < 500; ++i) {
+        if (listener1.count() == 3 && listener2.count() == 3)
+            break;
+        MilliSleep(10);
+    }
+    BOOST_CHECK_EQUAL(listener1.count(), 3);
+    BOOST_CHECK_EQUAL(listener2.count(), 3);
+
+    const ScannedBlock &scanned = listener1.blocks.front();
+    BOOST_CHECK(scanned.blockHash == hash);
+    BOOST_CHECK_EQUAL(scanned.blockHeight, 0);
+    BOOST_CHECK_EQUAL(scanned.transactions.size(), 1);
+    const ScannedBlock::Transaction &tx = scanned.transactions.front();
+    BOOST_CHECK(tx.txid == genesis.vtx[0].GetHash());
+    BOOST_CHECK_EQUAL(tx.offsetInBlock, 81);
+    BOOST_CHECK_EQUAL(tx.inputs.size(), 1);
+    BOOST_CHECK(tx.inputs[0].txid.IsNull());
+    BOOST_CHECK_EQUAL(tx.outputs.size(), 1);
+    BOOST_CHECK_EQUAL(tx.outputs[0].amount, genesis.vtx[0].vout[0].nValue);
+
+    auto stats = dispatcher->statistics();
+    BOOST_CHECK_EQUAL(stats.size(), 2);
+    for (auto &s : stats) {
+        BOOST_CHECK_EQUAL(s.delivered, 3);
+        BOOST_CHECK_EQUAL(s.backlog, 0);
+        BOOST_CHECK(s.maxBacklog >= 1);
+    }
+
+    dispatcher->removeListener(&listener1);
+    dispatcher->removeListener(&listener2);
+    BOOST_CHECK(dispatcher->statistics().empty());
+}
+
+BOOST_AUTO_TEST_CASE(blockscandispatcher_maxbacklog)
+{
+    const CBlock &genesis = Params().GenesisBlock();
+    const FastBlock block = FastBlock::fromOldBlock(genesis);
+    CBlockIndex index;
+    index.nHeight = 0;
+    const uint256 hash = genesis.GetHash();
+    index.phashBlock = &hash;
+
+    BlockScanDispatcher *dispatcher = BlockScanDispatcher::instance();
+    const int origMaxBacklog = dispatcher->maxBacklog();
+    dispatcher->setMaxBacklog(2);
+    GatedListener listener;
+    dispatcher->addListener(&listener, "gated");
+    for (int i = 0; i < 8; ++i) {
+        dispatcher->SyncAllTransactionsInBlock(block, &index);
+    }
+    MilliSleep(100);
+    auto stats = dispatcher->statistics();
+    BOOST_CHECK_EQUAL(stats.size(), 1);
+    BOOST_CHECK(stats.front().backlog <= 2);
+    BOOST_CHECK(stats.front().maxBacklog <= 2);
+
+    listener.open();
+    for (int i = 0; i < 500; ++i) {
+        if (listener.count() == 8)
+            break;
+        MilliSleep(10);
+    }
+    BOOST_CHECK_EQUAL(listener.count(), 8);
+    stats = dispatcher->statistics();
+    BOOST_CHECK(stats.front().maxBacklog <= 2);
+
+    dispatcher->removeListener(&listener);
+    dispatcher->setMaxBacklog(origMaxBacklog);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
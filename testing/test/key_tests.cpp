@@ -19,6 +19,11 @@
 #include <encodings_legacy.h>
 #include "test/test_bitcoin.h"
 #include <utilstrencodings.h>
+#include <util.h>
+#include <main.h>
+#include <primitives/FastBlock.h>
+#include <script/interpreter.h>
+#include <validation/Engine.h>
 
 #include <boost/test/unit_test.hpp>
 
@@ -192,4 +197,147 @@ BOOST_AUTO_TEST_CASE(key_test1)
     BOOST_CHECK(detsigc == ParseHex("2052d8a32079c11e79db95af63bb9600c5b04f21a9ca33dc129c2bfa8ac9dc1cd561d8ae5e0f6c1a16bde3719c64c2fd70e404b6428ab9a69566962e8771b5944d"));
 }
 
+BOOST_AUTO_TEST_CASE(schnorr_batch)
+{
+    CBitcoinSecret bsecret1, bsecret1C;
+    BOOST_CHECK(bsecret1.SetString(strSecret1));
+    BOOST_CHECK(bsecret1C.SetString(strSecret1C));
+    const CKey keys[2] = { bsecret1.GetKey(), bsecret1C.GetKey() };
+
+    SchnorrBatch batch;
+    BOOST_CHECK(batch.verify()); // empty is fine
+    std::vector<std::vector<unsigned char> > sigs;
+    std::vector<uint256> hashes;
+    for (int n = 0; n < 40; ++n) {
+        const CKey &key = keys[n % 2];
+        uint256 hashMsg = Hash(&n, &n + 1);
+        std::vector<unsigned char> sig;
+        BOOST_CHECK(key.SignSchnorr(hashMsg, sig));
+        BOOST_CHECK_EQUAL(sig.size(), 64);
+        BOOST_CHECK(key.GetPubKey().verifySchnorr(hashMsg, sig));
+        BOOST_CHECK(batch.add(key.GetPubKey(), hashMsg, sig, n + 100));
+        sigs.push_back(sig);
+        hashes.push_back(hashMsg);
+    }
+    BOOST_CHECK_EQUAL(batch.size(), 40);
+    BOOST_CHECK(batch.verify());
+    BOOST_CHECK_EQUAL(batch.findInvalid(), -1);
+
+    // sign the wrong message at index 17.
+    batch.clear();
+    BOOST_CHECK(batch.empty());
+    for (int n = 0; n < 40; ++n) {
+        const CKey &key = keys[n % 2];
+        BOOST_CHECK(batch.add(key.GetPubKey(), n == 17 ? hashes[0] : hashes[n], sigs[n], n + 100));
+    }
+    BOOST_CHECK(!batch.verify());
+    BOOST_CHECK_EQUAL(batch.findInvalid(), 17);
+    BOOST_CHECK_EQUAL(batch.tag(17), 117);
+}
+
+namespace {
+// Sets -batchschnorr before the validation engine of the TestingSetup is created.
+struct SchnorrBatchArg {
+    SchnorrBatchArg(bool on) {
+        mapArgs["-batchschnorr"] = on ? "1" : "0";
+    }
+    ~SchnorrBatchArg() {
+        mapArgs.erase("-batchschnorr");
+    }
+};
+struct SchnorrBatchedSetup : public SchnorrBatchArg, public TestingSetup {
+    SchnorrBatchedSetup() : SchnorrBatchArg(true) {}
+};
+struct SchnorrUnbatchedSetup : public SchnorrBatchArg, public TestingSetup {
+    SchnorrUnbatchedSetup() : SchnorrBatchArg(false) {}
+};
+
+void signSchnorr(const CKey &key, const CScript &scriptPubKey, CMutableTransaction &tx, int index, CAmount amount)
+{
+    const uint256 hash = SignatureHash(scriptPubKey, tx, index, amount, SIGHASH_ALL | SIGHASH_FORKID, SCRIPT_ENABLE_SIGHASH_FORKID);
+    std::vector<unsigned char> sig;
+    BOOST_REQUIRE(key.SignSchnorr(hash, sig));
+    sig.push_back(SIGHASH_ALL | SIGHASH_FORKID);
+    tx.vin[index].scriptSig = CScript() << sig;
+}
+
+/*
+ * Validate a block with only Schnorr signed inputs and report the sigchecks per second
+ * spent in the script-validation stage.
+ */
+void benchmarkSchnorrBlock(MockBlockValidation &bv, const char *name)
+{
+    const int Transactions = 200;
+    const int InputsPerTx = 20;
+    const CAmount OutputValue = 1000000;
+
+    CKey key;
+    std::vector<FastBlock> blocks = bv.appendChain(101, key, MockBlockValidation::StandardOutScript);
+    const CScript scriptPubKey = CScript() << ToByteVector(key.GetPubKey()) << OP_CHECKSIG;
+    blocks.front().findTransactions();
+
+    // split a mature coinbase into one output for each input of the benchmark block.
+    CMutableTransaction fanOut;
+    fanOut.vin.resize(1);
+    fanOut.vin[0].prevout = COutPoint(blocks.front().transactions().front().createHash(), 0);
+    fanOut.vout.resize(Transactions * InputsPerTx);
+    for (auto &out : fanOut.vout) {
+        out.nValue = OutputValue;
+        out.scriptPubKey = scriptPubKey;
+    }
+    signSchnorr(key, scriptPubKey, fanOut, 0, 50 * COIN);
+    FastBlock block = bv.createBlock(bv.blockchain()->Tip(), scriptPubKey, std::vector<CTransaction>(1, fanOut));
+    bv.addBlock(block, Validation::SaveGoodToDisk, 0).start().waitUntilFinished();
+    BOOST_REQUIRE(bv.blockchain()->Tip()->GetBlockHash() == block.createHash());
+
+    const uint256 fanOutId = fanOut.GetHash();
+    std::vector<CTransaction> transactions;
+    for (int t = 0; t < Transactions; ++t) {
+        CMutableTransaction tx;
+        tx.vin.resize(InputsPerTx);
+        for (int i = 0; i < InputsPerTx; ++i) {
+            tx.vin[i].prevout = COutPoint(fanOutId, t * InputsPerTx + i);
+        }
+        tx.vout.resize(1);
+        tx.vout[0].nValue = InputsPerTx * OutputValue - 10000;
+        tx.vout[0].scriptPubKey = scriptPubKey;
+        for (int i = 0; i < InputsPerTx; ++i) {
+            signSchnorr(key, scriptPubKey, tx, i, OutputValue);
+        }
+        transactions.push_back(tx);
+    }
+    block = bv.createBlock(bv.blockchain()->Tip(), scriptPubKey, transactions);
+
+    const Validation::Statistics before = bv.statistics();
+    bv.addBlock(block, Validation::SaveGoodToDisk, 0).start().waitUntilFinished();
+    const Validation::Statistics after = bv.statistics();
+    BOOST_REQUIRE(bv.blockchain()->Tip()->GetBlockHash() == block.createHash());
+
+    const uint64_t sigChecks = after.sigChecks - before.sigChecks;
+    const uint64_t time = after.stages[Validation::Statistics::ScriptValidation].totalTime
+            - before.stages[Validation::Statistics::ScriptValidation].totalTime;
+    BOOST_CHECK_EQUAL(sigChecks, static_cast<uint64_t>(Transactions * InputsPerTx));
+    BOOST_TEST_MESSAGE(name << ": " << sigChecks << " sigchecks in " << time << "us, "
+                       << static_cast<uint64_t>(sigChecks * 1E6 / std::max<uint64_t>(1, time)) << " sigchecks/s");
+}
+}
+
+/*
+ * Benchmark of the validation of a block holding 4000 Schnorr signatures, with and without batch verification.
+ * Set FLOWEE_LARGE_BENCHMARKS to run it, and use '--log_level=message' to see the results.
+ */
+BOOST_FIXTURE_TEST_CASE(schnorr_block_benchmark_batched, SchnorrBatchedSetup)
+{
+    if (getenv("FLOWEE_LARGE_BENCHMARKS") == nullptr)
+        return;
+    benchmarkSchnorrBlock(bv, "batchschnorr=1");
+}
+
+BOOST_FIXTURE_TEST_CASE(schnorr_block_benchmark_single, SchnorrUnbatchedSetup)
+{
+    if (getenv("FLOWEE_LARGE_BENCHMARKS") == nullptr)
+        return;
+    benchmarkSchnorrBlock(bv, "batchschnorr=0");
+}
+
 BOOST_AUTO_TEST_SUITE_END()
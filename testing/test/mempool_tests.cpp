@@ -18,11 +18,17 @@
 
 #include "txmempool.h"
 #include "util.h"
+#include "utiltime.h"
+#include <arith_uint256.h>
+#include <primitives/FastBlock.h>
+#include <primitives/block.h>
 
 #include "test/test_bitcoin.h"
 
 #include <boost/test/unit_test.hpp>
+#include <atomic>
 #include <list>
+#include <thread>
 
 
 BOOST_FIXTURE_TEST_SUITE(mempool_tests, TestingSetup)
@@ -116,6 +122,203 @@ BOOST_AUTO_TEST_CASE(MempoolRemoveTest)
     removed.clear();
 }
 
+BOOST_AUTO_TEST_CASE(MempoolRemoveForBlockTest)
+{
+    TestMemPoolEntryHelper entry;
+    CMutableTransaction txParent;
+    txParent.vin.resize(1);
+    txParent.vin[0].scriptSig = CScript() << OP_11;
+    txParent.vout.resize(2);
+    for (int i = 0; i < 2; i++) {
+        txParent.vout[i].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        txParent.vout[i].nValue = 33000LL;
+    }
+    // spends the first output of the parent, stays in the mempool
+    CMutableTransaction txChild;
+    txChild.vin.resize(1);
+    txChild.vin[0].scriptSig = CScript() << OP_11;
+    txChild.vin[0].prevout.hash = txParent.GetHash();
+    txChild.vin[0].prevout.n = 0;
+    txChild.vout.resize(1);
+    txChild.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+    txChild.vout[0].nValue = 11000LL;
+    // spends the second output of the parent, gets double spent by the block
+    CMutableTransaction txConflict = txChild;
+    txConflict.vin[0].prevout.n = 1;
+    CMutableTransaction txConflictChild = txChild;
+    txConflictChild.vin[0].prevout.hash = txConflict.GetHash();
+    txConflictChild.vin[0].prevout.n = 0;
+
+    CMutableTransaction txDoubleSpend = txConflict;
+    txDoubleSpend.vout[0].nValue = 10000LL;
+
+    CTxMemPool testPool;
+    testPool.addUnchecked(txParent.GetHash(), entry.FromTx(txParent));
+    testPool.addUnchecked(txChild.GetHash(), entry.FromTx(txChild));
+    testPool.addUnchecked(txConflict.GetHash(), entry.FromTx(txConflict));
+    testPool.addUnchecked(txConflictChild.GetHash(), entry.FromTx(txConflictChild));
+    BOOST_CHECK_EQUAL(testPool.size(), 4);
+
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].prevout.SetNull();
+    coinbase.vin[0].scriptSig = CScript() << OP_1 << OP_1;
+    coinbase.vout.resize(1);
+    coinbase.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    coinbase.vout[0].nValue = 50 * COIN;
+    CBlock block;
+    block.vtx.push_back(coinbase);
+    block.vtx.push_back(txParent);
+    block.vtx.push_back(txDoubleSpend);
+    FastBlock fastBlock = FastBlock::fromOldBlock(block);
+    fastBlock.findTransactions();
+    std::vector<uint256> txids;
+    for (const CTransaction &tx : block.vtx) {
+        txids.push_back(tx.GetHash());
+    }
+
+    std::list<CTransaction> conflicts;
+    testPool.removeForBlock(fastBlock, txids, conflicts);
+    BOOST_CHECK_EQUAL(conflicts.size(), 2);
+    BOOST_CHECK_EQUAL(testPool.size(), 1);
+    BOOST_CHECK(testPool.exists(txChild.GetHash()));
+    for (const CTransaction &tx : conflicts) {
+        BOOST_CHECK(tx.GetHash() == txConflict.GetHash() || tx.GetHash() == txConflictChild.GetHash());
+    }
+}
+
+BOOST_AUTO_TEST_CASE(MempoolConcurrentLookups)
+{
+    TestMemPoolEntryHelper entry;
+    auto createTx = [](int id) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(ArithToUint256(arith_uint256(id + 1)), 0);
+        tx.vin[0].scriptSig = CScript() << OP_11;
+        tx.vout.resize(1);
+        tx.vout[0].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+        tx.vout[0].nValue = 10000LL;
+        return tx;
+    };
+
+    CTxMemPool pool;
+    std::vector<uint256> stable;
+    for (int i = 0; i < 500; ++i) {
+        CMutableTransaction tx = createTx(i);
+        stable.push_back(tx.GetHash());
+        pool.addUnchecked(tx.GetHash(), entry.FromTx(tx));
+    }
+
+    // readers don't take the mempool lock, while we keep on adding and removing transactions.
+    std::atomic<bool> done(false);
+    std::atomic<int> failures(0);
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 4; ++t) {
+        readers.push_back(std::thread([&]() {
+            while (!done) {
+                for (const uint256 &txid : stable) {
+                    Tx tx;
+                    if (!pool.exists(txid) || !pool.lookup(txid, tx) || tx.createHash() != txid)
+                        ++failures;
+                }
+            }
+        }));
+    }
+    for (int round = 0; round < 20; ++round) {
+        std::vector<CTransaction> added;
+        for (int i = 0; i < 200; ++i) {
+            CMutableTransaction tx = createTx(1000 + round * 200 + i);
+            pool.addUnchecked(tx.GetHash(), entry.FromTx(tx));
+            added.push_back(tx);
+        }
+        std::list<CTransaction> removed;
+        for (const CTransaction &tx : added) {
+            pool.remove(tx, removed, false);
+            BOOST_CHECK(!pool.exists(tx.GetHash()));
+        }
+    }
+    done = true;
+    for (auto &thread : readers) {
+        thread.join();
+    }
+    BOOST_CHECK_EQUAL(failures.load(), 0);
+    BOOST_CHECK_EQUAL(pool.size(), stable.size());
+}
+
+/*
+ * Benchmark of adding 1M transactions to the mempool and removing them again by
+ * way of blocks being mined. Half the transactions spend an output of the other half.
+ * Set FLOWEE_LARGE_BENCHMARKS to run it, and use '--log_level=message' to see the timings.
+ */
+BOOST_AUTO_TEST_CASE(MempoolBenchmark)
+{
+    if (getenv("FLOWEE_LARGE_BENCHMARKS") == nullptr)
+        return;
+    const int PairCount = 500000;
+    const int PairsPerBlock = 5000;
+    auto createTx = [](const uint256 &prevTxId) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(prevTxId, 0);
+        tx.vin[0].scriptSig = CScript() << OP_11;
+        tx.vout.resize(2);
+        for (int i = 0; i < 2; ++i) {
+            tx.vout[i].scriptPubKey = CScript() << OP_11 << OP_EQUAL;
+            tx.vout[i].nValue = 10000LL;
+        }
+        return tx;
+    };
+
+    CTxMemPool pool;
+    TestMemPoolEntryHelper entry;
+    std::vector<uint256> parents;
+    parents.reserve(PairCount);
+    int64_t start = GetTimeMicros();
+    for (int i = 0; i < PairCount; ++i) {
+        CMutableTransaction parent = createTx(ArithToUint256(arith_uint256(i + 1)));
+        parents.push_back(parent.GetHash());
+        pool.addUnchecked(parents.back(), entry.FromTx(parent));
+        CMutableTransaction child = createTx(parents.back());
+        pool.addUnchecked(child.GetHash(), entry.FromTx(child));
+    }
+    BOOST_CHECK_EQUAL(pool.size(), PairCount * 2);
+    BOOST_TEST_MESSAGE("Adding " << PairCount * 2 << " transactions took " << (GetTimeMicros() - start) / 1000 << "ms");
+    BOOST_TEST_MESSAGE("Mempool uses " << pool.DynamicMemoryUsage() / 1000000 << "MB");
+
+    int64_t removeTime = 0;
+    std::list<CTransaction> conflicts;
+    for (int i = 0; i < PairCount; i += PairsPerBlock) {
+        CBlock block;
+        block.vtx.reserve(PairsPerBlock * 2 + 1);
+        CMutableTransaction coinbase;
+        coinbase.vin.resize(1);
+        coinbase.vin[0].prevout.SetNull();
+        coinbase.vin[0].scriptSig = CScript() << i << OP_1;
+        coinbase.vout.resize(1);
+        coinbase.vout[0].scriptPubKey = CScript() << OP_TRUE;
+        coinbase.vout[0].nValue = 50 * COIN;
+        block.vtx.push_back(coinbase);
+        for (int pair = i; pair < i + PairsPerBlock; ++pair) {
+            block.vtx.push_back(createTx(ArithToUint256(arith_uint256(pair + 1))));
+            block.vtx.push_back(createTx(parents.at(pair)));
+        }
+        FastBlock fastBlock = FastBlock::fromOldBlock(block);
+        fastBlock.findTransactions();
+        std::vector<uint256> txids;
+        txids.reserve(block.vtx.size());
+        for (const CTransaction &tx : block.vtx) {
+            txids.push_back(tx.GetHash());
+        }
+
+        start = GetTimeMicros();
+        pool.removeForBlock(fastBlock, txids, conflicts);
+        removeTime += GetTimeMicros() - start;
+    }
+    BOOST_CHECK_EQUAL(pool.size(), 0);
+    BOOST_CHECK(conflicts.empty());
+    BOOST_TEST_MESSAGE("Removing them in " << PairCount / PairsPerBlock << " blocks took " << removeTime / 1000 << "ms");
+}
+
 template<int index>
 void CheckSort(CTxMemPool &pool, std::vector<std::string> &sortedOrder)
 {
@@ -123,7 +326,7 @@ void CheckSort(CTxMemPool &pool, std::vector<std::string> &sortedOrder)
     typename CTxMemPool::indexed_transaction_set::nth_index<index>::type::iterator it = pool.mapTx.get<index>().begin();
     int count=0;
     for (; it != pool.mapTx.get<index>().end(); ++it, ++count) {
-        BOOST_CHECK_EQUAL(it->GetTx().GetHash().ToString(), sortedOrder[count]);
+        BOOST_CHECK_EQUAL(it->GetTxId().ToString(), sortedOrder[count]);
     }
 }
 
@@ -295,11 +498,11 @@ BOOST_AUTO_TEST_CASE(MempoolIndexingTest)
 
     // Now try removing tx10 and verify the sort order returns to normal
     std::list<CTransaction> removed;
-    pool.remove(pool.mapTx.find(tx10.GetHash())->GetTx(), removed, true);
+    pool.remove(pool.mapTx.find(tx10.GetHash())->createOldTransaction(), removed, true);
     CheckSort<1>(pool, snapshotOrder);
 
-    pool.remove(pool.mapTx.find(tx9.GetHash())->GetTx(), removed, true);
-    pool.remove(pool.mapTx.find(tx8.GetHash())->GetTx(), removed, true);
+    pool.remove(pool.mapTx.find(tx9.GetHash())->createOldTransaction(), removed, true);
+    pool.remove(pool.mapTx.find(tx8.GetHash())->createOldTransaction(), removed, true);
     /* Now check the sort on the mining score index.
      * Final order should be:
      *
@@ -152,6 +152,52 @@ BOOST_AUTO_TEST_CASE(sighash_test)
     #endif
 }
 
+// Goal: check that the precomputed data doesn't change the forkid style hash
+BOOST_AUTO_TEST_CASE(sighash_precomputed)
+{
+    seed_insecure_rand(false);
+
+    for (int i = 0; i < 5000; ++i) {
+        const int nHashType = insecure_rand() | SIGHASH_FORKID;
+        CMutableTransaction txTo;
+        TxUtils::RandomTransaction(txTo, (nHashType & 0x1f) == SIGHASH_SINGLE ? TxUtils::SingleOutput: TxUtils::AnyOutputCount);
+        const CTransaction tx(txTo);
+        CScript scriptCode;
+        TxUtils::RandomScript(scriptCode);
+        const int nIn = insecure_rand() % tx.vin.size();
+        const CAmount amount = insecure_rand();
+
+        const PrecomputedTransactionData txData(tx);
+        const uint256 sh = SignatureHash(scriptCode, tx, nIn, amount, nHashType);
+        BOOST_CHECK(sh == SignatureHash(scriptCode, tx, nIn, amount, nHashType, SCRIPT_ENABLE_SIGHASH_FORKID, &txData));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(sighash_txview)
+{
+    seed_insecure_rand(false);
+
+    for (int i = 0; i < 5000; ++i) {
+        const int nHashType = insecure_rand();
+        CMutableTransaction txTo;
+        TxUtils::RandomTransaction(txTo, (nHashType & 0x1f) == SIGHASH_SINGLE ? TxUtils::SingleOutput: TxUtils::AnyOutputCount);
+        const CTransaction tx(txTo);
+        const TxView view(Tx::fromOldTransaction(tx));
+        BOOST_CHECK_EQUAL(view.inputs.size(), tx.vin.size());
+        BOOST_CHECK_EQUAL(view.outputs.size(), tx.vout.size());
+        BOOST_CHECK_EQUAL(view.lockTime, tx.nLockTime);
+        CScript scriptCode;
+        TxUtils::RandomScript(scriptCode);
+        const int nIn = insecure_rand() % tx.vin.size();
+        const CAmount amount = insecure_rand();
+
+        const PrecomputedTransactionData txData(view);
+        const uint256 sh = SignatureHash(scriptCode, tx, nIn, amount, nHashType);
+        BOOST_CHECK(sh == SignatureHash(scriptCode, view, nIn, amount, nHashType));
+        BOOST_CHECK(sh == SignatureHash(scriptCode, view, nIn, amount, nHashType, SCRIPT_ENABLE_SIGHASH_FORKID, &txData));
+    }
+}
+
 // Goal: check that SignatureHash generates correct hash
 BOOST_AUTO_TEST_CASE(sighash_from_data)
 {
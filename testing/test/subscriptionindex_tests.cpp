@@ -0,0 +1,69 @@
+/*
+ * This file is part of the Flowee project
+ * Copyright (C) 2020 Tom Zander <tomz@freedommail.ch>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <SubscriptionIndex.h>
+
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(subscriptionindex_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(subscriptionindex_basic)
+{
+    SubscriptionIndex index;
+    BOOST_CHECK(index.isEmpty());
+
+    const uint256 hash1 = uint256S("7cbd398b58e489e13100f2f7b0d56f5abc83a2381f9a841434a12447cc7a3b14");
+    const uint256 hash2 = uint256S("00a7a0e144e7050ef5622b098faf19026631401fa46e68a93fe5e5630b94dcea");
+
+    std::vector<int> ids;
+    BOOST_CHECK(!index.find(hash1, ids));
+    BOOST_CHECK(ids.empty());
+
+    index.subscribe(hash1, 1);
+    index.subscribe(hash1, 2);
+    index.subscribe(hash1, 2); // duplicate is ignored
+    index.subscribe(hash2, 3);
+    BOOST_CHECK(!index.isEmpty());
+
+    BOOST_CHECK(index.find(hash1, ids));
+    BOOST_CHECK_EQUAL(ids.size(), 2);
+    BOOST_CHECK_EQUAL(ids[0], 1);
+    BOOST_CHECK_EQUAL(ids[1], 2);
+    BOOST_CHECK(index.find(hash2, ids)); // appends
+    BOOST_CHECK_EQUAL(ids.size(), 3);
+    BOOST_CHECK_EQUAL(ids[2], 3);
+
+    index.unsubscribe(hash1, 1);
+    index.unsubscribe(hash1, 4); // never subscribed
+    index.unsubscribe(hash2, 2); // never subscribed
+    ids.clear();
+    BOOST_CHECK(index.find(hash1, ids));
+    BOOST_CHECK_EQUAL(ids.size(), 1);
+    BOOST_CHECK_EQUAL(ids[0], 2);
+
+    index.unsubscribe(hash1, 2);
+    index.unsubscribe(hash2, 3);
+    ids.clear();
+    BOOST_CHECK(!index.find(hash1, ids));
+    BOOST_CHECK(!index.find(hash2, ids));
+    BOOST_CHECK(index.isEmpty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
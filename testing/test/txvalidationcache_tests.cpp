@@ -135,6 +135,81 @@ BOOST_FIXTURE_TEST_CASE(tx_mempool_block_doublespend, TestChain100Setup)
     // block with spends[0] is accepted:
     BOOST_CHECK_EQUAL(bv.mp.size(), 0);
 }
+
+BOOST_FIXTURE_TEST_CASE(tx_mempool_batch, TestingSetup)
+{
+    CKey coinbaseKey;
+    std::vector<FastBlock> blocks = bv.appendChain(101, coinbaseKey, MockBlockValidation::StandardOutScript);
+    const CScript scriptPubKey = CScript() << ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+    std::vector<uint256> coinbases;
+    for (int i = 0; i < 2; ++i) {
+        blocks[i].findTransactions();
+        coinbases.push_back(blocks[i].transactions().front().createHash());
+    }
+
+    // a chain of transactions, each spending the previous, starting with a mature coinbase.
+    std::vector<CMutableTransaction> chain;
+    chain.resize(4);
+    uint256 prevHash = coinbases[0];
+    CAmount prevValue = 50 * COIN;
+    for (size_t i = 0; i < chain.size(); i++) {
+        chain[i].vin.resize(1);
+        chain[i].vin[0].prevout.hash = prevHash;
+        chain[i].vin[0].prevout.n = 0;
+        chain[i].vout.resize(1);
+        chain[i].vout[0].nValue = prevValue - 10 * CENT;
+        chain[i].vout[0].scriptPubKey = scriptPubKey;
+
+        std::vector<unsigned char> vchSig;
+        uint256 hash = SignatureHash(scriptPubKey, chain[i], 0, prevValue, SIGHASH_ALL | SIGHASH_FORKID, SCRIPT_ENABLE_SIGHASH_FORKID);
+        BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+        vchSig.push_back((unsigned char)SIGHASH_ALL + SIGHASH_FORKID);
+        chain[i].vin[0].scriptSig << vchSig;
+        prevHash = chain[i].GetHash();
+        prevValue = chain[i].vout[0].nValue;
+    }
+
+    // submit them in reverse order, the engine has to validate the parents first.
+    std::vector<Tx> batch;
+    for (auto iter = chain.rbegin(); iter != chain.rend(); ++iter) {
+        batch.push_back(Tx::fromOldTransaction(*iter));
+    }
+    // an independent transaction spending another coinbase.
+    CMutableTransaction other = chain[0];
+    other.vin[0].prevout.hash = coinbases[1];
+    other.vin[0].scriptSig = CScript();
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(scriptPubKey, other, 0, 50 * COIN, SIGHASH_ALL | SIGHASH_FORKID, SCRIPT_ENABLE_SIGHASH_FORKID);
+    BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL + SIGHASH_FORKID);
+    other.vin[0].scriptSig << vchSig;
+    batch.push_back(Tx::fromOldTransaction(other));
+
+    auto results = bv.addTransactions(batch);
+    BOOST_CHECK_EQUAL(results.size(), batch.size());
+    for (auto &result : results) {
+        BOOST_CHECK_EQUAL(result.get(), std::string());
+    }
+    BOOST_CHECK_EQUAL(bv.mp.size(), batch.size());
+
+    // resubmitting fails for all, which should not stop the children from being processed.
+    results = bv.addTransactions(batch);
+    for (auto &result : results) {
+        BOOST_CHECK(!result.get().empty());
+    }
+    BOOST_CHECK_EQUAL(bv.mp.size(), batch.size());
+
+    // the callback is called once, after all transactions finished.
+    std::promise<std::vector<std::string> > finished;
+    bv.addTransactions(batch, [&finished](const std::vector<std::string> &results) {
+        finished.set_value(results);
+    });
+    auto strings = finished.get_future().get();
+    BOOST_CHECK_EQUAL(strings.size(), batch.size());
+    for (auto &result : strings) {
+        BOOST_CHECK(!result.empty());
+    }
+}
 #endif
 
 BOOST_AUTO_TEST_SUITE_END()
@@ -22,6 +22,9 @@
 #include <util.h>
 
 #include <utxo/UnspentOutputDatabase_p.h>
+#include <utils/hash.h>
+
+#include <sstream>
 
 void TestUtxo::init()
 {
@@ -49,6 +52,27 @@ void TestUtxo::insertTransactions(UnspentOutputDatabase &db, int number)
     }
 }
 
+UnspentOutputDatabase::BlockData TestUtxo::insertBlock(UnspentOutputDatabase &db, int number, bool withOutputData)
+{
+    // a compressed p2pkh script, as the hub would store it.
+    Streaming::BufferPool pool;
+    pool.writeHex("0x00c3a1b2c3d4e5f60718293a4b5c6d7e8f90a1b2c3");
+    const Streaming::ConstBuffer script = pool.commit();
+
+    UnspentOutputDatabase::BlockData data;
+    data.blockHeight = 112;
+    for (int i = 0; i < number; ++i) {
+        uint256 txid = Hash(reinterpret_cast<const char*>(&i), reinterpret_cast<const char*>(&i) + sizeof(i));
+        data.outputs.push_back(UnspentOutputDatabase::BlockData::TxOutputs(txid, 6000 + i, 0, 1));
+        if (withOutputData) {
+            data.outputs.back().outputData.push_back(UnspentOutputDatabase::OutputData(1000 + i, script));
+            data.outputs.back().outputData.push_back(UnspentOutputDatabase::OutputData(2000 + i, script));
+        }
+    }
+    db.insertAll(data);
+    return data;
+}
+
 uint256 TestUtxo::insertedTxId(int index)
 {
     char buf[67];
@@ -349,6 +373,194 @@ void TestUtxo::cowList()
     delete x;
 }
 
+void TestUtxo::membershipFilter()
+{
+    MembershipFilter filter;
+    QVERIFY(!filter.isValid());
+    QVERIFY(filter.mayContain(12345)); // invalid filters contain everything
+    filter.reset(0x10000);
+    QVERIFY(filter.isValid());
+    for (int i = 0; i < 200; ++i) {
+        filter.insert(insertedTxId(i).GetCheapHash());
+    }
+    for (int i = 0; i < 200; ++i) {
+        QVERIFY(filter.mayContain(insertedTxId(i).GetCheapHash()));
+    }
+    {   // store and load
+        std::stringstream stream;
+        filter.write(stream);
+        MembershipFilter copy;
+        QVERIFY(copy.read(stream, filter.bits(), filter.checksum()));
+        for (int i = 0; i < 200; ++i) {
+            QVERIFY(copy.mayContain(insertedTxId(i).GetCheapHash()));
+        }
+        QCOMPARE(copy.fillPercentage(), filter.fillPercentage());
+    }
+
+    boost::asio::io_service ioService;
+    {
+        UnspentOutputDatabase db(ioService, m_testPath);
+        insertTransactions(db, 50);
+        DataFile *df = db.priv()->dataFiles.last();
+        QVERIFY(df->m_filter.isValid());
+        const uint256 missing = uint256S("0xb4749f017444b051c44dfd2720e88f314ff94f3dd6d56d40ef65854fcd7fff6b");
+        QVERIFY(!db.find(missing, 0).isValid());
+        QVERIFY(!db.remove(missing, 0).isValid());
+        QCOMPARE(df->m_probesAvoided.load(), (uint64_t) 2);
+        db.blockFinished(150, uint256());
+    }
+    // the filter should survive a restart
+    UnspentOutputDatabase db(ioService, m_testPath);
+    DataFile *df = db.priv()->dataFiles.last();
+    QVERIFY(df->m_filter.isValid());
+    QCOMPARE(df->m_probesAvoided.load(), (uint64_t) 2);
+    for (int i = 0; i < 50; ++i) {
+        QVERIFY(db.find(insertedTxId(i), 1).isValid());
+    }
+}
+
+void TestUtxo::outputData()
+{
+    boost::asio::io_service ioService;
+    {
+        UnspentOutputDatabase db(ioService, m_testPath);
+        QCOMPARE(db.storesOutputData(), false);
+        db.setStoreOutputData(true);
+        auto data = insertBlock(db, 100, true);
+        insertTransactions(db, 2); // old style, without output data
+
+        for (const auto &tx : data.outputs) {
+            UnspentOutput uo = db.find(tx.txid, 1);
+            QVERIFY(uo.isValid());
+            QVERIFY(uo.hasOutputData());
+            QCOMPARE(uo.outputAmount(), tx.outputData.at(1).amount);
+            QVERIFY(uo.outputScript() == tx.outputData.at(1).script);
+            QCOMPARE(uo.offsetInBlock(), tx.offsetInBlock);
+        }
+        UnspentOutput uo = db.find(insertedTxId(1), 1);
+        QVERIFY(uo.isValid());
+        QVERIFY(!uo.hasOutputData());
+        db.blockFinished(112, uint256());
+    }
+    // after a restart, the leafs are read from disk.
+    UnspentOutputDatabase db(ioService, m_testPath);
+    for (int i = 0; i < 100; ++i) {
+        uint256 txid = Hash(reinterpret_cast<const char*>(&i), reinterpret_cast<const char*>(&i) + sizeof(i));
+        UnspentOutput uo = db.find(txid, 0);
+        QVERIFY(uo.isValid());
+        QVERIFY(uo.hasOutputData());
+        QCOMPARE(uo.outputAmount(), static_cast<uint64_t>(1000 + i));
+        QCOMPARE(uo.outputScript().size(), 21);
+        QCOMPARE(uo.outIndex(), 0);
+        SpentOutput removed = db.remove(txid, 0, uo.rmHint());
+        QVERIFY(removed.isValid());
+        QCOMPARE(removed.offsetInBlock, 6000 + i);
+    }
+}
+
+void TestUtxo::parallelInsert()
+{
+    WorkerThreads workers;
+    UnspentOutputDatabase db(workers.ioService(), m_testPath);
+    // large enough to be spread over the threads.
+    const int count = static_cast<int>(UODBPrivate::limits.ParallelInsertMin) + 500;
+    const UnspentOutputDatabase::BlockData data = insertBlock(db, count, true);
+    for (int i = 0; i < count; ++i) {
+        const auto &tx = data.outputs.at(static_cast<size_t>(i));
+        for (int out = 0; out <= 1; ++out) {
+            UnspentOutput uo = db.find(tx.txid, out);
+            QVERIFY(uo.isValid());
+            QCOMPARE(uo.blockHeight(), 112);
+            QCOMPARE(uo.offsetInBlock(), 6000 + i);
+            QCOMPARE(uo.outputAmount(), static_cast<uint64_t>(1000 * (out + 1) + i));
+        }
+    }
+    db.blockFinished(112, uint256());
+    QCOMPARE(db.find(data.outputs.at(10).txid, 1).offsetInBlock(), 6010);
+}
+
+void TestUtxo::batchLookup()
+{
+    boost::asio::io_service ioService;
+    UnspentOutputDatabase db(ioService, m_testPath);
+    insertTransactions(db, 40);
+    db.blockFinished(120, uint256());
+
+    std::vector<Tx::Input> inputs;
+    for (int i = 39; i >= 0; --i) {
+        Tx::Input input;
+        input.txid = insertedTxId(i);
+        input.index = i % 2;
+        inputs.push_back(input);
+    }
+    Tx::Input missing;
+    missing.txid = uint256S("0xb4749f017444b051c44dfd2720e88f314ff94f3dd6d56d40ef65854fcd7fff6b");
+    missing.index = 0;
+    inputs.insert(inputs.begin() + 5, missing);
+
+    auto unspents = db.findAll(inputs);
+    QCOMPARE(unspents.size(), inputs.size());
+    std::vector<uint64_t> rmHints;
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        const UnspentOutput &uo = unspents.at(i);
+        rmHints.push_back(uo.rmHint());
+        if (i == 5) {
+            QVERIFY(!uo.isValid());
+            continue;
+        }
+        QVERIFY(uo.isValid());
+        QCOMPARE(uo.prevTxId(), inputs.at(i).txid);
+        QCOMPARE(uo.outIndex(), inputs.at(i).index);
+        QVERIFY(((uo.rmHint() >> 32) & 0xFFFFF) > 0);
+    }
+
+    auto removed = db.removeAll(inputs, rmHints);
+    QCOMPARE(removed.size(), inputs.size());
+    for (size_t i = 0; i < inputs.size(); ++i) {
+        QCOMPARE(removed.at(i).isValid(), i != 5);
+        QVERIFY(!db.find(inputs.at(i).txid, inputs.at(i).index).isValid());
+    }
+    // double spend
+    removed = db.removeAll(inputs, std::vector<uint64_t>());
+    for (const auto &spent : removed) {
+        QVERIFY(!spent.isValid());
+    }
+}
+
+void TestUtxo::benchOutputData_data()
+{
+    QTest::addColumn<bool>("withOutputData");
+    QTest::newRow("index only") << false;
+    QTest::newRow("with output data") << true;
+}
+
+void TestUtxo::benchOutputData()
+{
+    QFETCH(bool, withOutputData);
+    boost::asio::io_service ioService;
+    UnspentOutputDatabase db(ioService, m_testPath);
+    db.setStoreOutputData(withOutputData);
+    auto data = insertBlock(db, 20000, withOutputData);
+    db.blockFinished(112, uint256());
+    DataFile *df = db.priv()->dataFiles.last();
+    {
+        std::lock_guard<std::recursive_mutex> saveLock(df->m_saveLock);
+        df->flushAll();
+    }
+    logCritical() << "UTXO bytes used for" << data.outputs.size() * 2 << "outputs:" << df->m_writeBuffer.offset();
+
+    // In the 'index only' case the validation engine needs to read the block to
+    // get the amount and the script; that is not measured here.
+    uint64_t total = 0;
+    QBENCHMARK {
+        for (const auto &tx : data.outputs) {
+            UnspentOutput uo = db.find(tx.txid, 1);
+            total += uo.outputAmount() + static_cast<uint64_t>(uo.outputScript().size());
+        }
+    }
+    QVERIFY(!withOutputData || total > 0);
+}
+
 void TestUtxo::restore_data()
 {
     QTest::addColumn<int>("cycles");
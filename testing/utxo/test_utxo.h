@@ -42,12 +42,20 @@ private slots:
     void saveInfo();
 
     void cowList();
+    void membershipFilter();
+    void outputData();
+    void batchLookup();
+    void parallelInsert();
+    void benchOutputData_data();
+    void benchOutputData();
 
     void restore_data();
     void restore();
 
 private:
     void insertTransactions(UnspentOutputDatabase &db, int number);
+    /// insert \a number transactions with 2 outputs each via insertAll(), returns the BlockData used.
+    UnspentOutputDatabase::BlockData insertBlock(UnspentOutputDatabase &db, int number, bool withOutputData);
     uint256 insertedTxId(int index);
     boost::filesystem::path m_testPath;
     const char *templateTxId = "0x1234517444b051c44dfd2720e88f314ff94f3dd6d56d40ef65854fcfd7ff6b%02x";
@@ -267,6 +267,15 @@ AbstractCommand::CheckPoint AbstractCommand::readInfoFile(const QString &filepat
         case UODB::PositionInFile:
             checkpoint.positionInFile = parser.longData();
             break;
+        case UODB::MembershipFilterBits:
+            checkpoint.filterBits = static_cast<uint32_t>(parser.longData());
+            break;
+        case UODB::MembershipFilterHash:
+            checkpoint.filterHash = parser.uint256Data();
+            break;
+        case UODB::ProbesAvoided:
+            checkpoint.probesAvoided = parser.longData();
+            break;
 
         case UODB::LeafPosOn512MB:
         case UODB::LeafPosFromPrevLeaf:
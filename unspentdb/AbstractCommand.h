@@ -126,6 +126,9 @@ protected:
         int jumptableFilepos = -1;
         int changesSincePrune = -1;
         int initialBucketSize = -1;
+        uint32_t filterBits = 0;
+        uint256 filterHash;
+        uint64_t probesAvoided = 0;
         bool isTip = false;
         std::deque<uint256> invalidBlockHashes;
     };
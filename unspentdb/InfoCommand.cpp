@@ -59,6 +59,12 @@ Flowee::ReturnCodes InfoCommand::run()
                 out << "unset";
             else
                 out << checkpoint.initialBucketSize;
+            out << "\nFilter size      : ";
+            if (checkpoint.filterBits == 0)
+                out << "none";
+            else
+                out << checkpoint.filterBits / 8 << " bytes";
+            out << "\nProbes avoided   : " << checkpoint.probesAvoided;
             out << "\nInvalid blocks   : ";
             if (checkpoint.invalidBlockHashes.size() == 0)
                 out << "none" << endl;
@@ -76,6 +82,8 @@ Flowee::ReturnCodes InfoCommand::run()
                     else
                         printStats(jumptables, infoFile);
                 }
+                if (checkpoint.filterBits > 0)
+                    printFilterStats(infoFile, checkpoint.jumptableFilepos + 0x400000, checkpoint.filterBits);
             }
             out << endl;
         }
@@ -138,3 +146,26 @@ void InfoCommand::printStats(uint32_t *tables, const DatabaseFile &df)
     out << "   leafs: " << leafs << endl;
     out << "   leafs per bucket. Average: " << leafs / revs.size() << " Median: " << sizes.at(sizes.size() / 2) << endl;
 }
+
+void InfoCommand::printFilterStats(const DatabaseFile &infoFile, int startPos, uint32_t filterBits)
+{
+    QFile file(infoFile.filepath());
+    if (!file.open(QIODevice::ReadOnly))
+        return;
+    file.seek(startPos);
+    uint64_t setBits = 0;
+    qint64 bytesLeft = filterBits / 8;
+    std::vector<uint64_t> words(0x10000);
+    while (bytesLeft > 0) {
+        const qint64 chunk = std::min<qint64>(bytesLeft, words.size() * sizeof(uint64_t));
+        if (file.read(reinterpret_cast<char*>(words.data()), chunk) != chunk) {
+            err << "Membership filter truncated" << endl;
+            return;
+        }
+        for (size_t i = 0; i < static_cast<size_t>(chunk) / sizeof(uint64_t); ++i) {
+            setBits += static_cast<uint64_t>(__builtin_popcountll(words[i]));
+        }
+        bytesLeft -= chunk;
+    }
+    out << "Membership filter: " << (setBits * 100 / filterBits) << "% of bits set" << endl;
+}
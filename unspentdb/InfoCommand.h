@@ -37,6 +37,7 @@ private:
     uint256 printBucketUsage(int startPos, QFile *infoFile);
 
     void printStats(uint32_t *tables, const DatabaseFile &df);
+    void printFilterStats(const DatabaseFile &infoFile, int startPos, uint32_t filterBits);
 
 
     QCommandLineOption m_printUsage;